@@ -0,0 +1,368 @@
+#include "ADISolver.h"
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+namespace
+{
+	// Depth below which a cell is treated as dry
+	const float DryDepth = 1e-6f;
+
+	inline int Padded(int count)
+	{
+		return (count + 3) & ~3;
+	}
+
+	// Depth of a face taken from the cell upwind of the discharges either side. With no flow the
+	// wetter side is used, so water can start to move into a dry cell.
+	inline float UpwindDepth(float dischargeA, float dischargeB, float depthA, float depthB)
+	{
+		float flow = dischargeA + dischargeB;
+		return flow > 0.0f ? depthA : (flow < 0.0f ? depthB : std::max(depthA, depthB));
+	}
+}
+
+ADISolver::ADISolver()
+{
+	sizeX = 0;
+	sizeY = 0;
+	pitch = 0;
+	xFirst = true;
+}
+
+ADISolver::~ADISolver()
+{
+}
+
+const char* ADISolver::GetName()
+{
+	return "ADI semi-implicit";
+}
+
+void ADISolver::Step(SimulationGrid2D* grid)
+{
+	if (grid->GetSizeX() != sizeX || grid->GetSizeY() != sizeY) {
+		sizeX = grid->GetSizeX();
+		sizeY = grid->GetSizeY();
+		int size = std::max(Padded(sizeX) * sizeY, Padded(sizeY) * sizeX);
+		for (std::vector<float>* v : { &height, &normalDischarge, &tangentialDischarge, &newHeight, &normalAdvection, &tangentialAdvection, &lower, &diagonal, &upper, &rhs, &scratch, &faceDepth, &fluxDown, &fluxRight, &outflowScale }) {
+			v->assign(size, 0.0f);
+		}
+	}
+	bool reflective = params.boundary == BoundaryType::Reflective;
+
+	// The x half step runs on the transposed grid, where x lines become columns
+	for (int half = 0; half < 2; half++) {
+		bool transposed = (half == 0) == xFirst;
+		Load(grid->GetRow(0), transposed);
+		if (transposed) {
+			HalfStep(sizeY, sizeX, reflective);
+		}
+		else {
+			HalfStep(sizeX, sizeY, reflective);
+		}
+		Store(grid->GetRow(0), transposed);
+	}
+	xFirst = !xFirst;
+	grid->MarkAllDirty();
+}
+
+void ADISolver::Load(const std::array<float, 4>* nodes, bool transposed)
+{
+	if (transposed) {
+		// Row i of the transposed grid is column i of the grid, the x discharge is normal to its faces
+		pitch = Padded(sizeY);
+		for (int y = 0; y < sizeY; y++) {
+			for (int x = 0; x < sizeX; x++) {
+				const std::array<float, 4>& node = nodes[y * sizeX + x];
+				height[x * pitch + y] = node[SimulationGrid2D::Height];
+				normalDischarge[x * pitch + y] = node[SimulationGrid2D::DischargeX];
+				tangentialDischarge[x * pitch + y] = node[SimulationGrid2D::DischargeY];
+			}
+		}
+	}
+	else {
+		pitch = Padded(sizeX);
+		for (int y = 0; y < sizeY; y++) {
+			for (int x = 0; x < sizeX; x++) {
+				const std::array<float, 4>& node = nodes[y * sizeX + x];
+				height[y * pitch + x] = node[SimulationGrid2D::Height];
+				normalDischarge[y * pitch + x] = node[SimulationGrid2D::DischargeY];
+				tangentialDischarge[y * pitch + x] = node[SimulationGrid2D::DischargeX];
+			}
+		}
+	}
+}
+
+void ADISolver::Store(std::array<float, 4>* nodes, bool transposed)
+{
+	for (int y = 0; y < sizeY; y++) {
+		for (int x = 0; x < sizeX; x++) {
+			std::array<float, 4>& node = nodes[y * sizeX + x];
+			int i = transposed ? x * pitch + y : y * pitch + x;
+			node[SimulationGrid2D::Height] = height[i];
+			node[transposed ? SimulationGrid2D::DischargeX : SimulationGrid2D::DischargeY] = normalDischarge[i];
+			node[transposed ? SimulationGrid2D::DischargeY : SimulationGrid2D::DischargeX] = tangentialDischarge[i];
+		}
+	}
+}
+
+void ADISolver::ComputeAdvection(int columns, int rows, bool reflective)
+{
+	float inverseDx = 1.0f / params.spatialStepSize;
+	const float* h = height.data();
+	const float* qn = normalDischarge.data();
+	const float* qt = tangentialDischarge.data();
+
+	// Flux of both discharges through a face, taken from the upwind cell
+	auto faceFlux = [&](int from, int to, float velocityFrom, float velocityTo, float& fluxN, float& fluxT) {
+		float velocity = 0.5f * (velocityFrom + velocityTo);
+		int upwind = velocity > 0.0f ? from : to;
+		fluxN = velocity * qn[upwind];
+		fluxT = velocity * qt[upwind];
+	};
+	auto velocity = [&](const float* q, int i) {
+		return h[i] > DryDepth ? q[i] / h[i] : 0.0f;
+	};
+
+	for (int y = 0; y < rows; y++) {
+		int up = y > 0 ? y - 1 : rows - 1;
+		int down = y + 1 < rows ? y + 1 : 0;
+		bool wallUp = reflective && y == 0;
+		bool wallDown = reflective && y + 1 == rows;
+		for (int x = 0; x < columns; x++) {
+			int left = x > 0 ? x - 1 : columns - 1;
+			int right = x + 1 < columns ? x + 1 : 0;
+			int i = y * pitch + x;
+			float fluxN[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float fluxT[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+			// Faces left, right, up and down of the cell, no flux through walls
+			if (!(reflective && x == 0)) {
+				faceFlux(y * pitch + left, i, velocity(qt, y * pitch + left), velocity(qt, i), fluxN[0], fluxT[0]);
+			}
+			if (!(reflective && x + 1 == columns)) {
+				faceFlux(i, y * pitch + right, velocity(qt, i), velocity(qt, y * pitch + right), fluxN[1], fluxT[1]);
+			}
+			if (!wallUp) {
+				faceFlux(up * pitch + x, i, velocity(qn, up * pitch + x), velocity(qn, i), fluxN[2], fluxT[2]);
+			}
+			if (!wallDown) {
+				faceFlux(i, down * pitch + x, velocity(qn, i), velocity(qn, down * pitch + x), fluxN[3], fluxT[3]);
+			}
+			normalAdvection[i] = (fluxN[1] - fluxN[0] + fluxN[3] - fluxN[2]) * inverseDx;
+			tangentialAdvection[i] = (fluxT[1] - fluxT[0] + fluxT[3] - fluxT[2]) * inverseDx;
+		}
+	}
+}
+
+void ADISolver::HalfStep(int columns, int rows, bool reflective)
+{
+	float theta = 0.5f * params.timeStepSize;
+	float dx = params.spatialStepSize;
+	float g = params.gravity;
+	float coupling = theta * theta * g / (dx * dx);
+	float* h = height.data();
+	float* qn = normalDischarge.data();
+	float* qt = tangentialDischarge.data();
+	const float* an = normalAdvection.data();
+	const float* at = tangentialAdvection.data();
+
+	ComputeAdvection(columns, rows, reflective);
+
+	/////////////////        FACE FLUXES        /////////////////
+	// Explicit fluxes through the face below and to the right of each cell, and the upwind depth
+	// of the face below for the implicit coupling, which is never negative
+	float* depthDown = faceDepth.data();
+	for (int y = 0; y < rows; y++) {
+		int down = y + 1 < rows ? y + 1 : 0;
+		bool wallDown = reflective && y + 1 == rows;
+		for (int x = 0; x < columns; x++) {
+			int right = x + 1 < columns ? x + 1 : 0;
+			int i = y * pitch + x;
+			int id = down * pitch + x;
+			int ir = y * pitch + right;
+			float explicitI = qn[i] - theta * an[i];
+			float explicitD = qn[id] - theta * an[id];
+
+			depthDown[i] = wallDown ? 0.0f : UpwindDepth(explicitI, explicitD, h[i], h[id]);
+			fluxDown[i] = wallDown ? 0.0f : 0.5f * (explicitI + explicitD);
+			fluxRight[i] = reflective && x + 1 == columns ? 0.0f : 0.5f * (qt[i] + qt[ir]);
+		}
+	}
+
+	// A cell can't send out more water than it holds, its outflows are scaled down to what it has
+	for (int y = 0; y < rows; y++) {
+		int up = y > 0 ? y - 1 : rows - 1;
+		for (int x = 0; x < columns; x++) {
+			int left = x > 0 ? x - 1 : columns - 1;
+			int i = y * pitch + x;
+			float outflow = std::max(fluxDown[i], 0.0f) + std::max(-fluxDown[up * pitch + x], 0.0f)
+				+ std::max(fluxRight[i], 0.0f) + std::max(-fluxRight[y * pitch + left], 0.0f);
+			float available = h[i] * dx / theta;
+			outflowScale[i] = outflow > available ? available / outflow : 1.0f;
+		}
+	}
+	auto limited = [&](float flux, int from, int to) {
+		return flux * (flux > 0.0f ? outflowScale[from] : outflowScale[to]);
+	};
+
+	/////////////////        IMPLICIT DEPTH        /////////////////
+	// The depth change from the y discharge uses the new depth gradient:
+	// h' - coupling * d/dy (H d/dy h') = h - theta * (d/dy explicit flux + d/dx tangential flux)
+	// With H never negative the matrix is an M-matrix, and the limited fluxes keep the right hand
+	// side non-negative, so the new depths are too.
+	for (int y = 0; y < rows; y++) {
+		int up = y > 0 ? y - 1 : rows - 1;
+		int down = y + 1 < rows ? y + 1 : 0;
+		for (int x = 0; x < columns; x++) {
+			int i = y * pitch + x;
+			int iu = up * pitch + x;
+			int id = down * pitch + x;
+
+			float rUp = coupling * depthDown[iu];
+			float rDown = coupling * depthDown[i];
+			float qUp = limited(fluxDown[iu], iu, i);
+			float qDown = limited(fluxDown[i], i, id);
+
+			int left = x > 0 ? x - 1 : columns - 1;
+			int right = x + 1 < columns ? x + 1 : 0;
+			int il = y * pitch + left;
+			float qLeft = limited(fluxRight[il], il, i);
+			float qRight = limited(fluxRight[i], i, y * pitch + right);
+
+			lower[i] = -rUp;
+			diagonal[i] = 1.0f + rUp + rDown;
+			upper[i] = -rDown;
+			rhs[i] = h[i] - theta * ((qDown - qUp) + (qRight - qLeft)) / dx;
+		}
+
+		// Padding columns hold systems with the identity matrix so whole groups of four can be solved
+		for (int x = columns; x < pitch; x++) {
+			int i = y * pitch + x;
+			lower[i] = 0.0f;
+			diagonal[i] = 1.0f;
+			upper[i] = 0.0f;
+			rhs[i] = 0.0f;
+		}
+	}
+
+	for (int x = 0; x < pitch; x += 4) {
+		SolveTridiagonal(&lower[x], &diagonal[x], &upper[x], &rhs[x], &scratch[x], rows, pitch, !reflective);
+	}
+	const float* hNew = rhs.data();
+
+	/////////////////        DISCHARGES        /////////////////
+	// The normal discharge feels the gradient of the new depth, the tangential one the old depth.
+	// The system arrays are free again and hold the new discharges until the depth is replaced.
+	// No water moves faster than a dam break front, 2 sqrt(g h) of the deepest cell, which holds
+	// thin cells at a wet/dry front where the donor cell advection would otherwise run away.
+	float deepest = 0.0f;
+	for (int y = 0; y < rows; y++) {
+		for (int x = 0; x < columns; x++) {
+			deepest = std::max(deepest, h[y * pitch + x]);
+		}
+	}
+	float maxSpeed = 2.0f * std::sqrt(g * deepest);
+	for (int y = 0; y < rows; y++) {
+		int up = reflective && y == 0 ? y : (y > 0 ? y - 1 : rows - 1);
+		int down = reflective && y + 1 == rows ? y : (y + 1 < rows ? y + 1 : 0);
+		for (int x = 0; x < columns; x++) {
+			int left = reflective && x == 0 ? x : (x > 0 ? x - 1 : columns - 1);
+			int right = reflective && x + 1 == columns ? x : (x + 1 < columns ? x + 1 : 0);
+			int i = y * pitch + x;
+			float normalGradient = (hNew[down * pitch + x] - hNew[up * pitch + x]) / (2.0f * dx);
+			float tangentialGradient = (h[y * pitch + right] - h[y * pitch + left]) / (2.0f * dx);
+			// Exact solves stay non-negative, this only removes rounding
+			newHeight[i] = std::max(hNew[i], 0.0f);
+			scratch[i] = qn[i] - theta * (an[i] + g * h[i] * normalGradient);
+			lower[i] = qt[i] - theta * (at[i] + g * h[i] * tangentialGradient);
+		}
+	}
+	for (int y = 0; y < rows; y++) {
+		for (int x = 0; x < columns; x++) {
+			int i = y * pitch + x;
+			bool dry = newHeight[i] <= DryDepth;
+			float limit = newHeight[i] * maxSpeed;
+			h[i] = newHeight[i];
+			qn[i] = dry ? 0.0f : std::min(std::max(scratch[i], -limit), limit);
+			qt[i] = dry ? 0.0f : std::min(std::max(lower[i], -limit), limit);
+		}
+	}
+}
+
+void ADISolver::SolveTridiagonal(float* a, float* b, float* c, float* d, float* scratch, int n, int stride, bool cyclic)
+{
+	// A cyclic system is solved as a tridiagonal one plus a rank one correction (Sherman-Morrison),
+	// which needs a second right hand side u = (gamma, 0, ..., 0, c[n - 1]) solved with the same matrix
+	float* u = scratch;
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 gamma = zero;
+	__m128 firstLower = zero;
+	__m128 lastUpper = zero;
+	if (cyclic) {
+		__m128 b0 = _mm_loadu_ps(b);
+		gamma = _mm_sub_ps(zero, b0);
+		firstLower = _mm_loadu_ps(a);
+		lastUpper = _mm_loadu_ps(c + (n - 1) * stride);
+		_mm_storeu_ps(b, _mm_sub_ps(b0, gamma));
+		__m128 bn = _mm_loadu_ps(b + (n - 1) * stride);
+		_mm_storeu_ps(b + (n - 1) * stride, _mm_sub_ps(bn, _mm_div_ps(_mm_mul_ps(firstLower, lastUpper), gamma)));
+		for (int i = 0; i < n; i++) {
+			_mm_storeu_ps(u + i * stride, zero);
+		}
+		_mm_storeu_ps(u, gamma);
+		_mm_storeu_ps(u + (n - 1) * stride, lastUpper);
+	}
+
+	// Forward elimination, c and d become the modified coefficients
+	__m128 m = _mm_div_ps(one, _mm_loadu_ps(b));
+	__m128 cPrevious = _mm_mul_ps(_mm_loadu_ps(c), m);
+	__m128 dPrevious = _mm_mul_ps(_mm_loadu_ps(d), m);
+	__m128 uPrevious = cyclic ? _mm_mul_ps(_mm_loadu_ps(u), m) : zero;
+	_mm_storeu_ps(c, cPrevious);
+	_mm_storeu_ps(d, dPrevious);
+	if (cyclic) {
+		_mm_storeu_ps(u, uPrevious);
+	}
+	for (int i = 1; i < n; i++) {
+		int k = i * stride;
+		__m128 ai = _mm_loadu_ps(a + k);
+		m = _mm_div_ps(one, _mm_sub_ps(_mm_loadu_ps(b + k), _mm_mul_ps(ai, cPrevious)));
+		cPrevious = _mm_mul_ps(_mm_loadu_ps(c + k), m);
+		dPrevious = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(d + k), _mm_mul_ps(ai, dPrevious)), m);
+		_mm_storeu_ps(c + k, cPrevious);
+		_mm_storeu_ps(d + k, dPrevious);
+		if (cyclic) {
+			uPrevious = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(u + k), _mm_mul_ps(ai, uPrevious)), m);
+			_mm_storeu_ps(u + k, uPrevious);
+		}
+	}
+
+	// Back substitution
+	__m128 dNext = _mm_loadu_ps(d + (n - 1) * stride);
+	__m128 uNext = cyclic ? _mm_loadu_ps(u + (n - 1) * stride) : zero;
+	for (int i = n - 2; i >= 0; i--) {
+		int k = i * stride;
+		__m128 ci = _mm_loadu_ps(c + k);
+		dNext = _mm_sub_ps(_mm_loadu_ps(d + k), _mm_mul_ps(ci, dNext));
+		_mm_storeu_ps(d + k, dNext);
+		if (cyclic) {
+			uNext = _mm_sub_ps(_mm_loadu_ps(u + k), _mm_mul_ps(ci, uNext));
+			_mm_storeu_ps(u + k, uNext);
+		}
+	}
+
+	if (cyclic) {
+		// x = y - z * (y[0] + a[0] / gamma * y[n - 1]) / (1 + z[0] + a[0] / gamma * z[n - 1])
+		__m128 ratio = _mm_div_ps(firstLower, gamma);
+		__m128 numerator = _mm_add_ps(_mm_loadu_ps(d), _mm_mul_ps(ratio, _mm_loadu_ps(d + (n - 1) * stride)));
+		__m128 denominator = _mm_add_ps(_mm_add_ps(one, _mm_loadu_ps(u)), _mm_mul_ps(ratio, _mm_loadu_ps(u + (n - 1) * stride)));
+		__m128 factor = _mm_div_ps(numerator, denominator);
+		for (int i = 0; i < n; i++) {
+			int k = i * stride;
+			_mm_storeu_ps(d + k, _mm_sub_ps(_mm_loadu_ps(d + k), _mm_mul_ps(factor, _mm_loadu_ps(u + k))));
+		}
+	}
+}
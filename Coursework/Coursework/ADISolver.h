@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include "ShallowWaterSolver.h"
+
+// Semi-implicit alternating direction solver (Leendertse, 1967). Each step is split into two
+// half steps, the first implicit in x and the second in y, alternating the order every step.
+// The gravity terms coupling the depth to the discharge along the implicit direction are
+// treated implicitly, leaving one tridiagonal system per row or column, while momentum
+// advection stays explicit (donor cell). Gravity waves no longer limit the time step, so in
+// deep, slow water steps 10-50 times larger than the explicit scheme's stay stable, at the
+// cost of damping and slowing the fastest waves. The flow speed still limits the step to
+// |u| dt / dx < 1, so fast bores over a dry bed need the explicit solvers.
+//
+// The systems are solved with the Thomas algorithm, four lines at a time in SSE lanes.
+// Lines along y sit next to each other in memory; the x half step transposes the state and
+// runs the same y code.
+class ADISolver : public ShallowWaterSolver
+{
+
+public:
+
+	ADISolver();
+	~ADISolver();
+
+	void Step(SimulationGrid2D* grid) override;
+	const char* GetName() override;
+
+	// Solve four tridiagonal systems of n unknowns at once, lane l of unknown i at [i * stride + l].
+	// a, b and c are the sub-, main and super-diagonals, d the right hand side, replaced by the
+	// solution. A cyclic system also couples the first and last unknowns through a[0] and
+	// c[n - 1], and needs scratch of the same layout. b and c are overwritten.
+	static void SolveTridiagonal(float* a, float* b, float* c, float* d, float* scratch, int n, int stride, bool cyclic);
+
+private:
+
+	// Half step implicit along y of a grid of the given size, rows are pitch floats apart.
+	// qn is the discharge along y and qt the one along x.
+	void HalfStep(int columns, int rows, bool reflective);
+
+	// Donor cell advection of both discharges
+	void ComputeAdvection(int columns, int rows, bool reflective);
+
+	// Copy between the grid and the padded arrays, optionally transposed
+	void Load(const std::array<float, 4>* nodes, bool transposed);
+	void Store(std::array<float, 4>* nodes, bool transposed);
+
+	int sizeX;
+	int sizeY;
+	int pitch;
+	bool xFirst;
+
+	// State with rows of pitch floats, in the orientation of the current half step
+	std::vector<float> height, normalDischarge, tangentialDischarge, newHeight;
+	std::vector<float> normalAdvection, tangentialAdvection;
+
+	// Tridiagonal systems, one per column, same layout as the state
+	std::vector<float> lower, diagonal, upper, rhs, scratch;
+
+	// Upwind depth of the face below each cell, the explicit fluxes through the faces below and
+	// to the right, and the factor each cell's outflows are scaled by so it never runs dry
+	std::vector<float> faceDepth, fluxDown, fluxRight, outflowScale;
+
+};
@@ -1,21 +1,27 @@
 #include "App1.h"
 #include <fstream>
 #include <sstream> 
+#include <chrono>
 
 App1::App1()
 {
 	water = nullptr;
+	predictedGrid = nullptr;
+	correctedGrid = nullptr;
+	taskScheduler = nullptr;
+	scenarioLibrary = nullptr;
 
 
 	// Initialise shallow water simulation parameters
 
 	spatialStepSize = 0.2f;  // 0.2f
-	constexpr int GRID_SIZE = 660; // 100
+	gridSizeX = 660; // 100, changed at runtime by regrid()
+	domainSize = gridSizeX * spatialStepSize;
+	requestedGridSize = gridSizeX;
 
-	gridSizeX = GRID_SIZE; 
 	stepSizeX = spatialStepSize;
 
-	gridSizeY = GRID_SIZE; 
+	gridSizeY = gridSizeX;
 	stepSizeY = spatialStepSize;
 
 	gravity = 9.8f;
@@ -34,38 +40,30 @@ void App1::init(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeigh
 {
 	BaseApplication::init(hinstance, hwnd, screenWidth, screenHeight, in, VSYNC, FULL_SCREEN);
 
-	// Initialise scene 3D models
-	water = new Water(renderer->getDevice(), renderer->getDeviceContext(),hwnd, textureMgr, gridSizeY);
+	// Initialise scene 3D models, the mesh starts with one vertex per grid node
+	meshResolution = gridSizeY;
+	water = new Water(renderer->getDevice(), renderer->getDeviceContext(),hwnd, textureMgr, meshResolution);
 
 
-	// Initialise simulation grids
-	predictedGrid = new SimulationGrid2D(gridSizeX, gridSizeY);
-	correctedGrid = new SimulationGrid2D(gridSizeX, gridSizeY);
+	// Initialise simulation grids, the initial state is generated once and copied
+	taskScheduler = new TaskScheduler();
+	resampler = new HeightFieldResampler(taskScheduler);
+	scenarioLibrary = new ScenarioLibrary(taskScheduler);
+	correctedGrid = scenarioLibrary->Create(scenario, gridSizeX, gridSizeY);
+	predictedGrid = new SimulationGrid2D(*correctedGrid);
+	disturbances = new DisturbanceQueue();
 
 	// Initialise simulation render pass objects: 
-	predictionShader = new PredictionShader(renderer->getDevice(), renderer->getDeviceContext(), hwnd, gridSizeX);
+	d3dTextureDevice = new D3D11GridTextureDevice(renderer->getDevice(), renderer->getDeviceContext());
+	textureDevice = new CountingGridTextureDevice(d3dTextureDevice);
+	texturePool = new GridTexturePool(textureDevice);
+	predictionShader = new PredictionShader(renderer->getDevice(), renderer->getDeviceContext(), hwnd, gridSizeX, texturePool);
 	correctionShader = new CorrectionShader(renderer->getDevice(), renderer->getDeviceContext(), hwnd, gridSizeX);
-
-	predictionGridRTA = new RenderTexture(renderer->getDevice(), gridSizeX, gridSizeY, 0.1f, 100.0f);
-	predictionGridRTB = new RenderTexture(renderer->getDevice(), gridSizeX, gridSizeY, 0.1f, 100.0f);
-	correctionGridRTA = new RenderTexture(renderer->getDevice(), gridSizeX, gridSizeY, 0.1f, 100.0f);
-	correctionGridRTB = new RenderTexture(renderer->getDevice(), gridSizeX, gridSizeY, 0.1f, 100.0f);
+	disturbanceShader = new DisturbanceShader(renderer->getDevice(), renderer->getDeviceContext(), hwnd);
 
 	orthoMesh = new OrthoMesh(renderer->getDevice(), renderer->getDeviceContext(), screenWidth, screenHeight, 0.0f, 0.0f);
 
-	renderTargetsA[0] = predictionGridRTA->getRenderTargetView();
-	renderTargetsA[1] = correctionGridRTA->getRenderTargetView();
-	renderTargetsB[0] = predictionGridRTB->getRenderTargetView();
-	renderTargetsB[1] = correctionGridRTB->getRenderTargetView();
-
-
-	// Setup the viewport for simulation
-	viewport.Width = (float)gridSizeX;
-	viewport.Height = (float)gridSizeX;
-	viewport.MinDepth = 0.0f;
-	viewport.MaxDepth = 1.0f;
-	viewport.TopLeftX = 0.0f;
-	viewport.TopLeftY = 0.0f;
+	createSimulationTargets();
 
 	initLight();
 
@@ -93,6 +91,108 @@ App1::~App1()
 		delete light;
 	}
 
+	if (predictedGrid) {
+		delete predictedGrid;
+	}
+	if (correctedGrid) {
+		delete correctedGrid;
+	}
+	if (scenarioLibrary) {
+		delete scenarioLibrary;
+	}
+	if (disturbances) {
+		delete disturbances;
+	}
+	if (disturbanceShader) {
+		delete disturbanceShader;
+	}
+	if (resampler) {
+		delete resampler;
+	}
+	if (renderGridTexture) {
+		texturePool->Release(renderGridTexture);
+	}
+	if (renderGrid) {
+		delete renderGrid;
+	}
+	releaseCpuWater();
+	if (pipeSolver) {
+		delete pipeSolver;
+	}
+	if (latticeSolver) {
+		delete latticeSolver;
+	}
+	if (spectralSolver) {
+		delete spectralSolver;
+	}
+	if (ocean) {
+		delete ocean;
+	}
+	if (surfaceQuery) {
+		delete surfaceQuery;
+	}
+	if (queryGrid) {
+		delete queryGrid;
+	}
+	if (floatingBodies) {
+		delete floatingBodies;
+	}
+	if (surfaceNormals) {
+		delete surfaceNormals;
+	}
+	if (surfaceNormalTexture) {
+		texturePool->Release(surfaceNormalTexture);
+	}
+	if (surfaceFoamTexture) {
+		texturePool->Release(surfaceFoamTexture);
+	}
+	if (oceanDisplacementTexture) {
+		texturePool->Release(oceanDisplacementTexture);
+	}
+	if (oceanNormalTexture) {
+		texturePool->Release(oceanNormalTexture);
+	}
+
+	// Stop recording, the recorder finishes writing any queued frames
+	if (gridRecorder) {
+		delete gridRecorder;
+	}
+	if (gridPublisher) {
+		delete gridPublisher;
+	}
+	if (ensembleRunner) {
+		delete ensembleRunner;
+	}
+	if (streamServer) {
+		delete streamServer;
+	}
+	if (streamClient) {
+		delete streamClient;
+	}
+	if (remoteGrid) {
+		delete remoteGrid;
+	}
+	if (remoteGridTexture) {
+		texturePool->Release(remoteGridTexture);
+	}
+	releaseSimulationTargets();
+
+	// The scheduler waits for queued work, so it goes after everything that uses it
+	if (taskScheduler) {
+		delete taskScheduler;
+	}
+
+	// The pool destroys every upload texture, including those still held by the shaders
+	if (texturePool) {
+		delete texturePool;
+	}
+	if (textureDevice) {
+		delete textureDevice;
+	}
+	if (d3dTextureDevice) {
+		delete d3dTextureDevice;
+	}
+
 }
 
 ///////////////////////////           [ FRAME ]           /////////////////////////// 
@@ -222,6 +322,7 @@ bool App1::render()
 
 	camera->update();
 	renderer->beginScene(0.5f, 0.5f, 0.5f, 1.0f);
+	texturePool->BeginFrame();
 
 
 	timeVar += time.getTime(); // Increase time counter for sine and Gerstner waves
@@ -229,14 +330,22 @@ bool App1::render()
 	if (toggleSWE) {
 		// Advance shallow water simulation
 		simulationTime += time.getTime();
+		emitDisturbances();
 	}
 
 
-	if (toggleSWE) {
+	if (toggleSWE && cpuWater) {
+		// The virtual pipe engine replaces the GPU passes while it is selected
+		stepCpuWater();
+	}
+	else if (toggleSWE) {
 		// Performing the shallow water simulation render passes
 
 		if (simulationTime >= timeStepSize) {
 
+			// Apply queued splashes, drags and sources to the state the next step reads
+			applyDisturbances(worldMatrix, orthoViewMatrix, orthoMatrix);
+
 			predictionStep(worldMatrix, orthoViewMatrix, orthoMatrix);
 			correctionStep(worldMatrix, orthoViewMatrix, orthoMatrix);
 			simulationTime -= timeStepSize;
@@ -245,13 +354,106 @@ bool App1::render()
 			if (counter >= 1 && firstPass) {
 				firstPass = false;
 			}
+
+			// Hand the completed frame to the recorder, which writes it on its own thread, and to the
+			// shared-memory ring and stream read by external viewers. The mesh samples the grid
+			// texture directly at any resolution, so rendering never needs the grid on the CPU.
+			if ((recordSWE && gridRecorder) || (publishSWE && gridPublisher) || (streamSWE && streamServer && streamServer->HasClient())) {
+				exportGrid(correctionGridRTA->getShaderResourceView());
+			}
+			else {
+				// Copies still in flight are stale by the time exporting starts again
+				for (int i = 0; i < ExportLatency; i++) {
+					exportPending[i] = false;
+				}
+			}
 		}
 	}
 
+	// The ocean maps are only evaluated while they are shown
+	if (toggleOcean && !toggleSWE) {
+		updateOcean();
+	}
+
+	// When viewing a remote simulation, the latest streamed heights replace the local grid
+	ID3D11ShaderResourceView* waterGridView = correctionGridRTA->getShaderResourceView();
+	int waterGridSize = gridSizeX;
+	bool renderSWE = toggleSWE;
+	if (cpuWater) {
+		waterGridSize = cpuGridSize;
+		if (cpuWaterTexture) {
+			waterGridView = (ID3D11ShaderResourceView*)cpuWaterTexture->view;
+		}
+	}
+	if (viewRemote && streamClient) {
+		int remoteFrame;
+		if (streamClient->GetLatest(remoteGrid, remoteFrame)) {
+			if (meshResolution != gridSizeX) {
+				resampleForRender(remoteGrid->GetView());
+			}
+			else {
+				texturePool->Upload(remoteGridTexture, remoteGrid);
+				updateSurfaceMaps(remoteGrid->GetView(), remoteGridTexture);
+			}
+		}
+		waterGridView = (ID3D11ShaderResourceView*)remoteGridTexture->view;
+		waterGridSize = gridSizeX;
+		renderSWE = true;
+	}
+	// Grids stepped or received on the CPU are resampled there with the chosen filter, the GPU
+	// simulation's texture is blended bilinearly by the vertex shader instead
+	bool cpuGrid = cpuWater || viewRemote;
+	if (renderSWE && cpuGrid && meshResolution != waterGridSize && renderGridTexture) {
+		waterGridView = (ID3D11ShaderResourceView*)renderGridTexture->view;
+	}
+
+	if (querySWE) {
+		querySurface(renderSWE);
+	}
+
+	// The maps only light the heights they were worked out from
+	if (renderSWE && shadeSWE && surfaceMapsGrid && waterGridView == (ID3D11ShaderResourceView*)surfaceMapsGrid->view) {
+		water->SetSurfaceMaps((ID3D11ShaderResourceView*)surfaceNormalTexture->view, foamSWE && surfaceFoamTexture ? (ID3D11ShaderResourceView*)surfaceFoamTexture->view : nullptr);
+	}
+	else {
+		water->SetSurfaceMaps(nullptr, nullptr);
+	}
+
 	if (renderWater)
 	{
+		// Level of detail ranges follow the projection, the viewport height over 2 tan(fov / 2)
+		XMFLOAT4X4 projection;
+		XMStoreFloat4x4(&projection, renderer->getProjectionMatrix());
+		water->SetLevelOfDetail(waterLod, lodPixels, 0.5f * sHeight * projection._22);
+
+		// Culling boxes reach as far as the waves can move the surface from rest
+		float reach = 0.0f;
+		float lowest = 0.0f;
+		float highest = sweHeightBound;
+		if (!renderSWE && toggleOcean) {
+			// Five standard deviations of the height, sideways scaled by the choppiness
+			float deviation = ocean ? 5.0f * sqrtf(ocean->GetVariance()) : 0.0f;
+			reach = oceanSettings.choppiness * deviation;
+			lowest = -deviation;
+			highest = deviation;
+		}
+		else if (!renderSWE && toggleGerstner) {
+			// The four waves' amplitudes, and their circles' radii of steepness * wavelength / 6 pi
+			float speed, amplitude, wavelength, steepness;
+			water->GetGerstnerParameters(speed, amplitude, wavelength, steepness);
+			reach = fabsf(steepness * wavelength) * (1.0f + 1.4f + 2.7f + 4.0f) / (6.0f * XM_PI);
+			highest = fabsf(amplitude) * (1.0f + 0.9f + 0.6f + 3.04f);
+			lowest = -highest;
+		}
+		else if (!renderSWE) {
+			// The two sine waves
+			highest = 1.7f;
+			lowest = -highest;
+		}
+		water->SetCulling(waterCulling, reach, lowest, highest);
+
 		// Render the water mesh to be manipulated by either Gerstner waves, sine waves or shallow water simulation
-		water->render(viewMatrix, worldMatrix, renderer->getProjectionMatrix(), light, camera->getPosition(), timeVar, correctionGridRTA->getShaderResourceView(), toggleGerstner, toggleSWE);
+		water->render(viewMatrix, worldMatrix, renderer->getProjectionMatrix(), light, camera->getPosition(), timeVar, waterGridView, toggleGerstner, renderSWE, toggleOcean);
 	}
 
 	// Render GUI
@@ -281,11 +483,42 @@ void App1::gui()
 	ImGui::Checkbox(" Render water", &renderWater);
 	ImGui::Checkbox(" Toggle Gerstner waves", &toggleGerstner);
 	ImGui::Checkbox(" Toggle SWE water", &toggleSWE);
+	ImGui::Checkbox(" Toggle FFT ocean", &toggleOcean);
 
 
 	// Water settings 
 	water->GUI();
 
+	// FFT ocean settings
+	oceanGUI();
+
+	// CPU queries of the water surface
+	surfaceQueryGUI();
+
+	// Bodies floating on the CPU water
+	floatingBodiesGUI();
+
+	// Normals and foam of the shallow water heights
+	surfaceMapsGUI();
+
+	// Initial condition settings
+	scenarioGUI();
+
+	// Simulation and render mesh resolution
+	resolutionGUI();
+
+	// Virtual pipe water engine
+	cpuWaterGUI();
+
+	// Interactive disturbances
+	disturbanceGUI();
+
+	// Grid recording settings
+	recordingGUI();
+
+	// Parameter sweep settings
+	ensembleGUI();
+
 	// Custom ImGui theme
 	ImGuiStyle& style = ImGui::GetStyle();
 	style.WindowRounding = 0.0f;
@@ -373,3 +606,1161 @@ void App1::correctionStep(XMMATRIX world, XMMATRIX view, XMMATRIX proj)
 	renderer->setBackBufferRenderTarget();
 	renderer->resetViewport();
 }
+
+void App1::exportGrid(ID3D11ShaderResourceView* gridTexture)
+{
+	// The slot's copy was issued ExportLatency steps ago. It is read back only if the GPU has
+	// finished it, so stepping never waits on the GPU, the consumers read the mapped rows in place.
+	ID3D11DeviceContext* deviceContext = renderer->getDeviceContext();
+	ID3D11Texture2D* stagingTexture = exportStagingTextures[exportSlot];
+	if (exportPending[exportSlot]) {
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		if (SUCCEEDED(deviceContext->Map(stagingTexture, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource))) {
+			int frame = exportFrames[exportSlot];
+			ConstGridView grid = ConstGridView::Interleaved((const void*)mappedResource.pData, gridSizeX, gridSizeY, mappedResource.RowPitch);
+			if (recordSWE && gridRecorder) {
+				gridRecorder->Submit(grid, frame);
+			}
+			if (publishSWE && gridPublisher) {
+				gridPublisher->Publish(grid, frame);
+			}
+			if (streamSWE && streamServer) {
+				streamServer->Submit(grid, frame);
+			}
+			deviceContext->Unmap(stagingTexture, 0);
+		}
+		else {
+			// Still being drawn, or the device is gone, either way the frame is lost
+			exportDropped++;
+		}
+		exportPending[exportSlot] = false;
+	}
+
+	// Queue this step's copy into the slot just freed
+	ID3D11Resource* gridResource;
+	gridTexture->GetResource(&gridResource);
+	deviceContext->CopyResource(stagingTexture, gridResource);
+	gridResource->Release();
+	exportFrames[exportSlot] = recordedFrame;
+	exportPending[exportSlot] = true;
+	exportSlot = (exportSlot + 1) % ExportLatency;
+	if ((recordSWE && gridRecorder) || (publishSWE && gridPublisher) || (streamSWE && streamServer)) {
+		recordedFrame++;
+	}
+}
+
+void App1::recordingGUI()
+{
+	if (ImGui::CollapsingHeader("Recording and Publishing")) {
+		const char* policies[] = { "Block", "Drop", "Decimate" };
+		if (ImGui::Combo(" Backpressure", &recordPolicy, policies, 3) && gridRecorder) {
+			gridRecorder->SetPolicy((GridRecorder::BackpressurePolicy)recordPolicy);
+		}
+
+		if (ImGui::Checkbox(" Record SWE grid", &recordSWE)) {
+			if (recordSWE && !gridRecorder) {
+				gridRecorder = new GridRecorder("simulationGrid.bin", gridSizeX, gridSizeY, 8, (GridRecorder::BackpressurePolicy)recordPolicy);
+				recordedFrame = 0;
+			}
+			else if (!recordSWE && gridRecorder) {
+				delete gridRecorder;
+				gridRecorder = nullptr;
+			}
+		}
+
+		ImGui::Text("Readback frames dropped: %d", exportDropped);
+		if (gridRecorder) {
+			ImGui::Text("Queue depth: %d / %d (max %d)", gridRecorder->GetQueueDepth(), gridRecorder->GetBufferCount(), gridRecorder->GetMaxQueueDepth());
+			ImGui::Text("Frames written: %d, dropped: %d", gridRecorder->GetFramesWritten(), gridRecorder->GetFramesDropped());
+			ImGui::Text("Write latency: %.2f ms (max %.2f ms)", gridRecorder->GetAverageWriteLatency(), gridRecorder->GetMaxWriteLatency());
+			if (recordPolicy == GridRecorder::Decimate) {
+				ImGui::Text("Decimation: every %d frames", gridRecorder->GetDecimationStride());
+			}
+		}
+
+		// Publishing keeps the last few frames in shared memory for other processes to map
+		if (ImGui::Checkbox(" Publish SWE grid", &publishSWE)) {
+			if (publishSWE && !gridPublisher) {
+				gridPublisher = new GridPublisher("WaterSimulationGrid", gridSizeX, gridSizeY, 3);
+			}
+			else if (!publishSWE && gridPublisher) {
+				delete gridPublisher;
+				gridPublisher = nullptr;
+			}
+		}
+
+		if (gridPublisher) {
+			ImGui::Text("Frames published: %llu", gridPublisher->GetFramesPublished());
+		}
+
+		// Streaming sends changed tiles of the height field to a remote viewer over TCP
+		if (ImGui::SliderInt(" Stream budget (KB)", &streamBudgetKB, 16, 2048) && streamServer) {
+			streamServer->SetByteBudget(streamBudgetKB * 1024);
+		}
+		if (ImGui::Checkbox(" Stream SWE grid", &streamSWE)) {
+			if (streamSWE && !streamServer) {
+				streamServer = new GridStreamServer(47000, gridSizeX, gridSizeY);
+				streamServer->SetByteBudget(streamBudgetKB * 1024);
+			}
+			else if (!streamSWE && streamServer) {
+				delete streamServer;
+				streamServer = nullptr;
+			}
+		}
+		if (streamServer) {
+			ImGui::Text("Viewer connected: %s, level %d", streamServer->HasClient() ? "yes" : "no", streamServer->GetLevel());
+			ImGui::Text("Bytes per frame: %d (avg %.0f), sent %d, skipped %d", streamServer->GetLastFrameBytes(), streamServer->GetAverageFrameBytes(), streamServer->GetFramesSent(), streamServer->GetFramesSkipped());
+			ImGui::Text("Throughput: %.0f KB/s", streamServer->GetThroughput() / 1024.0f);
+		}
+
+		ImGui::InputText(" Remote host", remoteHost, sizeof(remoteHost));
+		if (ImGui::Checkbox(" View remote stream", &viewRemote)) {
+			if (viewRemote && !streamClient) {
+				streamClient = new GridStreamClient(remoteHost, 47000);
+				if (!remoteGrid) {
+					remoteGrid = new SimulationGrid2D(gridSizeX, gridSizeY);
+				}
+				if (!remoteGridTexture) {
+					remoteGridTexture = texturePool->Acquire(gridSizeX, gridSizeY, true);
+					texturePool->Upload(remoteGridTexture, remoteGrid);
+				}
+			}
+			else if (!viewRemote && streamClient) {
+				delete streamClient;
+				streamClient = nullptr;
+			}
+		}
+		if (streamClient) {
+			const char* state = streamClient->IsConnecting() ? "connecting" : streamClient->IsConnected() ? "yes" : "no";
+			ImGui::Text("Connected: %s, frames received %d", state, streamClient->GetFramesReceived());
+			ImGui::Text("Bytes per frame: %d, latency %.2f ms", streamClient->GetLastFrameBytes(), streamClient->GetAverageLatency());
+			int remoteX = streamClient->GetRemoteSizeX();
+			int remoteY = streamClient->GetRemoteSizeY();
+			if (remoteX && (remoteX != gridSizeX || remoteY != gridSizeY)) {
+				ImGui::Text("Remote grid %dx%d does not match this one, re-grid to view it", remoteX, remoteY);
+			}
+			ImGui::Text("Uploaded: %lld bytes in %d regions last frame", texturePool->GetLastFrameBytes(), texturePool->GetLastFrameRegions());
+		}
+	}
+}
+
+void App1::ensembleGUI()
+{
+	if (ImGui::CollapsingHeader("Parameter Sweep")) {
+		if (!ensembleRunner || ensembleRunner->IsFinished()) {
+			if (ImGui::Button(" Run sweep.txt", ImVec2(170, 20))) {
+				if (ensembleRunner) {
+					delete ensembleRunner;
+				}
+				ensembleRunner = new EnsembleRunner(taskScheduler);
+				ensembleSummaryWritten = false;
+				if (ensembleRunner->LoadSweep("sweep.txt")) {
+					ensembleRunner->Start();
+				}
+				else {
+					// Nothing ran, so there is no summary to write
+					ensembleSummaryWritten = true;
+				}
+			}
+		}
+		else if (ImGui::Button(" Stop sweep", ImVec2(170, 20))) {
+			ensembleRunner->Stop();
+		}
+
+		if (ensembleRunner && !ensembleRunner->GetError().empty()) {
+			ImGui::Text("%s", ensembleRunner->GetError().c_str());
+		}
+		else if (ensembleRunner) {
+			ImGui::Text("Runs: %d / %d", ensembleRunner->GetRunsCompleted(), ensembleRunner->GetRunCount());
+			ImGui::Text("Progress: %.1f%%, %.1f s", ensembleRunner->GetProgress() * 100.0f, ensembleRunner->GetWallTime());
+			ImGui::Text("Workers: %d, steals: %lld", ensembleRunner->GetScheduler()->GetThreadCount(), ensembleRunner->GetScheduler()->GetSteals());
+
+			// Write the summary table once every run has finished
+			if (ensembleRunner->IsFinished() && !ensembleSummaryWritten) {
+				ensembleRunner->WriteSummary("sweepSummary.csv");
+				ensembleSummaryWritten = true;
+			}
+		}
+
+		// Measure the kernels specialised for each grid size, this stalls the frame while it runs
+		const char* boundaries[] = { "Periodic", "Reflective" };
+		ImGui::Combo(" Kernel boundary", &kernelBoundary, boundaries, (int)BoundaryType::Count);
+		if (ImGui::Button(" Benchmark CPU kernels", ImVec2(170, 20))) {
+			kernelTimings = MacCormackKernels::Benchmark((BoundaryType)kernelBoundary, 5);
+		}
+		for (size_t i = 0; i < kernelTimings.size(); i++) {
+			const MacCormackKernels::Timing& timing = kernelTimings[i];
+			ImGui::Text("%d: generic %.2f ms, specialised %.2f ms (%.2fx)", timing.size, timing.genericTime, timing.specialisedTime, timing.genericTime / timing.specialisedTime);
+		}
+
+		// Lattice updates per second of the lattice Boltzmann solver against MacCormack, on one core
+		if (ImGui::Button(" Benchmark lattice", ImVec2(170, 20))) {
+			latticeThroughput = LatticeBoltzmannSolver::Benchmark(5);
+		}
+		for (size_t i = 0; i < latticeThroughput.size(); i++) {
+			const LatticeBoltzmannSolver::Throughput& throughput = latticeThroughput[i];
+			ImGui::Text("%d: lattice %.1f MLUPS, MacCormack %.1f MLUPS", throughput.size, throughput.latticeBoltzmann, throughput.macCormack);
+		}
+	}
+}
+
+void App1::resetSimulation()
+{
+	// Replace the CPU grids with the scenario's initial state, the first pass uploads them to the render textures
+	delete predictedGrid;
+	delete correctedGrid;
+	correctedGrid = scenarioLibrary->Create(scenario, gridSizeX, gridSizeY);
+	predictedGrid = new SimulationGrid2D(*correctedGrid);
+	disturbances->Clear();
+	if (cpuWaterGrid) {
+		createCpuWater();
+	}
+
+	firstPass = true;
+	counter = 0;
+	simulationTime = 0.0f;
+}
+
+void App1::scenarioGUI()
+{
+	if (ImGui::CollapsingHeader("Scenario")) {
+		// An engine that takes the bed as flat would leave the basin's water standing on its slopes
+		bool bedAllowed = !cpuWater || cpuEngineUsesBed();
+		if (!bedAllowed && scenario.type == ScenarioType::ImageBasin) {
+			scenario.type = ScenarioType::GaussianPulse;
+		}
+		const char* names[(int)ScenarioType::Count];
+		ScenarioType types[(int)ScenarioType::Count];
+		int typeCount = 0;
+		int selected = 0;
+		for (int i = 0; i < (int)ScenarioType::Count; i++) {
+			if ((ScenarioType)i == ScenarioType::ImageBasin && !bedAllowed) {
+				continue;
+			}
+			if ((ScenarioType)i == scenario.type) {
+				selected = typeCount;
+			}
+			types[typeCount] = (ScenarioType)i;
+			names[typeCount++] = ScenarioLibrary::GetName((ScenarioType)i);
+		}
+		if (ImGui::Combo(" Scenario", &selected, names, typeCount)) {
+			scenario.type = types[selected];
+		}
+		if (!bedAllowed) {
+			ImGui::Text("Image basin needs the virtual pipe engine or the GPU simulation");
+		}
+
+		ImGui::SliderFloat(" Base height", &scenario.baseHeight, 0.0f, 10.0f);
+		switch (scenario.type) {
+		case ScenarioType::GaussianPulse:
+		case ScenarioType::MultipleDrops:
+			ImGui::SliderFloat(" Pulse height", &scenario.maxHeight, 0.1f, 30.0f);
+			ImGui::SliderFloat(" Pulse width", &scenario.pulseWidth, 0.0f, 200.0f);
+			if (scenario.type == ScenarioType::MultipleDrops) {
+				ImGui::SliderInt(" Drops", &scenario.dropCount, 1, 64);
+			}
+			break;
+		case ScenarioType::DamBreak:
+			ImGui::SliderFloat(" Dam position", &scenario.damPosition, 0.05f, 0.95f);
+			ImGui::SliderFloat(" Upstream height", &scenario.upstreamHeight, 0.1f, 20.0f);
+			ImGui::SliderFloat(" Downstream height", &scenario.downstreamHeight, 0.0f, 20.0f);
+			break;
+		case ScenarioType::ImageBasin:
+			ImGui::SliderFloat(" Bed scale", &scenario.bedScale, 0.0f, 20.0f);
+			ImGui::SliderFloat(" Water level", &scenario.waterLevel, 0.0f, 20.0f);
+			break;
+		case ScenarioType::StandingWave:
+			ImGui::SliderInt(" Modes x", &scenario.modesX, 1, 16);
+			ImGui::SliderInt(" Modes y", &scenario.modesY, 1, 16);
+			ImGui::SliderFloat(" Wave amplitude", &scenario.waveAmplitude, 0.1f, 5.0f);
+			break;
+		default:
+			break;
+		}
+
+		if (ImGui::Button(" Reset Simulation", ImVec2(170, 20))) {
+			resetSimulation();
+		}
+		ImGui::Text("Initial state %s in %.2f ms", scenarioLibrary->LastCreateWasCached() ? "loaded from cache" : "generated", scenarioLibrary->GetLastCreateTime());
+		ImGui::Text("Upload textures: %d, created %d, uploaded %.1f MB", texturePool->GetTextureCount(), textureDevice->GetCreateCount(), texturePool->GetBytesUploaded() / (1024.0f * 1024.0f));
+	}
+}
+
+void App1::applyDisturbances(XMMATRIX world, XMMATRIX view, XMMATRIX proj)
+{
+	if (!disturbances->BeginSubstep(timeStepSize, gridSizeX, gridSizeY)) {
+		disturbanceTime = 0.0f;
+		return;
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Before the first pass the CPU grids are still the simulation state and are uploaded by it
+	if (firstPass) {
+		disturbances->Apply(correctedGrid);
+		disturbances->Apply(predictedGrid);
+		disturbanceTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		return;
+	}
+
+	// Otherwise the state lives in the corrected render texture B and is changed on the GPU. The
+	// shader draws the disturbed nodes of each dirty rectangle into disturbanceRT, which are then
+	// copied back into B, so nothing waits for a read back. Events past the shader's limit are
+	// applied in further passes on top of the first. The first pass drew the CPU rows into B upside
+	// down, so the events and rectangles are flipped to land where they would on the CPU grids.
+	ID3D11DeviceContext* deviceContext = renderer->getDeviceContext();
+	ID3D11Resource* gridResource;
+	ID3D11Resource* disturbedResource;
+	correctionGridRTB->getShaderResourceView()->GetResource(&gridResource);
+	disturbanceRT->getShaderResourceView()->GetResource(&disturbedResource);
+	ID3D11RenderTargetView* disturbanceTarget = disturbanceRT->getRenderTargetView();
+	deviceContext->OMSetRenderTargets(1, &disturbanceTarget, nullptr);
+	orthoMesh->sendData(deviceContext);
+
+	disturbances->GetFlippedY(flippedEvents, flippedRects);
+	const std::vector<DisturbanceQueue::PreparedEvent>& events = flippedEvents;
+	const std::vector<GridRect>& rects = flippedRects;
+	for (size_t first = 0; first < events.size(); first += DisturbanceShader::MaxEvents) {
+		int count = (int)std::min(events.size() - first, (size_t)DisturbanceShader::MaxEvents);
+		disturbanceShader->setShaderParameters(world, view, proj, correctionGridRTB->getShaderResourceView(), &events[first], count);
+
+		// The quad is drawn into a viewport covering just the rectangle
+		for (size_t i = 0; i < rects.size(); i++) {
+			D3D11_VIEWPORT rectViewport = viewport;
+			rectViewport.TopLeftX = (float)rects[i].x0;
+			rectViewport.TopLeftY = (float)rects[i].y0;
+			rectViewport.Width = (float)rects[i].Width();
+			rectViewport.Height = (float)rects[i].Height();
+			deviceContext->RSSetViewports(1, &rectViewport);
+			disturbanceShader->render(deviceContext, orthoMesh->GetIndexCount());
+		}
+
+		// B is read by the pass, so it is unbound before the rectangles are copied into it
+		ID3D11ShaderResourceView* noTexture = nullptr;
+		deviceContext->PSSetShaderResources(0, 1, &noTexture);
+		for (size_t i = 0; i < rects.size(); i++) {
+			D3D11_BOX box = { (UINT)rects[i].x0, (UINT)rects[i].y0, 0, (UINT)rects[i].x1, (UINT)rects[i].y1, 1 };
+			deviceContext->CopySubresourceRegion(gridResource, 0, rects[i].x0, rects[i].y0, 0, disturbedResource, 0, &box);
+		}
+	}
+	disturbedResource->Release();
+	gridResource->Release();
+	disturbances->MarkApplied();
+
+	renderer->setBackBufferRenderTarget();
+	renderer->resetViewport();
+
+	disturbanceTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void App1::emitDisturbances()
+{
+	// Queue the continuous disturbances for this frame, they are applied at the next step
+	float frameTime = time.getTime();
+	int size = simulatedGridSize();
+	if (rainSWE) {
+		rainAccumulator += rainRate * frameTime;
+		while (rainAccumulator >= 1.0f) {
+			float x = (float)(rand() % size);
+			float y = (float)(rand() % size);
+			disturbances->Splash(x, y, 3.0f, 0.5f);
+			rainAccumulator -= 1.0f;
+		}
+	}
+	if (dragSWE) {
+		// An object circling the centre of the grid, dragging the water with it
+		dragAngle += frameTime * 0.5f;
+		float radius = size * 0.3f;
+		float speed = radius * 0.5f * domainSize / size;
+		disturbances->Drag(size * 0.5f + cosf(dragAngle) * radius, size * 0.5f + sinf(dragAngle) * radius,
+			-sinf(dragAngle) * speed, cosf(dragAngle) * speed, 8.0f, 0.2f);
+	}
+}
+
+void App1::disturbanceGUI()
+{
+	if (ImGui::CollapsingHeader("Disturbances")) {
+		int size = simulatedGridSize();
+		if (ImGui::Button(" Splash", ImVec2(170, 20))) {
+			disturbances->Splash((float)(rand() % size), (float)(rand() % size), 12.0f, 5.0f);
+		}
+		if (ImGui::Button(" Point source", ImVec2(170, 20))) {
+			disturbances->PointSource(size * 0.5f, size * 0.5f, 6.0f, 2.0f, 5.0f);
+		}
+		ImGui::Checkbox(" Rain", &rainSWE);
+		ImGui::SliderInt(" Drops per second", &rainRate, 1, 5000);
+		ImGui::Checkbox(" Drag object", &dragSWE);
+
+		ImGui::Text("Pending: %d, active sources: %d", disturbances->GetPendingCount(), disturbances->GetActiveSourceCount());
+		ImGui::Text("Dirty rectangles: %d, apply time %.3f ms", (int)disturbances->GetDirtyRects().size(), disturbanceTime);
+		ImGui::Text("Events applied: %lld, nodes touched: %lld", disturbances->GetEventsApplied(), disturbances->GetNodesTouched());
+	}
+}
+
+void App1::resampleForRender(const ConstGridView& grid)
+{
+	// The render grid follows the mesh resolution, one node per vertex
+	if (renderGrid && renderGrid->GetSizeX() != meshResolution) {
+		if (surfaceMapsGrid == renderGridTexture) {
+			surfaceMapsGrid = nullptr;
+		}
+		texturePool->Release(renderGridTexture);
+		renderGridTexture = nullptr;
+		delete renderGrid;
+		renderGrid = nullptr;
+	}
+	if (!renderGrid) {
+		renderGrid = new SimulationGrid2D(meshResolution, meshResolution, 0.0f);
+		renderGridTexture = texturePool->Acquire(meshResolution, meshResolution);
+	}
+
+	// The vertex shader displaces by the depth on top of the bed, the discharges are not drawn
+	resampler->Resample(grid, SimulationGrid2D::Height, renderGrid->GetView(), SimulationGrid2D::Height, (HeightFieldResampler::Filter)resampleFilter);
+	resampler->Resample(grid, SimulationGrid2D::Bathymetry, renderGrid->GetView(), SimulationGrid2D::Bathymetry, (HeightFieldResampler::Filter)resampleFilter);
+	texturePool->Upload(renderGridTexture, renderGrid->GetView());
+	updateSurfaceMaps(renderGrid->GetView(), renderGridTexture);
+}
+
+void App1::resolutionGUI()
+{
+	if (ImGui::CollapsingHeader("Resolution")) {
+		ImGui::SliderInt(" Mesh resolution", &meshResolution, 16, 2048);
+		if (ImGui::Button(" Match simulation grid", ImVec2(170, 20))) {
+			meshResolution = gridSizeX;
+		}
+		if (meshResolution != water->GetMeshResolution()) {
+			water->SetMeshResolution(meshResolution);
+		}
+
+		const char* filters[HeightFieldResampler::FilterCount];
+		for (int i = 0; i < HeightFieldResampler::FilterCount; i++) {
+			filters[i] = HeightFieldResampler::GetName((HeightFieldResampler::Filter)i);
+		}
+		ImGui::Combo(" Resample filter", &resampleFilter, filters, HeightFieldResampler::FilterCount);
+
+		ImGui::Text("Simulation %dx%d, mesh %dx%d", gridSizeX, gridSizeY, meshResolution, meshResolution);
+		if (meshResolution != simulatedGridSize()) {
+			if (cpuWater || viewRemote) {
+				ImGui::Text("Resample time: %.2f ms", resampler->GetLastTime());
+			}
+			else {
+				ImGui::Text("Sampled bilinearly from the grid texture on the GPU");
+			}
+		}
+
+		// Re-gridding moves the running simulation onto a new resolution over the same domain
+		ImGui::SliderInt(" Simulation grid", &requestedGridSize, 64, 2048);
+		if (ImGui::Button(" Re-grid", ImVec2(170, 20))) {
+			regrid(requestedGridSize);
+		}
+		ImGui::Text("Node spacing %.3f m, last re-grid %.1f ms", spatialStepSize, regridTime);
+
+		// The quadtree's finest level is as dense as the mesh
+		ImGui::Checkbox(" Level of detail", &waterLod);
+		ImGui::SliderFloat(" Triangle size (pixels)", &lodPixels, 1.0f, 32.0f);
+		WaterQuadtree* quadtree = water->GetQuadtree();
+		if (waterLod) {
+			ImGui::Text("%d levels of %d cell patches, %d patches, select %.3f ms", quadtree->GetLevelCount(), quadtree->GetPatchCells(), (int)quadtree->GetPatches().size(), quadtree->GetLastTime());
+		}
+		ImGui::Text("Triangles drawn: %lld", water->GetTriangleCount());
+
+		// Chunks of the uniform mesh, or patches when the level of detail is on
+		ImGui::Checkbox(" Frustum culling", &waterCulling);
+		ImGui::SliderFloat(" SWE height bound", &sweHeightBound, 1.0f, 100.0f);
+		ImGui::Text("%d of %d %s visible, %d draws", water->GetVisibleChunkCount(), water->GetChunkCount(), waterLod ? "patches" : "chunks", water->GetDrawCount());
+		if (waterCulling) {
+			ImGui::Text("Cull time: %.3f ms", water->GetCullTime());
+		}
+	}
+}
+
+void App1::createSimulationTargets()
+{
+	// Ping-pong render targets holding the predicted and corrected grids on the GPU
+	predictionGridRTA = new RenderTexture(renderer->getDevice(), gridSizeX, gridSizeY, 0.1f, 100.0f);
+	predictionGridRTB = new RenderTexture(renderer->getDevice(), gridSizeX, gridSizeY, 0.1f, 100.0f);
+	correctionGridRTA = new RenderTexture(renderer->getDevice(), gridSizeX, gridSizeY, 0.1f, 100.0f);
+	correctionGridRTB = new RenderTexture(renderer->getDevice(), gridSizeX, gridSizeY, 0.1f, 100.0f);
+	disturbanceRT = new RenderTexture(renderer->getDevice(), gridSizeX, gridSizeY, 0.1f, 100.0f);
+
+	renderTargetsA[0] = predictionGridRTA->getRenderTargetView();
+	renderTargetsA[1] = correctionGridRTA->getRenderTargetView();
+	renderTargetsB[0] = predictionGridRTB->getRenderTargetView();
+	renderTargetsB[1] = correctionGridRTB->getRenderTargetView();
+
+
+	// Staging texture for reads of the simulation grid that need the current state at once
+	D3D11_TEXTURE2D_DESC stagingDesc;
+	stagingDesc.Width = gridSizeX;
+	stagingDesc.Height = gridSizeY;
+	stagingDesc.MipLevels = 1;
+	stagingDesc.ArraySize = 1;
+	stagingDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	stagingDesc.SampleDesc.Count = 1;
+	stagingDesc.SampleDesc.Quality = 0;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	stagingDesc.MiscFlags = 0;
+	renderer->getDevice()->CreateTexture2D(&stagingDesc, nullptr, &gridStagingTexture);
+
+	// Ring the exported grid is copied through without waiting on the GPU
+	for (int i = 0; i < ExportLatency; i++) {
+		renderer->getDevice()->CreateTexture2D(&stagingDesc, nullptr, &exportStagingTextures[i]);
+		exportPending[i] = false;
+	}
+	exportSlot = 0;
+
+	// Ring the surface query reads the drawn state through the same way
+	for (int i = 0; i < QueryLatency; i++) {
+		renderer->getDevice()->CreateTexture2D(&stagingDesc, nullptr, &queryStagingTextures[i]);
+		queryPending[i] = false;
+	}
+	querySlot = 0;
+
+
+	// Setup the viewport for simulation
+	viewport.Width = (float)gridSizeX;
+	viewport.Height = (float)gridSizeX;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+	viewport.TopLeftX = 0.0f;
+	viewport.TopLeftY = 0.0f;
+}
+
+void App1::releaseSimulationTargets()
+{
+	if (predictionGridRTA) {
+		delete predictionGridRTA;
+		predictionGridRTA = nullptr;
+	}
+	if (predictionGridRTB) {
+		delete predictionGridRTB;
+		predictionGridRTB = nullptr;
+	}
+	if (correctionGridRTA) {
+		delete correctionGridRTA;
+		correctionGridRTA = nullptr;
+	}
+	if (correctionGridRTB) {
+		delete correctionGridRTB;
+		correctionGridRTB = nullptr;
+	}
+	if (disturbanceRT) {
+		delete disturbanceRT;
+		disturbanceRT = nullptr;
+	}
+	if (gridStagingTexture) {
+		gridStagingTexture->Release();
+		gridStagingTexture = nullptr;
+	}
+	for (int i = 0; i < ExportLatency; i++) {
+		if (exportStagingTextures[i]) {
+			exportStagingTextures[i]->Release();
+			exportStagingTextures[i] = nullptr;
+		}
+		exportPending[i] = false;
+	}
+	for (int i = 0; i < QueryLatency; i++) {
+		if (queryStagingTextures[i]) {
+			queryStagingTextures[i]->Release();
+			queryStagingTextures[i] = nullptr;
+		}
+		queryPending[i] = false;
+	}
+}
+
+void App1::readbackState(SimulationGrid2D* grid)
+{
+	// Before the first pass the GPU targets are still empty and the CPU grid is current
+	if (firstPass) {
+		CopyGridView(correctedGrid->GetView(), grid->GetView());
+		return;
+	}
+
+	// The state drawn and exported is in A. Waits for the GPU to finish the current step.
+	ID3D11Resource* gridResource;
+	correctionGridRTA->getShaderResourceView()->GetResource(&gridResource);
+	renderer->getDeviceContext()->CopyResource(gridStagingTexture, gridResource);
+	gridResource->Release();
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (SUCCEEDED(renderer->getDeviceContext()->Map(gridStagingTexture, 0, D3D11_MAP_READ, 0, &mappedResource))) {
+		CopyGridView(ConstGridView::Interleaved((const void*)mappedResource.pData, gridSizeX, gridSizeY, mappedResource.RowPitch), grid->GetView());
+		renderer->getDeviceContext()->Unmap(gridStagingTexture, 0);
+	}
+}
+
+void App1::readbackLatestState(SimulationGrid2D* grid)
+{
+	if (firstPass) {
+		CopyGridView(correctedGrid->GetView(), grid->GetView());
+		return;
+	}
+
+	// The oldest copy in the ring is read only once the GPU has finished it. Until then the slot
+	// is left alone and no new copy is queued, the grid keeps the last state read back.
+	ID3D11DeviceContext* deviceContext = renderer->getDeviceContext();
+	ID3D11Texture2D* stagingTexture = queryStagingTextures[querySlot];
+	if (queryPending[querySlot]) {
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		if (FAILED(deviceContext->Map(stagingTexture, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mappedResource))) {
+			return;
+		}
+		CopyGridView(ConstGridView::Interleaved((const void*)mappedResource.pData, gridSizeX, gridSizeY, mappedResource.RowPitch), grid->GetView());
+		deviceContext->Unmap(stagingTexture, 0);
+		queryPending[querySlot] = false;
+	}
+
+	// Queue this step's copy into the slot just read
+	ID3D11Resource* gridResource;
+	correctionGridRTA->getShaderResourceView()->GetResource(&gridResource);
+	deviceContext->CopyResource(stagingTexture, gridResource);
+	gridResource->Release();
+	queryPending[querySlot] = true;
+	querySlot = (querySlot + 1) % QueryLatency;
+}
+
+void App1::regrid(int newSize)
+{
+	if (newSize == gridSizeX || newSize < 2) {
+		return;
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Pull the running state off the GPU and move it onto the new grid, keeping the water volume and discharge
+	SimulationGrid2D current(gridSizeX, gridSizeY, 0.0f);
+	readbackState(&current);
+	float oldStepSize = spatialStepSize;
+	float newStepSize = domainSize / newSize;
+	SimulationGrid2D* resampled = new SimulationGrid2D(newSize, newSize, 0.0f);
+	resampler->ResampleState(current.GetView(), oldStepSize * oldStepSize, resampled->GetView(), newStepSize * newStepSize);
+
+	// Consumers sized to the old grid are stopped, they can be restarted at the new size from the GUI
+	if (gridRecorder) {
+		delete gridRecorder;
+		gridRecorder = nullptr;
+		recordSWE = false;
+	}
+	if (gridPublisher) {
+		delete gridPublisher;
+		gridPublisher = nullptr;
+		publishSWE = false;
+	}
+	if (streamServer) {
+		delete streamServer;
+		streamServer = nullptr;
+		streamSWE = false;
+	}
+	if (streamClient) {
+		delete streamClient;
+		streamClient = nullptr;
+		viewRemote = false;
+	}
+	if (remoteGrid) {
+		delete remoteGrid;
+		remoteGrid = nullptr;
+	}
+	if (remoteGridTexture) {
+		if (surfaceMapsGrid == remoteGridTexture) {
+			surfaceMapsGrid = nullptr;
+		}
+		texturePool->Release(remoteGridTexture);
+		remoteGridTexture = nullptr;
+	}
+	disturbances->Clear();
+
+	// A mesh matching the old grid follows it to the new resolution
+	if (meshResolution == gridSizeX) {
+		meshResolution = newSize;
+		water->SetMeshResolution(meshResolution);
+	}
+
+	gridSizeX = newSize;
+	gridSizeY = newSize;
+	spatialStepSize = newStepSize;
+	stepSizeX = spatialStepSize;
+	stepSizeY = spatialStepSize;
+	DTDXDY = timeStepSize / stepSizeX;
+
+	releaseSimulationTargets();
+	createSimulationTargets();
+	predictionShader->setGridSize(gridSizeX);
+	correctionShader->setGridSize(gridSizeX);
+
+	// The first pass uploads the resampled grids into the new render targets
+	delete predictedGrid;
+	delete correctedGrid;
+	correctedGrid = resampled;
+	predictedGrid = new SimulationGrid2D(*correctedGrid);
+	firstPass = true;
+	counter = 0;
+	requestedGridSize = gridSizeX;
+
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	regridTime = elapsed.count();
+}
+
+int App1::simulatedGridSize()
+{
+	// Disturbances are placed in cells of the grid the selected engine is stepping
+	return cpuWater ? cpuGridSize : gridSizeX;
+}
+
+void App1::createCpuWater()
+{
+	releaseCpuWater();
+
+	// Fourier transforms need power of two sides, the spectral engine rounds the size down
+	cpuGridSize = requestedCpuGridSize;
+	if (cpuEngine == CpuSpectral) {
+		while (cpuGridSize & (cpuGridSize - 1)) {
+			cpuGridSize &= cpuGridSize - 1;
+		}
+	}
+	cpuWaterGrid = scenarioLibrary->Create(scenario, cpuGridSize, cpuGridSize);
+	if (!cpuEngineUsesBed()) {
+		flattenCpuBed();
+	}
+
+	// The CPU grid covers the same domain as the GPU simulation at its own resolution
+	if (!pipeSolver) {
+		pipeSolver = new VirtualPipeSolver(taskScheduler);
+	}
+	if (!latticeSolver) {
+		latticeSolver = new LatticeBoltzmannSolver(taskScheduler);
+	}
+	if (!spectralSolver) {
+		spectralSolver = new SpectralWaveSolver(taskScheduler);
+	}
+	for (ShallowWaterSolver* solver : { (ShallowWaterSolver*)pipeSolver, (ShallowWaterSolver*)latticeSolver, (ShallowWaterSolver*)spectralSolver }) {
+		SimulationParameters& parameters = solver->GetParameters();
+		parameters.gravity = gravity;
+		parameters.n = n;
+		parameters.spatialStepSize = domainSize / cpuGridSize;
+		parameters.boundary = cpuReflective ? BoundaryType::Reflective : BoundaryType::Periodic;
+		solver->Reset();
+	}
+	disturbances->Clear();
+
+	// The bodies' pressure is sized to the old grid until their next step
+	pipeSolver->SetSurfacePressure(nullptr);
+
+	// Advancing by no steps reads the initial depths, which sets the first time step. The
+	// lattice keeps that step, its distributions are rebuilt whenever the step changes.
+	pipeSolver->Advance(cpuWaterGrid, 0);
+	latticeSolver->Advance(cpuWaterGrid, 0);
+	latticeSolver->GetParameters().timeStepSize = latticeSolver->GetStableTimeStep(cpuCourant);
+}
+
+bool App1::cpuEngineUsesBed()
+{
+	return cpuEngine == CpuVirtualPipe;
+}
+
+void App1::flattenCpuBed()
+{
+	// The lattice and spectral engines evolve the depth over a flat bed, and the renderer draws
+	// depth plus bed, so the bed they are drawn on has to be flat too
+	GridView view = cpuWaterGrid->GetView();
+	for (int y = 0; y < view.GetHeight(); y++) {
+		std::array<float, 4>* row = view.Row(y);
+		for (int x = 0; x < view.GetWidth(); x++) {
+			row[x][SimulationGrid2D::Bathymetry] = 0.0f;
+		}
+	}
+	cpuWaterGrid->MarkAllDirty();
+}
+
+void App1::releaseCpuWater()
+{
+	if (cpuWaterTexture) {
+		if (surfaceMapsGrid == cpuWaterTexture) {
+			surfaceMapsGrid = nullptr;
+		}
+		texturePool->Release(cpuWaterTexture);
+		cpuWaterTexture = nullptr;
+	}
+	if (cpuWaterGrid) {
+		delete cpuWaterGrid;
+		cpuWaterGrid = nullptr;
+	}
+}
+
+void App1::stepCpuWater()
+{
+	if (!cpuWaterGrid || (cpuEngine == CpuSpectral && !FourierTransform::IsPowerOfTwo(cpuGridSize))) {
+		createCpuWater();
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+	BoundaryType boundary = cpuReflective ? BoundaryType::Reflective : BoundaryType::Periodic;
+
+	// Pipe steps follow the deepest water of the last frame so the waves stay within one cell
+	// per step. The spectral engine makes one jump per frame whatever its length, only its
+	// near field is stepped.
+	float frameTime = 0.0f;
+	if (cpuEngine == CpuLatticeBoltzmann) {
+		latticeSolver->GetParameters().boundary = boundary;
+		latticeSolver->SetRelaxationTime(latticeTau);
+		frameTime = latticeSolver->GetParameters().timeStepSize * cpuSubsteps;
+	}
+	else if (cpuEngine == CpuSpectral) {
+		int side = (int)(cpuGridSize * spectralNearFraction);
+		GridRect region;
+		if (side > 0) {
+			region.x0 = (cpuGridSize - side) / 2;
+			region.y0 = region.x0;
+			region.x1 = region.x0 + side;
+			region.y1 = region.y0 + side;
+		}
+		float depth = std::max(2.0f * spectralSolver->GetMeanDepth(), 1e-3f);
+		float nearTimeStep = cpuCourant * spectralSolver->GetParameters().spatialStepSize / sqrtf(gravity * depth);
+		spectralSolver->SetNearField(region, spectralBlendWidth, SolverType::MacCormack, nearTimeStep);
+		frameTime = spectralJump;
+	}
+	else {
+		SimulationParameters& parameters = pipeSolver->GetParameters();
+		parameters.boundary = boundary;
+		parameters.timeStepSize = pipeSolver->GetStableTimeStep(cpuCourant);
+		pipeSolver->SetDamping(pipeDamping);
+		frameTime = parameters.timeStepSize * cpuSubsteps;
+	}
+
+	// Disturbances go straight into the CPU grid. The pipe and spectral solvers read the grid
+	// back every call, the lattice rebuilds the cells that changed.
+	if (disturbances->BeginSubstep(frameTime, cpuGridSize, cpuGridSize)) {
+		disturbances->Apply(cpuWaterGrid);
+		if (cpuEngine == CpuLatticeBoltzmann) {
+			latticeSolver->Reinitialise(cpuWaterGrid, disturbances->GetDirtyRects());
+		}
+	}
+	switch (cpuEngine) {
+	case CpuLatticeBoltzmann:
+		latticeSolver->Advance(cpuWaterGrid, cpuSubsteps);
+		break;
+	case CpuSpectral:
+		spectralSolver->Advance(cpuWaterGrid, spectralJump);
+		break;
+	default:
+		pipeSolver->Advance(cpuWaterGrid, cpuSubsteps);
+		break;
+	}
+	cpuStepTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	stepFloatingBodies(frameTime);
+
+	// Only a grid matching the mesh is uploaded whole, otherwise one height per vertex is
+	if (meshResolution != cpuGridSize) {
+		resampleForRender(cpuWaterGrid->GetView());
+		return;
+	}
+	if (!cpuWaterTexture) {
+		cpuWaterTexture = texturePool->Acquire(cpuGridSize, cpuGridSize);
+	}
+	texturePool->Upload(cpuWaterTexture, cpuWaterGrid);
+	updateSurfaceMaps(cpuWaterGrid->GetView(), cpuWaterTexture);
+}
+
+void App1::cpuWaterGUI()
+{
+	if (ImGui::CollapsingHeader("CPU water engines")) {
+		ImGui::Checkbox(" Use CPU water", &cpuWater);
+		const char* engines[] = { "Virtual pipe", "Lattice Boltzmann", "Spectral far field" };
+		if (ImGui::Combo(" Engine", &cpuEngine, engines, CpuEngineCount) && cpuWaterGrid && !cpuEngineUsesBed()) {
+			flattenCpuBed();
+			latticeSolver->Reset();
+		}
+		ImGui::SliderInt(" CPU grid", &requestedCpuGridSize, 256, 4096);
+		if (ImGui::Button(" Rebuild CPU grid", ImVec2(170, 20))) {
+			createCpuWater();
+		}
+		ImGui::SliderFloat(" Courant number", &cpuCourant, 0.05f, 1.0f);
+		ImGui::Checkbox(" Reflective walls", &cpuReflective);
+		switch (cpuEngine) {
+		case CpuLatticeBoltzmann:
+			// The lattice time step is chosen when the grid is built
+			ImGui::SliderInt(" Steps per frame", &cpuSubsteps, 1, 16);
+			ImGui::SliderFloat(" Relaxation time", &latticeTau, 0.505f, 1.5f);
+			break;
+		case CpuSpectral:
+			// The far field is periodic, the walls only apply inside the near field
+			ImGui::SliderFloat(" Jump per frame", &spectralJump, 0.005f, 1.0f);
+			ImGui::SliderFloat(" Near field size", &spectralNearFraction, 0.0f, 0.9f);
+			ImGui::SliderInt(" Blend width", &spectralBlendWidth, 0, 64);
+			break;
+		default:
+			ImGui::SliderInt(" Steps per frame", &cpuSubsteps, 1, 16);
+			ImGui::SliderFloat(" Outflow damping", &pipeDamping, 0.9f, 1.0f);
+			break;
+		}
+
+		if (cpuWaterGrid) {
+			ImGui::Text("Grid %dx%d, spacing %.3f m", cpuGridSize, cpuGridSize, domainSize / cpuGridSize);
+			if (cpuEngine == CpuSpectral) {
+				ImGui::Text("Mean depth %.2f m, far field %.2f ms", spectralSolver->GetMeanDepth(), spectralSolver->GetLastFarFieldTime());
+				ImGui::Text("Near field %d steps, %.2f ms", spectralSolver->GetLastNearFieldSteps(), spectralSolver->GetLastNearFieldTime());
+			}
+			else {
+				ShallowWaterSolver* solver = cpuEngine == CpuLatticeBoltzmann ? (ShallowWaterSolver*)latticeSolver : (ShallowWaterSolver*)pipeSolver;
+				float cellsPerSecond = (float)cpuGridSize * cpuGridSize * cpuSubsteps / (cpuStepTime * 1e-3f);
+				ImGui::Text("Time step %.4f s, step time %.2f ms", solver->GetParameters().timeStepSize, cpuStepTime);
+				ImGui::Text("%.0f million cells/s", cpuStepTime > 0.0f ? cellsPerSecond * 1e-6f : 0.0f);
+			}
+			if (cpuEngine == CpuLatticeBoltzmann) {
+				ImGui::Text("Viscosity %.4f m2/s", latticeSolver->GetViscosity());
+			}
+		}
+	}
+}
+
+void App1::updateOcean()
+{
+	int size = 256 << oceanSizeIndex;
+	if (!ocean) {
+		ocean = new OceanSpectrum(taskScheduler);
+	}
+	if (ocean->GetSize() != size) {
+		ocean->Resize(size);
+		if (oceanDisplacementTexture) {
+			texturePool->Release(oceanDisplacementTexture);
+		}
+		if (oceanNormalTexture) {
+			texturePool->Release(oceanNormalTexture);
+		}
+		oceanDisplacementTexture = texturePool->Acquire(size, size);
+		oceanNormalTexture = texturePool->Acquire(size, size);
+	}
+	oceanSettings.windDirection = XMConvertToRadians(oceanWindAngle);
+	ocean->SetSettings(oceanSettings);
+	ocean->Evaluate(timeVar);
+
+	texturePool->Upload(oceanDisplacementTexture, ocean->GetDisplacementView());
+	texturePool->Upload(oceanNormalTexture, ocean->GetNormalView());
+	water->SetOceanMaps((ID3D11ShaderResourceView*)oceanDisplacementTexture->view, (ID3D11ShaderResourceView*)oceanNormalTexture->view, oceanSettings.patchSize);
+}
+
+void App1::oceanGUI()
+{
+	if (ImGui::CollapsingHeader("FFT ocean")) {
+		const char* spectra[] = { OceanSpectrum::GetName(OceanSpectrum::Phillips), OceanSpectrum::GetName(OceanSpectrum::Jonswap) };
+		ImGui::Combo(" Spectrum", &oceanSettings.spectrum, spectra, OceanSpectrum::SpectrumCount);
+		const char* sizes[] = { "256", "512", "1024" };
+		ImGui::Combo(" Ocean maps", &oceanSizeIndex, sizes, 3);
+		ImGui::SliderFloat(" Wind speed", &oceanSettings.windSpeed, 1.0f, 30.0f);
+		ImGui::SliderFloat(" Wind direction", &oceanWindAngle, 0.0f, 360.0f);
+		if (oceanSettings.spectrum == OceanSpectrum::Jonswap) {
+			ImGui::SliderFloat(" Fetch", &oceanSettings.fetch, 1000.0f, 500000.0f);
+			ImGui::SliderFloat(" Peak enhancement", &oceanSettings.peakEnhancement, 1.0f, 7.0f);
+		}
+		ImGui::SliderFloat(" Patch size", &oceanSettings.patchSize, 20.0f, 1000.0f);
+		ImGui::SliderFloat(" Wave scale", &oceanSettings.amplitudeScale, 0.0f, 4.0f);
+		ImGui::SliderFloat(" Choppiness", &oceanSettings.choppiness, 0.0f, 2.0f);
+
+		if (ocean) {
+			ImGui::Text("Significant wave height %.2f m", 4.0f * sqrtf(ocean->GetVariance()));
+			ImGui::Text("Evaluate %.2f ms, of which FFT %.2f ms", ocean->GetLastTime(), ocean->GetLastTransformTime());
+		}
+	}
+}
+
+void App1::querySurface(bool renderSWE)
+{
+	if (!surfaceQuery) {
+		surfaceQuery = new WaterSurfaceQuery(taskScheduler);
+	}
+
+	// A square lattice of points over the water mesh, which spans 100 units
+	if ((int)querySamples.Size() != queryPointCount) {
+		int side = std::max(1, (int)ceilf(sqrtf((float)queryPointCount)));
+		querySamples.Resize(queryPointCount);
+		for (int i = 0; i < queryPointCount; i++) {
+			querySamples.x[i] = -50.0f + 100.0f * ((i % side) + 0.5f) / side;
+			querySamples.z[i] = -50.0f + 100.0f * ((i / side) + 0.5f) / side;
+		}
+	}
+
+	// The same choice of surface the wave shader makes
+	surfaceQuery->SetTime(timeVar);
+	surfaceQuery->SetDisplacementIterations(queryIterations);
+	if (renderSWE) {
+		surfaceQuery->SetMode(WaterSurfaceQuery::ShallowWater);
+		if (viewRemote && streamClient) {
+			surfaceQuery->SetGrid(remoteGrid->GetView(), 100.0f, spatialStepSize);
+		}
+		else if (cpuWater && cpuWaterGrid) {
+			surfaceQuery->SetGrid(cpuWaterGrid->GetView(), 100.0f, domainSize / cpuGridSize);
+		}
+		else {
+			if (queryGrid && queryGrid->GetSizeX() != gridSizeX) {
+				delete queryGrid;
+				queryGrid = nullptr;
+			}
+			// The state the mesh is drawn from, not the copy the next predictor reads. A new grid
+			// waits for one read back so it never answers with empty water, after that the ring
+			// lags the drawn state by a step or two.
+			if (!queryGrid) {
+				queryGrid = new SimulationGrid2D(gridSizeX, gridSizeY, 0.0f);
+				readbackState(queryGrid);
+			}
+			readbackLatestState(queryGrid);
+			surfaceQuery->SetGrid(queryGrid->GetView(), 100.0f, spatialStepSize);
+		}
+	}
+	else if (toggleOcean && ocean) {
+		surfaceQuery->SetMode(WaterSurfaceQuery::Ocean);
+		surfaceQuery->SetOcean(ocean);
+	}
+	else if (toggleGerstner) {
+		float speed, amplitude, wavelength, steepness;
+		water->GetGerstnerParameters(speed, amplitude, wavelength, steepness);
+		surfaceQuery->SetMode(WaterSurfaceQuery::Gerstner);
+		surfaceQuery->SetGerstnerParameters(speed, amplitude, wavelength, steepness);
+	}
+	else {
+		surfaceQuery->SetMode(WaterSurfaceQuery::Sine);
+	}
+	surfaceQuery->Query(querySamples);
+}
+
+void App1::surfaceQueryGUI()
+{
+	if (ImGui::CollapsingHeader("Surface queries")) {
+		ImGui::Checkbox(" Query surface", &querySWE);
+		ImGui::SliderInt(" Query points", &queryPointCount, 1, 200000);
+		ImGui::SliderInt(" Displacement iterations", &queryIterations, 0, 5);
+
+		if (surfaceQuery && querySamples.Size() > 0) {
+			const char* modes[] = { "Sine", "Gerstner", "FFT ocean", "Shallow water" };
+			ImGui::Text("%s, %d points in %.3f ms", modes[surfaceQuery->GetMode()], (int)querySamples.Size(), surfaceQuery->GetLastTime());
+			ImGui::Text("First point height %.3f", querySamples.height[0]);
+			ImGui::Text("Normal (%.2f, %.2f, %.2f)", querySamples.normalX[0], querySamples.normalY[0], querySamples.normalZ[0]);
+			ImGui::Text("Velocity (%.2f, %.2f, %.2f)", querySamples.velocityX[0], querySamples.velocityY[0], querySamples.velocityZ[0]);
+		}
+	}
+}
+
+void App1::spawnFloatingBodies()
+{
+	if (!floatingBodies) {
+		floatingBodies = new FloatingBodies(taskScheduler);
+	}
+
+	// Hulls from rowing boats to dinghies scattered over the CPU domain, each drawing 15 cm
+	// and dropped in resting on the water under it
+	floatingBodies->Clear();
+	float spacing = domainSize / cpuGridSize;
+	for (int i = 0; i < floatingCount; i++) {
+		float x = domainSize * (rand() % 10000) / 10000.0f;
+		float y = domainSize * (rand() % 10000) / 10000.0f;
+		float heading = XM_2PI * (rand() % 10000) / 10000.0f;
+		float halfLength = 0.5f + 1.5f * (rand() % 10000) / 10000.0f;
+		float halfWidth = halfLength * (0.3f + 0.2f * (rand() % 10000) / 10000.0f);
+		float mass = 150.0f * halfLength * halfWidth * 4.0f;
+		float surface = 1.0f;
+		if (cpuWaterGrid) {
+			int column = std::min((int)(x / spacing), cpuGridSize - 1);
+			int row = std::min((int)(y / spacing), cpuGridSize - 1);
+			const std::array<float, 4>& node = cpuWaterGrid->GetRow(row)[column];
+			surface = node[SimulationGrid2D::Height] + node[SimulationGrid2D::Bathymetry];
+		}
+		floatingBodies->Add(x, y, surface, heading, halfLength, halfWidth, 0.8f, mass);
+	}
+}
+
+void App1::stepFloatingBodies(float frameTime)
+{
+	if (!floatBodies || !floatingBodies || floatingBodies->GetCount() == 0) {
+		pipeSolver->SetSurfacePressure(nullptr);
+		return;
+	}
+	const SimulationParameters& parameters = cpuEngine == CpuLatticeBoltzmann ? latticeSolver->GetParameters()
+		: cpuEngine == CpuSpectral ? spectralSolver->GetParameters() : pipeSolver->GetParameters();
+
+	// The pipes keep their own flows, so they take the hulls' pressure from the next step on
+	floatingBodies->SetDragRate(floatingDragRate);
+	floatingBodies->SetPushWater(floatingPush);
+	floatingBodies->SetPushDischarges(cpuEngine != CpuVirtualPipe);
+
+	// Long spectral jumps are split so the hulls' bobbing stays stable
+	int steps = std::max(1, (int)ceilf(frameTime / 0.05f));
+	for (int step = 0; step < steps; step++) {
+		floatingBodies->Step(cpuWaterGrid, parameters, frameTime / steps);
+		if (cpuEngine == CpuLatticeBoltzmann) {
+			latticeSolver->Reinitialise(cpuWaterGrid, floatingBodies->GetChangedRects());
+		}
+	}
+	pipeSolver->SetSurfacePressure(cpuEngine == CpuVirtualPipe ? floatingBodies->GetPressure() : nullptr);
+}
+
+void App1::floatingBodiesGUI()
+{
+	if (ImGui::CollapsingHeader("Floating bodies")) {
+		// Bodies float on the CPU water engines only
+		ImGui::Checkbox(" Float bodies", &floatBodies);
+		ImGui::Checkbox(" Push water", &floatingPush);
+		ImGui::SliderInt(" Body count", &floatingCount, 1, 2000);
+		ImGui::SliderFloat(" Drag rate", &floatingDragRate, 0.0f, 10.0f);
+		if (ImGui::Button(" Spawn bodies", ImVec2(170, 20))) {
+			spawnFloatingBodies();
+		}
+
+		if (floatingBodies && floatingBodies->GetCount() > 0) {
+			float immersion = 0.0f;
+			for (int i = 0; i < floatingBodies->GetCount(); i++) {
+				immersion += floatingBodies->GetImmersion(i);
+			}
+			ImGui::Text("%d bodies, step %.2f ms, of which rasterise %.2f ms", floatingBodies->GetCount(), floatingBodies->GetLastTime(), floatingBodies->GetLastRasteriseTime());
+			ImGui::Text("Mean immersion %.3f m", immersion / floatingBodies->GetCount());
+		}
+	}
+}
+
+void App1::updateSurfaceMaps(const ConstGridView& grid, GridTexture* gridTexture)
+{
+	if (!shadeSWE) {
+		surfaceMapsGrid = nullptr;
+		return;
+	}
+	if (!surfaceNormals) {
+		surfaceNormals = new HeightFieldNormals(taskScheduler);
+		surfaceNormals->SetMeshSize(100.0f);
+	}
+	surfaceNormals->SetFoam(foamSWE);
+	surfaceNormals->SetFoamScale(foamRadius);
+	surfaceNormals->Compute(grid);
+
+	// The maps follow the size of the heights they go with
+	int width = grid.GetWidth();
+	int height = grid.GetHeight();
+	if (surfaceNormalTexture && (surfaceNormalTexture->width != width || surfaceNormalTexture->height != height)) {
+		texturePool->Release(surfaceNormalTexture);
+		surfaceNormalTexture = nullptr;
+	}
+	if (surfaceFoamTexture && (surfaceFoamTexture->width != width || surfaceFoamTexture->height != height)) {
+		texturePool->Release(surfaceFoamTexture);
+		surfaceFoamTexture = nullptr;
+	}
+	if (!surfaceNormalTexture) {
+		surfaceNormalTexture = texturePool->Acquire(width, height, false, GridTexture::Snorm16x2);
+	}
+	texturePool->Upload(surfaceNormalTexture, surfaceNormals->GetNormals(), width * sizeof(unsigned int));
+	if (foamSWE) {
+		if (!surfaceFoamTexture) {
+			surfaceFoamTexture = texturePool->Acquire(width, height, false, GridTexture::Unorm8);
+		}
+		texturePool->Upload(surfaceFoamTexture, surfaceNormals->GetFoamMap(), width);
+	}
+	surfaceMapsGrid = gridTexture;
+}
+
+void App1::surfaceMapsGUI()
+{
+	if (ImGui::CollapsingHeader("Surface normals")) {
+		// Only heights on the CPU get normals, the GPU simulation's when resampled for the mesh
+		ImGui::Checkbox(" Shade SWE normals", &shadeSWE);
+		ImGui::Checkbox(" Foam", &foamSWE);
+		ImGui::SliderFloat(" Foam radius", &foamRadius, 0.1f, 10.0f);
+
+		if (surfaceNormals && surfaceMapsGrid) {
+			ImGui::Text("Maps %dx%d, %.2f ms", surfaceNormals->GetWidth(), surfaceNormals->GetHeight(), surfaceNormals->GetLastTime());
+		}
+	}
+}
@@ -6,6 +6,21 @@
 #include "Water.h"
 #include "PredictionShader.h"
 #include "CorrectionShader.h"
+#include "GridRecorder.h"
+#include "GridPublisher.h"
+#include "GridStream.h"
+#include "EnsembleRunner.h"
+#include "ScenarioLibrary.h"
+#include "DisturbanceQueue.h"
+#include "DisturbanceShader.h"
+#include "HeightFieldResampler.h"
+#include "VirtualPipeSolver.h"
+#include "LatticeBoltzmannSolver.h"
+#include "SpectralWaveSolver.h"
+#include "OceanSpectrum.h"
+#include "WaterSurfaceQuery.h"
+#include "FloatingBodies.h"
+#include "HeightFieldNormals.h"
 class App1 : public BaseApplication
 {
 public:
@@ -26,6 +41,37 @@ private:
 	void predictionStep(XMMATRIX world, XMMATRIX view, XMMATRIX proj);
 	void correctionStep(XMMATRIX world, XMMATRIX view, XMMATRIX proj);
 	void App1::trackFrameRate();
+	void exportGrid(ID3D11ShaderResourceView* gridTexture);
+	void recordingGUI();
+	void ensembleGUI();
+	void scenarioGUI();
+	void resetSimulation();
+	void applyDisturbances(XMMATRIX world, XMMATRIX view, XMMATRIX proj);
+	void emitDisturbances();
+	void disturbanceGUI();
+	void resampleForRender(const ConstGridView& grid);
+	void resolutionGUI();
+	void createSimulationTargets();
+	void releaseSimulationTargets();
+	void readbackState(SimulationGrid2D* grid);
+	void readbackLatestState(SimulationGrid2D* grid);
+	void regrid(int newSize);
+	void createCpuWater();
+	void releaseCpuWater();
+	void stepCpuWater();
+	void cpuWaterGUI();
+	bool cpuEngineUsesBed();
+	void flattenCpuBed();
+	int simulatedGridSize();
+	void updateOcean();
+	void oceanGUI();
+	void querySurface(bool renderSWE);
+	void surfaceQueryGUI();
+	void spawnFloatingBodies();
+	void stepFloatingBodies(float frameTime);
+	void floatingBodiesGUI();
+	void updateSurfaceMaps(const ConstGridView& grid, GridTexture* gridTexture);
+	void surfaceMapsGUI();
 
 	// Time related variables 
 	float timeVar;
@@ -37,6 +83,11 @@ private:
 	SimulationGrid2D* predictedGrid;
 	SimulationGrid2D* correctedGrid;
 
+	// Initial conditions of the simulation, generated in parallel and cached on disk
+	TaskScheduler* taskScheduler;
+	ScenarioLibrary* scenarioLibrary;
+	ScenarioSettings scenario;
+
 	// Shallow water equation simulation parameters:
 	int gridSizeX;
 	float stepSizeX;
@@ -49,22 +100,167 @@ private:
 	float DTDXDY;
 	float spatialStepSize;
 
+	// The simulated domain keeps its physical size when re-gridding, only the node spacing changes
+	float domainSize;
+	int requestedGridSize;
+	float regridTime = 0.0f; // milliseconds spent in the last re-grid
+
 	// Objects used for the simulation render passes
 	OrthoMesh* orthoMesh;
-	RenderTexture* predictionGridRTA;
-	RenderTexture* predictionGridRTB;
-	RenderTexture* correctionGridRTA;
-	RenderTexture* correctionGridRTB;
+	RenderTexture* predictionGridRTA = nullptr;
+	RenderTexture* predictionGridRTB = nullptr;
+	RenderTexture* correctionGridRTA = nullptr;
+	RenderTexture* correctionGridRTB = nullptr;
 	ID3D11RenderTargetView* renderTargetsA[2];
 	ID3D11RenderTargetView* renderTargetsB[2];
 	D3D11_VIEWPORT viewport;
 
+	// Upload textures for CPU grids, created once per grid size and reused. The counting device
+	// wraps the Direct3D one so allocations per step can be shown in the GUI.
+	D3D11GridTextureDevice* d3dTextureDevice = nullptr;
+	CountingGridTextureDevice* textureDevice = nullptr;
+	GridTexturePool* texturePool = nullptr;
+
 	PredictionShader* predictionShader;
 	CorrectionShader* correctionShader;
 
 	bool firstPass;
 	int  counter = 0;
 
+	// Objects used to record the simulation grid to disk
+	GridRecorder* gridRecorder = nullptr;
+	ID3D11Texture2D* gridStagingTexture = nullptr;
+	bool recordSWE = false;
+	int recordPolicy = GridRecorder::Drop;
+	int recordedFrame = 0;
+
+	// Ring of staging textures the exported grid is copied into. Each copy is read back
+	// ExportLatency steps after it was issued, and dropped if the GPU has not finished it by then.
+	static const int ExportLatency = 3;
+	ID3D11Texture2D* exportStagingTextures[ExportLatency] = {};
+	int exportFrames[ExportLatency] = {};
+	bool exportPending[ExportLatency] = {};
+	int exportSlot = 0;
+	int exportDropped = 0;
+
+	// Shared-memory publication of the simulation grid for external viewers
+	GridPublisher* gridPublisher = nullptr;
+	bool publishSWE = false;
+
+	// Streaming of the height field to remote viewers, and the viewer side used to watch a remote simulation
+	GridStreamServer* streamServer = nullptr;
+	GridStreamClient* streamClient = nullptr;
+	SimulationGrid2D* remoteGrid = nullptr;
+	GridTexture* remoteGridTexture = nullptr;
+	bool streamSWE = false;
+	bool viewRemote = false;
+	int streamBudgetKB = 256;
+	char remoteHost[64] = "127.0.0.1";
+
+	// Parameter sweeps run on the CPU alongside the interactive simulation
+	EnsembleRunner* ensembleRunner = nullptr;
+	bool ensembleSummaryWritten = false;
+
+	// Step times of the size specialised CPU kernels against the generic one
+	std::vector<MacCormackKernels::Timing> kernelTimings;
+	int kernelBoundary = (int)BoundaryType::Periodic;
+	std::vector<LatticeBoltzmannSolver::Throughput> latticeThroughput;
+
+	// Splashes, drags and point sources injected into the running simulation between steps. On
+	// the GPU they are drawn into disturbanceRT from the state and the touched rectangles copied back.
+	DisturbanceQueue* disturbances = nullptr;
+	DisturbanceShader* disturbanceShader = nullptr;
+	RenderTexture* disturbanceRT = nullptr;
+	std::vector<DisturbanceQueue::PreparedEvent> flippedEvents; // events of the substep in B's row order
+	std::vector<GridRect> flippedRects;
+	bool rainSWE = false;
+	int rainRate = 200;        // drops per second
+	float rainAccumulator = 0.0f;
+	bool dragSWE = false;
+	float dragAngle = 0.0f;
+	float disturbanceTime = 0.0f; // milliseconds spent applying disturbances in the last step
+
+	// The render mesh can have a different resolution to the simulation grid. Grids on the CPU
+	// are then resampled to one value per mesh vertex before rendering, the vertex shader blends
+	// the GPU simulation's texture bilinearly itself.
+	int meshResolution;
+	int resampleFilter = HeightFieldResampler::CatmullRom;
+	HeightFieldResampler* resampler = nullptr;
+	SimulationGrid2D* renderGrid = nullptr;
+	GridTexture* renderGridTexture = nullptr;
+
+	// Water stepped on the CPU over the same domain by the virtual pipe, lattice Boltzmann or
+	// spectral solver, cheaper engines for large interactive grids. Their heights are uploaded, or
+	// resampled to the mesh, and rendered through the same shallow water path as the GPU simulation.
+	// Only the pipes follow the bed, the lattice and spectral engines get a flat one.
+	enum CpuEngine
+	{
+		CpuVirtualPipe = 0,
+		CpuLatticeBoltzmann = 1,
+		CpuSpectral = 2,
+		CpuEngineCount = 3
+	};
+	VirtualPipeSolver* pipeSolver = nullptr;
+	LatticeBoltzmannSolver* latticeSolver = nullptr;
+	SpectralWaveSolver* spectralSolver = nullptr;
+	SimulationGrid2D* cpuWaterGrid = nullptr;
+	GridTexture* cpuWaterTexture = nullptr;
+	bool cpuWater = false;
+	int cpuEngine = CpuVirtualPipe;
+	bool cpuReflective = false;
+	int cpuGridSize = 1024;
+	int requestedCpuGridSize = 1024;
+	int cpuSubsteps = 2;
+	float cpuCourant = 0.5f;
+	float pipeDamping = 1.0f;
+	float latticeTau = 0.6f;
+	float spectralJump = 0.05f;         // seconds the far field jumps each frame
+	float spectralNearFraction = 0.3f;  // side of the centred nonlinear region relative to the grid
+	int spectralBlendWidth = 16;
+	float cpuStepTime = 0.0f; // milliseconds spent stepping the CPU grid in the last frame
+
+	// Tessendorf ocean evaluated on the CPU every frame, its displacement and normal maps are
+	// uploaded and tiled over the mesh in place of the Gerstner waves
+	OceanSpectrum* ocean = nullptr;
+	OceanSettings oceanSettings;
+	GridTexture* oceanDisplacementTexture = nullptr;
+	GridTexture* oceanNormalTexture = nullptr;
+	int oceanSizeIndex = 1; // 256, 512 or 1024 nodes along a side
+	float oceanWindAngle = 0.0f; // degrees
+
+	// Height, normal and velocity of the rendered surface at batches of points, as buoyancy or
+	// gameplay code would ask for them. The GPU simulation's drawn state, correction target A, is
+	// read back into queryGrid through a ring of staging textures, so queries see the state of
+	// one or two steps ago rather than stall the frame waiting for the current one.
+	WaterSurfaceQuery* surfaceQuery = nullptr;
+	SurfaceSamples querySamples;
+	SimulationGrid2D* queryGrid = nullptr;
+	static const int QueryLatency = 2;
+	ID3D11Texture2D* queryStagingTextures[QueryLatency] = {};
+	bool queryPending[QueryLatency] = {};
+	int querySlot = 0;
+	bool querySWE = false;
+	int queryPointCount = 100000;
+	int queryIterations = 2;
+
+	// Boats and debris floating on the CPU water and pushing on it. They are not drawn, their
+	// wakes show in the water.
+	FloatingBodies* floatingBodies = nullptr;
+	bool floatBodies = false;
+	bool floatingPush = true;
+	int floatingCount = 1000;
+	float floatingDragRate = 2.0f;
+
+	// Normals and foam of the CPU heights being rendered, worked out and uploaded each time the
+	// heights are. The GPU simulation's heights are never on the CPU, it keeps the flat normal.
+	HeightFieldNormals* surfaceNormals = nullptr;
+	GridTexture* surfaceNormalTexture = nullptr;
+	GridTexture* surfaceFoamTexture = nullptr;
+	GridTexture* surfaceMapsGrid = nullptr; // height texture the maps go with
+	bool shadeSWE = true;
+	bool foamSWE = false;
+	float foamRadius = 2.0f; // metres, crests curving tighter are fully white
+
 	// Scene lights
 	Light* light;  
 
@@ -75,6 +271,17 @@ private:
 	bool renderWater = true;
 	bool toggleGerstner = false;
 	bool toggleSWE = false;
+	bool toggleOcean = false;
+
+	// The water is drawn as a quadtree of patches chosen from the camera, coarser with distance,
+	// instead of the uniform mesh. Vertex spacing projects to at most lodPixels pixels.
+	bool waterLod = false;
+	float lodPixels = 8.0f;
+
+	// Chunks of the water, or patches of the quadtree, outside the view are not drawn. Shallow
+	// water heights are taken to stay below sweHeightBound.
+	bool waterCulling = false;
+	float sweHeightBound = 20.0f;
 };
 
 #endif
\ No newline at end of file
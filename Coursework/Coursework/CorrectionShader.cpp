@@ -35,6 +35,11 @@ void CorrectionShader::setSimulationParameters(float g_, float n_, float timeSte
 }
 
 
+void CorrectionShader::setGridSize(int gsize)
+{
+	gridSize = gsize;
+}
+
 void CorrectionShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilename)
 {
 
@@ -35,6 +35,7 @@ public:
 	CorrectionShader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, HWND hwnd, int gridSize);
 	~CorrectionShader();
 	void setSimulationParameters(float gravity, float n, float timeStepSize, float cr);
+	void setGridSize(int gridSize);
 
 	void setShaderParameters(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, float DTDXDY, ID3D11ShaderResourceView* predictedGridTex, ID3D11ShaderResourceView* correctedGridTex, bool firstPass, SimulationGrid2D* predictedGrid, SimulationGrid2D* correctedGrid);
 
@@ -0,0 +1,139 @@
+#include "DirtyRegion.h"
+
+DirtyRegion::DirtyRegion(int nx, int ny)
+{
+	sizeX = nx;
+	sizeY = ny;
+	rectOverhead = 256; // roughly the cost of an update call, in 16 byte nodes
+	maxRects = 32;
+	fullFraction = 0.6f;
+}
+
+void DirtyRegion::Resize(int nx, int ny)
+{
+	sizeX = nx;
+	sizeY = ny;
+	rects.clear();
+}
+
+long long DirtyRegion::Cost(const GridRect& rect)
+{
+	return rect.Area() + rectOverhead;
+}
+
+void DirtyRegion::Add(const GridRect& rect)
+{
+	GridRect clipped = rect.Clip(sizeX, sizeY);
+	if (clipped.Empty()) {
+		return;
+	}
+
+	// Nothing to do if an existing rectangle already covers it
+	for (size_t i = 0; i < rects.size(); i++) {
+		if (rects[i].Union(clipped).Area() == rects[i].Area()) {
+			return;
+		}
+	}
+
+	rects.push_back(clipped);
+	Coalesce(rects.size() - 1);
+
+	while ((int)rects.size() > maxRects) {
+		MergeCheapestPair();
+	}
+
+	if (GetArea() >= (long long)(fullFraction * sizeX * sizeY)) {
+		AddAll();
+	}
+}
+
+void DirtyRegion::Coalesce(size_t index)
+{
+	// Merge the rectangle with any other it overlaps or is cheaper to send together with,
+	// and repeat with the grown rectangle until nothing more merges
+	bool merged = true;
+	while (merged) {
+		merged = false;
+		for (size_t i = 0; i < rects.size(); i++) {
+			if (i == index) {
+				continue;
+			}
+			GridRect combined = rects[index].Union(rects[i]);
+			if (rects[index].Overlaps(rects[i]) || Cost(combined) <= Cost(rects[index]) + Cost(rects[i])) {
+				rects[index] = combined;
+				rects.erase(rects.begin() + i);
+				if (i < index) {
+					index--;
+				}
+				merged = true;
+				break;
+			}
+		}
+	}
+}
+
+void DirtyRegion::MergeCheapestPair()
+{
+	// Merge the pair whose union adds the fewest extra nodes
+	size_t bestA = 0;
+	size_t bestB = 1;
+	long long bestWaste = -1;
+	for (size_t a = 0; a < rects.size(); a++) {
+		for (size_t b = a + 1; b < rects.size(); b++) {
+			long long waste = rects[a].Union(rects[b]).Area() - rects[a].Area() - rects[b].Area();
+			if (bestWaste < 0 || waste < bestWaste) {
+				bestWaste = waste;
+				bestA = a;
+				bestB = b;
+			}
+		}
+	}
+	rects[bestA] = rects[bestA].Union(rects[bestB]);
+	rects.erase(rects.begin() + bestB);
+	Coalesce(bestA);
+}
+
+void DirtyRegion::AddAll()
+{
+	rects.clear();
+	GridRect full;
+	full.x1 = sizeX;
+	full.y1 = sizeY;
+	if (!full.Empty()) {
+		rects.push_back(full);
+	}
+}
+
+void DirtyRegion::Clear()
+{
+	rects.clear();
+}
+
+bool DirtyRegion::IsEmpty()
+{
+	return rects.empty();
+}
+
+const std::vector<GridRect>& DirtyRegion::GetRects()
+{
+	return rects;
+}
+
+long long DirtyRegion::GetArea()
+{
+	long long area = 0;
+	for (size_t i = 0; i < rects.size(); i++) {
+		area += rects[i].Area();
+	}
+	return area;
+}
+
+void DirtyRegion::SetRectOverhead(int nodes)
+{
+	rectOverhead = nodes;
+}
+
+void DirtyRegion::SetMaxRects(int count)
+{
+	maxRects = count > 1 ? count : 1;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include "GridRect.h"
+
+// Set of rectangles of a grid that changed since the consumer last synchronised. Rectangles
+// are coalesced as they are added: two rectangles are merged when sending their union costs
+// no more than sending both separately, where every separate rectangle carries a fixed
+// overhead (one sub-resource update call) expressed in nodes. The list is also capped, and
+// once most of the grid is dirty it collapses into a single full rectangle.
+class DirtyRegion
+{
+
+public:
+
+	DirtyRegion(int sizeX = 0, int sizeY = 0);
+
+	void Resize(int sizeX, int sizeY);
+
+	void Add(const GridRect& rect);
+	void AddAll();
+	void Clear();
+
+	bool IsEmpty();
+	const std::vector<GridRect>& GetRects();
+	long long GetArea(); // total nodes covered by the rectangles
+
+	// Cost model used when merging
+	void SetRectOverhead(int nodes);
+	void SetMaxRects(int count);
+
+private:
+
+	long long Cost(const GridRect& rect);
+	void Coalesce(size_t index);
+	void MergeCheapestPair();
+
+	std::vector<GridRect> rects;
+	int sizeX;
+	int sizeY;
+	int rectOverhead;
+	int maxRects;
+	float fullFraction; // collapse to the whole grid once this fraction is dirty
+
+};
@@ -0,0 +1,246 @@
+#include "DisturbanceQueue.h"
+#include <cmath>
+#include <algorithm>
+
+DisturbanceQueue::DisturbanceQueue()
+{
+	sizeY = 0;
+	eventsApplied = 0;
+	nodesTouched = 0;
+}
+
+DisturbanceQueue::~DisturbanceQueue()
+{
+}
+
+void DisturbanceQueue::Push(const Disturbance& disturbance)
+{
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	pending.push_back(disturbance);
+}
+
+void DisturbanceQueue::Splash(float x, float y, float radius, float height)
+{
+	Disturbance disturbance;
+	disturbance.type = Disturbance::Splash;
+	disturbance.x = x;
+	disturbance.y = y;
+	disturbance.radius = radius;
+	disturbance.amount = height;
+	Push(disturbance);
+}
+
+void DisturbanceQueue::Drag(float x, float y, float velocityX, float velocityY, float radius, float strength)
+{
+	Disturbance disturbance;
+	disturbance.type = Disturbance::Drag;
+	disturbance.x = x;
+	disturbance.y = y;
+	disturbance.radius = radius;
+	disturbance.amount = strength;
+	disturbance.velocityX = velocityX;
+	disturbance.velocityY = velocityY;
+	Push(disturbance);
+}
+
+void DisturbanceQueue::PointSource(float x, float y, float radius, float rate, float duration)
+{
+	Disturbance disturbance;
+	disturbance.type = Disturbance::PointSource;
+	disturbance.x = x;
+	disturbance.y = y;
+	disturbance.radius = radius;
+	disturbance.amount = rate;
+	disturbance.duration = duration;
+	Push(disturbance);
+}
+
+bool DisturbanceQueue::BeginSubstep(float timeStep, int sizeX, int sizeY)
+{
+	// Swap the queue out so pushes from other threads only wait for the swap
+	incoming.clear();
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		incoming.swap(pending);
+	}
+
+	prepared.clear();
+	dirtyRects.Resize(sizeX, sizeY);
+	this->sizeY = sizeY;
+
+	for (size_t i = 0; i < incoming.size(); i++) {
+		if (incoming[i].type == Disturbance::PointSource) {
+			activeSources.push_back(incoming[i]);
+			continue;
+		}
+		PreparedEvent event;
+		event.disturbance = incoming[i];
+		event.amount = incoming[i].amount;
+		prepared.push_back(event);
+	}
+
+	// Point sources add rate * dt each substep until they run out
+	for (size_t i = 0; i < activeSources.size(); i++) {
+		PreparedEvent event;
+		event.disturbance = activeSources[i];
+		event.amount = activeSources[i].amount * std::min(timeStep, activeSources[i].duration);
+		prepared.push_back(event);
+		activeSources[i].duration -= timeStep;
+	}
+	activeSources.erase(std::remove_if(activeSources.begin(), activeSources.end(), [](const Disturbance& source) { return source.duration <= 0.0f; }), activeSources.end());
+
+	// Bounding rectangle of every event, events entirely outside the grid are dropped
+	size_t kept = 0;
+	for (size_t i = 0; i < prepared.size(); i++) {
+		const Disturbance& disturbance = prepared[i].disturbance;
+		float radius = std::max(disturbance.radius, 0.5f);
+		GridRect rect;
+		rect.x0 = (int)std::floor(disturbance.x - radius);
+		rect.y0 = (int)std::floor(disturbance.y - radius);
+		rect.x1 = (int)std::ceil(disturbance.x + radius) + 1;
+		rect.y1 = (int)std::ceil(disturbance.y + radius) + 1;
+		rect = rect.Clip(sizeX, sizeY);
+		if (rect.Empty()) {
+			continue;
+		}
+		prepared[i].rect = rect;
+		prepared[kept++] = prepared[i];
+		dirtyRects.Add(rect);
+	}
+	prepared.resize(kept);
+
+	eventsApplied += prepared.size();
+	return !prepared.empty();
+}
+
+const std::vector<GridRect>& DisturbanceQueue::GetDirtyRects()
+{
+	return dirtyRects.GetRects();
+}
+
+void DisturbanceQueue::ApplyToPatch(const GridRect& rect, const GridView& patch)
+{
+	for (size_t i = 0; i < prepared.size(); i++) {
+		if (prepared[i].rect.Overlaps(rect)) {
+			ApplyEvent(prepared[i], rect, patch);
+		}
+	}
+}
+
+void DisturbanceQueue::Apply(SimulationGrid2D* grid)
+{
+	// Each dirty rectangle is modified in place through a view into the grid
+	GridView view = grid->GetView();
+	const std::vector<GridRect>& rects = dirtyRects.GetRects();
+	for (size_t r = 0; r < rects.size(); r++) {
+		ApplyToPatch(rects[r], view.Sub(rects[r]));
+		grid->MarkDirty(rects[r]);
+	}
+}
+
+const std::vector<DisturbanceQueue::PreparedEvent>& DisturbanceQueue::GetEvents()
+{
+	return prepared;
+}
+
+void DisturbanceQueue::GetFlippedY(std::vector<PreparedEvent>& events, std::vector<GridRect>& rects)
+{
+	// Rows [y0, y1) land on rows [sizeY - y1, sizeY - y0), which is also the rectangle
+	// BeginSubstep works out for the flipped centre
+	events = prepared;
+	for (size_t i = 0; i < events.size(); i++) {
+		Disturbance& disturbance = events[i].disturbance;
+		disturbance.y = sizeY - 1 - disturbance.y;
+		disturbance.velocityY = -disturbance.velocityY;
+		GridRect rect = events[i].rect;
+		events[i].rect.y0 = sizeY - rect.y1;
+		events[i].rect.y1 = sizeY - rect.y0;
+	}
+	rects = dirtyRects.GetRects();
+	for (size_t i = 0; i < rects.size(); i++) {
+		GridRect rect = rects[i];
+		rects[i].y0 = sizeY - rect.y1;
+		rects[i].y1 = sizeY - rect.y0;
+	}
+}
+
+void DisturbanceQueue::MarkApplied()
+{
+	for (size_t i = 0; i < prepared.size(); i++) {
+		nodesTouched += prepared[i].rect.Area();
+	}
+}
+
+void DisturbanceQueue::ApplyEvent(const PreparedEvent& event, const GridRect& rect, const GridView& patch)
+{
+	const Disturbance& disturbance = event.disturbance;
+	const float pi = 3.14159265f;
+	float radius = std::max(disturbance.radius, 0.5f);
+	float invRadius = 1.0f / radius;
+
+	// Only the part of the event's rectangle that lies inside this patch
+	int x0 = std::max(event.rect.x0, rect.x0);
+	int x1 = std::min(event.rect.x1, rect.x1);
+	int y0 = std::max(event.rect.y0, rect.y0);
+	int y1 = std::min(event.rect.y1, rect.y1);
+
+	for (int y = y0; y < y1; y++) {
+		std::array<float, 4>* row = patch.Row(y - rect.y0) - rect.x0;
+		float dy = y - disturbance.y;
+		for (int x = x0; x < x1; x++) {
+			float dx = x - disturbance.x;
+			float distance = std::sqrt(dx * dx + dy * dy) * invRadius;
+			if (distance >= 1.0f) {
+				continue;
+			}
+
+			// Raised cosine falloff, smooth at the edge of the radius so no shocks are introduced
+			float weight = 0.5f * (1.0f + std::cos(pi * distance));
+			std::array<float, 4>& node = row[x];
+			switch (disturbance.type) {
+			case Disturbance::Splash:
+			case Disturbance::PointSource:
+				node[SimulationGrid2D::Height] += event.amount * weight;
+				break;
+			case Disturbance::Drag:
+				node[SimulationGrid2D::DischargeX] += event.amount * weight * (node[SimulationGrid2D::Height] * disturbance.velocityX - node[SimulationGrid2D::DischargeX]);
+				node[SimulationGrid2D::DischargeY] += event.amount * weight * (node[SimulationGrid2D::Height] * disturbance.velocityY - node[SimulationGrid2D::DischargeY]);
+				break;
+			}
+		}
+	}
+
+	nodesTouched += (long long)std::max(x1 - x0, 0) * std::max(y1 - y0, 0);
+}
+
+void DisturbanceQueue::Clear()
+{
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		pending.clear();
+	}
+	activeSources.clear();
+	prepared.clear();
+	dirtyRects.Clear();
+}
+
+int DisturbanceQueue::GetPendingCount()
+{
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	return (int)pending.size();
+}
+
+int DisturbanceQueue::GetActiveSourceCount()
+{
+	return (int)activeSources.size();
+}
+
+long long DisturbanceQueue::GetEventsApplied()
+{
+	return eventsApplied;
+}
+
+long long DisturbanceQueue::GetNodesTouched()
+{
+	return nodesTouched;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <mutex>
+#include "DirtyRegion.h"
+#include "SimulationGrid2D.h"
+
+// A single interaction with the water. Positions and radii are in grid nodes.
+struct Disturbance
+{
+	enum Type
+	{
+		Splash = 0,      // raises a smooth bump of the given height once
+		Drag = 1,        // pulls the discharge under the object towards the object's velocity once
+		PointSource = 2  // adds water at a rate (height per second) until the duration runs out
+	};
+
+	Type type = Splash;
+	float x = 0.0f;
+	float y = 0.0f;
+	float radius = 4.0f;
+	float amount = 1.0f;    // splash height, drag strength in [0, 1] or source rate
+	float velocityX = 0.0f; // drag only, in discharge per unit height
+	float velocityY = 0.0f;
+	float duration = 0.0f;  // point source only, seconds
+};
+
+
+// Queue of disturbances injected into the running simulation. Events can be pushed from any
+// thread at any time; between substeps the simulation takes everything queued so far and
+// applies it. Each event only touches the nodes inside its radius, and the rectangles it
+// touched are coalesced into a short dirty list so the GPU state and I/O consumers only need
+// to update those regions instead of the whole grid.
+class DisturbanceQueue
+{
+
+public:
+
+	DisturbanceQueue();
+	~DisturbanceQueue();
+
+	void Push(const Disturbance& disturbance);
+	void Splash(float x, float y, float radius, float height);
+	void Drag(float x, float y, float velocityX, float velocityY, float radius, float strength);
+	void PointSource(float x, float y, float radius, float rate, float duration);
+
+	// Take the queued events for the next substep and work out the rectangles they touch.
+	// Returns false if there is nothing to apply.
+	bool BeginSubstep(float timeStep, int sizeX, int sizeY);
+
+	// Merged rectangles touched by the events of the current substep
+	const std::vector<GridRect>& GetDirtyRects();
+
+	// Apply the events of the current substep to a view of the nodes covering the rectangle
+	void ApplyToPatch(const GridRect& rect, const GridView& patch);
+
+	// Apply the events of the current substep in place to a CPU grid
+	void Apply(SimulationGrid2D* grid);
+
+	// An event of the current substep, with the amount it adds in this substep and the
+	// rectangle of nodes it reaches
+	struct PreparedEvent
+	{
+		Disturbance disturbance;
+		GridRect rect;
+		float amount; // scaled by the time step for point sources
+	};
+
+	// Events of the current substep in the order they are applied, for applying them elsewhere
+	// such as on the GPU. MarkApplied counts their nodes in the statistics once they have been.
+	const std::vector<PreparedEvent>& GetEvents();
+	void MarkApplied();
+
+	// The events and dirty rectangles of the current substep for a copy of the grid stored with
+	// its rows upside down, as the state in the GPU's render textures is: node row y is row
+	// sizeY - 1 - y there and the y velocity of a drag points the other way
+	void GetFlippedY(std::vector<PreparedEvent>& events, std::vector<GridRect>& rects);
+
+	// Remove every queued event and running point source
+	void Clear();
+
+	int GetPendingCount();
+	int GetActiveSourceCount();
+	long long GetEventsApplied();
+	long long GetNodesTouched();
+
+private:
+
+	void ApplyEvent(const PreparedEvent& event, const GridRect& rect, const GridView& patch);
+
+	// Events pushed since the last substep
+	std::vector<Disturbance> pending;
+	std::mutex pendingMutex;
+
+	// Point sources that last longer than one substep
+	std::vector<Disturbance> activeSources;
+
+	// Events and dirty rectangles of the current substep
+	std::vector<PreparedEvent> prepared;
+	std::vector<Disturbance> incoming;
+	DirtyRegion dirtyRects;
+	int sizeY;
+
+	long long eventsApplied;
+	long long nodesTouched;
+
+};
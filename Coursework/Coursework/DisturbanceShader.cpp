@@ -0,0 +1,82 @@
+#include "DisturbanceShader.h"
+#include <algorithm>
+
+DisturbanceShader::DisturbanceShader(ID3D11Device* dev, ID3D11DeviceContext* deviceCntxt, HWND hwnd) : BaseShader(dev, hwnd)
+{
+	device = dev;
+	deviceContext = deviceCntxt;
+	initShader(L"default_vs.cso", L"disturbance_ps.cso");
+}
+
+DisturbanceShader::~DisturbanceShader()
+{
+	if (matrixBuffer) {
+		matrixBuffer->Release();
+		matrixBuffer = 0;
+	}
+	if (eventBuffer) {
+		eventBuffer->Release();
+		eventBuffer = 0;
+	}
+	if (layout) {
+		layout->Release();
+		layout = 0;
+	}
+	BaseShader::~BaseShader();
+}
+
+void DisturbanceShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilename)
+{
+	loadVertexShader(vsFilename);
+	loadPixelShader(psFilename);
+
+	D3D11_BUFFER_DESC matrixBufferDesc;
+	matrixBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	matrixBufferDesc.ByteWidth = sizeof(MatrixBufferType);
+	matrixBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	matrixBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	matrixBufferDesc.MiscFlags = 0;
+	matrixBufferDesc.StructureByteStride = 0;
+	device->CreateBuffer(&matrixBufferDesc, nullptr, &matrixBuffer);
+
+	// Events of the substep, rewritten before every pass
+	D3D11_BUFFER_DESC eventBufferDesc;
+	eventBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	eventBufferDesc.ByteWidth = sizeof(EventBufferType);
+	eventBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	eventBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	eventBufferDesc.MiscFlags = 0;
+	eventBufferDesc.StructureByteStride = 0;
+	device->CreateBuffer(&eventBufferDesc, nullptr, &eventBuffer);
+}
+
+void DisturbanceShader::setShaderParameters(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* stateTexture, const DisturbanceQueue::PreparedEvent* events, int count)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+	// Send matrix data
+	MatrixBufferType* dataPtr;
+	deviceContext->Map(matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	dataPtr = (MatrixBufferType*)mappedResource.pData;
+	dataPtr->world = XMMatrixTranspose(world);
+	dataPtr->view = XMMatrixTranspose(view);
+	dataPtr->projection = XMMatrixTranspose(projection);
+	deviceContext->Unmap(matrixBuffer, 0);
+	deviceContext->VSSetConstantBuffers(0, 1, &matrixBuffer);
+
+	// Send the events, the amount of each is already scaled for the substep
+	count = std::min(count, (int)MaxEvents);
+	EventBufferType* eventPtr;
+	deviceContext->Map(eventBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	eventPtr = (EventBufferType*)mappedResource.pData;
+	for (int i = 0; i < count; i++) {
+		const Disturbance& disturbance = events[i].disturbance;
+		eventPtr->shape[i] = XMFLOAT4(disturbance.x, disturbance.y, disturbance.radius, events[i].amount);
+		eventPtr->motion[i] = XMFLOAT4((float)disturbance.type, disturbance.velocityX, disturbance.velocityY, 0.0f);
+	}
+	eventPtr->count = XMFLOAT4((float)count, 0.0f, 0.0f, 0.0f);
+	deviceContext->Unmap(eventBuffer, 0);
+	deviceContext->PSSetConstantBuffers(0, 1, &eventBuffer);
+
+	deviceContext->PSSetShaderResources(0, 1, &stateTexture);
+}
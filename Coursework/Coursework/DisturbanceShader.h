@@ -0,0 +1,41 @@
+#pragma once
+#include "DXF.h"
+#include "DisturbanceQueue.h"
+using namespace DirectX;
+
+// Applies the events of a disturbance substep to the simulation state on the GPU. The pass
+// reads the state texture and writes the disturbed nodes to another render target, from which
+// the touched rectangles are copied back, so nothing is read back to the CPU.
+class DisturbanceShader : public BaseShader
+{
+
+public:
+
+	// Events sent in one pass, more are applied over several passes
+	static const int MaxEvents = 64;
+
+private:
+
+	struct EventBufferType
+	{
+		XMFLOAT4 shape[MaxEvents];  // x, y, radius and amount
+		XMFLOAT4 motion[MaxEvents]; // type, x and y velocity
+		XMFLOAT4 count;
+	};
+
+public:
+
+	DisturbanceShader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, HWND hwnd);
+	~DisturbanceShader();
+
+	// Up to MaxEvents events, applied in order to every node drawn
+	void setShaderParameters(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, ID3D11ShaderResourceView* stateTexture, const DisturbanceQueue::PreparedEvent* events, int count);
+
+private:
+	void initShader(const wchar_t* vs, const wchar_t* ps);
+
+	ID3D11DeviceContext* deviceContext;
+	ID3D11Buffer* matrixBuffer;
+	ID3D11Buffer* eventBuffer;
+
+};
@@ -0,0 +1,449 @@
+#include "EnsembleRunner.h"
+#include "FourierTransform.h"
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+	long long NowMicroseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Number of node updates a task should do before handing the run back to the scheduler
+	const long long CellsPerChunk = 4 * 1024 * 1024;
+
+	// Relative volume gain past which a run is reported unstable. Every solver conserves water,
+	// a gain means depths were clamped at a wet/dry front rather than the scheme staying positive.
+	const double MaxVolumeGain = 1e-3;
+
+	double GridVolume(const ConstGridView& view, float cellArea)
+	{
+		double volume = 0.0;
+		for (int y = 0; y < view.GetHeight(); y++) {
+			const std::array<float, 4>* row = view.Row(y);
+			for (int x = 0; x < view.GetWidth(); x++) {
+				volume += row[x][SimulationGrid2D::Height] * cellArea;
+			}
+		}
+		return volume;
+	}
+}
+
+EnsembleRunner::EnsembleRunner(int threadCount) : EnsembleRunner(new TaskScheduler(threadCount))
+{
+	ownsScheduler = true;
+}
+
+EnsembleRunner::EnsembleRunner(TaskScheduler* sharedScheduler)
+{
+	scheduler = sharedScheduler;
+	ownsScheduler = false;
+	tasksPending = 0;
+	maxActiveItems = scheduler->GetThreadCount() * 2;
+	laneBatchingSize = 256;
+	nextItem = 0;
+	runsCompleted = 0;
+	runsStopped = 0;
+	stopping = false;
+	stepsCompleted = 0;
+	totalSteps = 0;
+	startTime = 0;
+	endTime = 0;
+}
+
+EnsembleRunner::~EnsembleRunner()
+{
+	// Finish the running tasks before the runs they use are deleted, stopping first so that
+	// closing the app mid-sweep only waits for the chunks being stepped
+	Stop();
+	Wait();
+	if (ownsScheduler) {
+		delete scheduler;
+	}
+	for (Run* run : runs) {
+		delete run->grid;
+		delete run->solver;
+		delete run;
+	}
+	for (WorkItem& item : items) {
+		delete item.ensemble;
+	}
+}
+
+void EnsembleRunner::SetLaneBatching(int maxGridSize)
+{
+	laneBatchingSize = maxGridSize;
+}
+
+bool EnsembleRunner::LoadSweep(const std::string& filename)
+{
+	std::ifstream file(filename);
+	if (!file.is_open()) {
+		error = "Can't open " + filename;
+		return false;
+	}
+
+	// Values of each swept parameter, in the order they appear in the file
+	std::vector<std::pair<std::string, std::vector<float>>> sweep;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line)) {
+		lineNumber++;
+		line = line.substr(0, line.find('#'));
+		size_t equals = line.find('=');
+		if (equals == std::string::npos) {
+			continue;
+		}
+		std::string name;
+		std::stringstream(line.substr(0, equals)) >> name;
+
+		std::vector<float> values;
+		std::stringstream valueStream(line.substr(equals + 1));
+		std::string token;
+		while (valueStream >> token) {
+			float first, last, increment;
+			if (sscanf(token.c_str(), "%f:%f:%f", &first, &last, &increment) == 3 && increment > 0.0f) {
+				for (int i = 0; first + i * increment <= last + increment * 1e-3f; i++) {
+					values.push_back(first + i * increment);
+				}
+			}
+			else {
+				char* end;
+				float value = strtof(token.c_str(), &end);
+				if (end == token.c_str() || *end != '\0') {
+					error = filename + " line " + std::to_string(lineNumber) + ": '" + token + "' is not a number or first:last:increment";
+					return false;
+				}
+				values.push_back(value);
+			}
+		}
+		if (!name.empty() && !values.empty()) {
+			sweep.push_back(std::make_pair(name, values));
+		}
+	}
+
+	// A run for every combination, the last parameter changing fastest
+	std::vector<RunConfig> configs;
+	std::vector<int> index(sweep.size(), 0);
+	while (true) {
+		RunConfig config;
+		bool widthSet = false;
+		for (size_t i = 0; i < sweep.size(); i++) {
+			const std::string& name = sweep[i].first;
+			float value = sweep[i].second[index[i]];
+			if (name == "gridSize") config.gridSize = (int)value;
+			else if (name == "gravity") config.params.gravity = value;
+			else if (name == "n") config.params.n = value;
+			else if (name == "timeStepSize") config.params.timeStepSize = value;
+			else if (name == "spatialStepSize") config.params.spatialStepSize = value;
+			else if (name == "boundary") config.params.boundary = (BoundaryType)(int)value;
+			else if (name == "solver") config.solver = (SolverType)(int)value;
+			else if (name == "maxHeight") config.maxHeight = value;
+			else if (name == "pulseWidth") { config.pulseWidth = value; widthSet = true; }
+			else if (name == "steps") config.steps = (int)value;
+		}
+		if (!widthSet) {
+			// Same default as the SimulationGrid2D constructor
+			config.pulseWidth = config.gridSize / 8.0f;
+		}
+		configs.push_back(config);
+
+		int i = (int)sweep.size() - 1;
+		while (i >= 0 && ++index[i] == (int)sweep[i].second.size()) {
+			index[i] = 0;
+			i--;
+		}
+		if (i < 0) {
+			break;
+		}
+	}
+
+	// Nothing is added when a run can't be made, the spectral solver only steps power of two grids
+	for (const RunConfig& config : configs) {
+		if (config.solver == SolverType::Spectral && !FourierTransform::IsPowerOfTwo(config.gridSize)) {
+			error = filename + ": the spectral solver needs a power of two gridSize of at least 4, not " + std::to_string(config.gridSize);
+			return false;
+		}
+	}
+	for (const RunConfig& config : configs) {
+		AddRun(config);
+	}
+	return true;
+}
+
+std::string EnsembleRunner::GetError()
+{
+	return error;
+}
+
+void EnsembleRunner::AddRun(const RunConfig& config)
+{
+	Run* run = new Run();
+	run->config = config;
+	run->solver = ShallowWaterSolver::Create(config.solver);
+	run->solver->SetParameters(config.params);
+	runs.push_back(run);
+	totalSteps += config.steps;
+}
+
+void EnsembleRunner::BuildWorkItems()
+{
+	// Runs small enough to batch are grouped by grid size and length, the rest run alone
+	std::map<std::pair<int, int>, std::vector<int>> batches;
+	for (int i = 0; i < (int)runs.size(); i++) {
+		const RunConfig& config = runs[i]->config;
+		// The lane kernel is periodic MacCormack, walled runs and other solvers always run alone
+		if (config.gridSize <= laneBatchingSize && config.params.boundary == BoundaryType::Periodic && config.solver == SolverType::MacCormack) {
+			batches[std::make_pair(config.gridSize, config.steps)].push_back(i);
+		}
+		else {
+			WorkItem item;
+			item.runIndices.push_back(i);
+			item.gridSize = config.gridSize;
+			item.steps = config.steps;
+			items.push_back(item);
+		}
+	}
+
+	for (auto& batch : batches) {
+		const std::vector<int>& members = batch.second;
+		for (size_t first = 0; first < members.size(); first += LaneEnsemble::Lanes) {
+			WorkItem item;
+			item.runIndices.assign(members.begin() + first, members.begin() + std::min(members.size(), first + LaneEnsemble::Lanes));
+			item.batched = true;
+			item.gridSize = batch.first.first;
+			item.steps = batch.first.second;
+			items.push_back(item);
+		}
+	}
+}
+
+void EnsembleRunner::Start()
+{
+	startTime = NowMicroseconds();
+	BuildWorkItems();
+
+	int initialItems = std::min(maxActiveItems, (int)items.size());
+	nextItem = initialItems;
+	for (int i = 0; i < initialItems; i++) {
+		Submit([this, i] { StartItem(i); });
+	}
+}
+
+void EnsembleRunner::StartItem(int itemIndex)
+{
+	WorkItem& item = items[itemIndex];
+	if (stopping) {
+		FinishItem(itemIndex);
+		return;
+	}
+	for (int runIndex : item.runIndices) {
+		const RunConfig& config = runs[runIndex]->config;
+		runs[runIndex]->grid = new SimulationGrid2D(config.gridSize, config.gridSize, config.maxHeight, config.pulseWidth);
+		runs[runIndex]->initialVolume = GridVolume(runs[runIndex]->grid->GetView(), config.params.spatialStepSize * config.params.spatialStepSize);
+	}
+
+	// Batches copy their members into lanes, the member grids are reused for the results
+	if (item.batched) {
+		item.ensemble = new LaneEnsemble(item.gridSize, item.gridSize);
+		for (int lane = 0; lane < (int)item.runIndices.size(); lane++) {
+			Run* run = runs[item.runIndices[lane]];
+			item.ensemble->SetMember(lane, run->grid, run->config.params);
+		}
+	}
+	StepChunk(itemIndex);
+}
+
+void EnsembleRunner::StepChunk(int itemIndex)
+{
+	WorkItem& item = items[itemIndex];
+	if (stopping) {
+		FinishItem(itemIndex);
+		return;
+	}
+	long long cells = (long long)item.gridSize * item.gridSize;
+	if (item.ensemble) {
+		cells *= LaneEnsemble::Lanes;
+	}
+	int chunkSteps = (int)std::max(1LL, CellsPerChunk / cells);
+	int stepsToDo = std::min(chunkSteps, item.steps - item.stepsDone);
+
+	long long chunkStart = NowMicroseconds();
+	for (int i = 0; i < stepsToDo; i++) {
+		if (item.ensemble) {
+			item.ensemble->Step();
+		}
+		else {
+			Run* run = runs[item.runIndices[0]];
+			run->solver->Step(run->grid);
+			run->result.iterations += run->solver->GetLastIterations();
+			run->result.solveTime += run->solver->GetLastSolveTime();
+		}
+	}
+
+	// Members of a batch share the time spent stepping it
+	float chunkTime = (NowMicroseconds() - chunkStart) / 1e6f / item.runIndices.size();
+	for (int runIndex : item.runIndices) {
+		runs[runIndex]->result.wallTime += chunkTime;
+		runs[runIndex]->stepsDone += stepsToDo;
+	}
+	item.stepsDone += stepsToDo;
+	stepsCompleted += (long long)stepsToDo * item.runIndices.size();
+
+	if (item.stepsDone < item.steps) {
+		// Resubmitting from the worker keeps the item on this worker unless someone steals it
+		Submit([this, itemIndex] { StepChunk(itemIndex); });
+	}
+	else {
+		FinishItem(itemIndex);
+	}
+}
+
+void EnsembleRunner::FinishItem(int itemIndex)
+{
+	WorkItem& item = items[itemIndex];
+	// Items stopped before they started have no grids to take results from
+	for (int lane = 0; lane < (int)item.runIndices.size(); lane++) {
+		Run* run = runs[item.runIndices[lane]];
+		run->result.finished = run->stepsDone == run->config.steps;
+		if (!run->grid) {
+			continue;
+		}
+		if (item.ensemble) {
+			item.ensemble->GetMember(lane, run->grid);
+		}
+		ComputeResult(run, run->grid);
+		delete run->grid;
+		run->grid = nullptr;
+	}
+	delete item.ensemble;
+	item.ensemble = nullptr;
+
+	// Start the next waiting item in this slot
+	int next = nextItem++;
+	if (next < (int)items.size()) {
+		Submit([this, next] { StartItem(next); });
+	}
+
+	if (item.stepsDone == item.steps) {
+		runsCompleted += (int)item.runIndices.size();
+	}
+	else {
+		runsStopped += (int)item.runIndices.size();
+	}
+	if (runsCompleted + runsStopped == (int)runs.size()) {
+		endTime = NowMicroseconds();
+	}
+}
+
+void EnsembleRunner::ComputeResult(Run* run, SimulationGrid2D* grid)
+{
+	RunResult& result = run->result;
+	float cellArea = run->config.params.spatialStepSize * run->config.params.spatialStepSize;
+
+	ConstGridView view = grid->GetView();
+	result.minHeight = view.At(0, 0, SimulationGrid2D::Height);
+	result.maxHeight = result.minHeight;
+	for (int y = 0; y < view.GetHeight(); y++) {
+		const std::array<float, 4>* row = view.Row(y);
+		for (int x = 0; x < view.GetWidth(); x++) {
+			const std::array<float, 4>& node = row[x];
+			float h = node[SimulationGrid2D::Height];
+			if (!std::isfinite(h) || !std::isfinite(node[SimulationGrid2D::DischargeX]) || !std::isfinite(node[SimulationGrid2D::DischargeY])) {
+				result.stable = false;
+				continue;
+			}
+			result.volume += h * cellArea;
+			result.minHeight = std::min(result.minHeight, h);
+			result.maxHeight = std::max(result.maxHeight, h);
+		}
+	}
+	if (result.volume > run->initialVolume * (1.0 + MaxVolumeGain)) {
+		result.stable = false;
+	}
+}
+
+void EnsembleRunner::Submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		tasksPending++;
+	}
+	scheduler->Submit([this, task] {
+		task();
+		std::lock_guard<std::mutex> lock(tasksMutex);
+		if (--tasksPending == 0) {
+			tasksDone.notify_all();
+		}
+	});
+}
+
+void EnsembleRunner::Wait()
+{
+	std::unique_lock<std::mutex> lock(tasksMutex);
+	tasksDone.wait(lock, [this] { return tasksPending == 0; });
+}
+
+void EnsembleRunner::Stop()
+{
+	stopping = true;
+}
+
+bool EnsembleRunner::IsFinished()
+{
+	return runsCompleted + runsStopped == (int)runs.size();
+}
+
+int EnsembleRunner::GetRunCount()
+{
+	return (int)runs.size();
+}
+
+int EnsembleRunner::GetRunsCompleted()
+{
+	return runsCompleted;
+}
+
+float EnsembleRunner::GetProgress()
+{
+	return totalSteps > 0 ? (float)stepsCompleted / totalSteps : 1.0f;
+}
+
+float EnsembleRunner::GetWallTime()
+{
+	long long end = IsFinished() ? (long long)endTime : NowMicroseconds();
+	return startTime > 0 ? (end - startTime) / 1e6f : 0.0f;
+}
+
+TaskScheduler* EnsembleRunner::GetScheduler()
+{
+	return scheduler;
+}
+
+bool EnsembleRunner::WriteSummary(const std::string& filename)
+{
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	file << "run,solver,gridSize,gravity,n,timeStepSize,spatialStepSize,maxHeight,pulseWidth,steps,stepsDone,finished,volume,minHeight,maxHeightFinal,stable,wallTime,wallTimePerSimulatedSecond,iterationsPerStep,solveTimePerStep\n";
+	for (size_t i = 0; i < runs.size(); i++) {
+		const Run* run = runs[i];
+		const RunConfig& c = run->config;
+		const RunResult& r = run->result;
+		file << i << "," << run->solver->GetName() << "," << c.gridSize << "," << c.params.gravity << "," << c.params.n << "," << c.params.timeStepSize << ","
+			<< c.params.spatialStepSize << "," << c.maxHeight << "," << c.pulseWidth << "," << c.steps << "," << run->stepsDone << "," << (r.finished ? 1 : 0) << ","
+			<< r.volume << "," << r.minHeight << "," << r.maxHeight << "," << (r.stable ? 1 : 0) << "," << r.wallTime << ","
+			<< (run->stepsDone > 0 ? r.wallTime / (run->stepsDone * c.params.timeStepSize) : 0.0f) << ","
+			<< (run->stepsDone > 0 ? (float)r.iterations / run->stepsDone : 0.0f) << "," << (run->stepsDone > 0 ? r.solveTime / run->stepsDone : 0.0f) << "\n";
+	}
+	return true;
+}
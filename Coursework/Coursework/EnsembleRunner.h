@@ -0,0 +1,142 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include "SimulationGrid2D.h"
+#include "ShallowWaterSolver.h"
+#include "TaskScheduler.h"
+#include "LaneEnsemble.h"
+
+// Runs many independent simulations in one process for parameter sweeps. Each run is
+// advanced in chunks of steps scheduled on a work-stealing pool, so large and small grids
+// share the cores: a worker keeps stepping the run it has, and idle workers steal chunks.
+// Small runs of the same size and length can be batched into a LaneEnsemble so that up
+// to LaneEnsemble::Lanes of them are stepped together in vector lanes.
+class EnsembleRunner
+{
+
+public:
+
+	// Configuration of a single run of the sweep
+	struct RunConfig
+	{
+		int gridSize = 100;
+		SimulationParameters params;
+		SolverType solver = SolverType::MacCormack;
+		float maxHeight = 15.0f;
+		float pulseWidth = 12.5f; // in grid nodes
+		int steps = 1000;
+	};
+
+	// Results written to the summary table
+	struct RunResult
+	{
+		double volume = 0.0;     // sum of heights times cell area at the end of the run
+		float minHeight = 0.0f;
+		float maxHeight = 0.0f;
+		bool finished = false;   // false if the sweep was stopped before the run did all its steps
+		bool stable = true;      // false if any value became NaN or infinite, or water was made up
+		float wallTime = 0.0f;   // seconds spent stepping this run
+		long long iterations = 0; // linear solver iterations of an implicit solver over the run
+		float solveTime = 0.0f;   // milliseconds spent in those solves
+	};
+
+	// Step the runs on a pool of their own, 0 threads being one per hardware thread
+	EnsembleRunner(int threadCount = 0);
+
+	// Step the runs on a scheduler shared with the rest of the app, which must outlive the
+	// runner. The sweep then takes the workers the app leaves idle instead of adding threads.
+	EnsembleRunner(TaskScheduler* sharedScheduler);
+	~EnsembleRunner();
+
+	// Batch runs no larger than maxGridSize into lane ensembles, 0 turns batching off
+	void SetLaneBatching(int maxGridSize);
+
+	// Read a sweep spec, one parameter per line as "name = value value ..." or
+	// "name = first:last:increment", and add a run for every combination of values.
+	// Parameters: gridSize, gravity, n, timeStepSize, spatialStepSize, boundary (0 periodic, 1 reflective),
+	// solver (0 MacCormack, 1 HLL, 2 HLLC, 3 ADI, 4 semi-implicit, 5 virtual pipe, 6 lattice Boltzmann, 7 spectral), maxHeight, pulseWidth, steps
+	// Returns false, with the reason in GetError, if the file can't be read, a value isn't a number
+	// or a run can't be made, such as the spectral solver on a grid that isn't a power of two.
+	// No runs are added then.
+	bool LoadSweep(const std::string& filename);
+	std::string GetError();
+	void AddRun(const RunConfig& config);
+
+	// Start stepping every run in the background
+	void Start();
+	void Wait();
+
+	// Stop stepping. Chunks already queued return without stepping and runs not yet started are
+	// skipped, runs stopped part way keep the results of the steps they did.
+	void Stop();
+
+	// Every run has either finished or been stopped
+	bool IsFinished();
+
+	int GetRunCount();
+	int GetRunsCompleted();
+	float GetProgress();
+	float GetWallTime();
+	TaskScheduler* GetScheduler();
+
+	// Write one line per run with its parameters and results
+	bool WriteSummary(const std::string& filename);
+
+private:
+
+	struct Run
+	{
+		RunConfig config;
+		RunResult result;
+		SimulationGrid2D* grid = nullptr;
+		ShallowWaterSolver* solver = nullptr;
+		int stepsDone = 0;
+		double initialVolume = 0.0;
+	};
+
+	// Unit of scheduling, either a single run or a batch of runs stepped in lanes
+	struct WorkItem
+	{
+		std::vector<int> runIndices;
+		LaneEnsemble* ensemble = nullptr;
+		bool batched = false;
+		int gridSize = 0;
+		int steps = 0;
+		int stepsDone = 0;
+	};
+
+	// Queue a task of this runner on the scheduler, counted so Wait only waits for the runner's
+	void Submit(std::function<void()> task);
+
+	void BuildWorkItems();
+	void StartItem(int itemIndex);
+	void StepChunk(int itemIndex);
+	void FinishItem(int itemIndex);
+	void ComputeResult(Run* run, SimulationGrid2D* grid);
+
+	std::vector<Run*> runs;
+	std::vector<WorkItem> items;
+	int laneBatchingSize;
+	TaskScheduler* scheduler;
+	bool ownsScheduler;
+	std::mutex tasksMutex;
+	std::condition_variable tasksDone;
+	int tasksPending;
+
+	// Only a limited number of work items hold grids at once, the rest wait their turn
+	int maxActiveItems;
+	std::atomic<int> nextItem;
+	std::atomic<int> runsCompleted;
+	std::atomic<int> runsStopped;
+	std::atomic<bool> stopping;
+	std::string error;
+	std::atomic<long long> stepsCompleted;
+	long long totalSteps;
+	long long startTime;
+	std::atomic<long long> endTime;
+
+};
@@ -0,0 +1,310 @@
+#include "FiniteVolumeSolver.h"
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+namespace
+{
+	// Depth below which a cell is treated as dry
+	const float DryDepth = 1e-6f;
+
+	inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	inline __m128 Abs(__m128 a)
+	{
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+	}
+
+	// The smaller of the two slopes when they agree in sign, zero at an extremum
+	inline __m128 Minmod(__m128 a, __m128 b)
+	{
+		__m128 sameSign = _mm_cmpgt_ps(_mm_mul_ps(a, b), _mm_setzero_ps());
+		__m128 smaller = Select(_mm_cmplt_ps(Abs(a), Abs(b)), a, b);
+		return _mm_and_ps(sameSign, smaller);
+	}
+
+	// Rounds a count of faces up to whole SSE registers, the buffers are sized with this slack
+	inline int Padded(int count)
+	{
+		return (count + 3) & ~3;
+	}
+}
+
+FiniteVolumeSolver::FiniteVolumeSolver(RiemannSolver riemannSolver)
+{
+	riemann = riemannSolver;
+	sizeX = 0;
+	sizeY = 0;
+	maxWaveSpeed = 0.0f;
+}
+
+FiniteVolumeSolver::~FiniteVolumeSolver()
+{
+}
+
+const char* FiniteVolumeSolver::GetName()
+{
+	return riemann == HLLC ? "HLLC finite volume" : "HLL finite volume";
+}
+
+float FiniteVolumeSolver::GetStableTimeStep()
+{
+	if (maxWaveSpeed <= 0.0f) {
+		return params.timeStepSize;
+	}
+	return 0.5f * params.spatialStepSize / maxWaveSpeed;
+}
+
+void FiniteVolumeSolver::Resize(int nx, int ny)
+{
+	if (nx == sizeX && ny == sizeY) {
+		return;
+	}
+	sizeX = nx;
+	sizeY = ny;
+	int cells = nx * ny;
+
+	for (std::vector<float>* v : { &height, &dischargeX, &dischargeY, &stageH, &stageQX, &stageQY, &rateH, &rateQX, &rateQY, &velocityX, &velocityY }) {
+		v->assign(cells, 0.0f);
+	}
+	for (std::vector<float>* v : { &rowH, &rowU, &rowV }) {
+		v->assign(Padded(nx + 4) + 4, 0.0f);
+	}
+	for (std::vector<float>* v : { &ghostH, &ghostU, &ghostV }) {
+		v->assign(nx * (ny + 4) + 4, 0.0f);
+	}
+	for (std::vector<float>* v : { &faceHL, &faceUL, &faceVL, &faceHR, &faceUR, &faceVR, &faceFluxH, &faceFluxN, &faceFluxT, &previousFluxH, &previousFluxN, &previousFluxT }) {
+		v->assign(Padded(nx + 1), 0.0f);
+	}
+}
+
+void FiniteVolumeSolver::Step(SimulationGrid2D* grid)
+{
+	Resize(grid->GetSizeX(), grid->GetSizeY());
+	int cells = sizeX * sizeY;
+	float dt = params.timeStepSize;
+
+	const std::array<float, 4>* nodes = grid->GetRow(0);
+	for (int i = 0; i < cells; i++) {
+		height[i] = nodes[i][SimulationGrid2D::Height];
+		dischargeX[i] = nodes[i][SimulationGrid2D::DischargeX];
+		dischargeY[i] = nodes[i][SimulationGrid2D::DischargeY];
+	}
+	maxWaveSpeed = 0.0f;
+
+	// Heun's method, an Euler step to the intermediate state then the average of both slopes
+	ComputeRates(height.data(), dischargeX.data(), dischargeY.data());
+	for (int i = 0; i < cells; i++) {
+		stageH[i] = std::max(height[i] + dt * rateH[i], 0.0f);
+		stageQX[i] = dischargeX[i] + dt * rateQX[i];
+		stageQY[i] = dischargeY[i] + dt * rateQY[i];
+	}
+
+	ComputeRates(stageH.data(), stageQX.data(), stageQY.data());
+	std::array<float, 4>* output = grid->GetRow(0);
+	for (int i = 0; i < cells; i++) {
+		output[i][SimulationGrid2D::Height] = std::max(0.5f * (height[i] + stageH[i] + dt * rateH[i]), 0.0f);
+		output[i][SimulationGrid2D::DischargeX] = 0.5f * (dischargeX[i] + stageQX[i] + dt * rateQX[i]);
+		output[i][SimulationGrid2D::DischargeY] = 0.5f * (dischargeY[i] + stageQY[i] + dt * rateQY[i]);
+	}
+	grid->MarkAllDirty();
+}
+
+void FiniteVolumeSolver::ComputeRates(const float* h, const float* qx, const float* qy)
+{
+	int W = sizeX;
+	int H = sizeY;
+	float inverseDx = 1.0f / params.spatialStepSize;
+	bool reflective = params.boundary == BoundaryType::Reflective;
+
+	// Velocities are reconstructed rather than discharges, so a face of a dry cell never gets a large speed
+	for (int i = 0; i < W * H; i++) {
+		velocityX[i] = h[i] > DryDepth ? qx[i] / h[i] : 0.0f;
+		velocityY[i] = h[i] > DryDepth ? qy[i] / h[i] : 0.0f;
+	}
+	const float* u = velocityX.data();
+	const float* v = velocityY.data();
+
+	// Ghost cells beyond the left and right edges, mirrored with the x velocity reversed at walls
+	int first = std::min(1, W - 1);
+	int last = std::max(W - 2, 0);
+	int ghostLeft[2] = { reflective ? first : last, reflective ? 0 : W - 1 };
+	int ghostRight[2] = { reflective ? W - 1 : 0, reflective ? last : first };
+	float wallSign = reflective ? -1.0f : 1.0f;
+
+	/////////////////        X DIRECTION        /////////////////
+	for (int y = 0; y < H; y++) {
+		int row = y * W;
+		std::copy(h + row, h + row + W, rowH.begin() + 2);
+		std::copy(u + row, u + row + W, rowU.begin() + 2);
+		std::copy(v + row, v + row + W, rowV.begin() + 2);
+		for (int g = 0; g < 2; g++) {
+			rowH[g] = h[row + ghostLeft[g]];
+			rowU[g] = wallSign * u[row + ghostLeft[g]];
+			rowV[g] = v[row + ghostLeft[g]];
+			rowH[W + 2 + g] = h[row + ghostRight[g]];
+			rowU[W + 2 + g] = wallSign * u[row + ghostRight[g]];
+			rowV[W + 2 + g] = v[row + ghostRight[g]];
+		}
+
+		// Face j lies between cells j - 1 and j, which sit at j + 1 and j + 2 of the padded row
+		Reconstruct(&rowH[0], &rowH[1], &rowH[2], &rowH[3], W + 1, faceHL.data(), faceHR.data());
+		Reconstruct(&rowU[0], &rowU[1], &rowU[2], &rowU[3], W + 1, faceUL.data(), faceUR.data());
+		Reconstruct(&rowV[0], &rowV[1], &rowV[2], &rowV[3], W + 1, faceVL.data(), faceVR.data());
+		FaceFluxes(W + 1);
+
+		for (int x = 0; x < W; x++) {
+			rateH[row + x] = -(faceFluxH[x + 1] - faceFluxH[x]) * inverseDx;
+			rateQX[row + x] = -(faceFluxN[x + 1] - faceFluxN[x]) * inverseDx;
+			rateQY[row + x] = -(faceFluxT[x + 1] - faceFluxT[x]) * inverseDx;
+		}
+	}
+
+	/////////////////        Y DIRECTION        /////////////////
+	// Rows of faces are swept top to bottom, each cell row takes the difference of the face rows around it.
+	// The y velocity is the normal one here, so the normal flux feeds the y discharge.
+	FillGhostRows(h, u, v);
+	for (int j = 0; j <= H; j++) {
+		const float* m2 = &ghostH[j * W];
+		Reconstruct(m2, m2 + W, m2 + 2 * W, m2 + 3 * W, W, faceHL.data(), faceHR.data());
+		const float* n2 = &ghostV[j * W];
+		Reconstruct(n2, n2 + W, n2 + 2 * W, n2 + 3 * W, W, faceUL.data(), faceUR.data());
+		const float* t2 = &ghostU[j * W];
+		Reconstruct(t2, t2 + W, t2 + 2 * W, t2 + 3 * W, W, faceVL.data(), faceVR.data());
+		FaceFluxes(W);
+
+		if (j > 0) {
+			int row = (j - 1) * W;
+			for (int x = 0; x < W; x++) {
+				rateH[row + x] -= (faceFluxH[x] - previousFluxH[x]) * inverseDx;
+				rateQY[row + x] -= (faceFluxN[x] - previousFluxN[x]) * inverseDx;
+				rateQX[row + x] -= (faceFluxT[x] - previousFluxT[x]) * inverseDx;
+			}
+		}
+		faceFluxH.swap(previousFluxH);
+		faceFluxN.swap(previousFluxN);
+		faceFluxT.swap(previousFluxT);
+	}
+}
+
+void FiniteVolumeSolver::FillGhostRows(const float* h, const float* u, const float* v)
+{
+	int W = sizeX;
+	int H = sizeY;
+	bool reflective = params.boundary == BoundaryType::Reflective;
+
+	std::copy(h, h + W * H, ghostH.begin() + 2 * W);
+	std::copy(u, u + W * H, ghostU.begin() + 2 * W);
+	std::copy(v, v + W * H, ghostV.begin() + 2 * W);
+
+	// Padded rows 0, 1 sit above the grid and H + 2, H + 3 below it
+	int first = std::min(1, H - 1);
+	int last = std::max(H - 2, 0);
+	int sourceRows[4] = { reflective ? first : last, reflective ? 0 : H - 1, reflective ? H - 1 : 0, reflective ? last : first };
+	int ghostRows[4] = { 0, 1, H + 2, H + 3 };
+	float wallSign = reflective ? -1.0f : 1.0f;
+	for (int g = 0; g < 4; g++) {
+		int source = sourceRows[g] * W;
+		int ghost = ghostRows[g] * W;
+		for (int x = 0; x < W; x++) {
+			ghostH[ghost + x] = h[source + x];
+			ghostU[ghost + x] = u[source + x];
+			ghostV[ghost + x] = wallSign * v[source + x];
+		}
+	}
+}
+
+void FiniteVolumeSolver::Reconstruct(const float* m2, const float* m1, const float* p0, const float* p1, int count, float* left, float* right)
+{
+	// The last register may read past count, the buffers have slack for it and the extra faces are never used
+	__m128 half = _mm_set1_ps(0.5f);
+	for (int i = 0; i < count; i += 4) {
+		__m128 a = _mm_loadu_ps(m2 + i);
+		__m128 b = _mm_loadu_ps(m1 + i);
+		__m128 c = _mm_loadu_ps(p0 + i);
+		__m128 d = _mm_loadu_ps(p1 + i);
+		__m128 slopeLeft = Minmod(_mm_sub_ps(b, a), _mm_sub_ps(c, b));
+		__m128 slopeRight = Minmod(_mm_sub_ps(c, b), _mm_sub_ps(d, c));
+		_mm_storeu_ps(left + i, _mm_add_ps(b, _mm_mul_ps(half, slopeLeft)));
+		_mm_storeu_ps(right + i, _mm_sub_ps(c, _mm_mul_ps(half, slopeRight)));
+	}
+}
+
+void FiniteVolumeSolver::FaceFluxes(int count)
+{
+	__m128 g = _mm_set1_ps(params.gravity);
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 two = _mm_set1_ps(2.0f);
+	__m128 zero = _mm_setzero_ps();
+	__m128 dry = _mm_set1_ps(DryDepth);
+	__m128 tiny = _mm_set1_ps(1e-12f);
+	__m128 countLimit = _mm_set1_ps((float)count);
+	__m128 maxSpeed = zero;
+	bool contact = riemann == HLLC;
+
+	for (int i = 0; i < count; i += 4) {
+		__m128 hL = _mm_max_ps(_mm_loadu_ps(&faceHL[i]), zero);
+		__m128 uL = _mm_loadu_ps(&faceUL[i]);
+		__m128 vL = _mm_loadu_ps(&faceVL[i]);
+		__m128 hR = _mm_max_ps(_mm_loadu_ps(&faceHR[i]), zero);
+		__m128 uR = _mm_loadu_ps(&faceUR[i]);
+		__m128 vR = _mm_loadu_ps(&faceVR[i]);
+
+		// Wave speed estimates, a dry side takes the speed of the wet/dry front instead
+		__m128 cL = _mm_sqrt_ps(_mm_mul_ps(g, hL));
+		__m128 cR = _mm_sqrt_ps(_mm_mul_ps(g, hR));
+		__m128 sL = _mm_min_ps(_mm_sub_ps(uL, cL), _mm_sub_ps(uR, cR));
+		__m128 sR = _mm_max_ps(_mm_add_ps(uL, cL), _mm_add_ps(uR, cR));
+		sL = Select(_mm_cmple_ps(hL, dry), _mm_sub_ps(uR, _mm_mul_ps(two, cR)), sL);
+		sR = Select(_mm_cmple_ps(hR, dry), _mm_add_ps(uL, _mm_mul_ps(two, cL)), sR);
+
+		// Physical fluxes either side of the face
+		__m128 qL = _mm_mul_ps(hL, uL);
+		__m128 qR = _mm_mul_ps(hR, uR);
+		__m128 fhL = qL;
+		__m128 fhR = qR;
+		__m128 fnL = _mm_add_ps(_mm_mul_ps(qL, uL), _mm_mul_ps(half, _mm_mul_ps(g, _mm_mul_ps(hL, hL))));
+		__m128 fnR = _mm_add_ps(_mm_mul_ps(qR, uR), _mm_mul_ps(half, _mm_mul_ps(g, _mm_mul_ps(hR, hR))));
+		__m128 ftL = _mm_mul_ps(qL, vL);
+		__m128 ftR = _mm_mul_ps(qR, vR);
+
+		// HLL flux of the star region
+		__m128 inverseSpread = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(_mm_sub_ps(sR, sL), tiny));
+		__m128 sLsR = _mm_mul_ps(sL, sR);
+		__m128 fh = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(sR, fhL), _mm_mul_ps(sL, fhR)), _mm_mul_ps(sLsR, _mm_sub_ps(hR, hL))), inverseSpread);
+		__m128 fn = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(sR, fnL), _mm_mul_ps(sL, fnR)), _mm_mul_ps(sLsR, _mm_sub_ps(qR, qL))), inverseSpread);
+		__m128 ft;
+		if (contact) {
+			// HLLC carries the tangential velocity across the contact wave from the upwind side
+			__m128 numerator = _mm_sub_ps(_mm_mul_ps(sL, _mm_mul_ps(hR, _mm_sub_ps(uR, sR))), _mm_mul_ps(sR, _mm_mul_ps(hL, _mm_sub_ps(uL, sL))));
+			__m128 denominator = _mm_sub_ps(_mm_mul_ps(hR, _mm_sub_ps(uR, sR)), _mm_mul_ps(hL, _mm_sub_ps(uL, sL)));
+			__m128 contactMovesRight = _mm_cmpge_ps(_mm_mul_ps(numerator, denominator), zero);
+			ft = _mm_mul_ps(fh, Select(contactMovesRight, vL, vR));
+		}
+		else {
+			ft = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(sR, ftL), _mm_mul_ps(sL, ftR)), _mm_mul_ps(sLsR, _mm_sub_ps(_mm_mul_ps(hR, vR), _mm_mul_ps(hL, vL)))), inverseSpread);
+		}
+
+		// Supersonic faces take the upwind flux
+		__m128 allRight = _mm_cmpge_ps(sL, zero);
+		__m128 allLeft = _mm_cmple_ps(sR, zero);
+		fh = Select(allRight, fhL, Select(allLeft, fhR, fh));
+		fn = Select(allRight, fnL, Select(allLeft, fnR, fn));
+		ft = Select(allRight, ftL, Select(allLeft, ftR, ft));
+		_mm_storeu_ps(&faceFluxH[i], fh);
+		_mm_storeu_ps(&faceFluxN[i], fn);
+		_mm_storeu_ps(&faceFluxT[i], ft);
+
+		// Only faces below count take part in the time step estimate
+		__m128 index = _mm_add_ps(_mm_set1_ps((float)i), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+		__m128 speed = _mm_max_ps(Abs(sL), Abs(sR));
+		maxSpeed = _mm_max_ps(maxSpeed, _mm_and_ps(_mm_cmplt_ps(index, countLimit), speed));
+	}
+
+	alignas(16) float speeds[4];
+	_mm_store_ps(speeds, maxSpeed);
+	maxWaveSpeed = std::max(maxWaveSpeed, std::max(std::max(speeds[0], speeds[1]), std::max(speeds[2], speeds[3])));
+}
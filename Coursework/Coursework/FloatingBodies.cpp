@@ -0,0 +1,552 @@
+#include "FloatingBodies.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <xmmintrin.h>
+
+namespace
+{
+	const float WaterDensity = 1000.0f; // kg/m^3
+
+	// Depth below which a cell has no velocity
+	const float DryDepth = 1e-4f;
+
+	// The pressure falls off over this many nodes inside the hull's edge, down to the floor
+	// fraction at the edge, so the water is not pushed by a step
+	const float TaperWidth = 2.0f;
+	const float TaperFloor = 0.25f;
+
+	// Fraction of critical damping of the heave. The water answers a hull's push a step late,
+	// which feeds energy into the bobbing of light hulls unless it is damped.
+	const float HeaveDamping = 1.0f;
+
+	// Courant number the pressure's push on the discharges is held to
+	const float ImpulseCourant = 0.5f;
+
+	// Bodies per task when rasterising footprints
+	const int BodiesPerTask = 4;
+
+	// Largest integer not above v, for |v| below 2^22
+	inline __m128 Floor(__m128 v)
+	{
+		const __m128 magic = _mm_set1_ps(12582912.0f);
+		__m128 rounded = _mm_sub_ps(_mm_add_ps(v, magic), magic);
+		return _mm_sub_ps(rounded, _mm_and_ps(_mm_cmpgt_ps(rounded, v), _mm_set1_ps(1.0f)));
+	}
+
+	inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+}
+
+FloatingBodies::FloatingBodies(TaskScheduler* taskScheduler)
+{
+	scheduler = taskScheduler;
+	dragRate = 2.0f;
+	pushWater = true;
+	pushDischarges = true;
+	count = 0;
+	fieldSizeX = 0;
+	fieldSizeY = 0;
+	lastTime = 0.0f;
+	rasteriseTime = 0.0f;
+}
+
+FloatingBodies::~FloatingBodies()
+{
+}
+
+int FloatingBodies::Add(float x_, float y_, float elevation_, float heading_, float halfLength_, float halfWidth_, float height_, float mass_)
+{
+	int i = count++;
+
+	// Padding bodies have no inverse mass, so they never move
+	size_t padded = (size_t)(count + 3) & ~(size_t)3;
+	for (std::vector<float>* v : { &x, &y, &elevation, &heading, &velocityX, &velocityY, &velocityElevation, &spin,
+		&halfLength, &halfWidth, &height, &inverseMass, &inverseInertia, &forceX, &forceY, &forceElevation, &heaveRate, &torque, &submerged }) {
+		v->resize(padded, 0.0f);
+	}
+	mass.resize(padded, 1.0f);
+
+	x[i] = x_;
+	y[i] = y_;
+	elevation[i] = elevation_;
+	heading[i] = heading_;
+	halfLength[i] = halfLength_;
+	halfWidth[i] = halfWidth_;
+	height[i] = height_;
+	mass[i] = std::max(mass_, 1e-3f);
+	inverseMass[i] = 1.0f / mass[i];
+
+	// Solid box about its vertical axis
+	float length = 2.0f * halfLength_, width = 2.0f * halfWidth_;
+	inverseInertia[i] = 12.0f / (mass[i] * std::max(length * length + width * width, 1e-6f));
+	return i;
+}
+
+void FloatingBodies::Clear()
+{
+	count = 0;
+	for (std::vector<float>* v : { &x, &y, &elevation, &heading, &velocityX, &velocityY, &velocityElevation, &spin,
+		&halfLength, &halfWidth, &height, &mass, &inverseMass, &inverseInertia, &forceX, &forceY, &forceElevation, &heaveRate, &torque, &submerged }) {
+		v->clear();
+	}
+	changedRects.clear();
+}
+
+int FloatingBodies::GetCount()
+{
+	return count;
+}
+
+void FloatingBodies::SetDragRate(float rate)
+{
+	dragRate = std::max(0.0f, rate);
+}
+
+float FloatingBodies::GetDragRate()
+{
+	return dragRate;
+}
+
+void FloatingBodies::SetPushWater(bool push)
+{
+	pushWater = push;
+}
+
+void FloatingBodies::SetPushDischarges(bool push)
+{
+	pushDischarges = push;
+}
+
+const float* FloatingBodies::GetPressure()
+{
+	return pressure.empty() ? nullptr : pressure.data();
+}
+
+const std::vector<GridRect>& FloatingBodies::GetChangedRects()
+{
+	return changedRects;
+}
+
+float FloatingBodies::GetX(int i)
+{
+	return x[i];
+}
+
+float FloatingBodies::GetY(int i)
+{
+	return y[i];
+}
+
+float FloatingBodies::GetElevation(int i)
+{
+	return elevation[i];
+}
+
+float FloatingBodies::GetHeading(int i)
+{
+	return heading[i];
+}
+
+float FloatingBodies::GetImmersion(int i)
+{
+	return submerged[i] / std::max(4.0f * halfLength[i] * halfWidth[i], 1e-6f);
+}
+
+float FloatingBodies::GetLastTime()
+{
+	return lastTime;
+}
+
+float FloatingBodies::GetLastRasteriseTime()
+{
+	return rasteriseTime;
+}
+
+void FloatingBodies::ForRange(int n, int minRange, const std::function<void(int, int)>& body)
+{
+	if (scheduler) {
+		scheduler->ParallelFor(0, n, body, minRange);
+	}
+	else {
+		body(0, n);
+	}
+}
+
+GridRect FloatingBodies::Footprint(int i, float dx, int sizeX, int sizeY)
+{
+	// Bounding box of the rotated hull in nodes, grown by one for the ring
+	float c = fabsf(cosf(heading[i])), s = fabsf(sinf(heading[i]));
+	float extentX = c * halfLength[i] + s * halfWidth[i];
+	float extentY = s * halfLength[i] + c * halfWidth[i];
+	GridRect rect;
+	rect.x0 = (int)floorf((x[i] - extentX) / dx) - 1;
+	rect.y0 = (int)floorf((y[i] - extentY) / dx) - 1;
+	rect.x1 = (int)ceilf((x[i] + extentX) / dx) + 2;
+	rect.y1 = (int)ceilf((y[i] + extentY) / dx) + 2;
+	return rect.Clip(sizeX, sizeY);
+}
+
+void FloatingBodies::Step(SimulationGrid2D* grid, const SimulationParameters& parameters, float dt)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	int sizeX = grid->GetSizeX();
+	int sizeY = grid->GetSizeY();
+	if (sizeX != fieldSizeX || sizeY != fieldSizeY) {
+		fieldSizeX = sizeX;
+		fieldSizeY = sizeY;
+		pressure.assign((size_t)sizeX * sizeY, 0.0f);
+		rowFirst.clear();
+		previousRowFirst.clear();
+	}
+
+	Rasterise(grid, parameters);
+
+	// Periodic grids wrap a node past the last one, walls stand on the edge nodes
+	float dx = parameters.spatialStepSize;
+	bool reflective = parameters.boundary == BoundaryType::Reflective;
+	int extent = reflective ? 1 : 0;
+	Integrate(dt, (sizeX - extent) * dx, (sizeY - extent) * dx, reflective);
+	AccumulatePressure(sizeX, sizeY);
+	rasteriseTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	changedRects.clear();
+	if (pushWater && pushDischarges && count > 0) {
+		ApplyPressure(grid, parameters, dt);
+		for (int i = 0; i < count; i++) {
+			if (!footprints[i].Empty()) {
+				changedRects.push_back(footprints[i]);
+				grid->MarkDirty(footprints[i]);
+			}
+		}
+	}
+	lastTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void FloatingBodies::Rasterise(SimulationGrid2D* grid, const SimulationParameters& parameters)
+{
+	int sizeX = grid->GetSizeX();
+	int sizeY = grid->GetSizeY();
+	float dx = parameters.spatialStepSize;
+	float g = parameters.gravity;
+	float area = dx * dx;
+	float inverseTaper = 1.0f / (TaperWidth * dx);
+
+	// Footprints are laid out one after another so the bodies can be rasterised independently.
+	// Last step's are kept to clear the pressure they left.
+	footprints.swap(previousFootprints);
+	footprints.resize(count);
+	footprintOffset.resize(count);
+	size_t total = 0;
+	for (int i = 0; i < count; i++) {
+		footprints[i] = Footprint(i, dx, sizeX, sizeY);
+		footprintOffset[i] = total;
+		total += (size_t)footprints[i].Area();
+	}
+	immersion.resize(total);
+
+	ForRange(count, BodiesPerTask, [&](int b0, int b1) {
+		std::vector<int> spanStart, spanEnd;
+		for (int i = b0; i < b1; i++) {
+			const GridRect& rect = footprints[i];
+			submerged[i] = 0.0f;
+			forceX[i] = 0.0f;
+			forceY[i] = 0.0f;
+			forceElevation[i] = -mass[i] * g;
+			heaveRate[i] = 0.0f;
+			torque[i] = 0.0f;
+			if (rect.Empty()) {
+				continue;
+			}
+			int width = rect.Width();
+			int rows = rect.Height();
+			float* cells = immersion.data() + footprintOffset[i];
+			std::fill(cells, cells + (size_t)rect.Area(), 0.0f);
+			float c = cosf(heading[i]), s = sinf(heading[i]);
+
+			// Columns of each row under the hull, [spanStart, spanEnd) relative to the footprint.
+			// Along and across the hull are linear in x along a row, each bounds an interval.
+			spanStart.assign(rows + 2, 0);
+			spanEnd.assign(rows + 2, 0);
+			for (int row = 0; row < rows; row++) {
+				float ry = (rect.y0 + row) * dx - y[i];
+				float low = -1e30f, high = 1e30f;
+				if (fabsf(c) > 1e-6f) {
+					float a0 = (-halfLength[i] - ry * s) / c, a1 = (halfLength[i] - ry * s) / c;
+					low = std::max(low, std::min(a0, a1));
+					high = std::min(high, std::max(a0, a1));
+				}
+				else if (fabsf(ry * s) > halfLength[i]) {
+					continue;
+				}
+				if (fabsf(s) > 1e-6f) {
+					float a0 = (ry * c - halfWidth[i]) / s, a1 = (ry * c + halfWidth[i]) / s;
+					low = std::max(low, std::min(a0, a1));
+					high = std::min(high, std::max(a0, a1));
+				}
+				else if (fabsf(ry * c) > halfWidth[i]) {
+					continue;
+				}
+				int first = std::max((int)ceilf((x[i] + low) / dx) - rect.x0, 0);
+				int last = std::min((int)floorf((x[i] + high) / dx) - rect.x0 + 1, width);
+				if (first < last) {
+					spanStart[row + 1] = first;
+					spanEnd[row + 1] = last;
+				}
+			}
+
+			// The footprints are scattered over a grid far larger than the cache, so start loading
+			// every row before the plane fit needs the first of them
+			for (int row = 0; row < rows; row++) {
+				const char* nodes = (const char*)(grid->GetRow(rect.y0 + row) + rect.x0);
+				const char* field = (const char*)&pressure[(size_t)(rect.y0 + row) * sizeX + rect.x0];
+				for (int byte = 0; byte < width * (int)sizeof(std::array<float, 4>); byte += 64) {
+					_mm_prefetch(nodes + byte, _MM_HINT_T0);
+				}
+				for (int byte = 0; byte < width * (int)sizeof(float); byte += 64) {
+					_mm_prefetch(field + byte, _MM_HINT_T0);
+				}
+			}
+
+			// Least squares plane through h + b + P on the ring, the nodes beside the hull: either
+			// end of a row's span, and the columns of the rows either side it does not cover
+			float n = 0.0f, sx = 0.0f, sy = 0.0f, sxx = 0.0f, syy = 0.0f, sxy = 0.0f;
+			float se = 0.0f, sex = 0.0f, sey = 0.0f;
+			auto addRing = [&](int row, int column) {
+				int cx = rect.x0 + column, cy = rect.y0 + row;
+				float rx = cx * dx - x[i], ry = cy * dx - y[i];
+				const std::array<float, 4>& node = grid->GetRow(cy)[cx];
+				float surface = node[SimulationGrid2D::Height] + node[SimulationGrid2D::Bathymetry] + pressure[(size_t)cy * sizeX + cx];
+				n += 1.0f;
+				sx += rx;
+				sy += ry;
+				sxx += rx * rx;
+				syy += ry * ry;
+				sxy += rx * ry;
+				se += surface;
+				sex += surface * rx;
+				sey += surface * ry;
+			};
+			for (int row = 0; row < rows; row++) {
+				int start = spanStart[row + 1], end = spanEnd[row + 1];
+				int first = INT_MAX, last = INT_MIN;
+				for (int other : { row, row + 2 }) {
+					if (spanStart[other] < spanEnd[other]) {
+						first = std::min(first, spanStart[other]);
+						last = std::max(last, spanEnd[other]);
+					}
+				}
+				if (start < end) {
+					first = std::min(first, start - 1);
+					last = std::max(last, end + 1);
+				}
+				for (int column = std::max(first, 0); column < std::min(last, width); column++) {
+					bool hull = column >= start && column < end;
+					bool beside = column == start - 1 || column == end
+						|| (column >= spanStart[row] && column < spanEnd[row])
+						|| (column >= spanStart[row + 2] && column < spanEnd[row + 2]);
+					if (!hull && beside) {
+						addRing(row, column);
+					}
+				}
+			}
+			float level = n > 0.0f ? se / n : 0.0f, slopeX = 0.0f, slopeY = 0.0f;
+			float determinant = n * (sxx * syy - sxy * sxy) - sx * (sx * syy - sxy * sy) + sy * (sx * sxy - sxx * sy);
+			if (n >= 3.0f && fabsf(determinant) > 1e-6f * n * n * n * area * area) {
+				level = (se * (sxx * syy - sxy * sxy) - sx * (sex * syy - sxy * sey) + sy * (sex * sxy - sxx * sey)) / determinant;
+				slopeX = (n * (sex * syy - sxy * sey) - se * (sx * syy - sxy * sy) + sy * (sx * sey - sex * sy)) / determinant;
+				slopeY = (n * (sxx * sey - sex * sxy) - sx * (sx * sey - sex * sy) + se * (sx * sxy - sxx * sy)) / determinant;
+			}
+
+			// Buoyancy of the hull nodes below the plane, drag towards the water velocity against
+			// the motion of each point of the hull, and the push down the plane
+			float volume = 0.0f, wetNodes = 0.0f, fx = 0.0f, fy = 0.0f, turn = 0.0f;
+			for (int row = 0; row < rows; row++) {
+				int cy = rect.y0 + row;
+				const std::array<float, 4>* nodes = grid->GetRow(cy);
+				float* cellRow = cells + row * width;
+				float ry = cy * dx - y[i];
+				for (int column = spanStart[row + 1]; column < spanEnd[row + 1]; column++) {
+					int cx = rect.x0 + column;
+					float rx = cx * dx - x[i];
+					float d = std::min(std::max(level + slopeX * rx + slopeY * ry - elevation[i], 0.0f), height[i]);
+					if (d == 0.0f) {
+						continue;
+					}
+					float along = fabsf(rx * c + ry * s), across = fabsf(ry * c - rx * s);
+					float taper = std::max(std::min((halfLength[i] - along) * inverseTaper, 1.0f), 0.0f) * std::max(std::min((halfWidth[i] - across) * inverseTaper, 1.0f), 0.0f);
+					cellRow[column] = d * (TaperFloor + (1.0f - TaperFloor) * taper);
+					volume += d * area;
+					wetNodes += 1.0f;
+
+					float h = nodes[cx][SimulationGrid2D::Height];
+					float inverseDepth = h > DryDepth ? 1.0f / h : 0.0f;
+					float waterX = nodes[cx][SimulationGrid2D::DischargeX] * inverseDepth;
+					float waterY = nodes[cx][SimulationGrid2D::DischargeY] * inverseDepth;
+					float weight = WaterDensity * d * area;
+					float cellX = weight * (dragRate * (waterX - (velocityX[i] - spin[i] * ry)) - g * slopeX);
+					float cellY = weight * (dragRate * (waterY - (velocityY[i] + spin[i] * rx)) - g * slopeY);
+					fx += cellX;
+					fy += cellY;
+					turn += rx * cellY - ry * cellX;
+				}
+			}
+
+			// Buoyancy and weight, and the heave damping as a rate integrated implicitly
+			float stiffness = WaterDensity * g * wetNodes * area;
+			forceElevation[i] = WaterDensity * volume * g - mass[i] * g;
+			heaveRate[i] = 2.0f * HeaveDamping * sqrtf(stiffness * inverseMass[i]);
+			submerged[i] = volume;
+			forceX[i] = fx;
+			forceY[i] = fy;
+			torque[i] = turn;
+		}
+	});
+}
+
+void FloatingBodies::Integrate(float dt, float lengthX, float lengthY, bool reflective)
+{
+	// Semi-implicit Euler, four bodies per operation, with the heave damping implicit. Bodies
+	// out of the water fall.
+	__m128 step = _mm_set1_ps(dt);
+	__m128 zero = _mm_setzero_ps();
+	__m128 sizeX = _mm_set1_ps(lengthX), sizeY = _mm_set1_ps(lengthY);
+	__m128 inverseSizeX = _mm_set1_ps(1.0f / lengthX), inverseSizeY = _mm_set1_ps(1.0f / lengthY);
+	int padded = (int)x.size();
+	for (int i = 0; i < padded; i += 4) {
+		__m128 invM = _mm_loadu_ps(&inverseMass[i]);
+		__m128 vx = _mm_add_ps(_mm_loadu_ps(&velocityX[i]), _mm_mul_ps(step, _mm_mul_ps(_mm_loadu_ps(&forceX[i]), invM)));
+		__m128 vy = _mm_add_ps(_mm_loadu_ps(&velocityY[i]), _mm_mul_ps(step, _mm_mul_ps(_mm_loadu_ps(&forceY[i]), invM)));
+		__m128 vz = _mm_add_ps(_mm_loadu_ps(&velocityElevation[i]), _mm_mul_ps(step, _mm_mul_ps(_mm_loadu_ps(&forceElevation[i]), invM)));
+		vz = _mm_div_ps(vz, _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(step, _mm_loadu_ps(&heaveRate[i]))));
+		__m128 w = _mm_add_ps(_mm_loadu_ps(&spin[i]), _mm_mul_ps(step, _mm_mul_ps(_mm_loadu_ps(&torque[i]), _mm_loadu_ps(&inverseInertia[i]))));
+
+		__m128 px = _mm_add_ps(_mm_loadu_ps(&x[i]), _mm_mul_ps(step, vx));
+		__m128 py = _mm_add_ps(_mm_loadu_ps(&y[i]), _mm_mul_ps(step, vy));
+		__m128 pz = _mm_add_ps(_mm_loadu_ps(&elevation[i]), _mm_mul_ps(step, vz));
+		__m128 angle = _mm_add_ps(_mm_loadu_ps(&heading[i]), _mm_mul_ps(step, w));
+
+		if (reflective) {
+			// Walls bounce the bodies back inside
+			__m128 low = _mm_cmplt_ps(px, zero), high = _mm_cmpgt_ps(px, sizeX);
+			vx = Select(_mm_or_ps(low, high), _mm_sub_ps(zero, vx), vx);
+			px = _mm_min_ps(_mm_max_ps(px, zero), sizeX);
+			low = _mm_cmplt_ps(py, zero);
+			high = _mm_cmpgt_ps(py, sizeY);
+			vy = Select(_mm_or_ps(low, high), _mm_sub_ps(zero, vy), vy);
+			py = _mm_min_ps(_mm_max_ps(py, zero), sizeY);
+		}
+		else {
+			px = _mm_sub_ps(px, _mm_mul_ps(sizeX, Floor(_mm_mul_ps(px, inverseSizeX))));
+			py = _mm_sub_ps(py, _mm_mul_ps(sizeY, Floor(_mm_mul_ps(py, inverseSizeY))));
+		}
+
+		// The bed stops bodies sinking through it
+		__m128 grounded = _mm_cmplt_ps(pz, zero);
+		vz = Select(grounded, _mm_max_ps(vz, zero), vz);
+		pz = _mm_max_ps(pz, zero);
+
+		_mm_storeu_ps(&velocityX[i], vx);
+		_mm_storeu_ps(&velocityY[i], vy);
+		_mm_storeu_ps(&velocityElevation[i], vz);
+		_mm_storeu_ps(&spin[i], w);
+		_mm_storeu_ps(&x[i], px);
+		_mm_storeu_ps(&y[i], py);
+		_mm_storeu_ps(&elevation[i], pz);
+		_mm_storeu_ps(&heading[i], angle);
+	}
+}
+
+void FloatingBodies::AccumulatePressure(int sizeX, int sizeY)
+{
+	// Bodies covering each row, bucketed in index order so overlapping hulls add up the same
+	// way on any thread. Last step's buckets say what to clear.
+	std::swap(rowFirst, previousRowFirst);
+	std::swap(rowBodies, previousRowBodies);
+	rowFirst.assign(sizeY + 1, 0);
+	rowBodies.clear();
+	if (pushWater) {
+		for (int i = 0; i < count; i++) {
+			for (int row = footprints[i].y0; row < footprints[i].y1 && footprints[i].x0 < footprints[i].x1; row++) {
+				rowFirst[row + 1]++;
+			}
+		}
+		for (int row = 0; row < sizeY; row++) {
+			rowFirst[row + 1] += rowFirst[row];
+		}
+		rowBodies.resize(rowFirst[sizeY]);
+		std::vector<int> next(rowFirst.begin(), rowFirst.end() - 1);
+		for (int i = 0; i < count; i++) {
+			for (int row = footprints[i].y0; row < footprints[i].y1 && footprints[i].x0 < footprints[i].x1; row++) {
+				rowBodies[next[row]++] = i;
+			}
+		}
+	}
+
+	ForRange(sizeY, 8, [&](int y0, int y1) {
+		for (int row = y0; row < y1; row++) {
+			float* field = &pressure[(size_t)row * sizeX];
+			if ((int)previousRowFirst.size() > row + 1) {
+				for (int k = previousRowFirst[row]; k < previousRowFirst[row + 1]; k++) {
+					const GridRect& rect = previousFootprints[previousRowBodies[k]];
+					std::fill(field + rect.x0, field + rect.x1, 0.0f);
+				}
+			}
+			for (int k = rowFirst[row]; k < rowFirst[row + 1]; k++) {
+				int i = rowBodies[k];
+				const GridRect& rect = footprints[i];
+				const float* cells = immersion.data() + footprintOffset[i] + (size_t)(row - rect.y0) * rect.Width();
+				for (int cx = rect.x0; cx < rect.x1; cx++) {
+					field[cx] += cells[cx - rect.x0];
+				}
+			}
+		}
+	});
+}
+
+void FloatingBodies::ApplyPressure(SimulationGrid2D* grid, const SimulationParameters& parameters, float dt)
+{
+	// Momentum source -g h grad(P) on the discharges, over the footprints covering each row.
+	// The footprints reach a node past the hulls, so they hold every node the gradient is not
+	// zero at. A row reads the field of its neighbours but only writes itself. The whole step's
+	// push lands at once, so it is held to the time a wave takes to cross part of a node,
+	// beyond which it overshoots the solver's own response.
+	int sizeX = fieldSizeX;
+	int sizeY = fieldSizeY;
+	float g = parameters.gravity;
+	float dx = parameters.spatialStepSize;
+	float scale = g / (2.0f * dx);
+	ForRange(sizeY, 8, [&](int y0, int y1) {
+		std::vector<std::pair<int, int>> spans;
+		for (int row = y0; row < y1; row++) {
+			// Merge the row's footprints so overlapping ones are pushed once
+			spans.clear();
+			for (int k = rowFirst[row]; k < rowFirst[row + 1]; k++) {
+				const GridRect& rect = footprints[rowBodies[k]];
+				spans.push_back(std::make_pair(rect.x0, rect.x1));
+			}
+			std::sort(spans.begin(), spans.end());
+
+			int above = std::max(row - 1, 0), below = std::min(row + 1, sizeY - 1);
+			std::array<float, 4>* nodes = grid->GetRow(row);
+			const float* field = &pressure[(size_t)row * sizeX];
+			const float* fieldAbove = &pressure[(size_t)above * sizeX];
+			const float* fieldBelow = &pressure[(size_t)below * sizeX];
+			int done = 0;
+			for (const std::pair<int, int>& span : spans) {
+				for (int cx = std::max(span.first, done); cx < span.second; cx++) {
+					float h = nodes[cx][SimulationGrid2D::Height];
+					float gradientX = field[std::min(cx + 1, sizeX - 1)] - field[std::max(cx - 1, 0)];
+					float gradientY = fieldBelow[cx] - fieldAbove[cx];
+					float impulse = std::min(dt, ImpulseCourant * dx / sqrtf(g * std::max(h, DryDepth))) * scale * h;
+					nodes[cx][SimulationGrid2D::DischargeX] -= impulse * gradientX;
+					nodes[cx][SimulationGrid2D::DischargeY] -= impulse * gradientY;
+				}
+				done = std::max(done, span.second);
+			}
+		}
+	});
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <vector>
+#include "GridRect.h"
+#include "ShallowWaterSolver.h"
+#include "SimulationGrid2D.h"
+#include "TaskScheduler.h"
+
+// Box hulls floating on a CPU shallow water grid and pushing back on it. Bodies move in the
+// plane of the grid and heave and yaw, they do not pitch or roll. Positions are in metres
+// along the grid axes, node (i, j) sitting at (i dx, j dx), and elevations are from the datum
+// of the bathymetry, the water surface standing at h + b.
+//
+// A hull presses on the water under it with a pressure head P, in metres of water, equal to
+// how far its bottom sits below the surrounding surface. That surface is a plane fitted to
+// h + b + P over the ring of nodes just outside the hull, so a hull's own push does not feed
+// back into its draft. Every step has four phases:
+// - Over the bodies in parallel, each hull's ring and footprint are rasterised. The nodes
+//   under the hull get their immersion, and buoyancy, drag towards the water velocity and the
+//   push down the fitted plane are summed into forces and a yaw torque.
+// - Over the bodies four at a time in SSE, the structure of arrays state is integrated with
+//   semi-implicit Euler.
+// - Over the grid rows in parallel, the immersions are summed into P. Each row adds the
+//   bodies in index order, so the result does not depend on the thread count.
+// - Over the rows again, P acts on the water as a moving pressure source, the discharges
+//   getting -g h grad(P) dt. Solvers that keep their own fluxes, such as the virtual pipe,
+//   read P instead.
+//
+// A floating hull settles where the water it pushed aside weighs what it does. The pressure
+// tapers off inside the hull's edge so the water is not pushed by a step, and the heave is
+// damped because the water answers a push one step late. Footprints are clipped at the grid
+// edges.
+class FloatingBodies
+{
+
+public:
+
+	// A null scheduler steps everything on the calling thread
+	FloatingBodies(TaskScheduler* scheduler = nullptr);
+	~FloatingBodies();
+
+	// Add a hull centred at (x, y) with its length along the heading (radians from the x axis),
+	// returns its index. The elevation is that of its bottom, mass in kg.
+	int Add(float x, float y, float elevation, float heading, float halfLength, float halfWidth, float height, float mass);
+	void Clear();
+	int GetCount();
+
+	// Rate in 1/s at which the hulls follow the water, scaled by how deep they sit
+	void SetDragRate(float rate);
+	float GetDragRate();
+
+	// Bodies only feel the water when pushing is off
+	void SetPushWater(bool push);
+
+	// Push through the grid's discharges, off leaves the pushing to a solver reading GetPressure
+	void SetPushDischarges(bool push);
+
+	// Advance the bodies by dt and push the water they displace
+	void Step(SimulationGrid2D* grid, const SimulationParameters& parameters, float dt);
+
+	// Pressure head of the last step, one float per grid node row after row, null before the first
+	const float* GetPressure();
+
+	// Footprints the last step changed the grid in
+	const std::vector<GridRect>& GetChangedRects();
+
+	// State of body i
+	float GetX(int i);
+	float GetY(int i);
+	float GetElevation(int i);
+	float GetHeading(int i);
+	float GetImmersion(int i); // submerged volume over footprint area, m
+
+	// Milliseconds spent in the last step, and of that in the rasterisation phases
+	float GetLastTime();
+	float GetLastRasteriseTime();
+
+private:
+
+	void ForRange(int count, int minRange, const std::function<void(int, int)>& body);
+
+	// Bounding rectangle of a body's hull and ring, clipped to the grid
+	GridRect Footprint(int i, float dx, int sizeX, int sizeY);
+
+	void Rasterise(SimulationGrid2D* grid, const SimulationParameters& parameters);
+	void Integrate(float dt, float lengthX, float lengthY, bool reflective);
+	void AccumulatePressure(int sizeX, int sizeY);
+	void ApplyPressure(SimulationGrid2D* grid, const SimulationParameters& parameters, float dt);
+
+	TaskScheduler* scheduler;
+	float dragRate;
+	bool pushWater;
+	bool pushDischarges;
+	int count;
+
+	// Structure of arrays, padded to a multiple of four with bodies that do not move
+	std::vector<float> x, y, elevation, heading;
+	std::vector<float> velocityX, velocityY, velocityElevation, spin;
+	std::vector<float> halfLength, halfWidth, height;
+	std::vector<float> mass, inverseMass, inverseInertia;
+	std::vector<float> forceX, forceY, forceElevation, heaveRate, torque;
+	std::vector<float> submerged;
+
+	// Immersion of every node of every footprint, 0 off the hull, body i's starting at
+	// footprintOffset[i]
+	std::vector<GridRect> footprints;
+	std::vector<size_t> footprintOffset;
+	std::vector<float> immersion;
+
+	// Pressure head the hulls apply
+	int fieldSizeX;
+	int fieldSizeY;
+	std::vector<float> pressure;
+
+	// Bodies whose footprints cover each row, those of row y at rowBodies[rowFirst[y]] up to
+	// rowBodies[rowFirst[y + 1]], and the same for last step
+	std::vector<int> rowFirst, rowBodies;
+	std::vector<int> previousRowFirst, previousRowBodies;
+	std::vector<GridRect> previousFootprints;
+	std::vector<GridRect> changedRects;
+
+	float lastTime;
+	float rasteriseTime;
+
+};
@@ -0,0 +1,259 @@
+#include "FourierTransform.h"
+#include <cmath>
+#include <cstdint>
+#include <xmmintrin.h>
+
+namespace
+{
+	const double Pi = 3.14159265358979323846;
+
+	// Complex multiply of four lanes by one twiddle factor
+	inline void Multiply(__m128& re, __m128& im, __m128 wr, __m128 wi)
+	{
+		__m128 r = _mm_sub_ps(_mm_mul_ps(re, wr), _mm_mul_ps(im, wi));
+		im = _mm_add_ps(_mm_mul_ps(re, wi), _mm_mul_ps(im, wr));
+		re = r;
+	}
+
+	// Room for n points of four lanes in the storage, 16 byte aligned. A std::vector<__m128>
+	// would drop the alignment attribute of the type.
+	inline __m128* LaneBuffer(std::vector<float>& storage, int n)
+	{
+		storage.resize((size_t)n * 4 + 3);
+		uintptr_t address = (uintptr_t)storage.data();
+		return (__m128*)((address + 15) & ~(uintptr_t)15);
+	}
+
+	// Four transforms of n points in bit-reversed order, lane l of point i at [i]. cosines and
+	// sines hold exp(-2 pi i k / n); the inverse uses their conjugates and is not scaled.
+	void TransformLanes(int n, const float* cosines, const float* sines, __m128* re, __m128* im, bool inverse)
+	{
+		float sign = inverse ? -1.0f : 1.0f;
+		int half = 1;
+
+		// An odd power of two starts with one radix-2 stage, all of whose twiddles are one
+		int levels = 0;
+		while ((1 << levels) < n) {
+			levels++;
+		}
+		if (levels % 2 == 1) {
+			for (int i = 0; i < n; i += 2) {
+				__m128 ar = re[i], ai = im[i];
+				__m128 br = re[i + 1], bi = im[i + 1];
+				re[i] = _mm_add_ps(ar, br);
+				im[i] = _mm_add_ps(ai, bi);
+				re[i + 1] = _mm_sub_ps(ar, br);
+				im[i + 1] = _mm_sub_ps(ai, bi);
+			}
+			half = 2;
+		}
+
+		// Each radix-4 butterfly does two radix-2 stages at once, combining four transforms of
+		// half points into one of 4 * half
+		for (; half < n; half *= 4) {
+			int strideInner = n / (2 * half);
+			int strideOuter = n / (4 * half);
+			for (int start = 0; start < n; start += 4 * half) {
+				for (int j = 0; j < half; j++) {
+					__m128 w1r = _mm_set1_ps(cosines[j * strideInner]);
+					__m128 w1i = _mm_set1_ps(sign * sines[j * strideInner]);
+					__m128 w2r = _mm_set1_ps(cosines[j * strideOuter]);
+					__m128 w2i = _mm_set1_ps(sign * sines[j * strideOuter]);
+
+					int i0 = start + j;
+					int i1 = i0 + half;
+					int i2 = i1 + half;
+					int i3 = i2 + half;
+					__m128 ar = re[i0], ai = im[i0];
+					__m128 br = re[i1], bi = im[i1];
+					__m128 cr = re[i2], ci = im[i2];
+					__m128 dr = re[i3], di = im[i3];
+
+					Multiply(br, bi, w1r, w1i);
+					Multiply(dr, di, w1r, w1i);
+					__m128 sr = _mm_add_ps(ar, br), si = _mm_add_ps(ai, bi);
+					__m128 tr = _mm_sub_ps(ar, br), ti = _mm_sub_ps(ai, bi);
+					__m128 ur = _mm_add_ps(cr, dr), ui = _mm_add_ps(ci, di);
+					__m128 vr = _mm_sub_ps(cr, dr), vi = _mm_sub_ps(ci, di);
+
+					// The second pair's twiddle is the first one's times -i, or +i for the inverse
+					Multiply(ur, ui, w2r, w2i);
+					Multiply(vr, vi, w2r, w2i);
+					__m128 rotated = inverse ? _mm_sub_ps(_mm_setzero_ps(), vi) : vi;
+					vi = inverse ? vr : _mm_sub_ps(_mm_setzero_ps(), vr);
+					vr = rotated;
+
+					re[i0] = _mm_add_ps(sr, ur);
+					im[i0] = _mm_add_ps(si, ui);
+					re[i2] = _mm_sub_ps(sr, ur);
+					im[i2] = _mm_sub_ps(si, ui);
+					re[i1] = _mm_add_ps(tr, vr);
+					im[i1] = _mm_add_ps(ti, vi);
+					re[i3] = _mm_sub_ps(tr, vr);
+					im[i3] = _mm_sub_ps(ti, vi);
+				}
+			}
+		}
+	}
+}
+
+FourierTransform::FourierTransform(TaskScheduler* taskScheduler)
+{
+	scheduler = taskScheduler;
+}
+
+FourierTransform::~FourierTransform()
+{
+}
+
+bool FourierTransform::IsPowerOfTwo(int n)
+{
+	return n >= 4 && (n & (n - 1)) == 0;
+}
+
+int FourierTransform::Frequency(int i, int n)
+{
+	return i < n / 2 ? i : i - n;
+}
+
+int FourierTransform::GetSizeX()
+{
+	return rows.size;
+}
+
+int FourierTransform::GetSizeY()
+{
+	return columns.size;
+}
+
+bool FourierTransform::Resize(int sizeX, int sizeY)
+{
+	if (!IsPowerOfTwo(sizeX) || !IsPowerOfTwo(sizeY)) {
+		return false;
+	}
+	if (rows.size != sizeX) {
+		CreatePlan(rows, sizeX);
+	}
+	if (columns.size != sizeY) {
+		CreatePlan(columns, sizeY);
+	}
+	return true;
+}
+
+void FourierTransform::CreatePlan(Plan& plan, int n)
+{
+	plan.size = n;
+	plan.reversal.resize(n);
+	plan.cosines.resize(n);
+	plan.sines.resize(n);
+
+	int levels = 0;
+	while ((1 << levels) < n) {
+		levels++;
+	}
+	for (int i = 0; i < n; i++) {
+		int reversed = 0;
+		for (int b = 0; b < levels; b++) {
+			reversed |= ((i >> b) & 1) << (levels - 1 - b);
+		}
+		plan.reversal[i] = reversed;
+
+		double angle = -2.0 * Pi * i / n;
+		plan.cosines[i] = (float)cos(angle);
+		plan.sines[i] = (float)sin(angle);
+	}
+}
+
+void FourierTransform::ForRange(int count, const std::function<void(int, int)>& body)
+{
+	if (scheduler) {
+		scheduler->ParallelFor(0, count, body, 4);
+	}
+	else {
+		body(0, count);
+	}
+}
+
+void FourierTransform::Forward2D(float* real, float* imaginary)
+{
+	Transform2D(real, imaginary, false);
+}
+
+void FourierTransform::Inverse2D(float* real, float* imaginary)
+{
+	Transform2D(real, imaginary, true);
+}
+
+void FourierTransform::Transform2D(float* real, float* imaginary, bool inverse)
+{
+	int nx = rows.size;
+	int ny = columns.size;
+
+	// Rows, four at a time. Blocks of 4x4 are transposed so each lane holds one row.
+	ForRange(ny / 4, [&](int g0, int g1) {
+		std::vector<float> realStorage, imaginaryStorage;
+		__m128* re = LaneBuffer(realStorage, nx);
+		__m128* im = LaneBuffer(imaginaryStorage, nx);
+		for (int g = g0; g < g1; g++) {
+			float* rowReal = real + (size_t)g * 4 * nx;
+			float* rowImaginary = imaginary + (size_t)g * 4 * nx;
+			for (int x = 0; x < nx; x += 4) {
+				__m128 r0 = _mm_loadu_ps(rowReal + x), r1 = _mm_loadu_ps(rowReal + nx + x);
+				__m128 r2 = _mm_loadu_ps(rowReal + 2 * nx + x), r3 = _mm_loadu_ps(rowReal + 3 * nx + x);
+				__m128 i0 = _mm_loadu_ps(rowImaginary + x), i1 = _mm_loadu_ps(rowImaginary + nx + x);
+				__m128 i2 = _mm_loadu_ps(rowImaginary + 2 * nx + x), i3 = _mm_loadu_ps(rowImaginary + 3 * nx + x);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_MM_TRANSPOSE4_PS(i0, i1, i2, i3);
+				re[rows.reversal[x]] = r0;
+				re[rows.reversal[x + 1]] = r1;
+				re[rows.reversal[x + 2]] = r2;
+				re[rows.reversal[x + 3]] = r3;
+				im[rows.reversal[x]] = i0;
+				im[rows.reversal[x + 1]] = i1;
+				im[rows.reversal[x + 2]] = i2;
+				im[rows.reversal[x + 3]] = i3;
+			}
+
+			TransformLanes(nx, rows.cosines.data(), rows.sines.data(), re, im, inverse);
+
+			for (int x = 0; x < nx; x += 4) {
+				__m128 r0 = re[x], r1 = re[x + 1], r2 = re[x + 2], r3 = re[x + 3];
+				__m128 i0 = im[x], i1 = im[x + 1], i2 = im[x + 2], i3 = im[x + 3];
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				_MM_TRANSPOSE4_PS(i0, i1, i2, i3);
+				_mm_storeu_ps(rowReal + x, r0);
+				_mm_storeu_ps(rowReal + nx + x, r1);
+				_mm_storeu_ps(rowReal + 2 * nx + x, r2);
+				_mm_storeu_ps(rowReal + 3 * nx + x, r3);
+				_mm_storeu_ps(rowImaginary + x, i0);
+				_mm_storeu_ps(rowImaginary + nx + x, i1);
+				_mm_storeu_ps(rowImaginary + 2 * nx + x, i2);
+				_mm_storeu_ps(rowImaginary + 3 * nx + x, i3);
+			}
+		}
+	});
+
+	// Columns, four neighbouring ones at a time, which already sit next to each other in memory.
+	// The inverse scale is applied on the way out.
+	__m128 scale = _mm_set1_ps(inverse ? 1.0f / ((float)nx * ny) : 1.0f);
+	ForRange(nx / 4, [&](int g0, int g1) {
+		std::vector<float> realStorage, imaginaryStorage;
+		__m128* re = LaneBuffer(realStorage, ny);
+		__m128* im = LaneBuffer(imaginaryStorage, ny);
+		for (int g = g0; g < g1; g++) {
+			float* columnReal = real + g * 4;
+			float* columnImaginary = imaginary + g * 4;
+			for (int y = 0; y < ny; y++) {
+				re[columns.reversal[y]] = _mm_loadu_ps(columnReal + (size_t)y * nx);
+				im[columns.reversal[y]] = _mm_loadu_ps(columnImaginary + (size_t)y * nx);
+			}
+
+			TransformLanes(ny, columns.cosines.data(), columns.sines.data(), re, im, inverse);
+
+			for (int y = 0; y < ny; y++) {
+				_mm_storeu_ps(columnReal + (size_t)y * nx, _mm_mul_ps(re[y], scale));
+				_mm_storeu_ps(columnImaginary + (size_t)y * nx, _mm_mul_ps(im[y], scale));
+			}
+		}
+	});
+}
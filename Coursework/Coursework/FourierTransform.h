@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include "TaskScheduler.h"
+
+// Complex fast Fourier transforms of power of two sizes, at least 4. Four transforms run at
+// once, one per SSE lane, as radix-4 butterflies on bit-reversed input with one radix-2 stage
+// first when the size is an odd power of two. 2D transforms do the rows four at a time, then
+// the columns four at a time, each split over the task scheduler when one is set.
+//
+// The forward transform uses exp(-2 pi i k x / n). The inverse is scaled by 1 / (sizeX sizeY)
+// so it undoes the forward one.
+class FourierTransform
+{
+
+public:
+
+	FourierTransform(TaskScheduler* scheduler = nullptr);
+	~FourierTransform();
+
+	// Set the size of the 2D transforms, returns false if either side is not a power of two
+	bool Resize(int sizeX, int sizeY);
+	int GetSizeX();
+	int GetSizeY();
+
+	// Transform planes of real and imaginary parts in place, rows sizeX floats apart
+	void Forward2D(float* real, float* imaginary);
+	void Inverse2D(float* real, float* imaginary);
+
+	static bool IsPowerOfTwo(int n);
+
+	// Signed wavenumber in cycles per grid of frequency index i of an n point transform
+	static int Frequency(int i, int n);
+
+private:
+
+	// Bit reversal permutation and twiddle factors exp(-2 pi i k / n) of one transform length
+	struct Plan
+	{
+		int size = 0;
+		std::vector<int> reversal;
+		std::vector<float> cosines, sines;
+	};
+
+	static void CreatePlan(Plan& plan, int n);
+	void Transform2D(float* real, float* imaginary, bool inverse);
+	void ForRange(int count, const std::function<void(int, int)>& body);
+
+	TaskScheduler* scheduler;
+	Plan rows;
+	Plan columns;
+
+};
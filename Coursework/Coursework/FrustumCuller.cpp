@@ -0,0 +1,154 @@
+#include "FrustumCuller.h"
+#include <chrono>
+#include <cmath>
+#include <xmmintrin.h>
+
+void CullBoxes::Clear()
+{
+	centreX.clear();
+	centreY.clear();
+	centreZ.clear();
+	extentX.clear();
+	extentY.clear();
+	extentZ.clear();
+	count = 0;
+}
+
+void CullBoxes::Add(float minX, float minY, float minZ, float maxX, float maxY, float maxZ)
+{
+	if (count % 4 == 0) {
+		size_t padded = (size_t)count + 4;
+		centreX.resize(padded, 0.0f);
+		centreY.resize(padded, 0.0f);
+		centreZ.resize(padded, 0.0f);
+		extentX.resize(padded, 0.0f);
+		extentY.resize(padded, 0.0f);
+		extentZ.resize(padded, 0.0f);
+	}
+	centreX[count] = 0.5f * (minX + maxX);
+	centreY[count] = 0.5f * (minY + maxY);
+	centreZ[count] = 0.5f * (minZ + maxZ);
+	extentX[count] = 0.5f * (maxX - minX);
+	extentY[count] = 0.5f * (maxY - minY);
+	extentZ[count] = 0.5f * (maxZ - minZ);
+	count++;
+}
+
+int CullBoxes::Size() const
+{
+	return count;
+}
+
+
+
+FrustumCuller::FrustumCuller()
+{
+	// Until a matrix is given every box is inside
+	for (int p = 0; p < 6; p++) {
+		planes[p][0] = 0.0f;
+		planes[p][1] = 0.0f;
+		planes[p][2] = 0.0f;
+		planes[p][3] = 1.0f;
+	}
+	horizontal = 0.0f;
+	minHeight = 0.0f;
+	maxHeight = 0.0f;
+	tested = 0;
+	lastTime = 0.0f;
+}
+
+FrustumCuller::~FrustumCuller()
+{
+}
+
+void FrustumCuller::SetViewProjection(const float m[16])
+{
+	// A row vector v lands at clip = v M, so each plane is a sum of columns of M: -w <= x <= w,
+	// -w <= y <= w and 0 <= z <= w
+	for (int k = 0; k < 4; k++) {
+		float x = m[k * 4 + 0], y = m[k * 4 + 1], z = m[k * 4 + 2], w = m[k * 4 + 3];
+		planes[0][k] = w + x; // left
+		planes[1][k] = w - x; // right
+		planes[2][k] = w + y; // bottom
+		planes[3][k] = w - y; // top
+		planes[4][k] = z;     // near
+		planes[5][k] = w - z; // far
+	}
+}
+
+void FrustumCuller::SetDisplacement(float sideways, float minimum, float maximum)
+{
+	horizontal = sideways;
+	minHeight = minimum;
+	maxHeight = maximum;
+}
+
+const std::vector<int>& FrustumCuller::Cull(const CullBoxes& boxes)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	visible.clear();
+	tested = boxes.Size();
+
+	// The displacement moves the box centres up by the middle of the height range and grows
+	// the extents by the rest
+	__m128 shiftY = _mm_set1_ps(0.5f * (minHeight + maxHeight));
+	__m128 growX = _mm_set1_ps(horizontal);
+	__m128 growY = _mm_set1_ps(0.5f * (maxHeight - minHeight));
+
+	// A box is wholly behind a plane when even its corner furthest along the normal is
+	__m128 normalX[6], normalY[6], normalZ[6], offset[6], absoluteX[6], absoluteY[6], absoluteZ[6];
+	for (int p = 0; p < 6; p++) {
+		normalX[p] = _mm_set1_ps(planes[p][0]);
+		normalY[p] = _mm_set1_ps(planes[p][1]);
+		normalZ[p] = _mm_set1_ps(planes[p][2]);
+		offset[p] = _mm_set1_ps(planes[p][3]);
+		absoluteX[p] = _mm_set1_ps(fabsf(planes[p][0]));
+		absoluteY[p] = _mm_set1_ps(fabsf(planes[p][1]));
+		absoluteZ[p] = _mm_set1_ps(fabsf(planes[p][2]));
+	}
+
+	__m128 zero = _mm_setzero_ps();
+	for (int i = 0; i < tested; i += 4) {
+		__m128 cx = _mm_loadu_ps(&boxes.centreX[i]);
+		__m128 cy = _mm_add_ps(_mm_loadu_ps(&boxes.centreY[i]), shiftY);
+		__m128 cz = _mm_loadu_ps(&boxes.centreZ[i]);
+		__m128 ex = _mm_add_ps(_mm_loadu_ps(&boxes.extentX[i]), growX);
+		__m128 ey = _mm_add_ps(_mm_loadu_ps(&boxes.extentY[i]), growY);
+		__m128 ez = _mm_add_ps(_mm_loadu_ps(&boxes.extentZ[i]), growX);
+
+		__m128 outside = zero;
+		for (int p = 0; p < 6; p++) {
+			__m128 centre = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX[p], cx), _mm_mul_ps(normalY[p], cy)), _mm_add_ps(_mm_mul_ps(normalZ[p], cz), offset[p]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absoluteX[p], ex), _mm_mul_ps(absoluteY[p], ey)), _mm_mul_ps(absoluteZ[p], ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(centre, radius), zero));
+		}
+
+		// Lanes past the last box are padding
+		int lanes = tested - i < 4 ? (1 << (tested - i)) - 1 : 15;
+		int inside = ~_mm_movemask_ps(outside) & lanes;
+		for (int l = 0; l < 4; l++) {
+			if (inside & (1 << l)) {
+				visible.push_back(i + l);
+			}
+		}
+	}
+
+	lastTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return visible;
+}
+
+int FrustumCuller::GetTestedCount()
+{
+	return tested;
+}
+
+int FrustumCuller::GetVisibleCount()
+{
+	return (int)visible.size();
+}
+
+float FrustumCuller::GetLastTime()
+{
+	return lastTime;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+
+// Axis aligned boxes as centres and half extents, structure of arrays padded to a multiple of
+// four so four boxes fill one SSE register
+struct CullBoxes
+{
+	std::vector<float> centreX, centreY, centreZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+	void Clear();
+	void Add(float minX, float minY, float minZ, float maxX, float maxY, float maxZ);
+	int Size() const;
+
+private:
+
+	int count = 0;
+};
+
+// Tests boxes against the six planes of a view frustum, four boxes per SSE operation. The
+// planes are taken from a view-projection matrix (Gribb and Hartmann), and a box is culled when
+// it lies wholly behind any one of them. Boxes near a corner of the frustum can be kept when
+// they are outside, never the other way round.
+//
+// The boxes are grown by how far the surface can be displaced before they are tested, so the
+// chunks of the flat mesh are kept wherever the waves can carry them into view.
+class FrustumCuller
+{
+
+public:
+
+	FrustumCuller();
+	~FrustumCuller();
+
+	// Row major matrix taking row vectors to clip space, depth from 0 to 1, as Direct3D uses it
+	void SetViewProjection(const float matrix[16]);
+
+	// The surface moves at most horizontal sideways and stays between minHeight and maxHeight
+	// above the boxes' own heights
+	void SetDisplacement(float horizontal, float minHeight, float maxHeight);
+
+	// Indices of the boxes at least partly inside the frustum, in increasing order
+	const std::vector<int>& Cull(const CullBoxes& boxes);
+
+	// Of the last cull
+	int GetTestedCount();
+	int GetVisibleCount();
+	float GetLastTime(); // milliseconds
+
+private:
+
+	// Inward facing normal and offset of each plane, a point being inside when n.p + d >= 0
+	float planes[6][4];
+	float horizontal;
+	float minHeight;
+	float maxHeight;
+
+	std::vector<int> visible;
+	int tested;
+	float lastTime;
+
+};
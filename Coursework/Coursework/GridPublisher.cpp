@@ -0,0 +1,282 @@
+#include "GridPublisher.h"
+#include <cstring>
+#include <algorithm>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// Open (or create) a named shared-memory mapping of the given size, returns nullptr on failure
+	char* OpenMapping(const std::string& name, size_t size, bool create, void** handle)
+	{
+#ifdef _WIN32
+		HANDLE fileMapping;
+		if (create) {
+			fileMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)(size & 0xFFFFFFFF), name.c_str());
+		}
+		else {
+			fileMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+		}
+		if (!fileMapping) {
+			return nullptr;
+		}
+		void* view = MapViewOfFile(fileMapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size);
+		if (!view) {
+			CloseHandle(fileMapping);
+			return nullptr;
+		}
+		*handle = fileMapping;
+		return (char*)view;
+#else
+		std::string shmName = "/" + name;
+		int fd = create ? shm_open(shmName.c_str(), O_CREAT | O_RDWR, 0644) : shm_open(shmName.c_str(), O_RDONLY, 0);
+		if (fd < 0) {
+			return nullptr;
+		}
+		if (create && ftruncate(fd, (off_t)size) != 0) {
+			close(fd);
+			return nullptr;
+		}
+		if (!create) {
+			struct stat info;
+			if (fstat(fd, &info) != 0 || (size_t)info.st_size < size) {
+				close(fd);
+				return nullptr;
+			}
+		}
+		void* view = mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (view == MAP_FAILED) {
+			return nullptr;
+		}
+		*handle = nullptr;
+		return (char*)view;
+#endif
+	}
+
+	void CloseMapping(char* mapping, size_t size, void* handle)
+	{
+		if (!mapping) {
+			return;
+		}
+#ifdef _WIN32
+		UnmapViewOfFile(mapping);
+		CloseHandle((HANDLE)handle);
+#else
+		(void)handle;
+		munmap(mapping, size);
+#endif
+	}
+}
+
+size_t GridSharedMemory::MappingSize(int nx, int ny, int slotCount)
+{
+	return sizeof(Header) + (size_t)slotCount * (sizeof(SlotHeader) + (size_t)nx * ny * sizeof(std::array<float, 4>));
+}
+
+
+
+///////////////////////////           [ PUBLISHER ]           ///////////////////////////
+GridPublisher::GridPublisher(const std::string& name_, int nx, int ny, int slotCount)
+{
+	name = name_;
+	slotCount = std::max(slotCount, 2);
+	mappingSize = GridSharedMemory::MappingSize(nx, ny, slotCount);
+	mappingHandle = nullptr;
+	mapping = OpenMapping(name, mappingSize, true, &mappingHandle);
+	header = (GridSharedMemory::Header*)mapping;
+
+	if (header) {
+		// Mark the mapping invalid until the header is complete so readers don't attach early
+		header->magic = 0;
+		header->version = GridSharedMemory::Version;
+		header->sizeX = nx;
+		header->sizeY = ny;
+		header->slotCount = slotCount;
+		header->slotStride = (int32_t)(sizeof(GridSharedMemory::SlotHeader) + (size_t)nx * ny * sizeof(std::array<float, 4>));
+		header->framesPublished.store(0, std::memory_order_relaxed);
+		for (int i = 0; i < slotCount; i++) {
+			GridSharedMemory::SlotHeader* slot = (GridSharedMemory::SlotHeader*)(mapping + sizeof(GridSharedMemory::Header) + (size_t)i * header->slotStride);
+			slot->sequence.store(0, std::memory_order_relaxed);
+			slot->frameIndex = -1;
+			slot->publishNumber = 0;
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+		header->magic = GridSharedMemory::Magic;
+	}
+}
+
+GridPublisher::~GridPublisher()
+{
+	if (header) {
+		header->magic = 0;
+	}
+	CloseMapping(mapping, mappingSize, mappingHandle);
+#ifndef _WIN32
+	shm_unlink(("/" + name).c_str());
+#endif
+}
+
+void GridPublisher::Publish(const ConstGridView& grid, int frameIndex)
+{
+	if (!header || grid.GetWidth() != header->sizeX || grid.GetHeight() != header->sizeY) {
+		return;
+	}
+
+	uint64_t publishNumber = header->framesPublished.load(std::memory_order_relaxed);
+	int slotIndex = (int)(publishNumber % header->slotCount);
+	char* slotStart = mapping + sizeof(GridSharedMemory::Header) + (size_t)slotIndex * header->slotStride;
+	GridSharedMemory::SlotHeader* slot = (GridSharedMemory::SlotHeader*)slotStart;
+	std::array<float, 4>* slotData = (std::array<float, 4>*)(slotStart + sizeof(GridSharedMemory::SlotHeader));
+
+	// Odd sequence: the slot is being written
+	uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+	slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot->frameIndex = frameIndex;
+	slot->publishNumber = publishNumber;
+	CopyGridView(grid, GridView(slotData[0].data(), header->sizeX, header->sizeY, (ptrdiff_t)header->sizeX * 4));
+
+	// Even sequence: the slot is complete
+	slot->sequence.store(sequence + 2, std::memory_order_release);
+	header->framesPublished.store(publishNumber + 1, std::memory_order_release);
+}
+
+bool GridPublisher::IsOpen()
+{
+	return header != nullptr;
+}
+
+unsigned long long GridPublisher::GetFramesPublished()
+{
+	return header ? header->framesPublished.load(std::memory_order_relaxed) : 0;
+}
+
+
+
+///////////////////////////           [ SUBSCRIBER ]           ///////////////////////////
+GridSubscriber::GridSubscriber(const std::string& name)
+{
+	tornReads = 0;
+	mappingHandle = nullptr;
+	header = nullptr;
+
+	// Map the header first to find out the size of the whole ring
+	mappingSize = sizeof(GridSharedMemory::Header);
+	mapping = OpenMapping(name, mappingSize, false, &mappingHandle);
+	if (!mapping) {
+		return;
+	}
+	GridSharedMemory::Header* probe = (GridSharedMemory::Header*)mapping;
+	bool valid = probe->magic == GridSharedMemory::Magic && probe->version == GridSharedMemory::Version;
+	size_t fullSize = valid ? GridSharedMemory::MappingSize(probe->sizeX, probe->sizeY, probe->slotCount) : 0;
+	CloseMapping(mapping, mappingSize, mappingHandle);
+	mapping = nullptr;
+	if (!valid) {
+		return;
+	}
+
+	mappingSize = fullSize;
+	mapping = OpenMapping(name, mappingSize, false, &mappingHandle);
+	header = (GridSharedMemory::Header*)mapping;
+}
+
+GridSubscriber::~GridSubscriber()
+{
+	CloseMapping(mapping, mappingSize, mappingHandle);
+}
+
+bool GridSubscriber::IsOpen()
+{
+	return header != nullptr && header->magic == GridSharedMemory::Magic;
+}
+
+int GridSubscriber::GetSizeX()
+{
+	return header ? header->sizeX : 0;
+}
+
+int GridSubscriber::GetSizeY()
+{
+	return header ? header->sizeY : 0;
+}
+
+bool GridSubscriber::BeginRead(SlotRead& read)
+{
+	if (!IsOpen()) {
+		return false;
+	}
+	uint64_t published = header->framesPublished.load(std::memory_order_acquire);
+	if (published == 0) {
+		return false;
+	}
+	read.publishNumber = published - 1;
+	read.slotIndex = (int)(read.publishNumber % header->slotCount);
+	const GridSharedMemory::SlotHeader* slot = (const GridSharedMemory::SlotHeader*)(mapping + sizeof(GridSharedMemory::Header) + (size_t)read.slotIndex * header->slotStride);
+
+	read.sequence = slot->sequence.load(std::memory_order_acquire);
+	if (read.sequence & 1) {
+		// The writer has already wrapped around and is writing this slot
+		tornReads++;
+		return false;
+	}
+	read.frameIndex = slot->frameIndex;
+	return true;
+}
+
+const std::array<float, 4>* GridSubscriber::GetSlotData(const SlotRead& read)
+{
+	return (const std::array<float, 4>*)(mapping + sizeof(GridSharedMemory::Header) + (size_t)read.slotIndex * header->slotStride + sizeof(GridSharedMemory::SlotHeader));
+}
+
+bool GridSubscriber::Validate(const SlotRead& read)
+{
+	const GridSharedMemory::SlotHeader* slot = (const GridSharedMemory::SlotHeader*)(mapping + sizeof(GridSharedMemory::Header) + (size_t)read.slotIndex * header->slotStride);
+
+	// The reads of the data must be done before the sequence is checked again
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+	if (sequence != read.sequence || slot->publishNumber != read.publishNumber) {
+		// The slot changed while it was being read
+		tornReads++;
+		return false;
+	}
+	return true;
+}
+
+bool GridSubscriber::ReadLatest(std::vector<std::array<float, 4>>& output, int& frameIndex, int maxRetries)
+{
+	if (!IsOpen()) {
+		return false;
+	}
+	output.resize((size_t)header->sizeX * header->sizeY);
+
+	for (int attempt = 0; attempt <= maxRetries; attempt++) {
+		SlotRead read;
+		if (!BeginRead(read)) {
+			if (header->framesPublished.load(std::memory_order_relaxed) == 0) {
+				return false;
+			}
+			continue;
+		}
+		std::memcpy(output.data(), GetSlotData(read), output.size() * sizeof(std::array<float, 4>));
+		if (!Validate(read)) {
+			continue;
+		}
+		frameIndex = read.frameIndex;
+		return true;
+	}
+	return false;
+}
+
+unsigned long long GridSubscriber::GetTornReads()
+{
+	return tornReads;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include "SimulationGrid2D.h"
+
+// Publishes completed simulation grid frames into a named shared-memory ring so that
+// other processes (analysis tools, external viewers) can read the simulation while it
+// runs. Each slot in the ring is versioned seqlock-style: the writer makes the slot's
+// sequence odd while copying and even when done, so readers never block the writer
+// and can detect a frame that was overwritten while they were copying it.
+namespace GridSharedMemory
+{
+	const uint32_t Magic = 0x57415452; // "WATR"
+	const uint32_t Version = 1;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		int32_t sizeX;
+		int32_t sizeY;
+		int32_t slotCount;
+		int32_t slotStride;                  // bytes between slots, including the slot header
+		std::atomic<uint64_t> framesPublished; // total frames published, the newest is in slot (framesPublished - 1) % slotCount
+		char padding[32];
+	};
+
+	struct SlotHeader
+	{
+		std::atomic<uint32_t> sequence; // odd while the writer is copying into the slot
+		int32_t frameIndex;
+		uint64_t publishNumber;         // which publication this slot holds
+		char padding[48];
+	};
+
+	// Total size of the mapping for a given grid size and slot count
+	size_t MappingSize(int nx, int ny, int slotCount);
+}
+
+
+// Writer side, owned by the simulation
+class GridPublisher
+{
+
+public:
+
+	GridPublisher(const std::string& name, int nx, int ny, int slotCount);
+	~GridPublisher();
+
+	// Copy the grid into the next slot in the ring
+	void Publish(const ConstGridView& grid, int frameIndex);
+
+	bool IsOpen();
+	unsigned long long GetFramesPublished();
+
+private:
+
+	GridSharedMemory::Header* header;
+	char* mapping;
+	size_t mappingSize;
+	void* mappingHandle;
+	std::string name;
+
+};
+
+
+// Reader side, used by external consumers. Reads are zero-copy through BeginRead, GetSlotData
+// and Validate, or copying through ReadLatest, and never block the publisher.
+class GridSubscriber
+{
+
+public:
+
+	// A frame being read in place, as found by BeginRead
+	struct SlotRead
+	{
+		int slotIndex;
+		int frameIndex;
+		uint32_t sequence;
+		uint64_t publishNumber;
+	};
+
+	GridSubscriber(const std::string& name);
+	~GridSubscriber();
+
+	bool IsOpen();
+	int GetSizeX();
+	int GetSizeY();
+
+	// Find the newest complete frame. Returns false if nothing has been published yet or the
+	// writer is already overwriting the newest slot.
+	bool BeginRead(SlotRead& read);
+
+	// Nodes of the frame, row after row, straight from the shared mapping
+	const std::array<float, 4>* GetSlotData(const SlotRead& read);
+
+	// True if the slot still holds the frame BeginRead found, so whatever was read from
+	// GetSlotData in between is consistent. Call it after reading, not before.
+	bool Validate(const SlotRead& read);
+
+	// Copy the newest complete frame into the output, retrying if the frame is torn by
+	// the writer during the copy. Returns false if no consistent frame could be read.
+	bool ReadLatest(std::vector<std::array<float, 4>>& output, int& frameIndex, int maxRetries = 4);
+
+	// Number of reads that were detected as torn and discarded
+	unsigned long long GetTornReads();
+
+private:
+
+	GridSharedMemory::Header* header;
+	char* mapping;
+	size_t mappingSize;
+	void* mappingHandle;
+	unsigned long long tornReads;
+
+};
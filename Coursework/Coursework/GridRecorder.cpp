@@ -0,0 +1,228 @@
+#include "GridRecorder.h"
+#include <chrono>
+#include <algorithm>
+
+GridRecorder::GridRecorder(const std::string& filename, int nx, int ny, int bufferCount, BackpressurePolicy policy_)
+{
+	sizeX = nx;
+	sizeY = ny;
+	policy = policy_;
+	decimationStride = 1;
+	decimationCounter = 0;
+	stopWriter = false;
+	writesInFlight = 0;
+
+	framesWritten = 0;
+	framesDropped = 0;
+	maxQueueDepth = 0;
+	totalLatency = 0;
+	maxLatency = 0;
+
+	// Pre-allocate every frame buffer so that recording never allocates in the frame loop
+	bufferCount = std::max(bufferCount, 2);
+	buffers.resize(bufferCount);
+	for (int i = 0; i < bufferCount; i++) {
+		buffers[i].data.resize(sizeX * sizeY);
+		freeBuffers.push_back(i);
+	}
+
+	// The file starts with the grid size, followed by one record per frame
+	file.open(filename, std::ios::binary | std::ios::trunc);
+	if (file.is_open()) {
+		file.write((const char*)&sizeX, sizeof(int));
+		file.write((const char*)&sizeY, sizeof(int));
+	}
+
+	writer = std::thread(&GridRecorder::WriterLoop, this);
+}
+
+GridRecorder::~GridRecorder()
+{
+	// Let the writer drain the queue before closing the file
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopWriter = true;
+	}
+	frameQueued.notify_all();
+	if (writer.joinable()) {
+		writer.join();
+	}
+	file.close();
+}
+
+long long GridRecorder::Now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool GridRecorder::Submit(const ConstGridView& grid, int frameIndex)
+{
+	if (grid.GetWidth() != sizeX || grid.GetHeight() != sizeY) {
+		return false;
+	}
+
+	int bufferIndex;
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+
+		if (policy == Decimate) {
+			// Only every Nth frame is considered, N grows while the writer falls behind
+			if (decimationCounter++ % decimationStride != 0) {
+				framesDropped++;
+				return false;
+			}
+		}
+
+		if (freeBuffers.empty()) {
+			if (policy == Block) {
+				bufferFreed.wait(lock, [this] { return !freeBuffers.empty(); });
+			}
+			else {
+				if (policy == Decimate) {
+					decimationStride = std::min(decimationStride * 2, 64);
+				}
+				framesDropped++;
+				return false;
+			}
+		}
+		else if (policy == Decimate && freeBuffers.size() * 2 > buffers.size() && decimationStride > 1) {
+			// The writer has caught up, so record more frames again
+			decimationStride /= 2;
+		}
+
+		bufferIndex = freeBuffers.front();
+		freeBuffers.pop_front();
+	}
+
+	// Copy the grid rows into the buffer outside the lock, the writer never touches a buffer that isn't queued
+	FrameBuffer& buffer = buffers[bufferIndex];
+	buffer.frameIndex = frameIndex;
+	buffer.submitTime = Now();
+	CopyGridView(grid, GridView(buffer.data[0].data(), sizeX, sizeY, (ptrdiff_t)sizeX * 4));
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		writeQueue.push_back(bufferIndex);
+		int depth = (int)writeQueue.size();
+		if (depth > maxQueueDepth) {
+			maxQueueDepth = depth;
+		}
+	}
+	frameQueued.notify_one();
+	return true;
+}
+
+void GridRecorder::Flush()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	bufferFreed.wait(lock, [this] { return writeQueue.empty() && writesInFlight == 0; });
+
+	// The writer cannot take another frame while the lock is held, so the file is not in use
+	if (file.is_open()) {
+		file.flush();
+	}
+}
+
+void GridRecorder::WriterLoop()
+{
+	while (true) {
+		int bufferIndex;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			frameQueued.wait(lock, [this] { return stopWriter || !writeQueue.empty(); });
+			if (writeQueue.empty()) {
+				// Only reached once stopping and everything has been written
+				return;
+			}
+			bufferIndex = writeQueue.front();
+			writeQueue.pop_front();
+			writesInFlight++;
+		}
+
+		// Write the frame record: frame index followed by the grid values
+		FrameBuffer& buffer = buffers[bufferIndex];
+		if (file.is_open()) {
+			file.write((const char*)&buffer.frameIndex, sizeof(int));
+			file.write((const char*)buffer.data.data(), buffer.data.size() * sizeof(std::array<float, 4>));
+		}
+
+		long long latency = Now() - buffer.submitTime;
+		totalLatency += latency;
+		if (latency > maxLatency) {
+			maxLatency = latency;
+		}
+		framesWritten++;
+
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			freeBuffers.push_back(bufferIndex);
+			writesInFlight--;
+		}
+		bufferFreed.notify_all();
+	}
+}
+
+void GridRecorder::SetPolicy(BackpressurePolicy newPolicy)
+{
+	std::lock_guard<std::mutex> lock(queueMutex);
+	policy = newPolicy;
+	decimationStride = 1;
+	decimationCounter = 0;
+}
+
+GridRecorder::BackpressurePolicy GridRecorder::GetPolicy()
+{
+	std::lock_guard<std::mutex> lock(queueMutex);
+	return policy;
+}
+
+bool GridRecorder::IsOpen()
+{
+	return file.is_open();
+}
+
+int GridRecorder::GetQueueDepth()
+{
+	std::lock_guard<std::mutex> lock(queueMutex);
+	return (int)writeQueue.size() + writesInFlight;
+}
+
+int GridRecorder::GetMaxQueueDepth()
+{
+	return maxQueueDepth;
+}
+
+int GridRecorder::GetBufferCount()
+{
+	return (int)buffers.size();
+}
+
+int GridRecorder::GetFramesWritten()
+{
+	return framesWritten;
+}
+
+int GridRecorder::GetFramesDropped()
+{
+	return framesDropped;
+}
+
+int GridRecorder::GetDecimationStride()
+{
+	std::lock_guard<std::mutex> lock(queueMutex);
+	return decimationStride;
+}
+
+float GridRecorder::GetAverageWriteLatency()
+{
+	int written = framesWritten;
+	if (written == 0) {
+		return 0.0f;
+	}
+	return (float)totalLatency / written / 1000.0f;
+}
+
+float GridRecorder::GetMaxWriteLatency()
+{
+	return (float)maxLatency / 1000.0f;
+}
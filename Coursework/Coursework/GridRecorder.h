@@ -0,0 +1,93 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "SimulationGrid2D.h"
+
+// Records simulation grid frames to disk on a background thread so the frame loop
+// never waits on file I/O. Frames are copied into a fixed pool of pre-allocated
+// buffers which are handed to the writer thread through a bounded queue.
+class GridRecorder
+{
+
+public:
+
+	// What to do when every buffer in the pool is waiting to be written
+	enum BackpressurePolicy
+	{
+		Block = 0,   // wait for the writer to free a buffer
+		Drop = 1,    // discard the new frame
+		Decimate = 2 // keep only every Nth frame, N doubling while the queue stays full
+	};
+
+	GridRecorder(const std::string& filename, int nx, int ny, int bufferCount, BackpressurePolicy policy);
+	~GridRecorder();
+
+	// Copy the grid into a free buffer and queue it for writing, returns false if the frame was not queued.
+	// The view can point at a grid or straight at a mapped readback texture.
+	bool Submit(const ConstGridView& grid, int frameIndex);
+
+	// Wait until every queued frame has been written and flush the file. Frames are otherwise
+	// left to the stream's buffer until it fills or the recorder is destroyed.
+	void Flush();
+
+	void SetPolicy(BackpressurePolicy newPolicy);
+	BackpressurePolicy GetPolicy();
+
+	// Counters for the recording pipeline:
+	bool IsOpen();
+	int GetQueueDepth();
+	int GetMaxQueueDepth();
+	int GetBufferCount();
+	int GetFramesWritten();
+	int GetFramesDropped();
+	int GetDecimationStride();
+	float GetAverageWriteLatency(); // milliseconds from submission to the frame being written to the file
+	float GetMaxWriteLatency();
+
+private:
+
+	struct FrameBuffer
+	{
+		int frameIndex;
+		long long submitTime; // steady clock ticks in microseconds
+		std::vector<std::array<float, 4>> data;
+	};
+
+	void WriterLoop();
+	long long Now();
+
+	std::ofstream file;
+	int sizeX;
+	int sizeY;
+
+	// Buffer pool, buffers move between the free list and the write queue by index
+	std::vector<FrameBuffer> buffers;
+	std::deque<int> freeBuffers;
+	std::deque<int> writeQueue;
+
+	std::mutex queueMutex;
+	std::condition_variable bufferFreed;
+	std::condition_variable frameQueued;
+	std::thread writer;
+	bool stopWriter;
+	int writesInFlight;
+
+	BackpressurePolicy policy;
+	int decimationStride;
+	int decimationCounter;
+
+	// Statistics, updated by the writer thread
+	std::atomic<int> framesWritten;
+	std::atomic<int> framesDropped;
+	std::atomic<int> maxQueueDepth;
+	std::atomic<long long> totalLatency;
+	std::atomic<long long> maxLatency;
+
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <algorithm>
+
+// Axis aligned rectangle of grid nodes, [x0, x1) by [y0, y1)
+struct GridRect
+{
+	int x0 = 0;
+	int y0 = 0;
+	int x1 = 0;
+	int y1 = 0;
+
+	int Width() const { return x1 - x0; }
+	int Height() const { return y1 - y0; }
+	long long Area() const { return Empty() ? 0 : (long long)Width() * Height(); }
+	bool Empty() const { return x1 <= x0 || y1 <= y0; }
+
+	bool Overlaps(const GridRect& other) const
+	{
+		return x0 < other.x1 && other.x0 < x1 && y0 < other.y1 && other.y0 < y1;
+	}
+
+	GridRect Union(const GridRect& other) const
+	{
+		GridRect result;
+		result.x0 = std::min(x0, other.x0);
+		result.y0 = std::min(y0, other.y0);
+		result.x1 = std::max(x1, other.x1);
+		result.y1 = std::max(y1, other.y1);
+		return result;
+	}
+
+	// Clamp to a grid of the given size
+	GridRect Clip(int sizeX, int sizeY) const
+	{
+		GridRect result;
+		result.x0 = std::max(x0, 0);
+		result.y0 = std::max(y0, 0);
+		result.x1 = std::min(x1, sizeX);
+		result.y1 = std::min(y1, sizeY);
+		return result;
+	}
+};
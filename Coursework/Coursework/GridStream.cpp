@@ -0,0 +1,786 @@
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef int socklen_t;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+#include "GridStream.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+	const intptr_t NoSocket = (intptr_t)INVALID_SOCKET;
+
+	// A viewer that goes away must not raise SIGPIPE in the sender, which would end the process
+#ifdef MSG_NOSIGNAL
+	const int SendFlags = MSG_NOSIGNAL;
+#else
+	const int SendFlags = 0;
+#endif
+
+	// How long a client tries to reach the server before giving up
+	const int ConnectTimeoutMs = 5000;
+
+	void StartSockets()
+	{
+#ifdef _WIN32
+		WSADATA wsaData;
+		WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+	}
+
+	void StopSockets()
+	{
+#ifdef _WIN32
+		WSACleanup();
+#endif
+	}
+
+	// Wait up to timeout for a socket to become readable, so blocking threads can notice when to stop
+	bool WaitReadable(intptr_t s, int timeoutMs)
+	{
+#ifdef _WIN32
+		fd_set readSet;
+		FD_ZERO(&readSet);
+		FD_SET((SOCKET)s, &readSet);
+		timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+		return select(0, &readSet, nullptr, nullptr, &timeout) > 0;
+#else
+		pollfd descriptor = { (int)s, POLLIN, 0 };
+		return poll(&descriptor, 1, timeoutMs) > 0;
+#endif
+	}
+
+	void SetNonBlocking(intptr_t s, bool nonBlocking)
+	{
+#ifdef _WIN32
+		u_long mode = nonBlocking ? 1 : 0;
+		ioctlsocket((SOCKET)s, FIONBIO, &mode);
+#else
+		int flags = fcntl((int)s, F_GETFL, 0);
+		fcntl((int)s, F_SETFL, nonBlocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK);
+#endif
+	}
+
+	// Whether a non-blocking connect that did not succeed at once is still under way
+	bool ConnectPending()
+	{
+#ifdef _WIN32
+		return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+		return errno == EINPROGRESS;
+#endif
+	}
+
+	// Wait up to timeout for a non-blocking connect to finish: 1 once connected, -1 if it
+	// failed and 0 while it is still under way
+	int WaitConnected(intptr_t s, int timeoutMs)
+	{
+#ifdef _WIN32
+		fd_set writeSet;
+		fd_set errorSet;
+		FD_ZERO(&writeSet);
+		FD_ZERO(&errorSet);
+		FD_SET((SOCKET)s, &writeSet);
+		FD_SET((SOCKET)s, &errorSet);
+		timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+		if (select(0, nullptr, &writeSet, &errorSet, &timeout) <= 0) {
+			return 0;
+		}
+		if (FD_ISSET((SOCKET)s, &errorSet)) {
+			return -1;
+		}
+#else
+		pollfd descriptor = { (int)s, POLLOUT, 0 };
+		if (poll(&descriptor, 1, timeoutMs) <= 0) {
+			return 0;
+		}
+#endif
+		int error = 0;
+		socklen_t length = sizeof(error);
+		getsockopt(s, SOL_SOCKET, SO_ERROR, (char*)&error, &length);
+		return error == 0 ? 1 : -1;
+	}
+
+	void WriteVarint(uint32_t value, std::vector<uint8_t>& output)
+	{
+		while (value >= 0x80) {
+			output.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		output.push_back((uint8_t)value);
+	}
+
+	bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 35; shift += 7) {
+			if (data >= end) {
+				return false;
+			}
+			uint8_t byte = *data++;
+			value |= (uint32_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+uint64_t GridStreamProtocol::Now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void GridStreamProtocol::EncodeTile(const int32_t* current, const int32_t* previous, int count, std::vector<uint8_t>& output)
+{
+	// Each delta is zigzag coded so small negative changes stay small. A zero is always
+	// followed by the length of the run of zeros it starts, which covers calm water.
+	int i = 0;
+	while (i < count) {
+		int32_t delta = current[i] - previous[i];
+		if (delta == 0) {
+			int run = 1;
+			while (i + run < count && current[i + run] == previous[i + run]) {
+				run++;
+			}
+			WriteVarint(0, output);
+			WriteVarint((uint32_t)run, output);
+			i += run;
+		}
+		else {
+			WriteVarint(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31), output);
+			i++;
+		}
+	}
+}
+
+bool GridStreamProtocol::DecodeTile(const uint8_t* data, uint32_t size, int32_t* values, int count)
+{
+	const uint8_t* end = data + size;
+	int i = 0;
+	while (i < count) {
+		uint32_t code;
+		if (!ReadVarint(data, end, code)) {
+			return false;
+		}
+		if (code == 0) {
+			uint32_t run;
+			if (!ReadVarint(data, end, run) || run == 0 || i + (int)run > count) {
+				return false;
+			}
+			i += run;
+		}
+		else {
+			int32_t delta = (int32_t)(code >> 1) ^ -(int32_t)(code & 1);
+			// Wraps rather than overflows on malformed data
+			values[i] = (int32_t)((uint32_t)values[i] + (uint32_t)delta);
+			i++;
+		}
+	}
+	return data == end;
+}
+
+bool GridStreamProtocol::ValidHeader(const FrameHeader& header)
+{
+	if (header.magic != Magic || header.level < 0 || header.level > MaxLevel) {
+		return false;
+	}
+	if (header.fullSizeX < 1 || header.fullSizeY < 1 || header.fullSizeX > MaxGridSize || header.fullSizeY > MaxGridSize) {
+		return false;
+	}
+	int factor = 1 << header.level;
+	if (header.sizeX != (header.fullSizeX + factor - 1) / factor || header.sizeY != (header.fullSizeY + factor - 1) / factor) {
+		return false;
+	}
+
+	// A value codes to at most five bytes, a 31 bit zigzag delta
+	long long tiles = (long long)((header.sizeX + TileSize - 1) / TileSize) * ((header.sizeY + TileSize - 1) / TileSize);
+	long long maxPayload = (long long)header.sizeX * header.sizeY * 5 + tiles * (long long)sizeof(TileHeader);
+	return header.tileCount >= 0 && header.tileCount <= tiles && (long long)header.payloadBytes <= maxPayload;
+}
+
+
+
+///////////////////////////           [ SERVER ]           ///////////////////////////
+GridStreamServer::GridStreamServer(int port, int nx, int ny)
+{
+	sizeX = nx;
+	sizeY = ny;
+	clientSocket = NoSocket;
+	clientConnected = false;
+	hasPending = false;
+	pendingFrame = 0;
+	needKeyframe = true;
+	stopSender = false;
+	byteBudget = 256 * 1024;
+	level = 0;
+	framesUnderBudget = 0;
+	skippedAtLastSend = 0;
+	throughput = 0.0f;
+	submitInterval = 0.0f;
+	lastSubmit = std::chrono::steady_clock::now();
+	lastFrameBytes = 0;
+	totalBytes = 0;
+	framesSent = 0;
+	framesSkipped = 0;
+
+	pendingHeights.resize(sizeX * sizeY);
+	currentHeights.resize(sizeX * sizeY);
+
+	StartSockets();
+	listenSocket = (intptr_t)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listenSocket != NoSocket) {
+		int reuse = 1;
+		setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+		sockaddr_in address;
+		std::memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons((unsigned short)port);
+		if (bind(listenSocket, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenSocket, 1) != 0) {
+			closesocket(listenSocket);
+			listenSocket = NoSocket;
+		}
+	}
+
+	sender = std::thread(&GridStreamServer::SenderLoop, this);
+}
+
+GridStreamServer::~GridStreamServer()
+{
+	stopSender = true;
+	frameReady.notify_all();
+	if (sender.joinable()) {
+		sender.join();
+	}
+	if (clientSocket != NoSocket) {
+		closesocket(clientSocket);
+	}
+	if (listenSocket != NoSocket) {
+		closesocket(listenSocket);
+	}
+	StopSockets();
+}
+
+void GridStreamServer::Submit(const ConstGridView& grid, int frameIndex)
+{
+	if (grid.GetWidth() != sizeX || grid.GetHeight() != sizeY || !clientConnected) {
+		return;
+	}
+
+	// Quantize the heights straight into the mailbox, millimetres cover any height the app can make
+	{
+		std::lock_guard<std::mutex> lock(mailboxMutex);
+		if (hasPending) {
+			framesSkipped++;
+		}
+		auto now = std::chrono::steady_clock::now();
+		float interval = std::chrono::duration<float>(now - lastSubmit).count();
+		submitInterval = submitInterval > 0.0f ? 0.9f * submitInterval + 0.1f * interval : interval;
+		lastSubmit = now;
+		for (int y = 0; y < sizeY; y++) {
+			for (int x = 0; x < sizeX; x++) {
+				float steps = std::round(grid.At(x, y, SimulationGrid2D::Height) / GridStreamProtocol::QuantStep);
+				pendingHeights[y * sizeX + x] = (int32_t)std::max(-(float)GridStreamProtocol::MaxQuantized, std::min((float)GridStreamProtocol::MaxQuantized, steps));
+			}
+		}
+		pendingFrame = frameIndex;
+		hasPending = true;
+	}
+	frameReady.notify_one();
+}
+
+bool GridStreamServer::AcceptClient()
+{
+	if (listenSocket == NoSocket || !WaitReadable(listenSocket, 100)) {
+		return false;
+	}
+	intptr_t accepted = (intptr_t)accept(listenSocket, nullptr, nullptr);
+	if (accepted == NoSocket) {
+		return false;
+	}
+	int noDelay = 1;
+	setsockopt(accepted, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+#ifdef SO_NOSIGPIPE
+	int noSigPipe = 1;
+	setsockopt(accepted, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&noSigPipe, sizeof(noSigPipe));
+#endif
+	clientSocket = accepted;
+	clientConnected = true;
+	needKeyframe = true;
+	return true;
+}
+
+bool GridStreamServer::SendAll(const void* data, size_t size)
+{
+	const char* bytes = (const char*)data;
+	while (size > 0) {
+		int sent = send(clientSocket, bytes, (int)std::min(size, (size_t)1 << 20), SendFlags);
+		if (sent <= 0) {
+			return false;
+		}
+		bytes += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+void GridStreamServer::Downsample(const std::vector<int32_t>& source, std::vector<int32_t>& output, int lvl, int& outSizeX, int& outSizeY)
+{
+	// Box filter each 2^level square of cells into one
+	int factor = 1 << lvl;
+	outSizeX = (sizeX + factor - 1) / factor;
+	outSizeY = (sizeY + factor - 1) / factor;
+	output.resize(outSizeX * outSizeY);
+	for (int y = 0; y < outSizeY; y++) {
+		for (int x = 0; x < outSizeX; x++) {
+			long long sum = 0;
+			int count = 0;
+			for (int j = y * factor; j < std::min((y + 1) * factor, sizeY); j++) {
+				for (int i = x * factor; i < std::min((x + 1) * factor, sizeX); i++) {
+					sum += source[j * sizeX + i];
+					count++;
+				}
+			}
+			output[y * outSizeX + x] = (int32_t)(sum / count);
+		}
+	}
+}
+
+void GridStreamServer::SenderLoop()
+{
+	using namespace GridStreamProtocol;
+	std::vector<int32_t> tileCurrent(TileSize * TileSize);
+	std::vector<int32_t> tilePrevious(TileSize * TileSize);
+
+	while (!stopSender) {
+		if (clientSocket == NoSocket) {
+			AcceptClient();
+			continue;
+		}
+
+		// Take the newest frame out of the mailbox
+		int frameIndex;
+		float frameInterval;
+		{
+			std::unique_lock<std::mutex> lock(mailboxMutex);
+			frameReady.wait_for(lock, std::chrono::milliseconds(100), [this] { return hasPending || stopSender; });
+			if (!hasPending) {
+				continue;
+			}
+			currentHeights.swap(pendingHeights);
+			frameIndex = pendingFrame;
+			frameInterval = submitInterval;
+			hasPending = false;
+		}
+
+		int currentLevel = level;
+		int streamSizeX;
+		int streamSizeY;
+		Downsample(currentHeights, levelHeights, currentLevel, streamSizeX, streamSizeY);
+		if (needKeyframe || sentHeights.size() != levelHeights.size()) {
+			sentHeights.assign(levelHeights.size(), 0);
+			needKeyframe = true;
+		}
+
+		// Encode every tile that changed since the last frame sent
+		packet.resize(sizeof(FrameHeader));
+		int tileCount = 0;
+		for (int ty = 0; ty * TileSize < streamSizeY; ty++) {
+			for (int tx = 0; tx * TileSize < streamSizeX; tx++) {
+				int width = std::min(TileSize, streamSizeX - tx * TileSize);
+				int height = std::min(TileSize, streamSizeY - ty * TileSize);
+				bool changed = false;
+				for (int j = 0; j < height; j++) {
+					const int32_t* currentRow = &levelHeights[(ty * TileSize + j) * streamSizeX + tx * TileSize];
+					const int32_t* previousRow = &sentHeights[(ty * TileSize + j) * streamSizeX + tx * TileSize];
+					std::copy(currentRow, currentRow + width, tileCurrent.begin() + j * width);
+					std::copy(previousRow, previousRow + width, tilePrevious.begin() + j * width);
+					changed = changed || !std::equal(currentRow, currentRow + width, previousRow);
+				}
+				if (!changed && !needKeyframe) {
+					continue;
+				}
+
+				tileBytes.clear();
+				EncodeTile(tileCurrent.data(), tilePrevious.data(), width * height, tileBytes);
+				TileHeader tileHeader = { (uint16_t)tx, (uint16_t)ty, (uint32_t)tileBytes.size() };
+				const uint8_t* headerBytes = (const uint8_t*)&tileHeader;
+				packet.insert(packet.end(), headerBytes, headerBytes + sizeof(TileHeader));
+				packet.insert(packet.end(), tileBytes.begin(), tileBytes.end());
+				tileCount++;
+			}
+		}
+
+		FrameHeader header;
+		header.magic = Magic;
+		header.frameIndex = frameIndex;
+		header.fullSizeX = sizeX;
+		header.fullSizeY = sizeY;
+		header.sizeX = streamSizeX;
+		header.sizeY = streamSizeY;
+		header.level = currentLevel;
+		header.keyframe = needKeyframe ? 1 : 0;
+		header.tileCount = tileCount;
+		header.payloadBytes = (uint32_t)(packet.size() - sizeof(FrameHeader));
+		header.sendTime = Now();
+		std::memcpy(packet.data(), &header, sizeof(FrameHeader));
+
+		auto sendStart = std::chrono::steady_clock::now();
+		bool sent = SendAll(packet.data(), packet.size());
+		float sendTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - sendStart).count();
+		if (!sent) {
+			// The viewer went away, wait for the next one
+			closesocket(clientSocket);
+			clientSocket = NoSocket;
+			clientConnected = false;
+			continue;
+		}
+		sentHeights.swap(levelHeights);
+		needKeyframe = false;
+
+		lastFrameBytes = (int)packet.size();
+		totalBytes += packet.size();
+		framesSent++;
+
+		// The send only takes long once the socket buffer is full, so its rate is what the
+		// connection carries. Frames submitted while this one was being sent were skipped.
+		if (sendTime > 0.0f) {
+			float rate = packet.size() / sendTime;
+			throughput = throughput > 0.0f ? 0.8f * throughput + 0.2f * rate : rate;
+		}
+		int skipped = framesSkipped - skippedAtLastSend;
+		skippedAtLastSend = framesSkipped;
+		bool behind = skipped > 0 || (frameInterval > 0.0f && sendTime > frameInterval);
+
+		// Drop a level as soon as the connection falls behind or a frame is over budget. Go back
+		// up only after a run of frames on time, when a frame at the finer level, about four
+		// times the size, would still fit the budget and go out within the frame interval.
+		long long finerBytes = 4 * (long long)packet.size();
+		bool finerFits = finerBytes < byteBudget && (frameInterval <= 0.0f || finerBytes < 0.5f * throughput * frameInterval);
+		if ((behind || (int)packet.size() > byteBudget) && currentLevel < MaxLevel) {
+			level = currentLevel + 1;
+			framesUnderBudget = 0;
+		}
+		else if (!behind && finerFits && currentLevel > 0) {
+			if (++framesUnderBudget >= 60) {
+				level = currentLevel - 1;
+				framesUnderBudget = 0;
+			}
+		}
+		else {
+			framesUnderBudget = 0;
+		}
+	}
+}
+
+void GridStreamServer::SetByteBudget(int bytesPerFrame)
+{
+	byteBudget = bytesPerFrame;
+}
+
+bool GridStreamServer::IsListening()
+{
+	return listenSocket != NoSocket;
+}
+
+bool GridStreamServer::HasClient()
+{
+	return clientConnected;
+}
+
+int GridStreamServer::GetLevel()
+{
+	return level;
+}
+
+int GridStreamServer::GetLastFrameBytes()
+{
+	return lastFrameBytes;
+}
+
+float GridStreamServer::GetAverageFrameBytes()
+{
+	int sent = framesSent;
+	return sent > 0 ? (float)totalBytes / sent : 0.0f;
+}
+
+int GridStreamServer::GetFramesSent()
+{
+	return framesSent;
+}
+
+int GridStreamServer::GetFramesSkipped()
+{
+	return framesSkipped;
+}
+
+float GridStreamServer::GetThroughput()
+{
+	return throughput;
+}
+
+
+
+///////////////////////////           [ CLIENT ]           ///////////////////////////
+GridStreamClient::GridStreamClient(const std::string& host_, int port_)
+{
+	host = host_;
+	port = port_;
+	fullSizeX = 0;
+	fullSizeY = 0;
+	streamSizeX = 0;
+	streamSizeY = 0;
+	streamLevel = 0;
+	latestFrame = -1;
+	newFrame = false;
+	stopReceiver = false;
+	connecting = true;
+	connected = false;
+	lastFrameBytes = 0;
+	framesReceived = 0;
+	totalLatency = 0;
+
+	StartSockets();
+	socketHandle = NoSocket;
+
+	// Connecting can take seconds when the host does not answer, so it is not done on the
+	// caller's thread, which is the GUI's
+	receiver = std::thread(&GridStreamClient::ReceiveLoop, this);
+}
+
+GridStreamClient::~GridStreamClient()
+{
+	stopReceiver = true;
+	if (receiver.joinable()) {
+		receiver.join();
+	}
+	if (socketHandle != NoSocket) {
+		closesocket(socketHandle);
+	}
+	StopSockets();
+}
+
+bool GridStreamClient::Connect()
+{
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* result = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+		return false;
+	}
+	socketHandle = (intptr_t)socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	bool success = false;
+	if (socketHandle != NoSocket) {
+		// Connect without blocking and wait in short steps, so the client can be destroyed
+		// while the connection is still being made
+		SetNonBlocking(socketHandle, true);
+		if (connect(socketHandle, result->ai_addr, (socklen_t)result->ai_addrlen) == 0) {
+			success = true;
+		}
+		else if (ConnectPending()) {
+			for (int waited = 0; waited < ConnectTimeoutMs && !stopReceiver; waited += 100) {
+				int state = WaitConnected(socketHandle, 100);
+				if (state != 0) {
+					success = state > 0;
+					break;
+				}
+			}
+		}
+		SetNonBlocking(socketHandle, false);
+	}
+	freeaddrinfo(result);
+	return success;
+}
+
+bool GridStreamClient::ReceiveAll(void* data, size_t size)
+{
+	char* bytes = (char*)data;
+	while (size > 0) {
+		if (!WaitReadable(socketHandle, 100)) {
+			if (stopReceiver) {
+				return false;
+			}
+			continue;
+		}
+		int received = recv(socketHandle, bytes, (int)std::min(size, (size_t)1 << 20), 0);
+		if (received <= 0) {
+			return false;
+		}
+		bytes += received;
+		size -= received;
+	}
+	return true;
+}
+
+void GridStreamClient::ReceiveLoop()
+{
+	using namespace GridStreamProtocol;
+	std::vector<uint8_t> payload;
+	std::vector<int32_t> frame;
+	std::vector<int32_t> tile(TileSize * TileSize);
+
+	connected = Connect();
+	connecting = false;
+
+	while (connected && !stopReceiver) {
+		FrameHeader header;
+		if (!ReceiveAll(&header, sizeof(header)) || !ValidHeader(header)) {
+			break;
+		}
+		payload.resize(header.payloadBytes);
+		if (!ReceiveAll(payload.data(), payload.size())) {
+			break;
+		}
+
+		// Keyframes and resolution changes start from a zero baseline
+		if (header.keyframe || (int)frame.size() != header.sizeX * header.sizeY) {
+			frame.assign(header.sizeX * header.sizeY, 0);
+		}
+
+		const uint8_t* data = payload.data();
+		const uint8_t* end = data + payload.size();
+		bool valid = true;
+		for (int t = 0; t < header.tileCount && valid; t++) {
+			TileHeader tileHeader;
+			if (end - data < (long)sizeof(TileHeader)) {
+				valid = false;
+				break;
+			}
+			std::memcpy(&tileHeader, data, sizeof(TileHeader));
+			data += sizeof(TileHeader);
+			int x0 = tileHeader.tileX * TileSize;
+			int y0 = tileHeader.tileY * TileSize;
+			int width = std::min(TileSize, header.sizeX - x0);
+			int height = std::min(TileSize, header.sizeY - y0);
+			if (width <= 0 || height <= 0 || (uint32_t)(end - data) < tileHeader.encodedBytes) {
+				valid = false;
+				break;
+			}
+
+			for (int j = 0; j < height; j++) {
+				std::copy(&frame[(y0 + j) * header.sizeX + x0], &frame[(y0 + j) * header.sizeX + x0] + width, tile.begin() + j * width);
+			}
+			valid = DecodeTile(data, tileHeader.encodedBytes, tile.data(), width * height);
+			for (int j = 0; j < height; j++) {
+				std::copy(tile.begin() + j * width, tile.begin() + (j + 1) * width, &frame[(y0 + j) * header.sizeX + x0]);
+			}
+			data += tileHeader.encodedBytes;
+		}
+		if (!valid) {
+			break;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(frameMutex);
+			heights = frame;
+			fullSizeX = header.fullSizeX;
+			fullSizeY = header.fullSizeY;
+			streamSizeX = header.sizeX;
+			streamSizeY = header.sizeY;
+			streamLevel = header.level;
+			latestFrame = header.frameIndex;
+			newFrame = true;
+		}
+
+		uint64_t now = Now();
+		totalLatency += now > header.sendTime ? (long long)(now - header.sendTime) : 0;
+		lastFrameBytes = (int)(sizeof(header) + payload.size());
+		framesReceived++;
+	}
+	connected = false;
+}
+
+bool GridStreamClient::IsConnecting()
+{
+	return connecting;
+}
+
+bool GridStreamClient::IsConnected()
+{
+	return connected;
+}
+
+bool GridStreamClient::GetLatest(SimulationGrid2D* grid, int& frameIndex)
+{
+	std::lock_guard<std::mutex> lock(frameMutex);
+	if (!newFrame || grid->GetSizeX() != fullSizeX || grid->GetSizeY() != fullSizeY) {
+		return false;
+	}
+
+	// Rebuild the full resolution heights, cells of a downsampled frame cover 2^level cells.
+	// Only tiles whose heights changed are marked dirty, so uploads of the grid stay small.
+	GridView grid2D = grid->GetView();
+	const int tileSize = GridStreamProtocol::TileSize;
+	for (int tileY = 0; tileY < grid->GetSizeY(); tileY += tileSize) {
+		for (int tileX = 0; tileX < grid->GetSizeX(); tileX += tileSize) {
+			GridRect tile = { tileX, tileY, std::min(tileX + tileSize, grid->GetSizeX()), std::min(tileY + tileSize, grid->GetSizeY()) };
+			bool changed = false;
+			for (int y = tile.y0; y < tile.y1; y++) {
+				int sy = std::min(y >> streamLevel, streamSizeY - 1);
+				for (int x = tile.x0; x < tile.x1; x++) {
+					int sx = std::min(x >> streamLevel, streamSizeX - 1);
+					float height = heights[sy * streamSizeX + sx] * GridStreamProtocol::QuantStep;
+					if (grid2D.At(x, y, SimulationGrid2D::Height) != height) {
+						grid2D.At(x, y, SimulationGrid2D::Height) = height;
+						changed = true;
+					}
+				}
+			}
+			if (changed) {
+				grid->MarkDirty(tile);
+			}
+		}
+	}
+	frameIndex = latestFrame;
+	newFrame = false;
+	return true;
+}
+
+int GridStreamClient::GetRemoteSizeX()
+{
+	std::lock_guard<std::mutex> lock(frameMutex);
+	return fullSizeX;
+}
+
+int GridStreamClient::GetRemoteSizeY()
+{
+	std::lock_guard<std::mutex> lock(frameMutex);
+	return fullSizeY;
+}
+
+int GridStreamClient::GetLastFrameBytes()
+{
+	return lastFrameBytes;
+}
+
+float GridStreamClient::GetAverageLatency()
+{
+	int received = framesReceived;
+	return received > 0 ? (float)totalLatency / received / 1000.0f : 0.0f;
+}
+
+int GridStreamClient::GetFramesReceived()
+{
+	return framesReceived;
+}
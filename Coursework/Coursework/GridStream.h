@@ -0,0 +1,194 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "SimulationGrid2D.h"
+
+// Streams the simulation height field over TCP to remote viewers. Heights are quantized
+// to millimetres, split into tiles, and only tiles that changed since the last frame sent are
+// transmitted, delta coded against the previous frame and run-length compressed. When the
+// connection falls behind, or a frame is larger than the byte budget, the grid is downsampled
+// before sending.
+namespace GridStreamProtocol
+{
+	const uint32_t Magic = 0x33574653; // "SFW3"
+	const int TileSize = 32;
+	const float QuantStep = 0.001f;    // metres per quantization step
+	const int32_t MaxQuantized = 1 << 29; // heights are clamped to +-MaxQuantized steps, so deltas fit in 31 bits
+	const int MaxLevel = 3;            // grid is downsampled by 2^level
+	const int MaxGridSize = 8192;      // largest full resolution side a client accepts
+
+	struct FrameHeader
+	{
+		uint32_t magic;
+		int32_t frameIndex;
+		int32_t fullSizeX;      // size of the simulation grid
+		int32_t fullSizeY;
+		int32_t sizeX;          // size of the transmitted (downsampled) grid
+		int32_t sizeY;
+		int32_t level;
+		int32_t keyframe;       // 1 if tiles are coded against zero rather than the previous frame
+		int32_t tileCount;
+		uint32_t payloadBytes;  // bytes of tile data following the header
+		uint64_t sendTime;      // system clock in microseconds, for end-to-end latency
+	};
+
+	struct TileHeader
+	{
+		uint16_t tileX;
+		uint16_t tileY;
+		uint32_t encodedBytes;
+	};
+
+	// Delta code and run-length compress a tile of quantized heights against the previous values
+	void EncodeTile(const int32_t* current, const int32_t* previous, int count, std::vector<uint8_t>& output);
+
+	// Reverse of EncodeTile, applies the decoded deltas to values in place, returns false on malformed data
+	bool DecodeTile(const uint8_t* data, uint32_t size, int32_t* values, int count);
+
+	// Check a header read off the network before anything is allocated from it: sizes within
+	// MaxGridSize and consistent with the level, and no more tiles or payload than such a frame
+	// can encode to
+	bool ValidHeader(const FrameHeader& header);
+
+	uint64_t Now();
+}
+
+
+// Server side, owned by the simulation. Frames are handed over through a single-slot
+// mailbox so the frame loop never waits on the network; a slow client just sees fewer frames.
+class GridStreamServer
+{
+
+public:
+
+	GridStreamServer(int port, int nx, int ny);
+	~GridStreamServer();
+
+	// Queue the heights of this frame for sending, replacing any frame not yet sent
+	void Submit(const ConstGridView& grid, int frameIndex);
+
+	// Upper bound on the size of a frame, whatever the connection could carry
+	void SetByteBudget(int bytesPerFrame);
+
+	bool IsListening();
+	bool HasClient();
+	int GetLevel();
+	int GetLastFrameBytes();
+	float GetAverageFrameBytes();
+	int GetFramesSent();
+	int GetFramesSkipped();
+	float GetThroughput(); // bytes per second the last sends went out at, smoothed
+
+private:
+
+	void SenderLoop();
+	bool AcceptClient();
+	bool SendAll(const void* data, size_t size);
+	void Downsample(const std::vector<int32_t>& source, std::vector<int32_t>& output, int level, int& outSizeX, int& outSizeY);
+
+	int sizeX;
+	int sizeY;
+	intptr_t listenSocket;
+	intptr_t clientSocket;
+	std::atomic<bool> clientConnected;
+
+	// Mailbox holding the newest submitted frame
+	std::vector<int32_t> pendingHeights;
+	int pendingFrame;
+	bool hasPending;
+	std::mutex mailboxMutex;
+	std::condition_variable frameReady;
+
+	// Last frame sent, per tile delta coding is against these values
+	std::vector<int32_t> sentHeights;
+	std::vector<int32_t> currentHeights;
+	std::vector<int32_t> levelHeights;
+	std::vector<uint8_t> packet;
+	std::vector<uint8_t> tileBytes;
+	bool needKeyframe;
+
+	std::thread sender;
+	std::atomic<bool> stopSender;
+
+	// Adaptive resolution. The level follows the frames skipped because the sender was still
+	// busy, and how long the sends take against how often frames are submitted.
+	std::atomic<int> byteBudget;
+	std::atomic<int> level;
+	int framesUnderBudget;
+	int skippedAtLastSend;
+	std::atomic<float> throughput;
+	float submitInterval; // seconds between submitted frames, smoothed, guarded by the mailbox mutex
+	std::chrono::steady_clock::time_point lastSubmit;
+
+	// Statistics
+	std::atomic<int> lastFrameBytes;
+	std::atomic<long long> totalBytes;
+	std::atomic<int> framesSent;
+	std::atomic<int> framesSkipped;
+
+};
+
+
+// Reference client. Connects and receives frames on a background thread and rebuilds the
+// full resolution height field, ready to be copied into a SimulationGrid2D for rendering.
+class GridStreamClient
+{
+
+public:
+
+	// Returns straight away, the connection is made on the receiving thread
+	GridStreamClient(const std::string& host, int port);
+	~GridStreamClient();
+
+	bool IsConnecting();
+	bool IsConnected();
+
+	// Copy the newest reconstructed heights into the grid, returns false if no new frame arrived
+	// since the last call or the grid is not the size the server simulates
+	bool GetLatest(SimulationGrid2D* grid, int& frameIndex);
+
+	// Size of the server's grid, 0 until the first frame arrives
+	int GetRemoteSizeX();
+	int GetRemoteSizeY();
+
+	int GetLastFrameBytes();
+	float GetAverageLatency(); // milliseconds from the server sending a frame to it being rebuilt
+	int GetFramesReceived();
+
+private:
+
+	void ReceiveLoop();
+	bool Connect();
+	bool ReceiveAll(void* data, size_t size);
+
+	std::string host;
+	int port;
+	intptr_t socketHandle;
+	std::thread receiver;
+	std::atomic<bool> stopReceiver;
+	std::atomic<bool> connecting;
+	std::atomic<bool> connected;
+
+	// Reconstructed frame at the transmitted resolution
+	std::vector<int32_t> heights;
+	int fullSizeX;
+	int fullSizeY;
+	int streamSizeX;
+	int streamSizeY;
+	int streamLevel;
+	int latestFrame;
+	bool newFrame;
+	std::mutex frameMutex;
+
+	std::atomic<int> lastFrameBytes;
+	std::atomic<int> framesReceived;
+	std::atomic<long long> totalLatency;
+
+};
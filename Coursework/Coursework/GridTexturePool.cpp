@@ -0,0 +1,403 @@
+#include "GridTexturePool.h"
+#include <algorithm>
+#include <cstring>
+#ifdef _WIN32
+#include <d3d11.h>
+#endif
+
+size_t GridTexture::GetTexelSize(int format)
+{
+	switch (format) {
+	case Snorm16x2: return 2 * sizeof(short);
+	case Unorm8: return 1;
+	default: return sizeof(std::array<float, 4>);
+	}
+}
+
+#ifdef _WIN32
+namespace
+{
+	DXGI_FORMAT GetDxgiFormat(int format)
+	{
+		switch (format) {
+		case GridTexture::Snorm16x2: return DXGI_FORMAT_R16G16_SNORM;
+		case GridTexture::Unorm8: return DXGI_FORMAT_R8_UNORM;
+		default: return DXGI_FORMAT_R32G32B32A32_FLOAT; // R holds height, G holds x flux, B holds y flux
+		}
+	}
+}
+
+D3D11GridTextureDevice::D3D11GridTextureDevice(ID3D11Device* dev, ID3D11DeviceContext* deviceCntxt)
+{
+	device = dev;
+	deviceContext = deviceCntxt;
+}
+
+bool D3D11GridTextureDevice::Create(int width, int height, int format, bool partialUpdates, GridTexture& texture)
+{
+	// Dynamic textures can only be rewritten whole, partial updates need a default texture
+	D3D11_TEXTURE2D_DESC desc2D;
+	desc2D.Width = width;
+	desc2D.Height = height;
+	desc2D.MipLevels = 1;
+	desc2D.ArraySize = 1;
+	desc2D.Format = GetDxgiFormat(format);
+	desc2D.SampleDesc.Count = 1;
+	desc2D.SampleDesc.Quality = 0;
+	desc2D.Usage = partialUpdates ? D3D11_USAGE_DEFAULT : D3D11_USAGE_DYNAMIC;
+	desc2D.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc2D.CPUAccessFlags = partialUpdates ? 0 : D3D11_CPU_ACCESS_WRITE;
+	desc2D.MiscFlags = 0;
+
+	ID3D11Texture2D* texture2D = nullptr;
+	if (FAILED(device->CreateTexture2D(&desc2D, nullptr, &texture2D))) {
+		return false;
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc;
+	SRVDesc.Format = desc2D.Format;
+	SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	SRVDesc.Texture2D.MostDetailedMip = 0;
+	SRVDesc.Texture2D.MipLevels = 1;
+	ID3D11ShaderResourceView* view = nullptr;
+	if (FAILED(device->CreateShaderResourceView(texture2D, &SRVDesc, &view))) {
+		texture2D->Release();
+		return false;
+	}
+
+	texture.width = width;
+	texture.height = height;
+	texture.format = format;
+	texture.partialUpdates = partialUpdates;
+	texture.resource = texture2D;
+	texture.view = view;
+	return true;
+}
+
+void D3D11GridTextureDevice::Destroy(GridTexture& texture)
+{
+	if (texture.view) {
+		((ID3D11ShaderResourceView*)texture.view)->Release();
+		texture.view = nullptr;
+	}
+	if (texture.resource) {
+		((ID3D11Texture2D*)texture.resource)->Release();
+		texture.resource = nullptr;
+	}
+}
+
+void* D3D11GridTextureDevice::Map(GridTexture& texture, size_t& rowPitch)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (FAILED(deviceContext->Map((ID3D11Texture2D*)texture.resource, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource))) {
+		return nullptr;
+	}
+	rowPitch = mappedResource.RowPitch;
+	return mappedResource.pData;
+}
+
+void D3D11GridTextureDevice::Unmap(GridTexture& texture)
+{
+	deviceContext->Unmap((ID3D11Texture2D*)texture.resource, 0);
+}
+
+void D3D11GridTextureDevice::Update(GridTexture& texture, const GridRect& rect, const void* data, size_t rowPitch)
+{
+	D3D11_BOX box = { (UINT)rect.x0, (UINT)rect.y0, 0, (UINT)rect.x1, (UINT)rect.y1, 1 };
+	deviceContext->UpdateSubresource((ID3D11Texture2D*)texture.resource, 0, &box, data, (UINT)rowPitch, 0);
+}
+#endif
+
+
+
+CountingGridTextureDevice::CountingGridTextureDevice(GridTextureDevice* dev)
+{
+	device = dev;
+	createCount = 0;
+	destroyCount = 0;
+	mapCount = 0;
+	updateCount = 0;
+}
+
+CountingGridTextureDevice::~CountingGridTextureDevice()
+{
+}
+
+bool CountingGridTextureDevice::Create(int width, int height, int format, bool partialUpdates, GridTexture& texture)
+{
+	createCount++;
+	if (device) {
+		return device->Create(width, height, format, partialUpdates, texture);
+	}
+
+	// Host memory stand in for the texture
+	texture.width = width;
+	texture.height = height;
+	texture.format = format;
+	texture.partialUpdates = partialUpdates;
+	texture.resource = new std::vector<unsigned char>((size_t)width * height * GridTexture::GetTexelSize(format));
+	texture.view = nullptr;
+	return true;
+}
+
+void CountingGridTextureDevice::Destroy(GridTexture& texture)
+{
+	destroyCount++;
+	if (device) {
+		device->Destroy(texture);
+		return;
+	}
+	delete (std::vector<unsigned char>*)texture.resource;
+	texture.resource = nullptr;
+}
+
+void* CountingGridTextureDevice::Map(GridTexture& texture, size_t& rowPitch)
+{
+	mapCount++;
+	if (device) {
+		return device->Map(texture, rowPitch);
+	}
+	rowPitch = texture.width * GridTexture::GetTexelSize(texture.format);
+	return ((std::vector<unsigned char>*)texture.resource)->data();
+}
+
+void CountingGridTextureDevice::Unmap(GridTexture& texture)
+{
+	if (device) {
+		device->Unmap(texture);
+	}
+}
+
+void CountingGridTextureDevice::Update(GridTexture& texture, const GridRect& rect, const void* data, size_t rowPitch)
+{
+	updateCount++;
+	if (device) {
+		device->Update(texture, rect, data, rowPitch);
+		return;
+	}
+	std::vector<unsigned char>& texels = *(std::vector<unsigned char>*)texture.resource;
+	size_t texelSize = GridTexture::GetTexelSize(texture.format);
+	for (int y = rect.y0; y < rect.y1; y++) {
+		const unsigned char* row = (const unsigned char*)data + (y - rect.y0) * rowPitch;
+		std::memcpy(&texels[((size_t)y * texture.width + rect.x0) * texelSize], row, rect.Width() * texelSize);
+	}
+}
+
+int CountingGridTextureDevice::GetCreateCount()
+{
+	return createCount;
+}
+
+int CountingGridTextureDevice::GetDestroyCount()
+{
+	return destroyCount;
+}
+
+int CountingGridTextureDevice::GetMapCount()
+{
+	return mapCount;
+}
+
+int CountingGridTextureDevice::GetUpdateCount()
+{
+	return updateCount;
+}
+
+int CountingGridTextureDevice::GetLiveCount()
+{
+	return createCount - destroyCount;
+}
+
+
+
+GridTexturePool::GridTexturePool(GridTextureDevice* dev)
+{
+	device = dev;
+	bytesUploaded = 0;
+	frameBytes = 0;
+	lastFrameBytes = 0;
+	frameRegions = 0;
+	lastFrameRegions = 0;
+}
+
+GridTexturePool::~GridTexturePool()
+{
+	for (size_t i = 0; i < entries.size(); i++) {
+		device->Destroy(*entries[i].texture);
+		delete entries[i].texture;
+	}
+	entries.clear();
+}
+
+GridTexture* GridTexturePool::Acquire(int width, int height, bool partialUpdates, int format)
+{
+	for (size_t i = 0; i < entries.size(); i++) {
+		GridTexture* texture = entries[i].texture;
+		if (!entries[i].inUse && texture->width == width && texture->height == height && texture->partialUpdates == partialUpdates && texture->format == format) {
+			entries[i].inUse = true;
+			return entries[i].texture;
+		}
+	}
+
+	GridTexture* texture = new GridTexture();
+	if (!device->Create(width, height, format, partialUpdates, *texture)) {
+		delete texture;
+		return nullptr;
+	}
+	Entry entry;
+	entry.texture = texture;
+	entry.inUse = true;
+	entries.push_back(entry);
+	return texture;
+}
+
+void GridTexturePool::Release(GridTexture* texture)
+{
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (entries[i].texture == texture) {
+			entries[i].inUse = false;
+			return;
+		}
+	}
+}
+
+bool GridTexturePool::Upload(GridTexture* texture, SimulationGrid2D* grid)
+{
+	if (!texture || !texture->partialUpdates) {
+		return Upload(texture, grid->GetView());
+	}
+	if (texture->format != GridTexture::Float4 || texture->width != grid->GetSizeX() || texture->height != grid->GetSizeY()) {
+		return false;
+	}
+
+	// Each dirty rectangle is sent straight from the grid's memory, rows a grid width apart
+	ConstGridView view = grid->GetView();
+	const std::vector<GridRect>& rects = grid->GetDirtyRegion().GetRects();
+	for (size_t i = 0; i < rects.size(); i++) {
+		const GridRect& rect = rects[i];
+		device->Update(*texture, rect, view.Row(rect.y0) + rect.x0, view.GetPitch() * sizeof(float));
+
+		long long bytes = rect.Area() * (long long)sizeof(std::array<float, 4>);
+		bytesUploaded += bytes;
+		frameBytes += bytes;
+		frameRegions++;
+	}
+	grid->ClearDirty();
+	return true;
+}
+
+bool GridTexturePool::Upload(GridTexture* texture, const ConstGridView& view)
+{
+	if (!texture || texture->format != GridTexture::Float4 || texture->width != view.GetWidth() || texture->height != view.GetHeight()) {
+		return false;
+	}
+
+	GridRect full = { 0, 0, texture->width, texture->height };
+	if (texture->partialUpdates) {
+		// Partial update textures cannot be mapped, the view is sent as one region
+		if (!view.IsInterleaved()) {
+			return false;
+		}
+		device->Update(*texture, full, view.GetData(), view.GetPitch() * sizeof(float));
+	}
+	else {
+		size_t rowPitch;
+		void* mapped = device->Map(*texture, rowPitch);
+		if (!mapped) {
+			return false;
+		}
+
+		// Rows go straight from the view into the texture, no intermediate copy
+		CopyGridView(view, GridView::Interleaved(mapped, texture->width, texture->height, rowPitch));
+		device->Unmap(*texture);
+	}
+
+	long long bytes = full.Area() * (long long)sizeof(std::array<float, 4>);
+	bytesUploaded += bytes;
+	frameBytes += bytes;
+	frameRegions++;
+	return true;
+}
+
+bool GridTexturePool::Upload(GridTexture* texture, const void* data, size_t rowPitch)
+{
+	if (!texture || !data) {
+		return false;
+	}
+
+	GridRect full = { 0, 0, texture->width, texture->height };
+	size_t rowBytes = texture->width * GridTexture::GetTexelSize(texture->format);
+	if (texture->partialUpdates) {
+		device->Update(*texture, full, data, rowPitch);
+	}
+	else {
+		size_t mappedPitch;
+		unsigned char* mapped = (unsigned char*)device->Map(*texture, mappedPitch);
+		if (!mapped) {
+			return false;
+		}
+		for (int y = 0; y < texture->height; y++) {
+			std::memcpy(mapped + y * mappedPitch, (const unsigned char*)data + y * rowPitch, rowBytes);
+		}
+		device->Unmap(*texture);
+	}
+
+	long long bytes = (long long)rowBytes * texture->height;
+	bytesUploaded += bytes;
+	frameBytes += bytes;
+	frameRegions++;
+	return true;
+}
+
+void GridTexturePool::BeginFrame()
+{
+	lastFrameBytes = frameBytes;
+	lastFrameRegions = frameRegions;
+	frameBytes = 0;
+	frameRegions = 0;
+}
+
+void GridTexturePool::Trim()
+{
+	for (size_t i = 0; i < entries.size();) {
+		if (!entries[i].inUse) {
+			device->Destroy(*entries[i].texture);
+			delete entries[i].texture;
+			entries.erase(entries.begin() + i);
+		}
+		else {
+			i++;
+		}
+	}
+}
+
+int GridTexturePool::GetTextureCount()
+{
+	return (int)entries.size();
+}
+
+int GridTexturePool::GetFreeCount()
+{
+	int count = 0;
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (!entries[i].inUse) {
+			count++;
+		}
+	}
+	return count;
+}
+
+long long GridTexturePool::GetBytesUploaded()
+{
+	return bytesUploaded;
+}
+
+long long GridTexturePool::GetLastFrameBytes()
+{
+	return lastFrameBytes;
+}
+
+int GridTexturePool::GetLastFrameRegions()
+{
+	return lastFrameRegions;
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <cstddef>
+#include "SimulationGrid2D.h"
+#include "GridRect.h"
+
+// A four channel float texture the simulation grid is uploaded into, or a packed texture of
+// data worked out from it. The resource and view are owned by the device that created them
+// (ID3D11Texture2D and ID3D11ShaderResourceView for the Direct3D device).
+struct GridTexture
+{
+	enum Format
+	{
+		Float4 = 0,    // one grid node per texel, R32G32B32A32_FLOAT
+		Snorm16x2 = 1, // two signed normalised 16 bit channels, R16G16_SNORM
+		Unorm8 = 2     // one unsigned normalised byte, R8_UNORM
+	};
+
+	// Bytes per texel of a format
+	static size_t GetTexelSize(int format);
+
+	int width = 0;
+	int height = 0;
+	int format = Float4;
+	bool partialUpdates = false; // updated region by region rather than rewritten through a mapping
+	void* resource = nullptr;
+	void* view = nullptr;
+};
+
+
+// The few device operations the pool needs, so the pooling logic does not depend on Direct3D
+class GridTextureDevice
+{
+
+public:
+
+	virtual ~GridTextureDevice() {}
+
+	// Create a CPU writable texture, returns false on failure. Textures for partial updates
+	// are written with Update, the others with Map.
+	virtual bool Create(int width, int height, int format, bool partialUpdates, GridTexture& texture) = 0;
+	virtual void Destroy(GridTexture& texture) = 0;
+
+	// Map the whole texture for writing, the previous contents are discarded
+	virtual void* Map(GridTexture& texture, size_t& rowPitch) = 0;
+	virtual void Unmap(GridTexture& texture) = 0;
+
+	// Write a rectangle of a partial update texture, the rest of the texture is kept
+	virtual void Update(GridTexture& texture, const GridRect& rect, const void* data, size_t rowPitch) = 0;
+
+};
+
+
+#ifdef _WIN32
+struct ID3D11Device;
+struct ID3D11DeviceContext;
+
+// Dynamic textures of any of the grid texture formats with a shader resource view
+class D3D11GridTextureDevice : public GridTextureDevice
+{
+
+public:
+
+	D3D11GridTextureDevice(ID3D11Device* device, ID3D11DeviceContext* deviceContext);
+
+	bool Create(int width, int height, int format, bool partialUpdates, GridTexture& texture) override;
+	void Destroy(GridTexture& texture) override;
+	void* Map(GridTexture& texture, size_t& rowPitch) override;
+	void Unmap(GridTexture& texture) override;
+	void Update(GridTexture& texture, const GridRect& rect, const void* data, size_t rowPitch) override;
+
+private:
+
+	ID3D11Device* device;
+	ID3D11DeviceContext* deviceContext;
+
+};
+#endif
+
+
+// Counts the calls made through it, forwarding to another device. Without another device the
+// textures are kept in host memory, so the pool can be exercised without a GPU.
+class CountingGridTextureDevice : public GridTextureDevice
+{
+
+public:
+
+	CountingGridTextureDevice(GridTextureDevice* device = nullptr);
+	~CountingGridTextureDevice();
+
+	bool Create(int width, int height, int format, bool partialUpdates, GridTexture& texture) override;
+	void Destroy(GridTexture& texture) override;
+	void* Map(GridTexture& texture, size_t& rowPitch) override;
+	void Unmap(GridTexture& texture) override;
+	void Update(GridTexture& texture, const GridRect& rect, const void* data, size_t rowPitch) override;
+
+	int GetCreateCount();
+	int GetDestroyCount();
+	int GetMapCount();
+	int GetUpdateCount();
+	int GetLiveCount();
+
+private:
+
+	GridTextureDevice* device;
+	int createCount;
+	int destroyCount;
+	int mapCount;
+	int updateCount;
+
+};
+
+
+// Keeps the grid upload textures alive between steps. Textures are created the first time a
+// grid size is asked for and handed out again once released, so a running simulation never
+// allocates; uploads write the grid rows straight into the mapped texture. A partial update
+// texture follows one grid and only receives the grid's dirty rectangles.
+class GridTexturePool
+{
+
+public:
+
+	GridTexturePool(GridTextureDevice* device);
+	~GridTexturePool();
+
+	// Get a texture of the given size and format, reusing a released one when possible
+	GridTexture* Acquire(int width, int height, bool partialUpdates = false, int format = GridTexture::Float4);
+	void Release(GridTexture* texture);
+
+	// Write the grid into the texture, the grid and texture must be the same size. Partial
+	// update textures receive only the dirty rectangles, and the grid's dirty region is cleared.
+	bool Upload(GridTexture* texture, SimulationGrid2D* grid);
+
+	// Write a whole view into a texture of the same size
+	bool Upload(GridTexture* texture, const ConstGridView& view);
+
+	// Write packed texels into a whole texture, rows rowPitch bytes apart in the texture's format
+	bool Upload(GridTexture* texture, const void* data, size_t rowPitch);
+
+	// Start counting the upload statistics of a new frame
+	void BeginFrame();
+
+	// Destroy every texture that is not in use
+	void Trim();
+
+	int GetTextureCount();
+	int GetFreeCount();
+	long long GetBytesUploaded();
+	long long GetLastFrameBytes();
+	int GetLastFrameRegions();
+
+private:
+
+	struct Entry
+	{
+		GridTexture* texture;
+		bool inUse;
+	};
+
+	GridTextureDevice* device;
+	std::vector<Entry> entries;
+	long long bytesUploaded;
+	long long frameBytes;
+	long long lastFrameBytes;
+	int frameRegions;
+	int lastFrameRegions;
+
+};
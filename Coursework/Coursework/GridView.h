@@ -0,0 +1,112 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include "GridRect.h"
+
+// Non-owning view of a 2D grid of four channel nodes. Strides are in floats: pitch between
+// rows, nodeStride between neighbouring nodes and channelStride between the channels of a
+// node. The usual interleaved layout is nodeStride 4 and channelStride 1, a planar layout
+// (one plane per channel) is nodeStride 1 and channelStride = plane size. Views can point
+// into a SimulationGrid2D or borrow any externally owned buffer, such as a mapped texture
+// or a mapped file, so consumers read and write the data in place without copying it.
+template <typename T>
+class BasicGridView
+{
+
+public:
+
+	typedef typename std::conditional<std::is_const<T>::value, const std::array<float, 4>, std::array<float, 4>>::type Node;
+
+	BasicGridView() : data(nullptr), width(0), height(0), pitch(0), nodeStride(4), channelStride(1)
+	{
+	}
+
+	BasicGridView(T* data_, int width_, int height_, ptrdiff_t pitch_, ptrdiff_t nodeStride_ = 4, ptrdiff_t channelStride_ = 1)
+		: data(data_), width(width_), height(height_), pitch(pitch_), nodeStride(nodeStride_), channelStride(channelStride_)
+	{
+	}
+
+	// A mutable view converts to a read-only one
+	template <typename U, typename = typename std::enable_if<std::is_same<const U, T>::value && !std::is_same<U, T>::value>::type>
+	BasicGridView(const BasicGridView<U>& other)
+		: data(other.GetData()), width(other.GetWidth()), height(other.GetHeight()), pitch(other.GetPitch()), nodeStride(other.GetNodeStride()), channelStride(other.GetChannelStride())
+	{
+	}
+
+	// Borrow an interleaved buffer whose rows are rowPitchBytes apart, such as a mapped texture
+	static BasicGridView Interleaved(void* buffer, int width, int height, size_t rowPitchBytes)
+	{
+		return BasicGridView((T*)buffer, width, height, (ptrdiff_t)(rowPitchBytes / sizeof(float)));
+	}
+	static BasicGridView Interleaved(const void* buffer, int width, int height, size_t rowPitchBytes)
+	{
+		static_assert(std::is_const<T>::value, "a const buffer can only be borrowed by a read-only view");
+		return BasicGridView((T*)buffer, width, height, (ptrdiff_t)(rowPitchBytes / sizeof(float)));
+	}
+
+	T* GetData() const { return data; }
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	ptrdiff_t GetPitch() const { return pitch; }
+	ptrdiff_t GetNodeStride() const { return nodeStride; }
+	ptrdiff_t GetChannelStride() const { return channelStride; }
+	bool Empty() const { return data == nullptr || width <= 0 || height <= 0; }
+
+	// True when the four channels of a node are adjacent, so nodes can be read as arrays
+	bool IsInterleaved() const { return nodeStride == 4 && channelStride == 1; }
+	// True when the whole view is one contiguous block
+	bool IsContiguous() const { return IsInterleaved() && pitch == (ptrdiff_t)width * 4; }
+
+	T& At(int x, int y, int channel) const
+	{
+		return data[y * pitch + x * nodeStride + channel * channelStride];
+	}
+
+	// Row of interleaved nodes, only valid for interleaved views
+	Node* Row(int y) const
+	{
+		return (Node*)(data + y * pitch);
+	}
+
+	// View of a rectangle of this view, sharing the same memory
+	BasicGridView Sub(const GridRect& rect) const
+	{
+		return BasicGridView(data + rect.y0 * pitch + rect.x0 * nodeStride, rect.Width(), rect.Height(), pitch, nodeStride, channelStride);
+	}
+
+private:
+
+	T* data;
+	int width;
+	int height;
+	ptrdiff_t pitch;
+	ptrdiff_t nodeStride;
+	ptrdiff_t channelStride;
+
+};
+
+typedef BasicGridView<float> GridView;
+typedef BasicGridView<const float> ConstGridView;
+
+
+// Copy the overlapping part of two views, rows are copied whole when both are interleaved
+inline void CopyGridView(const ConstGridView& source, const GridView& destination)
+{
+	int width = source.GetWidth() < destination.GetWidth() ? source.GetWidth() : destination.GetWidth();
+	int height = source.GetHeight() < destination.GetHeight() ? source.GetHeight() : destination.GetHeight();
+	if (source.IsInterleaved() && destination.IsInterleaved()) {
+		for (int y = 0; y < height; y++) {
+			std::memcpy(destination.Row(y), source.Row(y), width * sizeof(std::array<float, 4>));
+		}
+		return;
+	}
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			for (int c = 0; c < 4; c++) {
+				destination.At(x, y, c) = source.At(x, y, c);
+			}
+		}
+	}
+}
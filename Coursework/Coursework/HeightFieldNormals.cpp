@@ -0,0 +1,209 @@
+#include "HeightFieldNormals.h"
+#include "SimulationGrid2D.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <xmmintrin.h>
+
+namespace
+{
+	// Rows per task when the grid is split over the scheduler
+	const int MinRows = 16;
+
+	// Largest magnitude of a 16 bit signed normalised value
+	const float SnormScale = 32767.0f;
+
+	// Adding 1.5 * 2^23 rounds v to the nearest integer and leaves it in the low bits of the
+	// float, as two's complement for |v| below 2^22
+	inline void RoundToBits(__m128 v, unsigned int bits[4])
+	{
+		float rounded[4];
+		_mm_storeu_ps(rounded, _mm_add_ps(v, _mm_set1_ps(12582912.0f)));
+		std::memcpy(bits, rounded, sizeof(rounded));
+	}
+}
+
+HeightFieldNormals::HeightFieldNormals(TaskScheduler* sched)
+{
+	scheduler = sched;
+	meshSize = 100.0f;
+	foam = false;
+	foamScale = 2.0f;
+	width = 0;
+	height = 0;
+	planePitch = 0;
+	lastTime = 0.0f;
+}
+
+HeightFieldNormals::~HeightFieldNormals()
+{
+}
+
+void HeightFieldNormals::SetMeshSize(float size)
+{
+	meshSize = size;
+}
+
+void HeightFieldNormals::SetFoam(bool enabled)
+{
+	foam = enabled;
+}
+
+bool HeightFieldNormals::GetFoam()
+{
+	return foam;
+}
+
+void HeightFieldNormals::SetFoamScale(float scale)
+{
+	foamScale = scale;
+}
+
+float HeightFieldNormals::GetFoamScale()
+{
+	return foamScale;
+}
+
+void HeightFieldNormals::ForRows(int rows, const std::function<void(int, int)>& body)
+{
+	if (scheduler) {
+		scheduler->ParallelFor(0, rows, body, MinRows);
+	}
+	else {
+		body(0, rows);
+	}
+}
+
+void HeightFieldNormals::Compute(const ConstGridView& grid)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (grid.Empty()) {
+		width = 0;
+		height = 0;
+		normals.clear();
+		foamMap.clear();
+		lastTime = 0.0f;
+		return;
+	}
+	width = grid.GetWidth();
+	height = grid.GetHeight();
+	int paddedWidth = (width + 3) & ~3;
+	planePitch = paddedWidth + 2;
+	plane.resize((size_t)(height + 2) * planePitch);
+	normals.resize((size_t)width * height);
+	foamMap.resize(foam ? (size_t)width * height : 0);
+
+	// Copy the surface heights, depth on top of the bed, in with a ghost either side continuing
+	// the slope at the edge. Columns past the grid repeat the last ghost, what is computed from
+	// them is thrown away.
+	ForRows(height, [&](int rowBegin, int rowEnd) {
+		for (int y = rowBegin; y < rowEnd; y++) {
+			float* row = &plane[(size_t)(y + 1) * planePitch + 1];
+			for (int x = 0; x < width; x++) {
+				row[x] = grid.At(x, y, SimulationGrid2D::Height) + grid.At(x, y, SimulationGrid2D::Bathymetry);
+			}
+			row[-1] = width > 1 ? 2.0f * row[0] - row[1] : row[0];
+			float ghost = width > 1 ? 2.0f * row[width - 1] - row[width - 2] : row[width - 1];
+			for (int x = width; x <= paddedWidth; x++) {
+				row[x] = ghost;
+			}
+		}
+	});
+
+	// Ghost rows above and below, the same way
+	const float* first = &plane[planePitch];
+	const float* last = &plane[(size_t)height * planePitch];
+	const float* secondFirst = height > 1 ? first + planePitch : first;
+	const float* secondLast = height > 1 ? last - planePitch : last;
+	float* above = &plane[0];
+	float* below = &plane[(size_t)(height + 1) * planePitch];
+	for (int x = 0; x < planePitch; x++) {
+		above[x] = 2.0f * first[x] - secondFirst[x];
+		below[x] = 2.0f * last[x] - secondLast[x];
+	}
+
+	// A grid one node across has no slope along that side
+	float spacingX = width > 1 ? meshSize / (width - 1) : 0.0f;
+	float spacingY = height > 1 ? meshSize / (height - 1) : 0.0f;
+	__m128 halfInverseX = _mm_set1_ps(width > 1 ? 0.5f / spacingX : 0.0f);
+	__m128 halfInverseY = _mm_set1_ps(height > 1 ? 0.5f / spacingY : 0.0f);
+	__m128 inverseSquareX = _mm_set1_ps(width > 1 ? 1.0f / (spacingX * spacingX) : 0.0f);
+	__m128 inverseSquareY = _mm_set1_ps(height > 1 ? 1.0f / (spacingY * spacingY) : 0.0f);
+	__m128 foamFactor = _mm_set1_ps(-foamScale);
+
+	ForRows(height, [&](int rowBegin, int rowEnd) {
+		__m128 zero = _mm_setzero_ps();
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 two = _mm_set1_ps(2.0f);
+		for (int y = rowBegin; y < rowEnd; y++) {
+			const float* north = &plane[(size_t)y * planePitch + 1];
+			const float* centre = north + planePitch;
+			const float* south = centre + planePitch;
+			unsigned int* normalRow = &normals[(size_t)y * width];
+			unsigned char* foamRow = foam ? &foamMap[(size_t)y * width] : nullptr;
+
+			for (int x = 0; x < width; x += 4) {
+				__m128 h = _mm_loadu_ps(centre + x);
+				__m128 west = _mm_loadu_ps(centre + x - 1);
+				__m128 east = _mm_loadu_ps(centre + x + 1);
+				__m128 up = _mm_loadu_ps(north + x);
+				__m128 down = _mm_loadu_ps(south + x);
+
+				// Rows run towards -z, so the normal is (-dh/dx, 1, dh/dy) before normalising
+				__m128 slopeX = _mm_mul_ps(_mm_sub_ps(east, west), halfInverseX);
+				__m128 slopeY = _mm_mul_ps(_mm_sub_ps(down, up), halfInverseY);
+				__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(slopeX, slopeX), _mm_mul_ps(slopeY, slopeY)), one);
+				__m128 scale = _mm_div_ps(_mm_set1_ps(SnormScale), _mm_sqrt_ps(lengthSquared));
+				unsigned int normalX[4], normalZ[4];
+				RoundToBits(_mm_sub_ps(zero, _mm_mul_ps(slopeX, scale)), normalX);
+				RoundToBits(_mm_mul_ps(slopeY, scale), normalZ);
+
+				int count = std::min(4, width - x);
+				for (int l = 0; l < count; l++) {
+					normalRow[x + l] = (normalX[l] & 0xFFFF) | (normalZ[l] << 16);
+				}
+
+				if (foamRow) {
+					__m128 twoH = _mm_mul_ps(two, h);
+					__m128 laplacian = _mm_add_ps(
+						_mm_mul_ps(_mm_sub_ps(_mm_add_ps(east, west), twoH), inverseSquareX),
+						_mm_mul_ps(_mm_sub_ps(_mm_add_ps(up, down), twoH), inverseSquareY));
+					__m128 amount = _mm_min_ps(_mm_max_ps(_mm_mul_ps(laplacian, foamFactor), zero), one);
+					unsigned int bits[4];
+					RoundToBits(_mm_mul_ps(amount, _mm_set1_ps(255.0f)), bits);
+					for (int l = 0; l < count; l++) {
+						foamRow[x + l] = (unsigned char)bits[l];
+					}
+				}
+			}
+		}
+	});
+
+	lastTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int HeightFieldNormals::GetWidth()
+{
+	return width;
+}
+
+int HeightFieldNormals::GetHeight()
+{
+	return height;
+}
+
+const unsigned int* HeightFieldNormals::GetNormals()
+{
+	return normals.empty() ? nullptr : normals.data();
+}
+
+const unsigned char* HeightFieldNormals::GetFoamMap()
+{
+	return foamMap.empty() ? nullptr : foamMap.data();
+}
+
+float HeightFieldNormals::GetLastTime()
+{
+	return lastTime;
+}
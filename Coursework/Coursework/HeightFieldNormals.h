@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include "GridView.h"
+#include "TaskScheduler.h"
+
+// Normals, and optionally foam, of a height field spread over the water mesh, packed for
+// upload so the shallow water mode of the wave shader can light the surface. The grid's
+// corners sit on the mesh's corners and its rows run towards -z, as wave_vs.hlsl reads it.
+//
+// The heights are first copied into a plane with a ring of ghost nodes extrapolated linearly
+// from the edge, so the central differences become one sided along the edges and every node
+// takes the same SSE path, four at a time. Each normal keeps only its x and z, the y being
+// positive on a height field, as two 16 bit signed normalised values (R16G16_SNORM). Foam
+// is the water's curvature on the crests, -laplacian(h) times a scale, as one byte per node
+// (R8_UNORM). Rows are split across the task scheduler and no node depends on how they are
+// split, so the output is the same whatever the number of threads.
+class HeightFieldNormals
+{
+
+public:
+
+	// A null scheduler computes on the calling thread
+	HeightFieldNormals(TaskScheduler* scheduler = nullptr);
+	~HeightFieldNormals();
+
+	// Side of the square mesh the grid is spread over, in the same units as the heights
+	void SetMeshSize(float meshSize);
+
+	// Foam is only computed when asked for. Crests curving tighter than the scale, a radius in
+	// metres, are fully white.
+	void SetFoam(bool foam);
+	bool GetFoam();
+	void SetFoamScale(float scale);
+	float GetFoamScale();
+
+	// Compute from the surface of the grid, the height channel on top of the bathymetry
+	void Compute(const ConstGridView& grid);
+
+	int GetWidth();
+	int GetHeight();
+
+	// Packed rows of GetWidth() texels, null before the first compute. Foam is null when off.
+	const unsigned int* GetNormals();
+	const unsigned char* GetFoamMap();
+
+	float GetLastTime(); // milliseconds
+
+private:
+
+	void ForRows(int rows, const std::function<void(int, int)>& body);
+
+	TaskScheduler* scheduler;
+	float meshSize;
+	bool foam;
+	float foamScale;
+
+	int width;
+	int height;
+	int planePitch;            // floats between the rows of the plane, a multiple of four plus the two ghosts
+	std::vector<float> plane;  // heights with their ghost ring, (height + 2) rows
+	std::vector<unsigned int> normals;
+	std::vector<unsigned char> foamMap;
+
+	float lastTime;
+
+};
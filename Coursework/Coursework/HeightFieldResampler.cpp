@@ -0,0 +1,203 @@
+#include "HeightFieldResampler.h"
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <xmmintrin.h>
+
+HeightFieldResampler::HeightFieldResampler(TaskScheduler* sched)
+{
+	scheduler = sched;
+	lastTime = 0.0f;
+}
+
+HeightFieldResampler::~HeightFieldResampler()
+{
+}
+
+const char* HeightFieldResampler::GetName(Filter filter)
+{
+	switch (filter) {
+	case Bilinear: return "Bilinear";
+	case CatmullRom: return "Catmull-Rom";
+	case BSpline: return "B-spline";
+	default: return "Unknown";
+	}
+}
+
+void HeightFieldResampler::ComputeTaps(Taps& taps, int sourceSize, int destinationSize, Filter filter)
+{
+	if (taps.sourceSize == sourceSize && taps.destinationSize == destinationSize && taps.filter == filter) {
+		return;
+	}
+	taps.sourceSize = sourceSize;
+	taps.destinationSize = destinationSize;
+	taps.filter = filter;
+	taps.first.resize(destinationSize);
+	taps.weights.resize(destinationSize * 4);
+
+	float scale = destinationSize > 1 ? (float)(sourceSize - 1) / (destinationSize - 1) : 0.0f;
+	for (int i = 0; i < destinationSize; i++) {
+		float position = i * scale;
+		int index = std::min((int)position, std::max(sourceSize - 2, 0));
+		float t = position - index;
+		float* w = &taps.weights[i * 4];
+
+		// Taps are at index - 1, index, index + 1 and index + 2
+		switch (filter) {
+		case CatmullRom:
+			w[0] = ((-0.5f * t + 1.0f) * t - 0.5f) * t;
+			w[1] = (1.5f * t - 2.5f) * t * t + 1.0f;
+			w[2] = ((-1.5f * t + 2.0f) * t + 0.5f) * t;
+			w[3] = (0.5f * t - 0.5f) * t * t;
+			break;
+		case BSpline:
+			w[0] = (1.0f - t) * (1.0f - t) * (1.0f - t) / 6.0f;
+			w[1] = (3.0f * t * t * t - 6.0f * t * t + 4.0f) / 6.0f;
+			w[2] = (-3.0f * t * t * t + 3.0f * t * t + 3.0f * t + 1.0f) / 6.0f;
+			w[3] = t * t * t / 6.0f;
+			break;
+		default:
+			w[0] = 0.0f;
+			w[1] = 1.0f - t;
+			w[2] = t;
+			w[3] = 0.0f;
+			break;
+		}
+		taps.first[i] = index - 1;
+	}
+}
+
+void HeightFieldResampler::ForRows(int rows, const std::function<void(int, int)>& body)
+{
+	if (scheduler) {
+		scheduler->ParallelFor(0, rows, body, 16);
+	}
+	else {
+		body(0, rows);
+	}
+}
+
+void HeightFieldResampler::Resample(const ConstGridView& source, int sourceChannel, const GridView& destination, int destinationChannel, Filter filter)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	int sourceWidth = source.GetWidth();
+	int sourceHeight = source.GetHeight();
+	int destinationWidth = destination.GetWidth();
+	int destinationHeight = destination.GetHeight();
+	if (source.Empty() || destination.Empty()) {
+		return;
+	}
+
+	ComputeTaps(tapsX, sourceWidth, destinationWidth, filter);
+	ComputeTaps(tapsY, sourceHeight, destinationHeight, filter);
+
+	// Horizontal pass. The channel is gathered into a contiguous row padded by one clamped
+	// value on the left and two on the right, so the four taps are one unaligned load.
+	int paddedWidth = (destinationWidth + 3) & ~3;
+	scratch.resize((size_t)sourceHeight * paddedWidth);
+	ForRows(sourceHeight, [&](int rowBegin, int rowEnd) {
+		std::vector<float> row(sourceWidth + 3);
+		for (int y = rowBegin; y < rowEnd; y++) {
+			for (int x = 0; x < sourceWidth; x++) {
+				row[x + 1] = source.At(x, y, sourceChannel);
+			}
+			row[0] = row[1];
+			row[sourceWidth + 1] = row[sourceWidth];
+			row[sourceWidth + 2] = row[sourceWidth];
+
+			float* output = &scratch[(size_t)y * paddedWidth];
+			for (int x = 0; x < destinationWidth; x++) {
+				__m128 values = _mm_loadu_ps(&row[tapsX.first[x] + 1]);
+				__m128 products = _mm_mul_ps(values, _mm_loadu_ps(&tapsX.weights[x * 4]));
+				// Horizontal sum of the four products
+				__m128 shuffled = _mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 3, 0, 1));
+				__m128 sums = _mm_add_ps(products, shuffled);
+				shuffled = _mm_movehl_ps(shuffled, sums);
+				sums = _mm_add_ss(sums, shuffled);
+				output[x] = _mm_cvtss_f32(sums);
+			}
+			for (int x = destinationWidth; x < paddedWidth; x++) {
+				output[x] = output[destinationWidth - 1];
+			}
+		}
+	});
+
+	// Vertical pass, every output row blends four scratch rows with the same weights
+	ForRows(destinationHeight, [&](int rowBegin, int rowEnd) {
+		std::vector<float> row(paddedWidth);
+		for (int y = rowBegin; y < rowEnd; y++) {
+			const float* w = &tapsY.weights[y * 4];
+			const float* rows[4];
+			for (int k = 0; k < 4; k++) {
+				int sourceY = std::min(std::max(tapsY.first[y] + k, 0), sourceHeight - 1);
+				rows[k] = &scratch[(size_t)sourceY * paddedWidth];
+			}
+
+			__m128 w0 = _mm_set1_ps(w[0]);
+			__m128 w1 = _mm_set1_ps(w[1]);
+			__m128 w2 = _mm_set1_ps(w[2]);
+			__m128 w3 = _mm_set1_ps(w[3]);
+			for (int x = 0; x < paddedWidth; x += 4) {
+				__m128 sum = _mm_mul_ps(_mm_loadu_ps(rows[0] + x), w0);
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[1] + x), w1));
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[2] + x), w2));
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[3] + x), w3));
+				_mm_storeu_ps(&row[x], sum);
+			}
+			for (int x = 0; x < destinationWidth; x++) {
+				destination.At(x, y, destinationChannel) = row[x];
+			}
+		}
+	});
+
+	lastTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void HeightFieldResampler::ResampleState(const ConstGridView& source, float sourceCellArea, const GridView& destination, float destinationCellArea)
+{
+	for (int channel = 0; channel < 4; channel++) {
+		Resample(source, channel, destination, channel, Bilinear);
+	}
+
+	// Totals of height and discharge over both grids, in double so large grids sum accurately
+	double sourceTotals[3] = { 0.0, 0.0, 0.0 };
+	double destinationTotals[3] = { 0.0, 0.0, 0.0 };
+	for (int y = 0; y < source.GetHeight(); y++) {
+		for (int x = 0; x < source.GetWidth(); x++) {
+			for (int k = 0; k < 3; k++) {
+				sourceTotals[k] += source.At(x, y, k);
+			}
+		}
+	}
+	for (int y = 0; y < destination.GetHeight(); y++) {
+		for (int x = 0; x < destination.GetWidth(); x++) {
+			destination.At(x, y, 0) = std::max(destination.At(x, y, 0), 0.0f);
+			for (int k = 0; k < 3; k++) {
+				destinationTotals[k] += destination.At(x, y, k);
+			}
+		}
+	}
+	for (int k = 0; k < 3; k++) {
+		sourceTotals[k] *= sourceCellArea;
+		destinationTotals[k] *= destinationCellArea;
+	}
+
+	// Depth is scaled so it stays positive, discharge is corrected by a uniform offset since its total can be near zero
+	float heightScale = destinationTotals[0] > 0.0 ? (float)(sourceTotals[0] / destinationTotals[0]) : 1.0f;
+	double destinationArea = (double)destination.GetWidth() * destination.GetHeight() * destinationCellArea;
+	float dischargeOffsetX = (float)((sourceTotals[1] - destinationTotals[1]) / destinationArea);
+	float dischargeOffsetY = (float)((sourceTotals[2] - destinationTotals[2]) / destinationArea);
+	for (int y = 0; y < destination.GetHeight(); y++) {
+		for (int x = 0; x < destination.GetWidth(); x++) {
+			destination.At(x, y, 0) *= heightScale;
+			destination.At(x, y, 1) += dischargeOffsetX;
+			destination.At(x, y, 2) += dischargeOffsetY;
+		}
+	}
+}
+
+float HeightFieldResampler::GetLastTime()
+{
+	return lastTime;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include "GridView.h"
+#include "TaskScheduler.h"
+
+// Resamples one channel of a grid onto a grid of another resolution, so the simulation
+// and the render mesh can use different resolutions. The filter is separable: every source
+// row is filtered horizontally into a scratch image, then each output row is a weighted sum
+// of four scratch rows, four output nodes per SSE operation. Rows are split across the task
+// scheduler. Grid corners map onto grid corners and edges are clamped.
+class HeightFieldResampler
+{
+
+public:
+
+	enum Filter
+	{
+		Bilinear = 0,
+		CatmullRom = 1, // interpolating cubic, sharper but can overshoot slightly
+		BSpline = 2,    // approximating cubic, smoothest, does not pass through the source values
+		FilterCount = 3
+	};
+
+	// A null scheduler resamples on the calling thread
+	HeightFieldResampler(TaskScheduler* scheduler);
+	~HeightFieldResampler();
+
+	void Resample(const ConstGridView& source, int sourceChannel, const GridView& destination, int destinationChannel, Filter filter);
+
+	// Move a simulation state onto a grid of another resolution covering the same domain. Every
+	// channel is resampled bilinearly (no overshoot, so depths stay positive), then the water
+	// volume and the total discharge are corrected to match the source. Cell areas are the
+	// squared spatial step of each grid.
+	void ResampleState(const ConstGridView& source, float sourceCellArea, const GridView& destination, float destinationCellArea);
+
+	float GetLastTime(); // milliseconds
+
+	static const char* GetName(Filter filter);
+
+private:
+
+	// Source index of the first of the four taps and the four weights for every output position
+	struct Taps
+	{
+		std::vector<int> first;
+		std::vector<float> weights;
+		int sourceSize = 0;
+		int destinationSize = 0;
+		Filter filter = Bilinear;
+	};
+
+	void ComputeTaps(Taps& taps, int sourceSize, int destinationSize, Filter filter);
+	void ForRows(int rows, const std::function<void(int, int)>& body);
+
+	TaskScheduler* scheduler;
+	Taps tapsX;
+	Taps tapsY;
+	std::vector<float> scratch; // source rows filtered horizontally, sourceHeight x destinationWidth
+	float lastTime;
+
+};
@@ -0,0 +1,188 @@
+#include "LaneEnsemble.h"
+#include <xmmintrin.h>
+
+namespace
+{
+	// Push of the bed slope across the face between two nodes on four members, taken with the
+	// mean depth either side so still water over an uneven bed stays still
+	inline __m128 FaceSlope(const float* h, const float* bed, int lower, int upper, __m128 halfGravity)
+	{
+		__m128 depth = _mm_add_ps(_mm_loadu_ps(h + lower), _mm_loadu_ps(h + upper));
+		__m128 rise = _mm_sub_ps(_mm_loadu_ps(bed + upper), _mm_loadu_ps(bed + lower));
+		return _mm_mul_ps(halfGravity, _mm_mul_ps(depth, rise));
+	}
+}
+
+LaneEnsemble::LaneEnsemble(int nx, int ny)
+{
+	sizeX = nx;
+	sizeY = ny;
+
+	int values = sizeX * sizeY * Lanes;
+	height.assign(values, 0.0f);
+	dischargeX.assign(values, 0.0f);
+	dischargeY.assign(values, 0.0f);
+	bathymetry.assign(values, 0.0f);
+	predictedH.resize(values);
+	predictedQ.resize(values);
+	predictedP.resize(values);
+	for (int k = 0; k < 3; k++) {
+		fluxF[k].resize(values);
+		fluxG[k].resize(values);
+	}
+
+	// Unused lanes hold still water so they stay well defined
+	for (int i = 0; i < sizeX * sizeY * Lanes; i++) {
+		height[i] = 1.0f;
+	}
+	for (int lane = 0; lane < Lanes; lane++) {
+		gravity[lane] = 9.8f;
+		n[lane] = 0.9f;
+		DTDXDY[lane] = 0.0f;
+	}
+}
+
+LaneEnsemble::~LaneEnsemble()
+{
+}
+
+int LaneEnsemble::GetSizeX()
+{
+	return sizeX;
+}
+
+int LaneEnsemble::GetSizeY()
+{
+	return sizeY;
+}
+
+void LaneEnsemble::SetMember(int lane, SimulationGrid2D* grid, const SimulationParameters& params)
+{
+	gravity[lane] = params.gravity;
+	n[lane] = params.n;
+	DTDXDY[lane] = params.timeStepSize / params.spatialStepSize;
+
+	for (int y = 0; y < sizeY; y++) {
+		const std::array<float, 4>* row = grid->GetRow(y);
+		for (int x = 0; x < sizeX; x++) {
+			int i = (y * sizeX + x) * Lanes + lane;
+			height[i] = row[x][SimulationGrid2D::Height];
+			dischargeX[i] = row[x][SimulationGrid2D::DischargeX];
+			dischargeY[i] = row[x][SimulationGrid2D::DischargeY];
+			bathymetry[i] = row[x][SimulationGrid2D::Bathymetry];
+		}
+	}
+}
+
+void LaneEnsemble::GetMember(int lane, SimulationGrid2D* grid)
+{
+	for (int y = 0; y < sizeY; y++) {
+		std::array<float, 4>* row = grid->GetRow(y);
+		for (int x = 0; x < sizeX; x++) {
+			int i = (y * sizeX + x) * Lanes + lane;
+			row[x][SimulationGrid2D::Height] = height[i];
+			row[x][SimulationGrid2D::DischargeX] = dischargeX[i];
+			row[x][SimulationGrid2D::DischargeY] = dischargeY[i];
+			row[x][SimulationGrid2D::Bathymetry] = bathymetry[i];
+		}
+	}
+	grid->MarkAllDirty();
+}
+
+void LaneEnsemble::ComputeFluxes(const float* h, const float* q, const float* p)
+{
+	float* F0 = fluxF[0].data();
+	float* F1 = fluxF[1].data();
+	float* F2 = fluxF[2].data();
+	float* G0 = fluxG[0].data();
+	float* G1 = fluxG[1].data();
+	float* G2 = fluxG[2].data();
+
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 dryHeight = _mm_set1_ps(1e-6f);
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	// Four members per SSE register, the lanes of a node fill Lanes / 4 registers
+	for (int node = 0; node < sizeX * sizeY; node++) {
+		for (int lane = 0; lane < Lanes; lane += 4) {
+			int i = node * Lanes + lane;
+			__m128 vh = _mm_loadu_ps(h + i);
+			__m128 vq = _mm_loadu_ps(q + i);
+			__m128 vp = _mm_loadu_ps(p + i);
+
+			// Velocities u and v, dry nodes carry no momentum
+			__m128 wet = _mm_cmpgt_ps(vh, dryHeight);
+			__m128 inverseH = _mm_and_ps(wet, _mm_div_ps(one, _mm_or_ps(_mm_and_ps(wet, vh), _mm_andnot_ps(wet, one))));
+			__m128 u = _mm_mul_ps(vq, inverseH);
+			__m128 v = _mm_mul_ps(vp, inverseH);
+			__m128 hydrostatic = _mm_mul_ps(_mm_mul_ps(half, _mm_load_ps(gravity + lane)), _mm_mul_ps(vh, vh));
+
+			_mm_storeu_ps(F0 + i, vq);
+			_mm_storeu_ps(F1 + i, _mm_add_ps(_mm_mul_ps(vq, u), hydrostatic));
+			_mm_storeu_ps(F2 + i, _mm_mul_ps(vq, v));
+			_mm_storeu_ps(G0 + i, vp);
+			_mm_storeu_ps(G1 + i, _mm_mul_ps(vp, u));
+			_mm_storeu_ps(G2 + i, _mm_add_ps(_mm_mul_ps(vp, v), hydrostatic));
+		}
+	}
+}
+
+void LaneEnsemble::Step()
+{
+	float* state[3] = { height.data(), dischargeX.data(), dischargeY.data() };
+	float* predicted[3] = { predictedH.data(), predictedQ.data(), predictedP.data() };
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	/////////////////        MACCORMACK PREDICTOR STEP        /////////////////
+	ComputeFluxes(height.data(), dischargeX.data(), dischargeY.data());
+	for (int y = 0; y < sizeY; y++) {
+		int bottom = (y + 1) % sizeY;
+		for (int x = 0; x < sizeX; x++) {
+			int right = (x + 1) % sizeX;
+			int i = (y * sizeX + x) * Lanes;
+			int r = (y * sizeX + right) * Lanes;
+			int b = (bottom * sizeX + x) * Lanes;
+			for (int lane = 0; lane < Lanes; lane += 4) {
+				__m128 halfGravity = _mm_mul_ps(half, _mm_load_ps(gravity + lane));
+				__m128 source[3] = { _mm_setzero_ps(),
+					FaceSlope(height.data(), bathymetry.data(), i + lane, r + lane, halfGravity),
+					FaceSlope(height.data(), bathymetry.data(), i + lane, b + lane, halfGravity) };
+				for (int k = 0; k < 3; k++) {
+					const float* F = fluxF[k].data();
+					const float* G = fluxG[k].data();
+					__m128 dF = _mm_sub_ps(_mm_loadu_ps(F + r + lane), _mm_loadu_ps(F + i + lane));
+					__m128 dG = _mm_sub_ps(_mm_loadu_ps(G + b + lane), _mm_loadu_ps(G + i + lane));
+					__m128 change = _mm_mul_ps(_mm_load_ps(DTDXDY + lane), _mm_add_ps(_mm_add_ps(dF, dG), source[k]));
+					_mm_storeu_ps(predicted[k] + i + lane, _mm_sub_ps(_mm_loadu_ps(state[k] + i + lane), change));
+				}
+			}
+		}
+	}
+
+	/////////////////        MACCORMACK CORRECTOR STEP        /////////////////
+	ComputeFluxes(predictedH.data(), predictedQ.data(), predictedP.data());
+	for (int y = 0; y < sizeY; y++) {
+		int top = (y + sizeY - 1) % sizeY;
+		for (int x = 0; x < sizeX; x++) {
+			int left = (x + sizeX - 1) % sizeX;
+			int i = (y * sizeX + x) * Lanes;
+			int l = (y * sizeX + left) * Lanes;
+			int t = (top * sizeX + x) * Lanes;
+			for (int lane = 0; lane < Lanes; lane += 4) {
+				__m128 halfGravity = _mm_mul_ps(half, _mm_load_ps(gravity + lane));
+				__m128 source[3] = { _mm_setzero_ps(),
+					FaceSlope(predictedH.data(), bathymetry.data(), l + lane, i + lane, halfGravity),
+					FaceSlope(predictedH.data(), bathymetry.data(), t + lane, i + lane, halfGravity) };
+				for (int k = 0; k < 3; k++) {
+					const float* F = fluxF[k].data();
+					const float* G = fluxG[k].data();
+					__m128 dF = _mm_sub_ps(_mm_loadu_ps(F + i + lane), _mm_loadu_ps(F + l + lane));
+					__m128 dG = _mm_sub_ps(_mm_loadu_ps(G + i + lane), _mm_loadu_ps(G + t + lane));
+					__m128 change = _mm_mul_ps(_mm_load_ps(DTDXDY + lane), _mm_add_ps(_mm_add_ps(dF, dG), source[k]));
+					__m128 sum = _mm_add_ps(_mm_loadu_ps(state[k] + i + lane), _mm_loadu_ps(predicted[k] + i + lane));
+					_mm_storeu_ps(state[k] + i + lane, _mm_mul_ps(half, _mm_sub_ps(sum, change)));
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include "SimulationGrid2D.h"
+#include "ShallowWaterSolver.h"
+
+// Advances several independent small simulations at once with the MacCormack scheme.
+// The members are interleaved node by node, so the values of one node for every member
+// sit next to each other and the stencil is evaluated for all members with full width
+// vector instructions, however short the rows are. Every member has its own gravity,
+// roughness and time step.
+class LaneEnsemble
+{
+
+public:
+
+	// Number of members advanced together, one per vector lane. Must be a multiple of 4,
+	// each node is processed as Lanes / 4 SSE registers.
+	static const int Lanes = 8;
+
+	LaneEnsemble(int nx, int ny);
+	~LaneEnsemble();
+
+	// Copy a member's initial state and parameters into its lane
+	void SetMember(int lane, SimulationGrid2D* grid, const SimulationParameters& params);
+
+	// Copy a member's current state out of its lane
+	void GetMember(int lane, SimulationGrid2D* grid);
+
+	// Advance every member by one of its own time steps
+	void Step();
+
+	int GetSizeX();
+	int GetSizeY();
+
+private:
+
+	// Fluxes of every member at every node from the given state
+	void ComputeFluxes(const float* h, const float* q, const float* p);
+
+	int sizeX;
+	int sizeY;
+
+	// Node values, indexed [(y * sizeX + x) * Lanes + lane]
+	std::vector<float> height;
+	std::vector<float> dischargeX;
+	std::vector<float> dischargeY;
+	std::vector<float> bathymetry;
+
+	// Predicted state and fluxes, same layout
+	std::vector<float> predictedH;
+	std::vector<float> predictedQ;
+	std::vector<float> predictedP;
+	std::vector<float> fluxF[3];
+	std::vector<float> fluxG[3];
+
+	// Parameters of each member, read with aligned SSE loads
+	alignas(16) float gravity[Lanes];
+	alignas(16) float n[Lanes];
+	alignas(16) float DTDXDY[Lanes];
+
+};
@@ -0,0 +1,402 @@
+#include "LatticeBoltzmannSolver.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <xmmintrin.h>
+
+namespace
+{
+	// Depth below which a cell is treated as dry
+	const float DryDepth = 1e-6f;
+
+	// Relaxation times closer to 0.5 than this are not stable
+	const float MinRelaxationTime = 0.505f;
+
+	// Lattice directions: rest, the four axes, then the four diagonals
+	const int DirectionX[9] = { 0, 1, 0, -1, 0, 1, -1, -1, 1 };
+	const int DirectionY[9] = { 0, 0, 1, 0, -1, 1, 1, -1, -1 };
+	const int Opposite[9] = { 0, 3, 4, 1, 2, 7, 8, 5, 6 };
+
+	// Grid sizes benchmarked, the largest the specialised MacCormack kernels cover
+	const int BenchmarkSizes[] = { 256, 512, 1024, 2048 };
+
+	inline int Wrap(int i, int n)
+	{
+		return i < 0 ? i + n : (i >= n ? i - n : i);
+	}
+
+	// Shallow water equilibrium of depth h and velocity (u, v) in units of the lattice speed.
+	// gravity is g divided by the lattice speed squared.
+	inline void Equilibrium(__m128 h, __m128 u, __m128 v, __m128 gravity, __m128 feq[9])
+	{
+		__m128 gh2 = _mm_mul_ps(gravity, _mm_mul_ps(h, h));
+		__m128 hu2 = _mm_mul_ps(h, _mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(v, v)));
+		feq[0] = _mm_sub_ps(h, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(5.0f / 6.0f), gh2), _mm_mul_ps(_mm_set1_ps(2.0f / 3.0f), hu2)));
+
+		// Velocity along each moving direction
+		__m128 sum = _mm_add_ps(u, v);
+		__m128 difference = _mm_sub_ps(v, u);
+		__m128 zero = _mm_setzero_ps();
+		__m128 along[9] = { zero, u, v, _mm_sub_ps(zero, u), _mm_sub_ps(zero, v),
+			sum, difference, _mm_sub_ps(zero, sum), _mm_sub_ps(zero, difference) };
+
+		__m128 isotropic = _mm_sub_ps(gh2, hu2);
+		__m128 axis = _mm_mul_ps(isotropic, _mm_set1_ps(1.0f / 6.0f));
+		__m128 diagonal = _mm_mul_ps(isotropic, _mm_set1_ps(1.0f / 24.0f));
+		for (int i = 1; i < 5; i++) {
+			__m128 c = along[i];
+			__m128 terms = _mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(1.0f / 3.0f)), _mm_mul_ps(_mm_mul_ps(c, c), _mm_set1_ps(0.5f)));
+			feq[i] = _mm_add_ps(axis, _mm_mul_ps(h, terms));
+		}
+		for (int i = 5; i < 9; i++) {
+			__m128 c = along[i];
+			__m128 terms = _mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(1.0f / 12.0f)), _mm_mul_ps(_mm_mul_ps(c, c), _mm_set1_ps(0.125f)));
+			feq[i] = _mm_add_ps(diagonal, _mm_mul_ps(h, terms));
+		}
+	}
+
+	// Depth and momentum in units of the lattice speed
+	inline void Moments(const __m128 f[9], __m128& h, __m128& mx, __m128& my)
+	{
+		h = _mm_add_ps(_mm_add_ps(_mm_add_ps(f[0], f[1]), _mm_add_ps(f[2], f[3])),
+			_mm_add_ps(_mm_add_ps(f[4], f[5]), _mm_add_ps(_mm_add_ps(f[6], f[7]), f[8])));
+		mx = _mm_add_ps(_mm_sub_ps(f[1], f[3]), _mm_sub_ps(_mm_sub_ps(f[5], f[6]), _mm_sub_ps(f[7], f[8])));
+		my = _mm_add_ps(_mm_sub_ps(f[2], f[4]), _mm_sub_ps(_mm_add_ps(f[5], f[6]), _mm_add_ps(f[7], f[8])));
+	}
+
+	// BGK collision of four cells
+	inline void Collide(__m128 f[9], __m128 gravity, __m128 omega)
+	{
+		__m128 h, mx, my;
+		Moments(f, h, mx, my);
+		__m128 dry = _mm_set1_ps(DryDepth);
+		__m128 inverse = _mm_and_ps(_mm_cmpgt_ps(h, dry), _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(h, dry)));
+
+		__m128 feq[9];
+		Equilibrium(h, _mm_mul_ps(mx, inverse), _mm_mul_ps(my, inverse), gravity, feq);
+		for (int i = 0; i < 9; i++) {
+			f[i] = _mm_add_ps(f[i], _mm_mul_ps(omega, _mm_sub_ps(feq[i], f[i])));
+		}
+	}
+}
+
+LatticeBoltzmannSolver::LatticeBoltzmannSolver(TaskScheduler* taskScheduler)
+{
+	scheduler = taskScheduler;
+	tau = 0.6f;
+	reflective = false;
+	initialised = false;
+	swapped = false;
+	sizeX = 0;
+	sizeY = 0;
+	pitch = 0;
+	planeSize = 0;
+	latticeTimeStep = 0.0f;
+	latticeSpacing = 0.0f;
+	maxDepth = 0.0f;
+}
+
+LatticeBoltzmannSolver::~LatticeBoltzmannSolver()
+{
+}
+
+const char* LatticeBoltzmannSolver::GetName()
+{
+	return "Lattice Boltzmann D2Q9";
+}
+
+void LatticeBoltzmannSolver::SetRelaxationTime(float newTau)
+{
+	tau = std::max(newTau, MinRelaxationTime);
+}
+
+float LatticeBoltzmannSolver::GetViscosity()
+{
+	float dx = params.spatialStepSize;
+	return (tau - 0.5f) * dx * dx / (3.0f * params.timeStepSize);
+}
+
+float LatticeBoltzmannSolver::GetStableTimeStep(float courant)
+{
+	float speed = sqrtf(params.gravity * std::max(maxDepth, 1e-3f));
+	return courant * params.spatialStepSize / speed;
+}
+
+void LatticeBoltzmannSolver::Reset()
+{
+	initialised = false;
+}
+
+void LatticeBoltzmannSolver::Resize(int nx, int ny)
+{
+	if (nx == sizeX && ny == sizeY) {
+		return;
+	}
+	sizeX = nx;
+	sizeY = ny;
+	pitch = (nx + 3) & ~3;
+	planeSize = (size_t)pitch * ny;
+	distributions.assign(planeSize * 9, 0.0f);
+	rowMax.assign(ny, 0.0f);
+	initialised = false;
+}
+
+void LatticeBoltzmannSolver::ForRows(int rows, const std::function<void(int, int)>& body)
+{
+	if (scheduler) {
+		scheduler->ParallelFor(0, rows, body, 8);
+	}
+	else {
+		body(0, rows);
+	}
+}
+
+size_t LatticeBoltzmannSolver::Slot(int x, int y, int i)
+{
+	if (!swapped) {
+		return i * planeSize + (size_t)y * pitch + x;
+	}
+
+	// After an even step the distribution arriving along i still sits in the upstream cell,
+	// stored in the opposite direction, or in this cell when it bounces off a wall
+	int sx = x - DirectionX[i];
+	int sy = y - DirectionY[i];
+	if (reflective && (sx < 0 || sx >= sizeX || sy < 0 || sy >= sizeY)) {
+		return i * planeSize + (size_t)y * pitch + x;
+	}
+	return Opposite[i] * planeSize + (size_t)Wrap(sy, sizeY) * pitch + Wrap(sx, sizeX);
+}
+
+void LatticeBoltzmannSolver::Step(SimulationGrid2D* grid)
+{
+	Advance(grid, 1);
+}
+
+void LatticeBoltzmannSolver::Advance(SimulationGrid2D* grid, int steps)
+{
+	Resize(grid->GetSizeX(), grid->GetSizeY());
+
+	// The distributions hold velocities in units of the lattice speed and where they sit at
+	// the edges depends on the boundary, so they are rebuilt from the grid when either changes
+	bool wasReflective = reflective;
+	reflective = params.boundary == BoundaryType::Reflective;
+	if (reflective != wasReflective || params.timeStepSize != latticeTimeStep || params.spatialStepSize != latticeSpacing) {
+		latticeTimeStep = params.timeStepSize;
+		latticeSpacing = params.spatialStepSize;
+		initialised = false;
+	}
+	if (!initialised) {
+		Load(grid);
+		initialised = true;
+	}
+
+	for (int step = 0; step < steps; step++) {
+		if (swapped) {
+			ForRows(sizeY, [&](int y0, int y1) { StreamCollideRows(y0, y1); });
+		}
+		else {
+			ForRows(sizeY, [&](int y0, int y1) { CollideRows(y0, y1); });
+		}
+		swapped = !swapped;
+	}
+	Store(grid);
+	grid->MarkAllDirty();
+}
+
+void LatticeBoltzmannSolver::Load(SimulationGrid2D* grid)
+{
+	std::vector<GridRect> all(1);
+	all[0].x1 = sizeX;
+	all[0].y1 = sizeY;
+	Reinitialise(grid, all);
+}
+
+void LatticeBoltzmannSolver::Reinitialise(SimulationGrid2D* grid, const std::vector<GridRect>& rects)
+{
+	if (grid->GetSizeX() != sizeX || grid->GetSizeY() != sizeY) {
+		return;
+	}
+	float speed = params.spatialStepSize / params.timeStepSize;
+	__m128 gravity = _mm_set1_ps(params.gravity / (speed * speed));
+
+	for (size_t r = 0; r < rects.size(); r++) {
+		const GridRect& rect = rects[r];
+		ForRows(rect.Height(), [&](int r0, int r1) {
+			for (int y = rect.y0 + r0; y < rect.y0 + r1; y++) {
+				const std::array<float, 4>* row = grid->GetRow(y);
+				for (int x = rect.x0; x < rect.x1; x++) {
+					float h = std::max(0.0f, row[x][SimulationGrid2D::Height]);
+					float inverse = h > DryDepth ? 1.0f / (h * speed) : 0.0f;
+
+					__m128 feq[9];
+					Equilibrium(_mm_set1_ps(h), _mm_set1_ps(row[x][SimulationGrid2D::DischargeX] * inverse),
+						_mm_set1_ps(row[x][SimulationGrid2D::DischargeY] * inverse), gravity, feq);
+					for (int i = 0; i < 9; i++) {
+						distributions[Slot(x, y, i)] = _mm_cvtss_f32(feq[i]);
+					}
+				}
+			}
+		});
+	}
+}
+
+void LatticeBoltzmannSolver::Store(SimulationGrid2D* grid)
+{
+	float speed = params.spatialStepSize / params.timeStepSize;
+	ForRows(sizeY, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			std::array<float, 4>* row = grid->GetRow(y);
+			float deepest = 0.0f;
+			for (int x = 0; x < sizeX; x++) {
+				__m128 f[9];
+				for (int i = 0; i < 9; i++) {
+					f[i] = _mm_set_ss(distributions[Slot(x, y, i)]);
+				}
+				__m128 h, mx, my;
+				Moments(f, h, mx, my);
+				row[x][SimulationGrid2D::Height] = _mm_cvtss_f32(h);
+				row[x][SimulationGrid2D::DischargeX] = _mm_cvtss_f32(mx) * speed;
+				row[x][SimulationGrid2D::DischargeY] = _mm_cvtss_f32(my) * speed;
+				deepest = std::max(deepest, _mm_cvtss_f32(h));
+			}
+			rowMax[y] = deepest;
+		}
+	});
+	maxDepth = *std::max_element(rowMax.begin(), rowMax.end());
+}
+
+void LatticeBoltzmannSolver::CollideRows(int y0, int y1)
+{
+	float speed = params.spatialStepSize / params.timeStepSize;
+	__m128 gravity = _mm_set1_ps(params.gravity / (speed * speed));
+	__m128 omega = _mm_set1_ps(1.0f / tau);
+	float* planes = distributions.data();
+
+	// Purely local, so the padding at the end of each row is collided as well; it holds zeros
+	for (int y = y0; y < y1; y++) {
+		for (int x = 0; x < pitch; x += 4) {
+			size_t index = (size_t)y * pitch + x;
+			__m128 f[9];
+			for (int i = 0; i < 9; i++) {
+				f[i] = _mm_loadu_ps(planes + i * planeSize + index);
+			}
+			Collide(f, gravity, omega);
+			for (int i = 0; i < 9; i++) {
+				_mm_storeu_ps(planes + Opposite[i] * planeSize + index, f[i]);
+			}
+		}
+	}
+}
+
+void LatticeBoltzmannSolver::StreamCollideRows(int y0, int y1)
+{
+	float speed = params.spatialStepSize / params.timeStepSize;
+	__m128 gravity = _mm_set1_ps(params.gravity / (speed * speed));
+	__m128 omega = _mm_set1_ps(1.0f / tau);
+	float* planes = distributions.data();
+
+	for (int y = y0; y < y1; y++) {
+		// Rows next to a wall bounce distributions back, they and the edge columns take the scalar path
+		if (reflective && (y == 0 || y == sizeY - 1)) {
+			for (int x = 0; x < sizeX; x++) {
+				StreamCollideCell(x, y);
+			}
+			continue;
+		}
+
+		// Read along i from the upstream cell's opposite direction, write along i to the downstream cell
+		float* source[9];
+		float* target[9];
+		for (int i = 0; i < 9; i++) {
+			source[i] = planes + Opposite[i] * planeSize + (size_t)Wrap(y - DirectionY[i], sizeY) * pitch - DirectionX[i];
+			target[i] = planes + i * planeSize + (size_t)Wrap(y + DirectionY[i], sizeY) * pitch + DirectionX[i];
+		}
+
+		int x = 1;
+		for (; x + 4 <= sizeX - 1; x += 4) {
+			__m128 f[9];
+			for (int i = 0; i < 9; i++) {
+				f[i] = _mm_loadu_ps(source[i] + x);
+			}
+			Collide(f, gravity, omega);
+			for (int i = 0; i < 9; i++) {
+				_mm_storeu_ps(target[i] + x, f[i]);
+			}
+		}
+		for (; x < sizeX - 1; x++) {
+			StreamCollideCell(x, y);
+		}
+		StreamCollideCell(0, y);
+		if (sizeX > 1) {
+			StreamCollideCell(sizeX - 1, y);
+		}
+	}
+}
+
+void LatticeBoltzmannSolver::StreamCollideCell(int x, int y)
+{
+	float speed = params.spatialStepSize / params.timeStepSize;
+	__m128 gravity = _mm_set1_ps(params.gravity / (speed * speed));
+	__m128 omega = _mm_set1_ps(1.0f / tau);
+
+	// The outgoing distribution along i goes where the incoming one along the opposite direction came from
+	size_t slots[9];
+	__m128 f[9];
+	for (int i = 0; i < 9; i++) {
+		slots[i] = Slot(x, y, i);
+		f[i] = _mm_set_ss(distributions[slots[i]]);
+	}
+	Collide(f, gravity, omega);
+	for (int i = 0; i < 9; i++) {
+		distributions[slots[Opposite[i]]] = _mm_cvtss_f32(f[i]);
+	}
+}
+
+std::vector<LatticeBoltzmannSolver::Throughput> LatticeBoltzmannSolver::Benchmark(int steps)
+{
+	std::vector<Throughput> results;
+	SimulationParameters parameters;
+	parameters.timeStepSize = 0.005f;
+
+	for (int size : BenchmarkSizes) {
+		// Still water with a small pulse, so the fluxes are not trivially zero
+		SimulationGrid2D initial(size, size, 10.0f);
+		float width = size / 8.0f;
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+				float dx = (x - size * 0.5f) / width;
+				float dy = (y - size * 0.5f) / width;
+				initial.SetValue(SimulationGrid2D::Height, x, y, 10.0f + expf(-(dx * dx + dy * dy)));
+			}
+		}
+
+		// Each solver starts from the same state, the first steps are a warm up
+		LatticeBoltzmannSolver lattice;
+		MacCormackSolver macCormack;
+		ShallowWaterSolver* solvers[2] = { &lattice, &macCormack };
+		float rates[2];
+		for (int s = 0; s < 2; s++) {
+			SimulationGrid2D grid(initial);
+			solvers[s]->SetParameters(parameters);
+			solvers[s]->Step(&grid);
+			auto start = std::chrono::high_resolution_clock::now();
+			if (s == 0) {
+				lattice.Advance(&grid, steps);
+			}
+			else {
+				for (int i = 0; i < steps; i++) {
+					macCormack.Step(&grid);
+				}
+			}
+			float seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start).count();
+			rates[s] = (float)size * size * steps / (seconds * 1e6f);
+		}
+
+		Throughput throughput;
+		throughput.size = size;
+		throughput.latticeBoltzmann = rates[0];
+		throughput.macCormack = rates[1];
+		results.push_back(throughput);
+	}
+	return results;
+}
@@ -0,0 +1,105 @@
+#include "MacCormackKernel.h"
+#include <chrono>
+#include <cmath>
+
+const int MacCormackKernels::Sizes[MacCormackKernels::SizeCount] = { 256, 512, 660, 1024, 2048 };
+
+namespace
+{
+	// Kernels indexed [boundary][size], in the order of MacCormackKernels::Sizes
+	template<BoundaryType Boundary>
+	struct KernelTable
+	{
+		static const MacCormackKernels::Kernel kernels[MacCormackKernels::SizeCount];
+	};
+
+	template<BoundaryType Boundary>
+	const MacCormackKernels::Kernel KernelTable<Boundary>::kernels[MacCormackKernels::SizeCount] = {
+		&MacCormackKernel<256, 256, Boundary>,
+		&MacCormackKernel<512, 512, Boundary>,
+		&MacCormackKernel<660, 660, Boundary>,
+		&MacCormackKernel<1024, 1024, Boundary>,
+		&MacCormackKernel<2048, 2048, Boundary>
+	};
+
+	int SizeIndex(int sizeX, int sizeY)
+	{
+		if (sizeX != sizeY) {
+			return -1;
+		}
+		for (int i = 0; i < MacCormackKernels::SizeCount; i++) {
+			if (MacCormackKernels::Sizes[i] == sizeX) {
+				return i;
+			}
+		}
+		return -1;
+	}
+}
+
+MacCormackKernels::Kernel MacCormackKernels::Select(int sizeX, int sizeY, BoundaryType boundary)
+{
+	int index = SizeIndex(sizeX, sizeY);
+	if (index < 0) {
+		return Generic(boundary);
+	}
+	if (boundary == BoundaryType::Reflective) {
+		return KernelTable<BoundaryType::Reflective>::kernels[index];
+	}
+	return KernelTable<BoundaryType::Periodic>::kernels[index];
+}
+
+MacCormackKernels::Kernel MacCormackKernels::Generic(BoundaryType boundary)
+{
+	if (boundary == BoundaryType::Reflective) {
+		return &MacCormackKernel<0, 0, BoundaryType::Reflective>;
+	}
+	return &MacCormackKernel<0, 0, BoundaryType::Periodic>;
+}
+
+bool MacCormackKernels::IsSpecialised(int sizeX, int sizeY)
+{
+	return SizeIndex(sizeX, sizeY) >= 0;
+}
+
+std::vector<MacCormackKernels::Timing> MacCormackKernels::Benchmark(BoundaryType boundary, int steps)
+{
+	std::vector<Timing> timings;
+	MacCormackWorkspace workspace;
+
+	for (int s = 0; s < SizeCount; s++) {
+		int size = Sizes[s];
+		workspace.Resize(size * size);
+
+		// Still water with a small pulse, so the fluxes are not trivially zero
+		std::vector<std::array<float, 4>> initial(size * size);
+		float width = size / 8.0f;
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+				float dx = (x - size * 0.5f) / width;
+				float dy = (y - size * 0.5f) / width;
+				std::array<float, 4> node = { { 10.0f + expf(-(dx * dx + dy * dy)), 0.0f, 0.0f, 0.0f } };
+				initial[y * size + x] = node;
+			}
+		}
+
+		// Each kernel starts from the same state, the first step is a warm up
+		Kernel kernels[2] = { Generic(boundary), Select(size, size, boundary) };
+		float times[2];
+		for (int k = 0; k < 2; k++) {
+			std::vector<std::array<float, 4>> grid = initial;
+			kernels[k](grid.data(), size, size, 9.8f, 0.005f, workspace);
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < steps; i++) {
+				kernels[k](grid.data(), size, size, 9.8f, 0.005f, workspace);
+			}
+			times[k] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / steps;
+		}
+
+		Timing timing;
+		timing.size = size;
+		timing.genericTime = times[0];
+		timing.specialisedTime = times[1];
+		timings.push_back(timing);
+	}
+	return timings;
+}
@@ -0,0 +1,174 @@
+#pragma once
+#include <array>
+#include <vector>
+
+// Boundary conditions of the CPU MacCormack kernels
+enum class BoundaryType
+{
+	Periodic = 0,   // the grid wraps around at the edges, like the wrap sampler on the GPU
+	Reflective = 1, // solid walls, the node beyond an edge mirrors the edge node with its normal discharge reversed
+	Count = 2
+};
+
+// Scratch arrays of a MacCormack step, one float per node in each
+struct MacCormackWorkspace
+{
+	void Resize(int nodes)
+	{
+		for (int k = 0; k < 3; k++) {
+			predicted[k].resize(nodes);
+			fluxF[k].resize(nodes);
+			fluxG[k].resize(nodes);
+		}
+	}
+
+	std::vector<float> predicted[3];
+	std::vector<float> fluxF[3];
+	std::vector<float> fluxG[3];
+};
+
+
+// One MacCormack step of a grid of nodes { height, x discharge, y discharge, bathymetry }, in place.
+// FixedX and FixedY give the grid size at compile time so every stride and trip count is a
+// constant, 0 takes them from sizeX and sizeY instead. The edges are peeled off the row loops,
+// so the interior loops have no wrap-around or boundary branches left in them.
+template<int FixedX, int FixedY, BoundaryType Boundary>
+void MacCormackKernel(std::array<float, 4>* grid, int sizeX, int sizeY, float gravity, float DTDXDY, MacCormackWorkspace& workspace)
+{
+	const int W = FixedX > 0 ? FixedX : sizeX;
+	const int H = FixedY > 0 ? FixedY : sizeY;
+	const bool reflective = Boundary == BoundaryType::Reflective;
+
+	float* __restrict F0 = workspace.fluxF[0].data();
+	float* __restrict F1 = workspace.fluxF[1].data();
+	float* __restrict F2 = workspace.fluxF[2].data();
+	float* __restrict G0 = workspace.fluxG[0].data();
+	float* __restrict G1 = workspace.fluxG[1].data();
+	float* __restrict G2 = workspace.fluxG[2].data();
+	float* __restrict ph = workspace.predicted[0].data();
+	float* __restrict pq = workspace.predicted[1].data();
+	float* __restrict pp = workspace.predicted[2].data();
+
+	/////////////////        MACCORMACK PREDICTOR STEP        /////////////////
+	// Fluxes of the corrected grid, dry nodes carry no momentum
+	for (int i = 0; i < W * H; i++) {
+		float h = grid[i][0];
+		float q = grid[i][1];
+		float p = grid[i][2];
+		float inverseH = h > 1e-6f ? 1.0f / h : 0.0f;
+		float hydrostatic = 0.5f * gravity * h * h;
+		F0[i] = q;
+		F1[i] = q * q * inverseH + hydrostatic;
+		F2[i] = q * p * inverseH;
+		G0[i] = p;
+		G1[i] = p * q * inverseH;
+		G2[i] = p * p * inverseH + hydrostatic;
+	}
+
+	// Forward differences. A wall reverses the discharge normal to it, which flips the sign of
+	// the F components 0 and 2 across a vertical wall and the G components 0 and 1 across a horizontal one.
+	// The bed slope is taken with the mean depth across each face, so still water over an uneven
+	// bed stays still. Beyond a wall the bed is the edge node's, with no slope.
+	const float halfGravity = 0.5f * gravity;
+	for (int y = 0; y < H; y++) {
+		int row = y * W;
+		bool lastRow = y == H - 1;
+		int bottom = lastRow ? (reflective ? row : 0) : row + W;
+		float sg = lastRow && reflective ? -1.0f : 1.0f;
+
+		for (int x = 0; x < W - 1; x++) {
+			int i = row + x;
+			int b = bottom + x;
+			ph[i] = grid[i][0] - DTDXDY * ((F0[i + 1] - F0[i]) + (sg * G0[b] - G0[i]));
+			float slopeX = halfGravity * (grid[i][0] + grid[i + 1][0]) * (grid[i + 1][3] - grid[i][3]);
+			float slopeY = halfGravity * (grid[i][0] + grid[b][0]) * (grid[b][3] - grid[i][3]);
+			pq[i] = grid[i][1] - DTDXDY * ((F1[i + 1] - F1[i]) + (sg * G1[b] - G1[i]) + slopeX);
+			pp[i] = grid[i][2] - DTDXDY * ((F2[i + 1] - F2[i]) + (G2[b] - G2[i]) + slopeY);
+		}
+
+		int i = row + W - 1;
+		int b = bottom + W - 1;
+		int r = reflective ? i : row;
+		float sf = reflective ? -1.0f : 1.0f;
+		ph[i] = grid[i][0] - DTDXDY * ((sf * F0[r] - F0[i]) + (sg * G0[b] - G0[i]));
+		float slopeX = halfGravity * (grid[i][0] + grid[r][0]) * (grid[r][3] - grid[i][3]);
+		float slopeY = halfGravity * (grid[i][0] + grid[b][0]) * (grid[b][3] - grid[i][3]);
+		pq[i] = grid[i][1] - DTDXDY * ((F1[r] - F1[i]) + (sg * G1[b] - G1[i]) + slopeX);
+		pp[i] = grid[i][2] - DTDXDY * ((sf * F2[r] - F2[i]) + (G2[b] - G2[i]) + slopeY);
+	}
+
+	/////////////////        MACCORMACK CORRECTOR STEP        /////////////////
+	// Fluxes of the predicted grid
+	for (int i = 0; i < W * H; i++) {
+		float h = ph[i];
+		float q = pq[i];
+		float p = pp[i];
+		float inverseH = h > 1e-6f ? 1.0f / h : 0.0f;
+		float hydrostatic = 0.5f * gravity * h * h;
+		F0[i] = q;
+		F1[i] = q * q * inverseH + hydrostatic;
+		F2[i] = q * p * inverseH;
+		G0[i] = p;
+		G1[i] = p * q * inverseH;
+		G2[i] = p * p * inverseH + hydrostatic;
+	}
+
+	// Backward differences averaged with the old state
+	for (int y = 0; y < H; y++) {
+		int row = y * W;
+		bool firstRow = y == 0;
+		int top = firstRow ? (reflective ? row : (H - 1) * W) : row - W;
+		float sg = firstRow && reflective ? -1.0f : 1.0f;
+
+		int i = row;
+		int t = top;
+		int l = reflective ? i : row + W - 1;
+		float sf = reflective ? -1.0f : 1.0f;
+		grid[i][0] = 0.5f * (grid[i][0] + ph[i] - DTDXDY * ((F0[i] - sf * F0[l]) + (G0[i] - sg * G0[t])));
+		float slopeX = halfGravity * (ph[i] + ph[l]) * (grid[i][3] - grid[l][3]);
+		float slopeY = halfGravity * (ph[i] + ph[t]) * (grid[i][3] - grid[t][3]);
+		grid[i][1] = 0.5f * (grid[i][1] + pq[i] - DTDXDY * ((F1[i] - F1[l]) + (G1[i] - sg * G1[t]) + slopeX));
+		grid[i][2] = 0.5f * (grid[i][2] + pp[i] - DTDXDY * ((F2[i] - sf * F2[l]) + (G2[i] - G2[t]) + slopeY));
+
+		for (int x = 1; x < W; x++) {
+			i = row + x;
+			t = top + x;
+			grid[i][0] = 0.5f * (grid[i][0] + ph[i] - DTDXDY * ((F0[i] - F0[i - 1]) + (G0[i] - sg * G0[t])));
+			slopeX = halfGravity * (ph[i] + ph[i - 1]) * (grid[i][3] - grid[i - 1][3]);
+			slopeY = halfGravity * (ph[i] + ph[t]) * (grid[i][3] - grid[t][3]);
+			grid[i][1] = 0.5f * (grid[i][1] + pq[i] - DTDXDY * ((F1[i] - F1[i - 1]) + (G1[i] - sg * G1[t]) + slopeX));
+			grid[i][2] = 0.5f * (grid[i][2] + pp[i] - DTDXDY * ((F2[i] - F2[i - 1]) + (G2[i] - G2[t]) + slopeY));
+		}
+	}
+}
+
+
+// Picks the MacCormack kernel specialised for a grid size and boundary, and measures the
+// specialised kernels against the generic one
+class MacCormackKernels
+{
+
+public:
+
+	typedef void(*Kernel)(std::array<float, 4>* grid, int sizeX, int sizeY, float gravity, float DTDXDY, MacCormackWorkspace& workspace);
+
+	// Square grid sizes with a specialised kernel
+	static const int SizeCount = 5;
+	static const int Sizes[SizeCount];
+
+	// Returns the specialised kernel when there is one, the generic kernel otherwise
+	static Kernel Select(int sizeX, int sizeY, BoundaryType boundary);
+	static Kernel Generic(BoundaryType boundary);
+	static bool IsSpecialised(int sizeX, int sizeY);
+
+	struct Timing
+	{
+		int size;
+		float genericTime;     // milliseconds per step
+		float specialisedTime;
+	};
+
+	// Time both kernels on a still basin with a pulse at every specialised size
+	static std::vector<Timing> Benchmark(BoundaryType boundary, int steps);
+
+};
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file, so large files can be used in place rather
+// than read into a buffer first.
+class MappedFile
+{
+
+public:
+
+	MappedFile(const std::string& filename);
+	~MappedFile();
+
+	bool IsOpen();
+	const char* GetData();
+	size_t GetSize();
+
+private:
+
+	const char* data;
+	size_t size;
+	void* fileHandle;
+	void* mappingHandle;
+
+};
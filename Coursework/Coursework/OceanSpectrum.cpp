@@ -0,0 +1,341 @@
+#include "OceanSpectrum.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	const float Pi = 3.14159265358979f;
+
+	// Waves running against the wind keep this fraction of their energy
+	const float AgainstWind = 0.07f;
+
+	// Uniform number in (0, 1] from a hash of the seed and an index, so the amplitudes do not
+	// depend on the thread count or the order they are drawn in
+	float HashUniform(unsigned int seed, unsigned int index)
+	{
+		unsigned int h = index * 0x9E3779B9u ^ seed * 0x85EBCA6Bu;
+		h ^= h >> 16;
+		h *= 0x7FEB352Du;
+		h ^= h >> 15;
+		h *= 0x846CA68Bu;
+		h ^= h >> 16;
+		return ((h >> 8) + 1) * (1.0f / 16777216.0f);
+	}
+}
+
+OceanSpectrum::OceanSpectrum(TaskScheduler* taskScheduler) : fourier(taskScheduler)
+{
+	scheduler = taskScheduler;
+	amplitudesValid = false;
+	size = 0;
+	variance = 0.0f;
+	lastTime = 0.0f;
+	transformTime = 0.0f;
+	evaluatedTime = 0.0f;
+	timeStep = 0.0f;
+	evaluated = false;
+}
+
+OceanSpectrum::~OceanSpectrum()
+{
+}
+
+const char* OceanSpectrum::GetName(Spectrum spectrum)
+{
+	switch (spectrum) {
+	case Jonswap:
+		return "JONSWAP";
+	default:
+		return "Phillips";
+	}
+}
+
+bool OceanSpectrum::Resize(int newSize)
+{
+	if (!fourier.Resize(newSize, newSize)) {
+		return false;
+	}
+	if (newSize == size) {
+		return true;
+	}
+	size = newSize;
+	size_t count = (size_t)size * size;
+	for (std::vector<float>* v : { &amplitudeReal, &amplitudeImaginary, &mirrorReal, &mirrorImaginary, &frequency }) {
+		v->assign(count, 0.0f);
+	}
+	for (int i = 0; i < 4; i++) {
+		planeReal[i].assign(count, 0.0f);
+		planeImaginary[i].assign(count, 0.0f);
+	}
+	displacement.assign(count, { 0.0f, 0.0f, 0.0f, 1.0f });
+	previousDisplacement.assign(count, { 0.0f, 0.0f, 0.0f, 1.0f });
+	normals.assign(count, { 0.0f, 1.0f, 0.0f, 0.0f });
+	rowVariance.assign(size, 0.0);
+	amplitudesValid = false;
+	evaluated = false;
+	return true;
+}
+
+int OceanSpectrum::GetSize()
+{
+	return size;
+}
+
+void OceanSpectrum::SetSettings(const OceanSettings& newSettings)
+{
+	// The choppiness only scales the output, the rest changes the amplitudes
+	bool changed = newSettings.spectrum != settings.spectrum || newSettings.windSpeed != settings.windSpeed ||
+		newSettings.windDirection != settings.windDirection || newSettings.fetch != settings.fetch ||
+		newSettings.peakEnhancement != settings.peakEnhancement || newSettings.patchSize != settings.patchSize ||
+		newSettings.amplitudeScale != settings.amplitudeScale || newSettings.gravity != settings.gravity ||
+		newSettings.seed != settings.seed;
+	if (changed) {
+		amplitudesValid = false;
+		evaluated = false;
+	}
+	settings = newSettings;
+}
+
+const OceanSettings& OceanSpectrum::GetSettings()
+{
+	return settings;
+}
+
+ConstGridView OceanSpectrum::GetDisplacementView() const
+{
+	return ConstGridView(displacement.empty() ? nullptr : displacement[0].data(), size, size, (ptrdiff_t)size * 4);
+}
+
+ConstGridView OceanSpectrum::GetNormalView() const
+{
+	return ConstGridView(normals.empty() ? nullptr : normals[0].data(), size, size, (ptrdiff_t)size * 4);
+}
+
+ConstGridView OceanSpectrum::GetPreviousDisplacementView() const
+{
+	return ConstGridView(previousDisplacement.empty() ? nullptr : previousDisplacement[0].data(), size, size, (ptrdiff_t)size * 4);
+}
+
+float OceanSpectrum::GetLastTimeStep()
+{
+	return timeStep;
+}
+
+float OceanSpectrum::GetVariance()
+{
+	return variance;
+}
+
+float OceanSpectrum::GetLastTime()
+{
+	return lastTime;
+}
+
+float OceanSpectrum::GetLastTransformTime()
+{
+	return transformTime;
+}
+
+void OceanSpectrum::ForRows(int rows, const std::function<void(int, int)>& body)
+{
+	if (scheduler) {
+		scheduler->ParallelFor(0, rows, body, 8);
+	}
+	else {
+		body(0, rows);
+	}
+}
+
+float OceanSpectrum::Density(float kx, float kz)
+{
+	float k = sqrtf(kx * kx + kz * kz);
+	float g = settings.gravity;
+	float u = std::max(settings.windSpeed, 0.1f);
+
+	// cos^2 spreading about the wind, normalised over the half plane it blows into
+	float along = (kx * cosf(settings.windDirection) + kz * sinf(settings.windDirection)) / k;
+	float spreading = 2.0f / Pi * along * along * (along < 0.0f ? AgainstWind : 1.0f);
+
+	float omnidirectional;
+	if (settings.spectrum == Jonswap) {
+		// Frequency spectrum of a fetch limited sea, moved onto wavenumbers with dw/dk = g / 2w.
+		// Dividing by k turns the polar density into one per unit kx kz.
+		float fetch = std::max(settings.fetch, 1.0f);
+		float alpha = 0.076f * powf(u * u / (fetch * g), 0.22f);
+		float peak = 22.0f * powf(g * g / (u * fetch), 1.0f / 3.0f);
+		float w = sqrtf(g * k);
+		float sigma = w <= peak ? 0.07f : 0.09f;
+		float r = expf(-(w - peak) * (w - peak) / (2.0f * sigma * sigma * peak * peak));
+		float ratio = peak / w;
+		float s = alpha * g * g / powf(w, 5.0f) * expf(-1.25f * ratio * ratio * ratio * ratio) * powf(settings.peakEnhancement, r);
+		omnidirectional = s * g / (2.0f * w) / k;
+	}
+	else {
+		// Phillips saturation spectrum with the largest waves the wind can raise, L = U^2 / g,
+		// and the ripples much shorter than them suppressed
+		const float alpha = 0.0081f;
+		float largest = u * u / g;
+		float smallest = 0.001f * largest;
+		float kl = k * largest;
+		omnidirectional = 0.5f * alpha / (k * k * k * k) * expf(-1.0f / (kl * kl)) * expf(-k * k * smallest * smallest);
+	}
+	return settings.amplitudeScale * omnidirectional * spreading;
+}
+
+void OceanSpectrum::CreateAmplitudes()
+{
+	float step = 2.0f * Pi / settings.patchSize;
+	float cellArea = step * step;
+
+	// The inverse transform divides by the node count, the ocean sum does not
+	float scale = (float)size * size;
+
+	ForRows(size, [&](int y0, int y1) {
+		for (int iz = y0; iz < y1; iz++) {
+			double sum = 0.0;
+			for (int ix = 0; ix < size; ix++) {
+				size_t index = (size_t)iz * size + ix;
+				float kx = FourierTransform::Frequency(ix, size) * step;
+				float kz = FourierTransform::Frequency(iz, size) * step;
+				float k = sqrtf(kx * kx + kz * kz);
+				frequency[index] = sqrtf(settings.gravity * k);
+
+				// The Nyquist row and column have no partner at -k, so they are left empty. The
+				// mean height is zero.
+				if (ix == size / 2 || iz == size / 2 || k == 0.0f) {
+					amplitudeReal[index] = 0.0f;
+					amplitudeImaginary[index] = 0.0f;
+					continue;
+				}
+
+				// E|h0|^2 = F dk^2 / 2, the other half of the variance comes from the -k term
+				float density = Density(kx, kz) * cellArea;
+				float u1 = HashUniform(settings.seed, (unsigned int)(2 * index));
+				float u2 = HashUniform(settings.seed, (unsigned int)(2 * index + 1));
+				float radius = sqrtf(-2.0f * logf(u1));
+				float magnitude = sqrtf(0.25f * density) * scale;
+				amplitudeReal[index] = magnitude * radius * cosf(2.0f * Pi * u2);
+				amplitudeImaginary[index] = magnitude * radius * sinf(2.0f * Pi * u2);
+				sum += density;
+			}
+			rowVariance[iz] = sum;
+		}
+	});
+
+	ForRows(size, [&](int y0, int y1) {
+		for (int iz = y0; iz < y1; iz++) {
+			int mz = (size - iz) & (size - 1);
+			for (int ix = 0; ix < size; ix++) {
+				int mx = (size - ix) & (size - 1);
+				size_t index = (size_t)iz * size + ix;
+				size_t mirror = (size_t)mz * size + mx;
+				mirrorReal[index] = amplitudeReal[mirror];
+				mirrorImaginary[index] = -amplitudeImaginary[mirror];
+			}
+		}
+	});
+
+	double total = 0.0;
+	for (int iz = 0; iz < size; iz++) {
+		total += rowVariance[iz];
+	}
+	variance = (float)total;
+	amplitudesValid = true;
+}
+
+void OceanSpectrum::Evaluate(float time)
+{
+	if (size == 0) {
+		return;
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+	if (!amplitudesValid) {
+		CreateAmplitudes();
+	}
+	float step = 2.0f * Pi / settings.patchSize;
+
+	// Spectra of the eight real fields, paired A + i B so one inverse gives both:
+	// height and Dx, Dz and dh/dx, dh/dz and dDx/dx, dDz/dz and dDx/dz
+	ForRows(size, [&](int y0, int y1) {
+		for (int iz = y0; iz < y1; iz++) {
+			float kz = FourierTransform::Frequency(iz, size) * step;
+			for (int ix = 0; ix < size; ix++) {
+				size_t index = (size_t)iz * size + ix;
+				float kx = FourierTransform::Frequency(ix, size) * step;
+				float k = sqrtf(kx * kx + kz * kz);
+				float phase = frequency[index] * time;
+				float c = cosf(phase), s = sinf(phase);
+
+				// h = h0 e^(i w t) + conj(h0(-k)) e^(-i w t)
+				float ar = amplitudeReal[index], ai = amplitudeImaginary[index];
+				float mr = mirrorReal[index], mi = mirrorImaginary[index];
+				float hr = (ar + mr) * c - (ai - mi) * s;
+				float hi = (ai + mi) * c + (ar - mr) * s;
+
+				float ux = k > 0.0f ? kx / k : 0.0f;
+				float uz = k > 0.0f ? kz / k : 0.0f;
+
+				// Dx = -i kx / k h, dh/dx = i kx h, dDx/dx = kx^2 / k h, and so on. Multiplying a
+				// field B by i before adding it to A: A + i B = (Ar - Bi) + i (Ai + Br).
+				float dxr = ux * hi, dxi = -ux * hr;
+				float dzr = uz * hi, dzi = -uz * hr;
+				float sxr = -kx * hi, sxi = kx * hr;
+				float szr = -kz * hi, szi = kz * hr;
+				float xxr = kx * ux * hr, xxi = kx * ux * hi;
+				float zzr = kz * uz * hr, zzi = kz * uz * hi;
+				float xzr = kx * uz * hr, xzi = kx * uz * hi;
+
+				planeReal[0][index] = hr - dxi;
+				planeImaginary[0][index] = hi + dxr;
+				planeReal[1][index] = dzr - sxi;
+				planeImaginary[1][index] = dzi + sxr;
+				planeReal[2][index] = szr - xxi;
+				planeImaginary[2][index] = szi + xxr;
+				planeReal[3][index] = zzr - xzi;
+				planeImaginary[3][index] = zzi + xzr;
+			}
+		}
+	});
+
+	auto transformStart = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < 4; i++) {
+		fourier.Inverse2D(planeReal[i].data(), planeImaginary[i].data());
+	}
+	auto transformEnd = std::chrono::high_resolution_clock::now();
+	transformTime = std::chrono::duration<float, std::milli>(transformEnd - transformStart).count();
+
+	// Pack the maps, keeping the last ones for differencing. A new sea has no history.
+	// The normal is that of the height field before the horizontal displacement.
+	displacement.swap(previousDisplacement);
+	timeStep = evaluated ? time - evaluatedTime : 0.0f;
+	evaluatedTime = time;
+	float lambda = settings.choppiness;
+	ForRows(size, [&](int y0, int y1) {
+		for (int iz = y0; iz < y1; iz++) {
+			for (int ix = 0; ix < size; ix++) {
+				size_t index = (size_t)iz * size + ix;
+				float height = planeReal[0][index];
+				float dx = planeImaginary[0][index];
+				float dz = planeReal[1][index];
+				float slopeX = planeImaginary[1][index];
+				float slopeZ = planeReal[2][index];
+				float dxx = planeImaginary[2][index];
+				float dzz = planeReal[3][index];
+				float dxz = planeImaginary[3][index];
+
+				float jacobian = (1.0f + lambda * dxx) * (1.0f + lambda * dzz) - lambda * lambda * dxz * dxz;
+				displacement[index] = { lambda * dx, height, lambda * dz, jacobian };
+
+				float inverseLength = 1.0f / sqrtf(slopeX * slopeX + 1.0f + slopeZ * slopeZ);
+				normals[index] = { -slopeX * inverseLength, inverseLength, -slopeZ * inverseLength, 0.0f };
+			}
+		}
+	});
+
+	if (!evaluated) {
+		previousDisplacement = displacement;
+		evaluated = true;
+	}
+	lastTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
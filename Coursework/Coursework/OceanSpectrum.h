@@ -0,0 +1,114 @@
+#pragma once
+#include <array>
+#include <vector>
+#include "FourierTransform.h"
+#include "GridView.h"
+
+// Settings of a wind driven deep water sea
+struct OceanSettings
+{
+	int spectrum = 0;              // OceanSpectrum::Spectrum
+	float windSpeed = 10.0f;       // m/s at 10 m
+	float windDirection = 0.0f;    // radians from +x towards +z
+	float fetch = 100000.0f;       // m, JONSWAP only
+	float peakEnhancement = 3.3f;  // JONSWAP gamma
+	float patchSize = 250.0f;      // m covered by one tile of the maps
+	float amplitudeScale = 1.0f;
+	float choppiness = 1.0f;       // horizontal displacement scale, 0 gives plain heights
+	float gravity = 9.81f;
+	unsigned int seed = 1;
+};
+
+// Tessendorf ocean. Random amplitudes h0(k) are drawn once from a Phillips or JONSWAP
+// spectrum with a cos^2 spreading about the wind. Every evaluation rotates them by the deep
+// water dispersion w = sqrt(g |k|), h(k, t) = h0(k) e^(i w t) + conj(h0(-k)) e^(-i w t), forms
+// the spectra of the horizontal displacement (-i k / |k| h), the slopes (i k h) and the
+// displacement derivatives, and inverts them with the in-house FFT. Real fields are paired
+// as the real and imaginary parts of one complex transform, so the eight fields cost four
+// inverse transforms, whatever the number of waves.
+//
+// The maps tile every patchSize metres. Node (x, z) of the displacement map holds the
+// horizontal displacement along x, the height and the displacement along z, then the
+// Jacobian of the horizontal mapping, which drops below one where crests fold (foam). The
+// normal map holds the unit normal of the height field and zero.
+class OceanSpectrum
+{
+
+public:
+
+	enum Spectrum
+	{
+		Phillips = 0,
+		Jonswap = 1,
+		SpectrumCount = 2
+	};
+
+	// A null scheduler evaluates on the calling thread
+	OceanSpectrum(TaskScheduler* scheduler = nullptr);
+	~OceanSpectrum();
+
+	// Set the number of nodes along each side, returns false if it is not a power of two
+	bool Resize(int size);
+	int GetSize();
+
+	// New amplitudes are drawn at the next evaluation when a setting other than the
+	// choppiness changed
+	void SetSettings(const OceanSettings& settings);
+	const OceanSettings& GetSettings();
+
+	// Fill the maps for the given time in seconds
+	void Evaluate(float time);
+
+	ConstGridView GetDisplacementView() const;
+	ConstGridView GetNormalView() const;
+
+	// Displacement map of the evaluation before the last, and the time between the two, so
+	// the surface velocity can be differenced. The step is zero after the first evaluation.
+	ConstGridView GetPreviousDisplacementView() const;
+	float GetLastTimeStep();
+
+	// Height variance the spectrum puts on the grid's wavenumbers, in m^2. The significant
+	// wave height is four times its square root.
+	float GetVariance();
+
+	// Milliseconds spent in the last evaluation, and in its inverse transforms
+	float GetLastTime();
+	float GetLastTransformTime();
+
+	static const char* GetName(Spectrum spectrum);
+
+private:
+
+	void ForRows(int rows, const std::function<void(int, int)>& body);
+
+	// Directional wavenumber spectrum, variance per unit kx kz
+	float Density(float kx, float kz);
+	void CreateAmplitudes();
+
+	TaskScheduler* scheduler;
+	FourierTransform fourier;
+	OceanSettings settings;
+	bool amplitudesValid;
+	int size;
+	float variance;
+
+	// h0(k) and conj(h0(-k)) scaled for the unnormalised inverse, and the dispersion
+	std::vector<float> amplitudeReal, amplitudeImaginary;
+	std::vector<float> mirrorReal, mirrorImaginary;
+	std::vector<float> frequency;
+	std::vector<double> rowVariance;
+
+	// Four complex planes, each pairing two real fields
+	std::array<std::vector<float>, 4> planeReal, planeImaginary;
+
+	std::vector<std::array<float, 4>> displacement;
+	std::vector<std::array<float, 4>> previousDisplacement;
+	std::vector<std::array<float, 4>> normals;
+
+	float lastTime;
+	float transformTime;
+	float evaluatedTime;
+	float timeStep;
+	bool evaluated;
+
+};
@@ -0,0 +1,111 @@
+#include "PatchMesh.h"
+
+PatchMesh::PatchMesh(ID3D11Device* ID3D11_device, ID3D11DeviceContext* device_context, int cellCount)
+{
+	cells = cellCount;
+	device = ID3D11_device;
+	deviceContext = device_context;
+	initBuffers(device);
+}
+
+// Release resources
+PatchMesh::~PatchMesh()
+{
+	// Run parent deconstructor
+	BaseMesh::~BaseMesh();
+}
+
+
+void PatchMesh::initBuffers(ID3D11Device* device)
+{
+	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
+	D3D11_SUBRESOURCE_DATA vertexData, indexData;
+
+	// Vertices along each side
+	UINT n = cells + 1;
+	UINT half = cells / 2;
+	vertexCount = n * n;
+
+	vertices = new VertexType[vertexCount];
+	for (UINT j = 0; j < n; ++j)
+	{
+		for (UINT i = 0; i < n; ++i)
+		{
+			vertices[j * n + i].position = XMFLOAT3((float)i, 0.0f, (float)j);
+			vertices[j * n + i].normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			vertices[j * n + i].texture = XMFLOAT2((float)i / cells, (float)j / cells);
+		}
+	}
+
+	// Quarter by quarter, bit 0 at the smallest x and z, bit 1 along x, bit 2 along z. The
+	// triangles wind the same way as PlanarMesh's.
+	indexCount = cells * cells * 6;
+	indices = new unsigned long[indexCount];
+	UINT k = 0;
+	for (UINT q = 0; q < 4; ++q)
+	{
+		UINT i0 = (q & 1) * half;
+		UINT j0 = (q >> 1) * half;
+		for (UINT j = j0; j < j0 + half; ++j)
+		{
+			for (UINT i = i0; i < i0 + half; ++i)
+			{
+				indices[k] = j * n + i + 1;
+				indices[k + 1] = (j + 1) * n + i + 1;
+				indices[k + 2] = j * n + i;
+				indices[k + 3] = j * n + i;
+				indices[k + 4] = (j + 1) * n + i + 1;
+				indices[k + 5] = (j + 1) * n + i;
+				k += 6;
+			}
+		}
+	}
+
+	// Set up the description of the static vertex buffer
+	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	vertexBufferDesc.ByteWidth = sizeof(VertexType) * vertexCount;
+	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vertexBufferDesc.CPUAccessFlags = 0;
+	vertexBufferDesc.MiscFlags = 0;
+	vertexBufferDesc.StructureByteStride = 0;
+
+	// Give the subresource structure a pointer to the vertex data
+	vertexData.pSysMem = vertices;
+	vertexData.SysMemPitch = 0;
+	vertexData.SysMemSlicePitch = 0;
+
+	// Now create the vertex buffer
+	device->CreateBuffer(&vertexBufferDesc, &vertexData, &vertexBuffer);
+
+	// Set up the description of the static index buffer
+	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	indexBufferDesc.ByteWidth = sizeof(unsigned long) * indexCount;
+	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexBufferDesc.CPUAccessFlags = 0;
+	indexBufferDesc.MiscFlags = 0;
+	indexBufferDesc.StructureByteStride = 0;
+
+	// Give the subresource structure a pointer to the index data
+	indexData.pSysMem = indices;
+	indexData.SysMemPitch = 0;
+	indexData.SysMemSlicePitch = 0;
+	// Create the index buffer.
+	device->CreateBuffer(&indexBufferDesc, &indexData, &indexBuffer);
+
+	// Release the arrays now that the buffers have been created and loaded
+	delete[] vertices;
+	vertices = 0;
+	delete[] indices;
+	indices = 0;
+
+}
+
+int PatchMesh::GetCells()
+{
+	return cells;
+}
+
+int PatchMesh::GetQuadrantIndexCount()
+{
+	return (cells / 2) * (cells / 2) * 6;
+}
@@ -0,0 +1,33 @@
+#ifndef _PATCHMESH_H_
+#define _PATCHMESH_H_
+#include "BaseMesh.h"
+
+class PatchMesh : public BaseMesh
+{
+public:
+
+	// Initialises and builds the grid patch every node of the water quadtree is drawn with.
+	// Vertex positions are the x and z grid coordinates within the patch, from 0 to cells, the
+	// vertex shader places and morphs them. Indices are grouped by quarter of the patch so a
+	// quarter can be drawn on its own, bit q of a quadrant mask starting at q times the
+	// quadrant index count.
+	PatchMesh(ID3D11Device* device, ID3D11DeviceContext* device_context, int cells);
+	~PatchMesh();
+
+	int GetCells();
+	int GetQuadrantIndexCount();
+
+
+protected:
+	void initBuffers(ID3D11Device* device) override;
+
+	ID3D11DeviceContext* deviceContext;
+	ID3D11Device* device;
+
+	int cells;
+	VertexType* vertices;
+	unsigned long* indices;
+
+};
+
+#endif
@@ -1,5 +1,13 @@
 #include "PlanarMesh.h"
+#include <algorithm>
 #include <iostream>
+
+namespace
+{
+	// Cells along the side of a chunk
+	const UINT ChunkCells = 64;
+}
+
 PlanarMesh::PlanarMesh(ID3D11Device* ID3D11_device, ID3D11DeviceContext* device_context, int res)
 {
 	resolution = res;
@@ -62,21 +70,40 @@ void PlanarMesh::initBuffers(ID3D11Device* device)
 		}
 	}
 
-	// Set indices
+	// Set indices, chunk by chunk. Rows run towards -z, so chunks start from the last row.
 	indexCount = faceCnt * 3;
 	indices = new unsigned long[indexCount];
+	chunks.clear();
 	UINT k = 0;
-	for (UINT i = 0; i < m - 1; ++i)
+	for (UINT i1 = m - 1; i1 > 0; i1 -= std::min(ChunkCells, i1))
 	{
-		for (UINT j = 0; j < n - 1; ++j)
+		UINT i0 = i1 - std::min(ChunkCells, i1);
+		for (UINT j0 = 0; j0 < n - 1; j0 += ChunkCells)
 		{
-			indices[k + 5] = i * n + j;
-			indices[k + 4] = i * n + j + 1;
-			indices[k + 3] = (i + 1) * n + j;
-			indices[k + 2] = (i + 1) * n + j;
-			indices[k + 1] = i * n + j + 1;
-			indices[k] = (i + 1) * n + j + 1;
-			k += 6;
+			UINT j1 = std::min(j0 + ChunkCells, n - 1);
+
+			Chunk chunk;
+			chunk.startIndex = k;
+			chunk.minX = -halfWidth + j0 * dx;
+			chunk.maxX = -halfWidth + j1 * dx;
+			chunk.minZ = halfDepth - i1 * dz;
+			chunk.maxZ = halfDepth - i0 * dz;
+
+			for (UINT i = i0; i < i1; ++i)
+			{
+				for (UINT j = j0; j < j1; ++j)
+				{
+					indices[k + 5] = i * n + j;
+					indices[k + 4] = i * n + j + 1;
+					indices[k + 3] = (i + 1) * n + j;
+					indices[k + 2] = (i + 1) * n + j;
+					indices[k + 1] = i * n + j + 1;
+					indices[k] = (i + 1) * n + j + 1;
+					k += 6;
+				}
+			}
+			chunk.indexCount = k - chunk.startIndex;
+			chunks.push_back(chunk);
 		}
 	}
 
@@ -123,6 +150,11 @@ int PlanarMesh::GetResolution()
 	return resolution;
 }
 
+const std::vector<PlanarMesh::Chunk>& PlanarMesh::GetChunks()
+{
+	return chunks;
+}
+
 
 
 
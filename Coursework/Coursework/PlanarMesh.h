@@ -1,6 +1,7 @@
 #ifndef _PLANARMESH_H_
 #define _PLANARMESH_H_
 #include "BaseMesh.h"
+#include <vector>
 
 class PlanarMesh : public BaseMesh
 {
@@ -13,6 +14,17 @@ public:
 
 	int GetResolution();
 
+	// The triangles are laid out square chunk by chunk, each chunk a run of the index buffer, so
+	// parts of the plane can be drawn on their own. Chunks go along x first, from -z to +z.
+	struct Chunk
+	{
+		int startIndex;
+		int indexCount;
+		float minX, maxX;
+		float minZ, maxZ;
+	};
+	const std::vector<Chunk>& GetChunks();
+
 
 protected:
 	void initBuffers(ID3D11Device* device) override;
@@ -21,6 +33,7 @@ protected:
 	ID3D11Device* device;
 
 	int resolution;
+	std::vector<Chunk> chunks;
 	VertexType* vertices;
 	unsigned long* indices;
 
@@ -1,12 +1,17 @@
 #include "PredictionShader.h"
 #include <iostream>
 
-PredictionShader::PredictionShader(ID3D11Device* dev, ID3D11DeviceContext* deviceCntxt, HWND hwnd, int gsize) : BaseShader(device, hwnd)
+PredictionShader::PredictionShader(ID3D11Device* dev, ID3D11DeviceContext* deviceCntxt, HWND hwnd, int gsize, GridTexturePool* pool) : BaseShader(device, hwnd)
 {
 	gridSize = gsize;
 	device = dev;
 	deviceContext = deviceCntxt;
+	texturePool = pool;
 	initShader(L"default_vs.cso", L"predictor_step_ps.cso");
+
+	// The upload textures are created once here rather than every step
+	predictedGridTexture2D = texturePool->Acquire(gridSize, gridSize);
+	correctedGridTexture2D = texturePool->Acquire(gridSize, gridSize);
 }
 
 PredictionShader::~PredictionShader()
@@ -21,6 +26,13 @@ PredictionShader::~PredictionShader()
 		layout->Release();
 		layout = 0;
 	}
+	// Hand the upload textures back to the pool
+	if (predictedGridTexture2D) {
+		texturePool->Release(predictedGridTexture2D);
+	}
+	if (correctedGridTexture2D) {
+		texturePool->Release(correctedGridTexture2D);
+	}
 	//Release base shader components
 	BaseShader::~BaseShader();
 
@@ -35,6 +47,19 @@ void PredictionShader::setSimulationParameters(float g_, float n_, float timeSte
 }
 
 
+// Called when the simulation is re-gridded, the upload textures are swapped for ones of the new size
+void PredictionShader::setGridSize(int gsize)
+{
+	if (gsize == gridSize) {
+		return;
+	}
+	gridSize = gsize;
+	texturePool->Release(predictedGridTexture2D);
+	texturePool->Release(correctedGridTexture2D);
+	predictedGridTexture2D = texturePool->Acquire(gridSize, gridSize);
+	correctedGridTexture2D = texturePool->Acquire(gridSize, gridSize);
+}
+
 void PredictionShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilename)
 {
 
@@ -144,78 +169,19 @@ void PredictionShader::setShaderParameters(const XMMATRIX& world, const XMMATRIX
 	deviceContext->PSSetConstantBuffers(1, 1, &simulationBuffer);
 
 
-	// Creating the 2D texture containing the predicted grid
-	D3D11_TEXTURE2D_DESC desc2D;
-	D3D11_SUBRESOURCE_DATA data2D;
-
-	// Flatten the 2D grid to 1D so it can be stored in the 2D texture
-	std::vector<std::vector<std::array<float, 4>>> grid2D = predictedGrid->GetSimulationGrid2D();
-	std::vector<std::array<float, 4>> grid1D;
-
-	for (auto& row : grid2D) {
-		grid1D.insert(grid1D.end(), row.begin(), row.end());
-	}
-	// Set the 2D texture data
-	data2D.pSysMem = grid1D.data();
-	data2D.SysMemPitch = gridSize * sizeof(std::array<float, 4>);
-	// Defining the 2D texture
-	desc2D.Width = gridSize;
-	desc2D.Height = gridSize;
-	desc2D.MipLevels = 1;
-	desc2D.ArraySize = 1;
-	desc2D.Format = DXGI_FORMAT_R32G32B32A32_FLOAT; // R holds height, G holds x flux, B holds y flux
-	desc2D.SampleDesc.Count = 1;
-	desc2D.SampleDesc.Quality = 0;
-	desc2D.Usage = D3D11_USAGE_DYNAMIC;
-	desc2D.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-	desc2D.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	desc2D.MiscFlags = 0;
-	device->CreateTexture2D(&desc2D, &data2D, &predictedGridTexture2D);
-
-	// Create shader resource view for 2D texture
-	D3D11_SHADER_RESOURCE_VIEW_DESC SRVDesc;
-	SRVDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-	SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	SRVDesc.Texture2D.MostDetailedMip = 0;
-	SRVDesc.Texture2D.MipLevels = 1;
-	device->CreateShaderResourceView(predictedGridTexture2D, &SRVDesc, &predictedGridTexture2DView);
-
-
-
-
-	// Creating the 2D texture containing the corrected grid
-	std::vector<std::vector<std::array<float, 4>>> grid2Dc = correctedGrid->GetSimulationGrid2D();
-	std::vector<std::array<float, 4>> grid1Dc;
-
-	for (auto& row : grid2Dc) {
-		grid1Dc.insert(grid1Dc.end(), row.begin(), row.end());
+	// The grids are only read by the shader on the first pass, so they are only uploaded then.
+	// The rows are written straight into the pooled textures.
+	if (firstPass) {
+		texturePool->Upload(predictedGridTexture2D, predictedGrid);
+		texturePool->Upload(correctedGridTexture2D, correctedGrid);
 	}
-	data2D.pSysMem = grid1Dc.data();
-	data2D.SysMemPitch = gridSize * sizeof(std::array<float, 4>);
-	desc2D.Width = gridSize;
-	desc2D.Height = gridSize;
-	desc2D.MipLevels = 1;
-	desc2D.ArraySize = 1;
-	desc2D.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-	desc2D.SampleDesc.Count = 1;
-	desc2D.SampleDesc.Quality = 0;
-	desc2D.Usage = D3D11_USAGE_DYNAMIC;
-	desc2D.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-	desc2D.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	desc2D.MiscFlags = 0;
-	device->CreateTexture2D(&desc2D, &data2D, &correctedGridTexture2D);
-
-	SRVDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-	SRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	SRVDesc.Texture2D.MostDetailedMip = 0;
-	SRVDesc.Texture2D.MipLevels = 1;
-	device->CreateShaderResourceView(correctedGridTexture2D, &SRVDesc, &correctedGridTexture2DView);
-
 
 	// Bind the 2D predicted grid texture to the pixel shader
+	ID3D11ShaderResourceView* predictedGridTexture2DView = predictedGridTexture2D ? (ID3D11ShaderResourceView*)predictedGridTexture2D->view : nullptr;
 	deviceContext->PSSetShaderResources(0, 1, &predictedGridTexture2DView);
 
 	// Bind the 2D corrected grid texture to the pixel shader
+	ID3D11ShaderResourceView* correctedGridTexture2DView = correctedGridTexture2D ? (ID3D11ShaderResourceView*)correctedGridTexture2D->view : nullptr;
 	deviceContext->PSSetShaderResources(1, 1, &correctedGridTexture2DView);
 
 	// Set render texture resource containing the predicted simulation grid data in the pixel shader.
@@ -1,6 +1,7 @@
 #pragma once
 #include "DXF.h"
 #include "SimulationGrid2D.h"
+#include "GridTexturePool.h"
 using namespace DirectX;
 
 class PredictionShader : public BaseShader
@@ -32,9 +33,10 @@ class PredictionShader : public BaseShader
 
 public:
 
-	PredictionShader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, HWND hwnd, int gridSize);
+	PredictionShader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, HWND hwnd, int gridSize, GridTexturePool* texturePool);
 	~PredictionShader();
 	void setSimulationParameters(float gravity, float n, float timeStepSize, float cr);
+	void setGridSize(int gridSize);
 
 	void setShaderParameters(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, float DTDXDY, ID3D11ShaderResourceView* predictedGridTex, ID3D11ShaderResourceView* correctedGridTex, bool firstPass, SimulationGrid2D* predictedGrid, SimulationGrid2D* correctedGrid);
 
@@ -48,13 +50,10 @@ private:
 
 
 
-	// 2D textures used to send the simulation grid to the GPU
-	ID3D11Texture2D* predictedGridTexture2D;
-	ID3D11Texture2D* correctedGridTexture2D;
-
-	// Shader resource views for the 2D grid textures
-	ID3D11ShaderResourceView* predictedGridTexture2DView;
-	ID3D11ShaderResourceView* correctedGridTexture2DView;
+	// 2D textures used to send the simulation grid to the GPU, taken from the pool once and reused every step
+	GridTexturePool* texturePool;
+	GridTexture* predictedGridTexture2D;
+	GridTexture* correctedGridTexture2D;
 
 
 	ID3D11SamplerState* sampleStateUVText;
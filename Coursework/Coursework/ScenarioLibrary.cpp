@@ -0,0 +1,449 @@
+#include "ScenarioLibrary.h"
+#include "MappedFile.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	const uint32_t CacheMagic = 0x314E4353; // "SCN1"
+	const float Pi = 3.14159265358979f;
+
+	// Cached states kept on disk, the least recently written are deleted past this
+	const int MaxCachedScenarios = 8;
+
+	// FNV-1a hash of the bytes of a value, used to key the cache
+	void HashBytes(uint64_t& hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+	}
+
+	template<typename T>
+	void HashValue(uint64_t& hash, const T& value)
+	{
+		HashBytes(hash, &value, sizeof(T));
+	}
+
+	// Hash of a whole file, so an edited image gives a new key. A missing file adds nothing.
+	void HashFile(uint64_t& hash, const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		char buffer[65536];
+		while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+			HashBytes(hash, buffer, (size_t)file.gcount());
+		}
+	}
+
+	// Greyscale binary PGM (P5) reader, values are returned in [0, 1]
+	bool LoadPGM(const std::string& path, std::vector<float>& pixels, int& width, int& height)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		// Header: magic, width, height and maximum value, with optional comments
+		std::string tokens[4];
+		for (int i = 0; i < 4; i++) {
+			file >> tokens[i];
+			while (!tokens[i].empty() && tokens[i][0] == '#') {
+				std::string comment;
+				std::getline(file, comment);
+				file >> tokens[i];
+			}
+		}
+		file.get(); // single whitespace before the pixel data
+		if (tokens[0] != "P5") {
+			return false;
+		}
+		width = std::stoi(tokens[1]);
+		height = std::stoi(tokens[2]);
+		int maxValue = std::stoi(tokens[3]);
+		if (width <= 0 || height <= 0 || maxValue <= 0 || maxValue > 65535) {
+			return false;
+		}
+
+		int bytesPerPixel = maxValue < 256 ? 1 : 2;
+		std::vector<unsigned char> raw(width * height * bytesPerPixel);
+		file.read((char*)raw.data(), raw.size());
+		if (file.gcount() != (std::streamsize)raw.size()) {
+			return false;
+		}
+
+		pixels.resize(width * height);
+		for (int i = 0; i < width * height; i++) {
+			int value = bytesPerPixel == 1 ? raw[i] : (raw[2 * i] << 8) | raw[2 * i + 1];
+			pixels[i] = (float)value / maxValue;
+		}
+		return true;
+	}
+}
+
+ScenarioLibrary::ScenarioLibrary(TaskScheduler* scheduler_, const std::string& cacheDirectory_)
+{
+	scheduler = scheduler_;
+	cacheDirectory = cacheDirectory_;
+	caching = true;
+	lastWasCached = false;
+	lastCreateTime = 0.0f;
+}
+
+const char* ScenarioLibrary::GetName(ScenarioType type)
+{
+	switch (type) {
+	case ScenarioType::GaussianPulse: return "Gaussian pulse";
+	case ScenarioType::DamBreak: return "Dam break";
+	case ScenarioType::MultipleDrops: return "Multiple drops";
+	case ScenarioType::ImageBasin: return "Image basin";
+	case ScenarioType::StandingWave: return "Standing wave";
+	default: return "Unknown";
+	}
+}
+
+void ScenarioLibrary::SetCaching(bool enabled)
+{
+	caching = enabled;
+}
+
+bool ScenarioLibrary::LastCreateWasCached()
+{
+	return lastWasCached;
+}
+
+float ScenarioLibrary::GetLastCreateTime()
+{
+	return lastCreateTime;
+}
+
+void ScenarioLibrary::ForRows(int rows, const std::function<void(int, int)>& body)
+{
+	if (scheduler) {
+		scheduler->ParallelFor(0, rows, body, 16);
+	}
+	else {
+		body(0, rows);
+	}
+}
+
+SimulationGrid2D* ScenarioLibrary::Create(const ScenarioSettings& settings, int nx, int ny)
+{
+	auto start = std::chrono::steady_clock::now();
+	SimulationGrid2D* grid = new SimulationGrid2D(nx, ny, settings.baseHeight);
+
+	std::string path = CachePath(settings, nx, ny);
+	lastWasCached = caching && LoadCached(path, grid);
+	if (!lastWasCached) {
+		Generate(settings, grid);
+		if (caching) {
+			SaveCached(path, grid);
+		}
+	}
+
+	lastCreateTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return grid;
+}
+
+void ScenarioLibrary::Generate(const ScenarioSettings& settings, SimulationGrid2D* grid)
+{
+	int sizeX = grid->GetSizeX();
+	int sizeY = grid->GetSizeY();
+	float width = settings.pulseWidth > 0.0f ? settings.pulseWidth : std::min(sizeX, sizeY) / 8.0f;
+
+	switch (settings.type) {
+	case ScenarioType::GaussianPulse: {
+		std::vector<float> x(1, (float)(sizeX / 2));
+		std::vector<float> y(1, (float)(sizeY / 2));
+		std::vector<float> h(1, settings.maxHeight);
+		GenerateDrops(x, y, h, width, settings.baseHeight, grid);
+		break;
+	}
+	case ScenarioType::MultipleDrops: {
+		// Drops are placed away from the edges, heights vary between half and full height
+		std::mt19937 random(settings.seed);
+		std::uniform_real_distribution<float> position(0.15f, 0.85f);
+		std::uniform_real_distribution<float> scale(0.5f, 1.0f);
+		std::vector<float> x, y, h;
+		for (int i = 0; i < settings.dropCount; i++) {
+			x.push_back(position(random) * sizeX);
+			y.push_back(position(random) * sizeY);
+			h.push_back(scale(random) * settings.maxHeight);
+		}
+		GenerateDrops(x, y, h, width * 0.5f, settings.baseHeight, grid);
+		break;
+	}
+	case ScenarioType::DamBreak:
+		GenerateDamBreak(settings, grid);
+		break;
+	case ScenarioType::ImageBasin:
+		GenerateImageBasin(settings, grid);
+		break;
+	case ScenarioType::StandingWave:
+		GenerateStandingWave(settings, grid);
+		break;
+	default:
+		break;
+	}
+}
+
+void ScenarioLibrary::GenerateDrops(const std::vector<float>& dropX, const std::vector<float>& dropY, const std::vector<float>& dropHeight, float width, float baseHeight, SimulationGrid2D* grid)
+{
+	int sizeX = grid->GetSizeX();
+	int sizeY = grid->GetSizeY();
+	int drops = (int)dropX.size();
+	float inverseWidth = 1.0f / (2.0f * width * width);
+
+	// A gaussian is separable, exp(-(dx^2 + dy^2) / 2w^2) = exp(-dx^2 / 2w^2) * exp(-dy^2 / 2w^2),
+	// so each drop needs sizeX + sizeY exponentials and the grid is filled with multiplies
+	std::vector<float> profileX(drops * sizeX);
+	std::vector<float> profileY(drops * sizeY);
+	for (int d = 0; d < drops; d++) {
+		for (int i = 0; i < sizeX; i++) {
+			float dx = i - dropX[d];
+			profileX[d * sizeX + i] = std::exp(-dx * dx * inverseWidth);
+		}
+		for (int j = 0; j < sizeY; j++) {
+			float dy = j - dropY[d];
+			profileY[d * sizeY + j] = dropHeight[d] * std::exp(-dy * dy * inverseWidth);
+		}
+	}
+
+	GridView grid2D = grid->GetView();
+	ForRows(sizeY, [&](int rowBegin, int rowEnd) {
+		std::vector<float> row(sizeX);
+		for (int j = rowBegin; j < rowEnd; j++) {
+			std::fill(row.begin(), row.end(), baseHeight);
+			for (int d = 0; d < drops; d++) {
+				float scale = profileY[d * sizeY + j];
+				const float* profile = &profileX[d * sizeX];
+				for (int i = 0; i < sizeX; i++) {
+					row[i] += scale * profile[i];
+				}
+			}
+			for (int i = 0; i < sizeX; i++) {
+				grid2D.Row(j)[i] = { row[i], 0.0f, 0.0f, 0.0f };
+			}
+		}
+	});
+}
+
+void ScenarioLibrary::GenerateDamBreak(const ScenarioSettings& settings, SimulationGrid2D* grid)
+{
+	int sizeX = grid->GetSizeX();
+	int wall = (int)(settings.damPosition * sizeX);
+
+	GridView grid2D = grid->GetView();
+	ForRows(grid->GetSizeY(), [&](int rowBegin, int rowEnd) {
+		for (int j = rowBegin; j < rowEnd; j++) {
+			for (int i = 0; i < sizeX; i++) {
+				grid2D.Row(j)[i] = { i < wall ? settings.upstreamHeight : settings.downstreamHeight, 0.0f, 0.0f, 0.0f };
+			}
+		}
+	});
+}
+
+void ScenarioLibrary::GenerateImageBasin(const ScenarioSettings& settings, SimulationGrid2D* grid)
+{
+	int sizeX = grid->GetSizeX();
+	int sizeY = grid->GetSizeY();
+
+	// Without a readable image the basin has a flat bed
+	std::vector<float> pixels;
+	int imageWidth = 1;
+	int imageHeight = 1;
+	if (!LoadPGM(settings.imagePath, pixels, imageWidth, imageHeight)) {
+		pixels.assign(1, 0.0f);
+	}
+
+	// The image is stretched over the grid with bilinear filtering, the bed elevation is
+	// stored as bathymetry and the water depth fills the basin up to the water level
+	GridView grid2D = grid->GetView();
+	ForRows(sizeY, [&](int rowBegin, int rowEnd) {
+		for (int j = rowBegin; j < rowEnd; j++) {
+			float v = sizeY > 1 ? (float)j / (sizeY - 1) * (imageHeight - 1) : 0.0f;
+			int y0 = std::min((int)v, imageHeight - 1);
+			int y1 = std::min(y0 + 1, imageHeight - 1);
+			float fy = v - y0;
+			for (int i = 0; i < sizeX; i++) {
+				float u = sizeX > 1 ? (float)i / (sizeX - 1) * (imageWidth - 1) : 0.0f;
+				int x0 = std::min((int)u, imageWidth - 1);
+				int x1 = std::min(x0 + 1, imageWidth - 1);
+				float fx = u - x0;
+				float top = pixels[y0 * imageWidth + x0] * (1.0f - fx) + pixels[y0 * imageWidth + x1] * fx;
+				float bottom = pixels[y1 * imageWidth + x0] * (1.0f - fx) + pixels[y1 * imageWidth + x1] * fx;
+				float bed = (top * (1.0f - fy) + bottom * fy) * settings.bedScale;
+
+				grid2D.Row(j)[i] = { std::max(0.0f, settings.waterLevel - bed), 0.0f, 0.0f, bed };
+			}
+		}
+	});
+}
+
+void ScenarioLibrary::GenerateStandingWave(const ScenarioSettings& settings, SimulationGrid2D* grid)
+{
+	int sizeX = grid->GetSizeX();
+	int sizeY = grid->GetSizeY();
+	float base = std::max(settings.baseHeight, settings.waveAmplitude * 2.0f);
+
+	// Separable like the drops: the mode shape is a product of a cosine in x and one in y
+	std::vector<float> modeX(sizeX);
+	std::vector<float> modeY(sizeY);
+	for (int i = 0; i < sizeX; i++) {
+		modeX[i] = std::cos(settings.modesX * Pi * i / std::max(sizeX - 1, 1));
+	}
+	for (int j = 0; j < sizeY; j++) {
+		modeY[j] = settings.waveAmplitude * std::cos(settings.modesY * Pi * j / std::max(sizeY - 1, 1));
+	}
+
+	GridView grid2D = grid->GetView();
+	ForRows(sizeY, [&](int rowBegin, int rowEnd) {
+		for (int j = rowBegin; j < rowEnd; j++) {
+			for (int i = 0; i < sizeX; i++) {
+				grid2D.Row(j)[i] = { base + modeY[j] * modeX[i], 0.0f, 0.0f, 0.0f };
+			}
+		}
+	});
+}
+
+std::string ScenarioLibrary::CachePath(const ScenarioSettings& settings, int nx, int ny)
+{
+	// Every setting that affects the generated state goes into the key
+	uint64_t hash = 14695981039346656037ULL;
+	HashValue(hash, CacheMagic);
+	HashValue(hash, nx);
+	HashValue(hash, ny);
+	HashValue(hash, (int)settings.type);
+	HashValue(hash, settings.baseHeight);
+	HashValue(hash, settings.maxHeight);
+	HashValue(hash, settings.pulseWidth);
+	HashValue(hash, settings.dropCount);
+	HashValue(hash, settings.seed);
+	HashValue(hash, settings.damPosition);
+	HashValue(hash, settings.upstreamHeight);
+	HashValue(hash, settings.downstreamHeight);
+	HashBytes(hash, settings.imagePath.data(), settings.imagePath.size());
+	if (settings.type == ScenarioType::ImageBasin) {
+		HashFile(hash, settings.imagePath);
+	}
+	HashValue(hash, settings.bedScale);
+	HashValue(hash, settings.waterLevel);
+	HashValue(hash, settings.modesX);
+	HashValue(hash, settings.modesY);
+	HashValue(hash, settings.waveAmplitude);
+
+	std::stringstream path;
+	path << cacheDirectory;
+	if (!cacheDirectory.empty() && cacheDirectory.back() != '/' && cacheDirectory.back() != '\\') {
+		path << "/";
+	}
+	path << "scenario_" << std::hex << hash << ".bin";
+	return path.str();
+}
+
+bool ScenarioLibrary::LoadCached(const std::string& path, SimulationGrid2D* grid)
+{
+	MappedFile file(path);
+	int sizeX = grid->GetSizeX();
+	int sizeY = grid->GetSizeY();
+	size_t rowBytes = sizeX * sizeof(std::array<float, 4>);
+	size_t headerBytes = 3 * sizeof(uint32_t);
+	if (!file.IsOpen() || file.GetSize() != headerBytes + rowBytes * sizeY) {
+		return false;
+	}
+
+	uint32_t header[3];
+	std::memcpy(header, file.GetData(), headerBytes);
+	if (header[0] != CacheMagic || (int)header[1] != sizeX || (int)header[2] != sizeY) {
+		return false;
+	}
+
+	// The mapping is borrowed as a view and its rows copied straight into the grid
+	ConstGridView cached = ConstGridView::Interleaved(file.GetData() + headerBytes, sizeX, sizeY, rowBytes);
+	GridView grid2D = grid->GetView();
+	ForRows(sizeY, [&](int rowBegin, int rowEnd) {
+		GridRect rows = { 0, rowBegin, sizeX, rowEnd };
+		CopyGridView(cached.Sub(rows), grid2D.Sub(rows));
+	});
+	return true;
+}
+
+void ScenarioLibrary::SaveCached(const std::string& path, SimulationGrid2D* grid)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		return;
+	}
+	uint32_t header[3] = { CacheMagic, (uint32_t)grid->GetSizeX(), (uint32_t)grid->GetSizeY() };
+	file.write((const char*)header, sizeof(header));
+
+	// The grid is contiguous, so the view is written in one go
+	ConstGridView view = grid->GetView();
+	file.write((const char*)view.GetData(), (std::streamsize)view.GetWidth() * view.GetHeight() * sizeof(std::array<float, 4>));
+	file.close();
+
+	EvictCached(path);
+}
+
+void ScenarioLibrary::EvictCached(const std::string& keep)
+{
+	// Cached states in the directory with their last write times
+	std::string directory = cacheDirectory.empty() ? "." : cacheDirectory;
+	std::vector<std::pair<uint64_t, std::string>> files;
+#ifdef _WIN32
+	WIN32_FIND_DATAA found;
+	HANDLE search = FindFirstFileA((directory + "/scenario_*.bin").c_str(), &found);
+	if (search != INVALID_HANDLE_VALUE) {
+		do {
+			uint64_t written = ((uint64_t)found.ftLastWriteTime.dwHighDateTime << 32) | found.ftLastWriteTime.dwLowDateTime;
+			files.push_back({ written, found.cFileName });
+		} while (FindNextFileA(search, &found));
+		FindClose(search);
+	}
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (dir) {
+		while (dirent* entry = readdir(dir)) {
+			std::string name = entry->d_name;
+			if (name.size() < 13 || name.compare(0, 9, "scenario_") != 0 || name.compare(name.size() - 4, 4, ".bin") != 0) {
+				continue;
+			}
+			struct stat info;
+			if (stat((directory + "/" + name).c_str(), &info) == 0) {
+				files.push_back({ (uint64_t)info.st_mtime, name });
+			}
+		}
+		closedir(dir);
+	}
+#endif
+	if ((int)files.size() <= MaxCachedScenarios) {
+		return;
+	}
+
+	// Oldest first, the file just written is never deleted
+	std::string keepName = keep.substr(keep.find_last_of("/\\") + 1);
+	std::sort(files.begin(), files.end());
+	int excess = (int)files.size() - MaxCachedScenarios;
+	for (int i = 0; i < (int)files.size() && excess > 0; i++) {
+		if (files[i].second != keepName) {
+			std::remove((directory + "/" + files[i].second).c_str());
+			excess--;
+		}
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "SimulationGrid2D.h"
+#include "TaskScheduler.h"
+
+// Initial conditions for the shallow water simulation
+enum class ScenarioType
+{
+	GaussianPulse = 0, // single pulse at the centre, the original initial condition
+	DamBreak = 1,      // two still water levels separated by a wall that is removed at t = 0
+	MultipleDrops = 2, // several gaussian drops at random positions
+	ImageBasin = 3,    // bed shape read from a greyscale PGM image, filled to a water level
+	StandingWave = 4,  // cosine modes of a closed basin
+	Count = 5
+};
+
+struct ScenarioSettings
+{
+	ScenarioType type = ScenarioType::GaussianPulse;
+	float baseHeight = 0.0f;    // still water height under the disturbance
+
+	// Gaussian pulse and drops
+	float maxHeight = 15.0f;
+	float pulseWidth = 0.0f;    // in grid nodes, 0 uses the grid size / 8 like SimulationGrid2D
+	int dropCount = 8;
+	unsigned int seed = 1;
+
+	// Dam break
+	float damPosition = 0.5f;   // fraction of the grid width where the wall stands
+	float upstreamHeight = 10.0f;
+	float downstreamHeight = 1.0f;
+
+	// Image basin
+	std::string imagePath = "res/basin.pgm";
+	float bedScale = 5.0f;      // bed elevation of a white pixel
+	float waterLevel = 4.0f;
+
+	// Standing wave
+	int modesX = 2;
+	int modesY = 2;
+	float waveAmplitude = 1.0f;
+};
+
+
+// Builds initial states for the simulation. Generation is split into row ranges on the task
+// scheduler and every generated state is cached on disk, keyed by the scenario settings, grid
+// size and the contents of a basin's image, so restarting a large scenario maps the cached file
+// instead of recomputing it. Only the most recently written states are kept.
+class ScenarioLibrary
+{
+
+public:
+
+	// A null scheduler generates on the calling thread, an empty cache directory uses the working directory
+	ScenarioLibrary(TaskScheduler* scheduler, const std::string& cacheDirectory = "");
+
+	// Create a grid holding the initial state of the scenario
+	SimulationGrid2D* Create(const ScenarioSettings& settings, int nx, int ny);
+
+	void SetCaching(bool enabled);
+	bool LastCreateWasCached();
+	float GetLastCreateTime(); // milliseconds
+
+	static const char* GetName(ScenarioType type);
+
+private:
+
+	void Generate(const ScenarioSettings& settings, SimulationGrid2D* grid);
+	void ForRows(int rows, const std::function<void(int, int)>& body);
+
+	// Scenario generators, each fills rows [rowBegin, rowEnd) of the grid
+	void GenerateDrops(const std::vector<float>& dropX, const std::vector<float>& dropY, const std::vector<float>& dropHeight, float width, float baseHeight, SimulationGrid2D* grid);
+	void GenerateDamBreak(const ScenarioSettings& settings, SimulationGrid2D* grid);
+	void GenerateImageBasin(const ScenarioSettings& settings, SimulationGrid2D* grid);
+	void GenerateStandingWave(const ScenarioSettings& settings, SimulationGrid2D* grid);
+
+	std::string CachePath(const ScenarioSettings& settings, int nx, int ny);
+	bool LoadCached(const std::string& path, SimulationGrid2D* grid);
+	void SaveCached(const std::string& path, SimulationGrid2D* grid);
+
+	// Delete the least recently written cached states past the limit, except the given one
+	void EvictCached(const std::string& keep);
+
+	TaskScheduler* scheduler;
+	std::string cacheDirectory;
+	bool caching;
+	bool lastWasCached;
+	float lastCreateTime;
+
+};
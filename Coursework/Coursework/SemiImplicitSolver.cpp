@@ -0,0 +1,492 @@
+#include "SemiImplicitSolver.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	// Depth below which a cell is treated as dry
+	const float DryDepth = 1e-6f;
+
+	// Relative residual the solve stops at, and the multigrid limits before conjugate gradients take over
+	const float Tolerance = 1e-5f;
+	const int MaxCycles = 20;
+	const float MinReduction = 0.7f;
+	const int MaxConjugateGradientIterations = 1000;
+	const int SmoothingSweeps = 2;
+
+	// Levels stop coarsening below this size or at an odd size
+	const int CoarsestSize = 8;
+
+	inline int Wrap(int i, int n)
+	{
+		return i < 0 ? i + n : (i >= n ? i - n : i);
+	}
+
+	// Depth of a face taken from the cell upwind of the discharges either side. With no flow the
+	// wetter side is used, so water can start to move into a dry cell.
+	inline float UpwindDepth(float dischargeA, float dischargeB, float depthA, float depthB)
+	{
+		float flow = dischargeA + dischargeB;
+		return flow > 0.0f ? depthA : (flow < 0.0f ? depthB : std::max(depthA, depthB));
+	}
+}
+
+SemiImplicitSolver::SemiImplicitSolver(TaskScheduler* taskScheduler)
+{
+	scheduler = taskScheduler;
+	reflective = false;
+	lastIterations = 0;
+	lastSolveTime = 0.0f;
+	lastResidual = 0.0f;
+	usedFallback = false;
+}
+
+SemiImplicitSolver::~SemiImplicitSolver()
+{
+}
+
+const char* SemiImplicitSolver::GetName()
+{
+	return "Semi-implicit multigrid";
+}
+
+int SemiImplicitSolver::GetLastIterations()
+{
+	return lastIterations;
+}
+
+float SemiImplicitSolver::GetLastSolveTime()
+{
+	return lastSolveTime;
+}
+
+float SemiImplicitSolver::GetLastResidual()
+{
+	return lastResidual;
+}
+
+bool SemiImplicitSolver::LastSolveUsedFallback()
+{
+	return usedFallback;
+}
+
+int SemiImplicitSolver::GetLevelCount()
+{
+	return (int)levels.size();
+}
+
+void SemiImplicitSolver::Resize(int nx, int ny)
+{
+	if (!levels.empty() && levels[0].sizeX == nx && levels[0].sizeY == ny) {
+		return;
+	}
+
+	// Halve the grid while both sides stay even and above the coarsest size
+	levels.clear();
+	int sx = nx;
+	int sy = ny;
+	while (true) {
+		Level level;
+		level.sizeX = sx;
+		level.sizeY = sy;
+		int cells = sx * sy;
+		for (std::vector<float>* v : { &level.solution, &level.rhs, &level.residual, &level.eastCoupling, &level.southCoupling, &level.diagonal, &level.direction, &level.product, &level.preconditioned }) {
+			v->assign(cells, 0.0f);
+		}
+		levels.push_back(level);
+		if (sx % 2 != 0 || sy % 2 != 0 || sx / 2 < CoarsestSize || sy / 2 < CoarsestSize) {
+			break;
+		}
+		sx /= 2;
+		sy /= 2;
+	}
+	explicitX.assign(nx * ny, 0.0f);
+	explicitY.assign(nx * ny, 0.0f);
+	faceFluxX.assign(nx * ny, 0.0f);
+	faceFluxY.assign(nx * ny, 0.0f);
+	outflowScale.assign(nx * ny, 1.0f);
+	rowSums.assign(ny, 0.0);
+}
+
+void SemiImplicitSolver::ForRows(int rows, const std::function<void(int, int)>& body)
+{
+	if (scheduler) {
+		scheduler->ParallelFor(0, rows, body, 8);
+	}
+	else {
+		body(0, rows);
+	}
+}
+
+void SemiImplicitSolver::Step(SimulationGrid2D* grid)
+{
+	int nx = grid->GetSizeX();
+	int ny = grid->GetSizeY();
+	Resize(nx, ny);
+	reflective = params.boundary == BoundaryType::Reflective;
+	float dt = params.timeStepSize;
+	float dx = params.spatialStepSize;
+	float g = params.gravity;
+	std::array<float, 4>* nodes = grid->GetRow(0);
+
+	ComputeExplicitDischarges(nodes);
+
+	/////////////////        FREE SURFACE SYSTEM        /////////////////
+	// Couplings through each face from the upwind face depth, which is never negative, so the
+	// matrix is an M-matrix and a non-negative right hand side gives non-negative depths.
+	// Explicit fluxes are the mean of the discharges either side.
+	Level& fine = levels[0];
+	float coupling = dt * dt * g / (dx * dx);
+	ForRows(ny, [&](int rowBegin, int rowEnd) {
+		for (int y = rowBegin; y < rowEnd; y++) {
+			bool wallSouth = reflective && y == ny - 1;
+			int south = Wrap(y + 1, ny);
+			for (int x = 0; x < nx; x++) {
+				bool wallEast = reflective && x == nx - 1;
+				int i = y * nx + x;
+				int east = y * nx + Wrap(x + 1, nx);
+				int s = south * nx + x;
+				float h = nodes[i][SimulationGrid2D::Height];
+
+				float depthEast = UpwindDepth(explicitX[i], explicitX[east], h, nodes[east][SimulationGrid2D::Height]);
+				fine.eastCoupling[i] = wallEast ? 0.0f : coupling * depthEast;
+				faceFluxX[i] = wallEast ? 0.0f : 0.5f * (explicitX[i] + explicitX[east]);
+				float depthSouth = UpwindDepth(explicitY[i], explicitY[s], h, nodes[s][SimulationGrid2D::Height]);
+				fine.southCoupling[i] = wallSouth ? 0.0f : coupling * depthSouth;
+				faceFluxY[i] = wallSouth ? 0.0f : 0.5f * (explicitY[i] + explicitY[s]);
+			}
+		}
+	});
+
+	// A cell can't send out more water than it holds, its outflows are scaled down to what it has
+	ForRows(ny, [&](int rowBegin, int rowEnd) {
+		for (int y = rowBegin; y < rowEnd; y++) {
+			int north = Wrap(y - 1, ny);
+			for (int x = 0; x < nx; x++) {
+				int i = y * nx + x;
+				int west = y * nx + Wrap(x - 1, nx);
+				float outflow = std::max(faceFluxX[i], 0.0f) + std::max(-faceFluxX[west], 0.0f)
+					+ std::max(faceFluxY[i], 0.0f) + std::max(-faceFluxY[north * nx + x], 0.0f);
+				float available = nodes[i][SimulationGrid2D::Height] * dx / dt;
+				outflowScale[i] = outflow > available ? available / outflow : 1.0f;
+			}
+		}
+	});
+
+	// Right hand side from the divergence of the limited explicit face fluxes
+	auto limited = [&](float flux, int from, int to) {
+		return flux * (flux > 0.0f ? outflowScale[from] : outflowScale[to]);
+	};
+	ForRows(ny, [&](int rowBegin, int rowEnd) {
+		for (int y = rowBegin; y < rowEnd; y++) {
+			int south = Wrap(y + 1, ny);
+			int north = Wrap(y - 1, ny);
+			for (int x = 0; x < nx; x++) {
+				int i = y * nx + x;
+				int east = y * nx + Wrap(x + 1, nx);
+				int west = y * nx + Wrap(x - 1, nx);
+				int n = north * nx + x;
+				float h = nodes[i][SimulationGrid2D::Height];
+				float fluxEast = limited(faceFluxX[i], i, east);
+				float fluxWest = limited(faceFluxX[west], west, i);
+				float fluxSouth = limited(faceFluxY[i], i, south * nx + x);
+				float fluxNorth = limited(faceFluxY[n], n, i);
+				fine.rhs[i] = h - dt / dx * ((fluxEast - fluxWest) + (fluxSouth - fluxNorth));
+				fine.solution[i] = h;
+			}
+		}
+	});
+	for (size_t l = 1; l < levels.size(); l++) {
+		CoarsenCoefficients(levels[l - 1], levels[l]);
+	}
+	for (Level& level : levels) {
+		int sx = level.sizeX;
+		int sy = level.sizeY;
+		for (int y = 0; y < sy; y++) {
+			for (int x = 0; x < sx; x++) {
+				int i = y * sx + x;
+				level.diagonal[i] = 1.0f + level.eastCoupling[i] + level.eastCoupling[y * sx + Wrap(x - 1, sx)]
+					+ level.southCoupling[i] + level.southCoupling[Wrap(y - 1, sy) * sx + x];
+			}
+		}
+	}
+
+	/////////////////        SOLVE        /////////////////
+	auto start = std::chrono::high_resolution_clock::now();
+	double rhsNorm = std::sqrt(Dot(fine, fine.rhs, fine.rhs));
+	ComputeResidual(fine);
+	double residualNorm = std::sqrt(Dot(fine, fine.residual, fine.residual));
+	lastIterations = 0;
+	usedFallback = false;
+
+	while (residualNorm > Tolerance * rhsNorm && lastIterations < MaxCycles) {
+		VCycle(0);
+		lastIterations++;
+		ComputeResidual(fine);
+		double newNorm = std::sqrt(Dot(fine, fine.residual, fine.residual));
+		bool stalled = newNorm > MinReduction * residualNorm;
+		residualNorm = newNorm;
+		if (stalled) {
+			break;
+		}
+	}
+	if (residualNorm > Tolerance * rhsNorm) {
+		usedFallback = true;
+		lastIterations += ConjugateGradient(fine, MaxConjugateGradientIterations, Tolerance);
+		ComputeResidual(fine);
+		residualNorm = std::sqrt(Dot(fine, fine.residual, fine.residual));
+	}
+	lastResidual = rhsNorm > 0.0 ? (float)(residualNorm / rhsNorm) : 0.0f;
+	lastSolveTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	/////////////////        DISCHARGES        /////////////////
+	// The explicit discharges are corrected by the gradient of the new surface. No water moves
+	// faster than a dam break front, 2 sqrt(g h) of the deepest cell, which holds thin cells at a
+	// wet/dry front where the donor cell advection would otherwise run away.
+	const std::vector<float>& surface = fine.solution;
+	float deepest = 0.0f;
+	for (int i = 0; i < nx * ny; i++) {
+		deepest = std::max(deepest, nodes[i][SimulationGrid2D::Height]);
+	}
+	float maxSpeed = 2.0f * std::sqrt(g * deepest);
+	ForRows(ny, [&](int rowBegin, int rowEnd) {
+		for (int y = rowBegin; y < rowEnd; y++) {
+			int north = reflective && y == 0 ? y : Wrap(y - 1, ny);
+			int south = reflective && y == ny - 1 ? y : Wrap(y + 1, ny);
+			for (int x = 0; x < nx; x++) {
+				int west = reflective && x == 0 ? x : Wrap(x - 1, nx);
+				int east = reflective && x == nx - 1 ? x : Wrap(x + 1, nx);
+				int i = y * nx + x;
+				float h = nodes[i][SimulationGrid2D::Height];
+				float gradientX = (surface[y * nx + east] - surface[y * nx + west]) / (2.0f * dx);
+				float gradientY = (surface[south * nx + x] - surface[north * nx + x]) / (2.0f * dx);
+				// Exact solves stay non-negative, this only removes the solver tolerance
+				float newHeight = std::max(surface[i], 0.0f);
+				bool dry = newHeight <= DryDepth;
+				float limit = newHeight * maxSpeed;
+				nodes[i][SimulationGrid2D::Height] = newHeight;
+				nodes[i][SimulationGrid2D::DischargeX] = dry ? 0.0f : std::min(std::max(explicitX[i] - dt * g * h * gradientX, -limit), limit);
+				nodes[i][SimulationGrid2D::DischargeY] = dry ? 0.0f : std::min(std::max(explicitY[i] - dt * g * h * gradientY, -limit), limit);
+			}
+		}
+	});
+	grid->MarkAllDirty();
+}
+
+void SemiImplicitSolver::ComputeExplicitDischarges(const std::array<float, 4>* nodes)
+{
+	int nx = levels[0].sizeX;
+	int ny = levels[0].sizeY;
+	float dt = params.timeStepSize;
+	float inverseDx = 1.0f / params.spatialStepSize;
+
+	auto velocity = [&](int i, int component) {
+		float h = nodes[i][SimulationGrid2D::Height];
+		return h > DryDepth ? nodes[i][component] / h : 0.0f;
+	};
+
+	// Donor cell fluxes of both discharges through the faces of each cell, none through walls
+	ForRows(ny, [&](int rowBegin, int rowEnd) {
+		for (int y = rowBegin; y < rowEnd; y++) {
+			for (int x = 0; x < nx; x++) {
+				int i = y * nx + x;
+				int neighbours[4] = { y * nx + Wrap(x - 1, nx), y * nx + Wrap(x + 1, nx), Wrap(y - 1, ny) * nx + x, Wrap(y + 1, ny) * nx + x };
+				bool walls[4] = { reflective && x == 0, reflective && x == nx - 1, reflective && y == 0, reflective && y == ny - 1 };
+				int components[4] = { SimulationGrid2D::DischargeX, SimulationGrid2D::DischargeX, SimulationGrid2D::DischargeY, SimulationGrid2D::DischargeY };
+				float advectionX = 0.0f;
+				float advectionY = 0.0f;
+				for (int f = 0; f < 4; f++) {
+					if (walls[f]) {
+						continue;
+					}
+					// Outward face velocity, positive when leaving the cell
+					float sign = (f % 2 == 0) ? -1.0f : 1.0f;
+					float faceVelocity = sign * 0.5f * (velocity(i, components[f]) + velocity(neighbours[f], components[f]));
+					int upwind = faceVelocity > 0.0f ? i : neighbours[f];
+					advectionX += faceVelocity * nodes[upwind][SimulationGrid2D::DischargeX];
+					advectionY += faceVelocity * nodes[upwind][SimulationGrid2D::DischargeY];
+				}
+				explicitX[i] = nodes[i][SimulationGrid2D::DischargeX] - dt * advectionX * inverseDx;
+				explicitY[i] = nodes[i][SimulationGrid2D::DischargeY] - dt * advectionY * inverseDx;
+			}
+		}
+	});
+}
+
+void SemiImplicitSolver::CoarsenCoefficients(const Level& fine, Level& coarse)
+{
+	// A coarse face spans two fine faces and twice the spacing: the mean coupling over four
+	for (int y = 0; y < coarse.sizeY; y++) {
+		for (int x = 0; x < coarse.sizeX; x++) {
+			int i = y * coarse.sizeX + x;
+			int f = (2 * y) * fine.sizeX + 2 * x;
+			coarse.eastCoupling[i] = 0.125f * (fine.eastCoupling[f + 1] + fine.eastCoupling[f + fine.sizeX + 1]);
+			coarse.southCoupling[i] = 0.125f * (fine.southCoupling[f + fine.sizeX] + fine.southCoupling[f + fine.sizeX + 1]);
+		}
+	}
+}
+
+void SemiImplicitSolver::Apply(Level& level, const std::vector<float>& x, std::vector<float>& result)
+{
+	int sx = level.sizeX;
+	int sy = level.sizeY;
+	ForRows(sy, [&](int rowBegin, int rowEnd) {
+		for (int y = rowBegin; y < rowEnd; y++) {
+			int north = Wrap(y - 1, sy) * sx;
+			int south = Wrap(y + 1, sy) * sx;
+			for (int c = 0; c < sx; c++) {
+				int i = y * sx + c;
+				int west = y * sx + Wrap(c - 1, sx);
+				int east = y * sx + Wrap(c + 1, sx);
+				result[i] = level.diagonal[i] * x[i] - level.eastCoupling[i] * x[east] - level.eastCoupling[west] * x[west]
+					- level.southCoupling[i] * x[south + c] - level.southCoupling[north + c] * x[north + c];
+			}
+		}
+	});
+}
+
+void SemiImplicitSolver::ComputeResidual(Level& level)
+{
+	Apply(level, level.solution, level.product);
+	for (size_t i = 0; i < level.residual.size(); i++) {
+		level.residual[i] = level.rhs[i] - level.product[i];
+	}
+}
+
+double SemiImplicitSolver::Dot(const Level& level, const std::vector<float>& a, const std::vector<float>& b)
+{
+	int sx = level.sizeX;
+	int sy = level.sizeY;
+	ForRows(sy, [&](int rowBegin, int rowEnd) {
+		for (int y = rowBegin; y < rowEnd; y++) {
+			double sum = 0.0;
+			for (int x = 0; x < sx; x++) {
+				sum += (double)a[y * sx + x] * b[y * sx + x];
+			}
+			rowSums[y] = sum;
+		}
+	});
+
+	// Rows are added in order so the total is the same for any number of threads
+	double total = 0.0;
+	for (int y = 0; y < sy; y++) {
+		total += rowSums[y];
+	}
+	return total;
+}
+
+void SemiImplicitSolver::Smooth(Level& level, int sweeps)
+{
+	// Red-black Gauss-Seidel, cells of one colour only depend on cells of the other
+	int sx = level.sizeX;
+	int sy = level.sizeY;
+	float* u = level.solution.data();
+	for (int sweep = 0; sweep < sweeps; sweep++) {
+		for (int colour = 0; colour < 2; colour++) {
+			ForRows(sy, [&](int rowBegin, int rowEnd) {
+				for (int y = rowBegin; y < rowEnd; y++) {
+					int north = Wrap(y - 1, sy) * sx;
+					int south = Wrap(y + 1, sy) * sx;
+					for (int x = (y + colour) % 2; x < sx; x += 2) {
+						int i = y * sx + x;
+						int west = y * sx + Wrap(x - 1, sx);
+						int east = y * sx + Wrap(x + 1, sx);
+						float neighbours = level.eastCoupling[i] * u[east] + level.eastCoupling[west] * u[west]
+							+ level.southCoupling[i] * u[south + x] + level.southCoupling[north + x] * u[north + x];
+						u[i] = (level.rhs[i] + neighbours) / level.diagonal[i];
+					}
+				}
+			});
+		}
+	}
+}
+
+void SemiImplicitSolver::VCycle(int levelIndex)
+{
+	Level& level = levels[levelIndex];
+	if (levelIndex + 1 == (int)levels.size()) {
+		// The coarsest grid is small, conjugate gradients solve it almost exactly
+		ConjugateGradient(level, 4 * (level.sizeX + level.sizeY), 1e-3f);
+		return;
+	}
+
+	Smooth(level, SmoothingSweeps);
+	ComputeResidual(level);
+
+	// Restrict the residual by averaging, the coarse correction starts from zero
+	Level& coarse = levels[levelIndex + 1];
+	int sx = level.sizeX;
+	for (int y = 0; y < coarse.sizeY; y++) {
+		for (int x = 0; x < coarse.sizeX; x++) {
+			int f = (2 * y) * sx + 2 * x;
+			coarse.rhs[y * coarse.sizeX + x] = 0.25f * (level.residual[f] + level.residual[f + 1] + level.residual[f + sx] + level.residual[f + sx + 1]);
+		}
+	}
+	std::fill(coarse.solution.begin(), coarse.solution.end(), 0.0f);
+	VCycle(levelIndex + 1);
+
+	// Bilinear prolongation of the correction, cell centres sit a quarter of a coarse cell from the coarse centres
+	int cx = coarse.sizeX;
+	int cy = coarse.sizeY;
+	const float* e = coarse.solution.data();
+	ForRows(level.sizeY, [&](int rowBegin, int rowEnd) {
+		for (int y = rowBegin; y < rowEnd; y++) {
+			int J = y / 2;
+			int J2 = (y % 2 == 0) ? J - 1 : J + 1;
+			J2 = reflective ? std::min(std::max(J2, 0), cy - 1) : Wrap(J2, cy);
+			for (int x = 0; x < sx; x++) {
+				int I = x / 2;
+				int I2 = (x % 2 == 0) ? I - 1 : I + 1;
+				I2 = reflective ? std::min(std::max(I2, 0), cx - 1) : Wrap(I2, cx);
+				float correction = 0.5625f * e[J * cx + I] + 0.1875f * (e[J * cx + I2] + e[J2 * cx + I]) + 0.0625f * e[J2 * cx + I2];
+				level.solution[y * sx + x] += correction;
+			}
+		}
+	});
+
+	Smooth(level, SmoothingSweeps);
+}
+
+int SemiImplicitSolver::ConjugateGradient(Level& level, int maxIterations, float tolerance)
+{
+	// Jacobi preconditioned conjugate gradients from the current solution
+	int cells = level.sizeX * level.sizeY;
+	ComputeResidual(level);
+	double rhsNorm = std::sqrt(Dot(level, level.rhs, level.rhs));
+	if (rhsNorm == 0.0) {
+		std::fill(level.solution.begin(), level.solution.end(), 0.0f);
+		return 0;
+	}
+	for (int i = 0; i < cells; i++) {
+		level.preconditioned[i] = level.residual[i] / level.diagonal[i];
+		level.direction[i] = level.preconditioned[i];
+	}
+	double rz = Dot(level, level.residual, level.preconditioned);
+
+	int iteration = 0;
+	while (iteration < maxIterations) {
+		if (std::sqrt(Dot(level, level.residual, level.residual)) <= tolerance * rhsNorm) {
+			break;
+		}
+		Apply(level, level.direction, level.product);
+		double pAp = Dot(level, level.direction, level.product);
+		if (pAp <= 0.0) {
+			break;
+		}
+		float alpha = (float)(rz / pAp);
+		for (int i = 0; i < cells; i++) {
+			level.solution[i] += alpha * level.direction[i];
+			level.residual[i] -= alpha * level.product[i];
+			level.preconditioned[i] = level.residual[i] / level.diagonal[i];
+		}
+		double rzNew = Dot(level, level.residual, level.preconditioned);
+		float beta = (float)(rzNew / rz);
+		rz = rzNew;
+		for (int i = 0; i < cells; i++) {
+			level.direction[i] = level.preconditioned[i] + beta * level.direction[i];
+		}
+		iteration++;
+	}
+	return iteration;
+}
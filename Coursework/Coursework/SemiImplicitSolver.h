@@ -0,0 +1,90 @@
+#pragma once
+#include <vector>
+#include "ShallowWaterSolver.h"
+#include "TaskScheduler.h"
+
+// Semi-implicit free surface solver after Casulli (1990). Momentum advection is explicit
+// (donor cell); the surface gradient in the momentum equations and the divergence in the
+// continuity equation are implicit, which leaves one symmetric positive definite five point
+// system for the new surface elevation each step:
+//
+//   h' + dt^2 g / dx^2 * sum over faces of H_face (h' - h'_neighbour) = h - dt div(explicit discharge)
+//
+// H_face is the depth of the upwind cell and the explicit fluxes are limited so no cell sends out
+// more than it holds. The system is then an M-matrix with a non-negative right hand side, so
+// depths stay non-negative and a drying cell never has water made up for it.
+//
+// The system is solved with a geometric multigrid V-cycle (red-black Gauss-Seidel smoothing,
+// averaging restriction, bilinear prolongation, coefficients rediscretised on every level).
+// When the cycles stop converging, Jacobi preconditioned conjugate gradients take over from
+// the current iterate. Gravity waves do not limit the time step, the flow speed still does.
+//
+// With a task scheduler the smoothing, residuals and conjugate gradient products run over row
+// ranges in parallel. Dot products sum per-row partial sums in order, so the result does not
+// depend on the thread count. No scheduler must be set when the solver itself runs on one of
+// the scheduler's workers.
+class SemiImplicitSolver : public ShallowWaterSolver
+{
+
+public:
+
+	SemiImplicitSolver(TaskScheduler* scheduler = nullptr);
+	~SemiImplicitSolver();
+
+	void Step(SimulationGrid2D* grid) override;
+	const char* GetName() override;
+	int GetLastIterations() override;
+	float GetLastSolveTime() override;
+
+	// Residual of the last solve relative to its right hand side, and whether the cycles needed the fallback
+	float GetLastResidual();
+	bool LastSolveUsedFallback();
+	int GetLevelCount();
+
+private:
+
+	// One grid of the multigrid hierarchy. eastCoupling[i] couples cell i with its right neighbour
+	// and southCoupling[i] with the cell below, both zero across walls.
+	struct Level
+	{
+		int sizeX = 0;
+		int sizeY = 0;
+		std::vector<float> solution, rhs, residual;
+		std::vector<float> eastCoupling, southCoupling, diagonal;
+		std::vector<float> direction, product, preconditioned;
+	};
+
+	void Resize(int nx, int ny);
+	void ForRows(int rows, const std::function<void(int, int)>& body);
+
+	// Explicit discharges after advection
+	void ComputeExplicitDischarges(const std::array<float, 4>* nodes);
+
+	// Coefficients of the coarser level from the finer one
+	void CoarsenCoefficients(const Level& fine, Level& coarse);
+
+	void Smooth(Level& level, int sweeps);
+	void ComputeResidual(Level& level);
+	double Dot(const Level& level, const std::vector<float>& a, const std::vector<float>& b);
+	void Apply(Level& level, const std::vector<float>& x, std::vector<float>& result);
+	void VCycle(int levelIndex);
+	int ConjugateGradient(Level& level, int maxIterations, float tolerance);
+
+	TaskScheduler* scheduler;
+	bool reflective;
+	std::vector<Level> levels;
+	std::vector<double> rowSums;
+
+	// Discharges after explicit advection, one per cell
+	std::vector<float> explicitX, explicitY;
+
+	// Explicit fluxes through the east and south face of each cell, and the factor each cell's
+	// outflows are scaled by so it never sends out more water than it holds
+	std::vector<float> faceFluxX, faceFluxY, outflowScale;
+
+	int lastIterations;
+	float lastSolveTime;
+	float lastResidual;
+	bool usedFallback;
+
+};
@@ -0,0 +1,72 @@
+#include "ShallowWaterSolver.h"
+#include "FiniteVolumeSolver.h"
+#include "ADISolver.h"
+#include "SemiImplicitSolver.h"
+#include "VirtualPipeSolver.h"
+#include "LatticeBoltzmannSolver.h"
+#include "SpectralWaveSolver.h"
+
+void ShallowWaterSolver::SetParameters(const SimulationParameters& parameters)
+{
+	params = parameters;
+}
+
+SimulationParameters& ShallowWaterSolver::GetParameters()
+{
+	return params;
+}
+
+ShallowWaterSolver* ShallowWaterSolver::Create(SolverType type)
+{
+	switch (type) {
+	case SolverType::HLL:
+		return new FiniteVolumeSolver(FiniteVolumeSolver::HLL);
+	case SolverType::HLLC:
+		return new FiniteVolumeSolver(FiniteVolumeSolver::HLLC);
+	case SolverType::ADI:
+		return new ADISolver();
+	case SolverType::SemiImplicit:
+		return new SemiImplicitSolver();
+	case SolverType::VirtualPipe:
+		return new VirtualPipeSolver();
+	case SolverType::LatticeBoltzmann:
+		return new LatticeBoltzmannSolver();
+	case SolverType::Spectral:
+		return new SpectralWaveSolver();
+	default:
+		return new MacCormackSolver();
+	}
+}
+
+
+
+MacCormackSolver::MacCormackSolver()
+{
+}
+
+MacCormackSolver::~MacCormackSolver()
+{
+}
+
+const char* MacCormackSolver::GetName()
+{
+	return "MacCormack";
+}
+
+void MacCormackSolver::Step(SimulationGrid2D* grid)
+{
+	int sizeX = grid->GetSizeX();
+	int sizeY = grid->GetSizeY();
+	float DTDXDY = params.timeStepSize / params.spatialStepSize;
+
+	workspace.Resize(sizeX * sizeY);
+	specialised = MacCormackKernels::IsSpecialised(sizeX, sizeY);
+	MacCormackKernels::Kernel kernel = MacCormackKernels::Select(sizeX, sizeY, params.boundary);
+	kernel(grid->GetRow(0), sizeX, sizeY, params.gravity, DTDXDY, workspace);
+	grid->MarkAllDirty();
+}
+
+bool MacCormackSolver::WasSpecialised()
+{
+	return specialised;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <array>
+#include <vector>
+#include "SimulationGrid2D.h"
+#include "MacCormackKernel.h"
+
+// Parameters shared by every shallow water solver
+struct SimulationParameters
+{
+	float gravity = 9.8f;
+	float n = 0.9f;                 // Manning roughness, not used by the MacCormack scheme
+	float timeStepSize = 0.001f;
+	float spatialStepSize = 0.2f;
+	BoundaryType boundary = BoundaryType::Periodic;
+};
+
+// Solvers that can advance a SimulationGrid2D, used to pick one by number from a sweep file
+enum class SolverType
+{
+	MacCormack = 0,
+	HLL = 1,
+	HLLC = 2,
+	ADI = 3,
+	SemiImplicit = 4,
+	VirtualPipe = 5,
+	LatticeBoltzmann = 6,
+	Spectral = 7,
+	Count = 8
+};
+
+
+// Common interface for the CPU shallow water solvers. A solver advances the state stored
+// in a SimulationGrid2D (height and discharges in x and y) by one time step in place. The
+// MacCormack and virtual pipe solvers push the water down the slope of the bathymetry, the
+// others, the lattice Boltzmann and spectral solvers among them, take the bed as flat and
+// should be given grids with a flat one.
+class ShallowWaterSolver
+{
+
+public:
+
+	virtual ~ShallowWaterSolver() {}
+
+	virtual void SetParameters(const SimulationParameters& parameters);
+	SimulationParameters& GetParameters();
+
+	// Advance the grid by one time step of parameters.timeStepSize
+	virtual void Step(SimulationGrid2D* grid) = 0;
+
+	virtual const char* GetName() = 0;
+
+	// Drop any state carried between steps, so the next step starts from the grid alone
+	virtual void Reset() {}
+
+	// Iterations and milliseconds spent in the linear solve of the last step, zero for explicit solvers
+	virtual int GetLastIterations() { return 0; }
+	virtual float GetLastSolveTime() { return 0.0f; }
+
+	// Create a solver of the given type, deleted by the caller
+	static ShallowWaterSolver* Create(SolverType type);
+
+protected:
+
+	SimulationParameters params;
+
+};
+
+
+// CPU version of the MacCormack scheme run on the GPU by predictor_step_ps.hlsl and
+// corrector_step_ps.hlsl (Hubbard and Baines, 1997). The predictor uses forward differences,
+// the corrector backward differences. With periodic boundaries the grid wraps around at the
+// edges the same way the wrap sampler does on the GPU. Each step runs the kernel specialised
+// for the grid size when there is one.
+class MacCormackSolver : public ShallowWaterSolver
+{
+
+public:
+
+	MacCormackSolver();
+	~MacCormackSolver();
+
+	void Step(SimulationGrid2D* grid) override;
+	const char* GetName() override;
+
+	// Whether the last step ran a kernel specialised for its grid size
+	bool WasSpecialised();
+
+private:
+
+	// Predicted grid and fluxes
+	MacCormackWorkspace workspace;
+	bool specialised = false;
+
+};
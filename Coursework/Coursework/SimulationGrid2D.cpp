@@ -1,8 +1,13 @@
 #include "SimulationGrid2D.h"
 #include <cmath> // For std::exp and M_PI
 #include <iostream>
+#include <algorithm>
 
-SimulationGrid2D::SimulationGrid2D(int nx, int ny)
+SimulationGrid2D::SimulationGrid2D(int nx, int ny) : SimulationGrid2D(nx, ny, 15.0f, std::min(nx, ny) / 8.0f)
+{
+}
+
+SimulationGrid2D::SimulationGrid2D(int nx, int ny, float maxHeight, float pulseWidth)
 {
 
 	// Setting the grid size
@@ -11,12 +16,11 @@ SimulationGrid2D::SimulationGrid2D(int nx, int ny)
 	resolution = sizeX * sizeY;
 
 	// Resizing the data structure that will contain the grid data
-	grid.resize(ny, std::vector<std::array<float, 4>>(nx));
+	grid.resize((size_t)nx * ny);
+	dirty.Resize(nx, ny);
+	dirty.AddAll();
 
 	// Adding a gaussian pulse to the height values of the grid as initial condition
-	float maxHeight = 15.0f; // Height of pulse
-	float pulseWidth = std::min(sizeX, sizeY) /8.0f; // Width
-
 	// Used to center the pulse
 	int centerX = sizeX / 2;  
 	int centerY = sizeY / 2;
@@ -30,32 +34,78 @@ SimulationGrid2D::SimulationGrid2D(int nx, int ny)
 			float distanceSquared = dx * dx + dy * dy;
 			float pulse = maxHeight * exp(-distanceSquared / (2 * pulseWidth * pulseWidth));
 
-			grid[j][i][Height] = pulse;
-			grid[j][i][DischargeX] = 0;
-			grid[j][i][DischargeY] = 0;
-			grid[j][i][Bathymetry] = 0;
+			std::array<float, 4>& node = grid[(size_t)j * sizeX + i];
+			node[Height] = pulse;
+			node[DischargeX] = 0;
+			node[DischargeY] = 0;
+			node[Bathymetry] = 0;
 		}
 	}
 }
 
+SimulationGrid2D::SimulationGrid2D(int nx, int ny, float stillWaterHeight)
+{
+	sizeX = nx;
+	sizeY = ny;
+	resolution = sizeX * sizeY;
+
+	std::array<float, 4> stillWater = { stillWaterHeight, 0.0f, 0.0f, 0.0f };
+	grid.resize((size_t)nx * ny, stillWater);
+	dirty.Resize(nx, ny);
+	dirty.AddAll();
+}
+
 SimulationGrid2D::~SimulationGrid2D()
 {
 	grid.clear();
 }
 
-std::vector<std::vector<std::array<float, 4>>>& SimulationGrid2D::GetSimulationGrid2D()
+GridView SimulationGrid2D::GetView()
+{
+	return GridView(grid.empty() ? nullptr : grid[0].data(), sizeX, sizeY, (ptrdiff_t)sizeX * 4);
+}
+
+ConstGridView SimulationGrid2D::GetView() const
+{
+	return ConstGridView(grid.empty() ? nullptr : grid[0].data(), sizeX, sizeY, (ptrdiff_t)sizeX * 4);
+}
+
+std::array<float, 4>* SimulationGrid2D::GetRow(int y)
 {
-	return grid;
+	return &grid[(size_t)y * sizeX];
 }
 
 std::array<float, 4>& SimulationGrid2D::GetNode(int x, int y)
 {
-	return grid[y][x];
+	return grid[(size_t)y * sizeX + x];
 }
 
 void SimulationGrid2D::SetValue(GridValues data, int x, int y, float newValue)
 {
-	grid[y][x][data] = newValue;
+	grid[(size_t)y * sizeX + x][data] = newValue;
+
+	GridRect node = { x, y, x + 1, y + 1 };
+	dirty.Add(node);
+}
+
+void SimulationGrid2D::MarkDirty(const GridRect& rect)
+{
+	dirty.Add(rect);
+}
+
+void SimulationGrid2D::MarkAllDirty()
+{
+	dirty.AddAll();
+}
+
+DirtyRegion& SimulationGrid2D::GetDirtyRegion()
+{
+	return dirty;
+}
+
+void SimulationGrid2D::ClearDirty()
+{
+	dirty.Clear();
 }
 
 int SimulationGrid2D::GetSizeX()
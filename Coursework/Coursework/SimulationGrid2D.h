@@ -1,6 +1,8 @@
 #pragma once
 #include <array>
 #include <vector>
+#include "DirtyRegion.h"
+#include "GridView.h"
 
 class SimulationGrid2D
 {
@@ -12,14 +14,22 @@ public:
 		Height = 0,
 		DischargeX = 1,
 		DischargeY = 2,
-		Bathymetry = 3 // not used 
+		Bathymetry = 3 // bed elevation, the water surface is Height + Bathymetry
 	};
 
 	SimulationGrid2D(int nx, int ny);
+	// Initial condition is a gaussian pulse of the given height and width at the centre of the grid
+	SimulationGrid2D(int nx, int ny, float maxHeight, float pulseWidth);
+	// Initial condition is still water of the given height, used when a scenario fills the grid
+	SimulationGrid2D(int nx, int ny, float stillWaterHeight);
 	~SimulationGrid2D();
 
-	// Get the simulation grid data structure
-	std::vector<std::vector<std::array<float, 4>>>& GetSimulationGrid2D();
+	// View of the grid data, rows are stored one after another so no copy is needed to hand it out
+	GridView GetView();
+	ConstGridView GetView() const;
+
+	// Get the row of nodes at y
+	std::array<float, 4>* GetRow(int y);
 
 	// Get the array containing data for a specific grid node
 	std::array<float, 4>& GetNode(int x, int y);
@@ -27,18 +37,28 @@ public:
 	// Used to set the grid values
 	void SetValue(GridValues data, int x, int y, float newValue);
 
+	// Regions changed since the last upload. Code writing through GetView, GetRow or GetNode
+	// marks what it changed; the consumer that uploads the grid clears it afterwards.
+	void MarkDirty(const GridRect& rect);
+	void MarkAllDirty();
+	DirtyRegion& GetDirtyRegion();
+	void ClearDirty();
+
 	// Get the size of the grid:
 	int GetSizeX();
 	int GetSizeY();
 
 private:
 
-	// Data structure used to store the 2D grid 
-	std::vector<std::vector<std::array<float, 4>>> grid;
+	// Data structure used to store the 2D grid, row major and contiguous
+	std::vector<std::array<float, 4>> grid;
 
 	// Size variables for the grid
 	int sizeX;
 	int sizeY;
 	int resolution;
 
+	// Changed regions, a new grid starts fully dirty
+	DirtyRegion dirty;
+
 };
@@ -0,0 +1,275 @@
+#include "SpectralWaveSolver.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	const float Pi = 3.14159265358979f;
+}
+
+SpectralWaveSolver::SpectralWaveSolver(TaskScheduler* taskScheduler) : fourier(taskScheduler)
+{
+	scheduler = taskScheduler;
+	sizeX = 0;
+	sizeY = 0;
+	meanDepth = 0.0f;
+	nearBlendWidth = 0;
+	nearTimeStep = 0.001f;
+	nearSolverType = SolverType::MacCormack;
+	nearSolver = nullptr;
+	nearGrid = nullptr;
+	farFieldTime = 0.0f;
+	nearFieldTime = 0.0f;
+	nearFieldSteps = 0;
+}
+
+SpectralWaveSolver::~SpectralWaveSolver()
+{
+	if (nearSolver) {
+		delete nearSolver;
+	}
+	if (nearGrid) {
+		delete nearGrid;
+	}
+}
+
+const char* SpectralWaveSolver::GetName()
+{
+	return "Spectral linear";
+}
+
+float SpectralWaveSolver::GetLastFarFieldTime()
+{
+	return farFieldTime;
+}
+
+float SpectralWaveSolver::GetLastNearFieldTime()
+{
+	return nearFieldTime;
+}
+
+int SpectralWaveSolver::GetLastNearFieldSteps()
+{
+	return nearFieldSteps;
+}
+
+float SpectralWaveSolver::GetMeanDepth()
+{
+	return meanDepth;
+}
+
+void SpectralWaveSolver::SetNearField(const GridRect& region, int blendWidth, SolverType solver, float timeStep)
+{
+	nearRegion = region;
+	nearBlendWidth = std::max(0, blendWidth);
+	nearTimeStep = timeStep;
+	if (nearSolver && solver != nearSolverType) {
+		delete nearSolver;
+		nearSolver = nullptr;
+	}
+	nearSolverType = solver;
+}
+
+void SpectralWaveSolver::ForRows(int rows, const std::function<void(int, int)>& body)
+{
+	if (scheduler) {
+		scheduler->ParallelFor(0, rows, body, 8);
+	}
+	else {
+		body(0, rows);
+	}
+}
+
+void SpectralWaveSolver::Step(SimulationGrid2D* grid)
+{
+	Advance(grid, params.timeStepSize);
+}
+
+bool SpectralWaveSolver::Advance(SimulationGrid2D* grid, float time)
+{
+	int nx = grid->GetSizeX();
+	int ny = grid->GetSizeY();
+	if (!fourier.Resize(nx, ny)) {
+		return false;
+	}
+	if (nx != sizeX || ny != sizeY) {
+		sizeX = nx;
+		sizeY = ny;
+		size_t count = (size_t)nx * ny;
+		for (std::vector<float>* v : { &surfaceReal, &surfaceImaginary, &dischargeReal, &dischargeImaginary, &nextReal, &nextImaginary }) {
+			v->assign(count, 0.0f);
+		}
+		rowSums.assign(ny, 0.0);
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// The near field starts from the grid before the jump
+	GridRect window = GetNearWindow(grid);
+	if (!window.Empty()) {
+		if (nearGrid && (nearGrid->GetSizeX() != window.Width() || nearGrid->GetSizeY() != window.Height())) {
+			delete nearGrid;
+			nearGrid = nullptr;
+		}
+		if (!nearGrid) {
+			nearGrid = new SimulationGrid2D(window.Width(), window.Height(), 0.0f);
+		}
+		for (int y = window.y0; y < window.y1; y++) {
+			std::copy(grid->GetRow(y) + window.x0, grid->GetRow(y) + window.x1, nearGrid->GetRow(y - window.y0));
+		}
+	}
+
+	// Linearise about the mean depth, summed per row in order so it does not depend on the thread count
+	ForRows(ny, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			const std::array<float, 4>* row = grid->GetRow(y);
+			double sum = 0.0;
+			for (int x = 0; x < nx; x++) {
+				sum += row[x][SimulationGrid2D::Height];
+			}
+			rowSums[y] = sum;
+		}
+	});
+	double total = 0.0;
+	for (int y = 0; y < ny; y++) {
+		total += rowSums[y];
+	}
+	meanDepth = (float)(total / ((double)nx * ny));
+
+	// The two real discharges share one complex transform
+	ForRows(ny, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			const std::array<float, 4>* row = grid->GetRow(y);
+			size_t offset = (size_t)y * nx;
+			for (int x = 0; x < nx; x++) {
+				surfaceReal[offset + x] = row[x][SimulationGrid2D::Height] - meanDepth;
+				surfaceImaginary[offset + x] = 0.0f;
+				dischargeReal[offset + x] = row[x][SimulationGrid2D::DischargeX];
+				dischargeImaginary[offset + x] = row[x][SimulationGrid2D::DischargeY];
+			}
+		}
+	});
+	fourier.Forward2D(surfaceReal.data(), surfaceImaginary.data());
+	fourier.Forward2D(dischargeReal.data(), dischargeImaginary.data());
+	Propagate(time);
+	fourier.Inverse2D(surfaceReal.data(), surfaceImaginary.data());
+	fourier.Inverse2D(nextReal.data(), nextImaginary.data());
+
+	// Linear waves can dip below a shallow bed, the depth is clamped like the other solvers'
+	ForRows(ny, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			std::array<float, 4>* row = grid->GetRow(y);
+			size_t offset = (size_t)y * nx;
+			for (int x = 0; x < nx; x++) {
+				row[x][SimulationGrid2D::Height] = std::max(0.0f, meanDepth + surfaceReal[offset + x]);
+				row[x][SimulationGrid2D::DischargeX] = nextReal[offset + x];
+				row[x][SimulationGrid2D::DischargeY] = nextImaginary[offset + x];
+			}
+		}
+	});
+	auto farEnd = std::chrono::high_resolution_clock::now();
+	farFieldTime = std::chrono::duration<float, std::milli>(farEnd - start).count();
+
+	// Step the near field over the same time and blend it back
+	nearFieldSteps = 0;
+	if (!window.Empty()) {
+		if (!nearSolver) {
+			nearSolver = ShallowWaterSolver::Create(nearSolverType);
+		}
+		nearFieldSteps = std::max(1, (int)ceilf(time / nearTimeStep - 1e-3f));
+		SimulationParameters nearParameters = params;
+		nearParameters.boundary = BoundaryType::Reflective;
+		nearParameters.timeStepSize = time / nearFieldSteps;
+		nearSolver->SetParameters(nearParameters);
+		nearSolver->Reset();
+		for (int i = 0; i < nearFieldSteps; i++) {
+			nearSolver->Step(nearGrid);
+		}
+		BlendNearField(grid, window);
+	}
+	nearFieldTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - farEnd).count();
+
+	grid->MarkAllDirty();
+	return true;
+}
+
+void SpectralWaveSolver::Propagate(float time)
+{
+	float c = sqrtf(params.gravity * std::max(meanDepth, 0.0f));
+	float waveX = 2.0f * Pi / (sizeX * params.spatialStepSize);
+	float waveY = 2.0f * Pi / (sizeY * params.spatialStepSize);
+
+	ForRows(sizeY, [&](int y0, int y1) {
+		for (int iy = y0; iy < y1; iy++) {
+			float ky = iy == sizeY / 2 ? 0.0f : FourierTransform::Frequency(iy, sizeY) * waveY;
+			int my = (sizeY - iy) & (sizeY - 1);
+			for (int ix = 0; ix < sizeX; ix++) {
+				float kx = ix == sizeX / 2 ? 0.0f : FourierTransform::Frequency(ix, sizeX) * waveX;
+				int mx = (sizeX - ix) & (sizeX - 1);
+				size_t index = (size_t)iy * sizeX + ix;
+				size_t mirror = (size_t)my * sizeX + mx;
+
+				// Unpack the spectra of both discharges from that of qx + i qy and its mirror
+				float zr = dischargeReal[index], zi = dischargeImaginary[index];
+				float mr = dischargeReal[mirror], mi = -dischargeImaginary[mirror];
+				float qr = 0.5f * (zr + mr), qi = 0.5f * (zi + mi);
+				float pr = 0.5f * (zi - mi), pi = -0.5f * (zr - mr);
+
+				float k = sqrtf(kx * kx + ky * ky);
+				if (k == 0.0f || c == 0.0f) {
+					nextReal[index] = zr;
+					nextImaginary[index] = zi;
+					continue;
+				}
+
+				// Discharge along k and the surface rotate into each other at frequency c |k|
+				float alongX = kx / k, alongY = ky / k;
+				float lr = alongX * qr + alongY * pr, li = alongX * qi + alongY * pi;
+				float er = surfaceReal[index], ei = surfaceImaginary[index];
+				float phase = c * k * time;
+				float cs = cosf(phase), sn = sinf(phase);
+
+				surfaceReal[index] = er * cs + li * sn / c;
+				surfaceImaginary[index] = ei * cs - lr * sn / c;
+				float dr = lr * (cs - 1.0f) + c * ei * sn;
+				float di = li * (cs - 1.0f) - c * er * sn;
+
+				// Repack the new discharges, qx' + i qy'
+				float nqr = qr + alongX * dr, nqi = qi + alongX * di;
+				float npr = pr + alongY * dr, npi = pi + alongY * di;
+				nextReal[index] = nqr - npi;
+				nextImaginary[index] = nqi + npr;
+			}
+		}
+	});
+}
+
+GridRect SpectralWaveSolver::GetNearWindow(SimulationGrid2D* grid)
+{
+	GridRect window;
+	if (nearRegion.Empty()) {
+		return window;
+	}
+	window.x0 = std::max(0, nearRegion.x0 - nearBlendWidth);
+	window.y0 = std::max(0, nearRegion.y0 - nearBlendWidth);
+	window.x1 = std::min(grid->GetSizeX(), nearRegion.x1 + nearBlendWidth);
+	window.y1 = std::min(grid->GetSizeY(), nearRegion.y1 + nearBlendWidth);
+	return window;
+}
+
+void SpectralWaveSolver::BlendNearField(SimulationGrid2D* grid, const GridRect& window)
+{
+	// The weight of the near field rises from zero at the edge of the window to one at the region
+	for (int y = window.y0; y < window.y1; y++) {
+		std::array<float, 4>* row = grid->GetRow(y);
+		const std::array<float, 4>* nearRow = nearGrid->GetRow(y - window.y0);
+		int edgeY = std::min(y - window.y0, window.y1 - 1 - y);
+		for (int x = window.x0; x < window.x1; x++) {
+			int edge = std::min(edgeY, std::min(x - window.x0, window.x1 - 1 - x));
+			float weight = nearBlendWidth > 0 ? std::min(1.0f, (float)edge / nearBlendWidth) : 1.0f;
+			for (int channel = SimulationGrid2D::Height; channel <= SimulationGrid2D::DischargeY; channel++) {
+				row[x][channel] += weight * (nearRow[x - window.x0][channel] - row[x][channel]);
+			}
+		}
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <vector>
+#include "ShallowWaterSolver.h"
+#include "FourierTransform.h"
+#include "GridRect.h"
+
+// Linear shallow water waves propagated exactly in Fourier space. About the mean depth H the
+// linearised equations decouple per wavenumber k into a standing pair of waves of frequency
+// sqrt(g H) |k|, so a jump of any length costs two forward and two inverse FFTs, however
+// long it is. The part of the discharge along k is rotated with the surface, the part across
+// k (vorticity) has no linear dynamics and is kept. The grid must be periodic with power of
+// two sides; the Nyquist row and column are treated as having no wavenumber along their axis.
+// A single mean depth means a flat bed, the bathymetry is ignored.
+//
+// Where the waves are not linear, for example near a shore or a splash, a near field can be
+// set. That rectangle, and a blend band of blendWidth cells around it, is copied out and
+// stepped by a nonlinear solver with reflective walls at its own small time step, then
+// blended back over the linear solution across the band. The band works as a relaxation
+// zone, overwritten every jump, so the jump should be short enough that waves cross less
+// than the band in one jump. Near fields touching the grid edge lose the wrap there.
+class SpectralWaveSolver : public ShallowWaterSolver
+{
+
+public:
+
+	SpectralWaveSolver(TaskScheduler* scheduler = nullptr);
+	~SpectralWaveSolver();
+
+	// Jump by parameters.timeStepSize
+	void Step(SimulationGrid2D* grid) override;
+	const char* GetName() override;
+
+	// Advance the grid by the given time in one jump. Returns false and leaves the grid
+	// unchanged when a side of the grid is not a power of two.
+	bool Advance(SimulationGrid2D* grid, float time);
+
+	// Keep the region nonlinear, stepped by the given solver at the given time step. An empty
+	// region turns the near field off.
+	void SetNearField(const GridRect& region, int blendWidth, SolverType solver, float timeStep);
+
+	// Milliseconds spent in the last jump on the linear solution and on the near field
+	float GetLastFarFieldTime();
+	float GetLastNearFieldTime();
+	int GetLastNearFieldSteps();
+
+	// Depth the last jump linearised about
+	float GetMeanDepth();
+
+private:
+
+	void ForRows(int rows, const std::function<void(int, int)>& body);
+
+	// Rotate the spectra of the surface and the packed discharges by time
+	void Propagate(float time);
+
+	// Copy the near field window out of the grid, and blend the stepped copy back into it
+	GridRect GetNearWindow(SimulationGrid2D* grid);
+	void BlendNearField(SimulationGrid2D* grid, const GridRect& window);
+
+	TaskScheduler* scheduler;
+	FourierTransform fourier;
+	int sizeX;
+	int sizeY;
+	float meanDepth;
+
+	// Spectrum of the surface about the mean depth, and of qx + i qy before and after the jump
+	std::vector<float> surfaceReal, surfaceImaginary;
+	std::vector<float> dischargeReal, dischargeImaginary;
+	std::vector<float> nextReal, nextImaginary;
+	std::vector<double> rowSums;
+
+	// Nonlinear near field
+	GridRect nearRegion;
+	int nearBlendWidth;
+	float nearTimeStep;
+	SolverType nearSolverType;
+	ShallowWaterSolver* nearSolver;
+	SimulationGrid2D* nearGrid;
+
+	float farFieldTime;
+	float nearFieldTime;
+	int nearFieldSteps;
+
+};
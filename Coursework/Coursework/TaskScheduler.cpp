@@ -0,0 +1,193 @@
+#include "TaskScheduler.h"
+#include <algorithm>
+
+namespace
+{
+	// Identifies the scheduler and worker the current thread belongs to, if any
+	thread_local TaskScheduler* currentScheduler = nullptr;
+	thread_local int currentWorker = -1;
+}
+
+TaskScheduler::TaskScheduler(int threadCount)
+{
+	if (threadCount <= 0) {
+		threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+
+	stop = false;
+	queuedTasks = 0;
+	unfinishedTasks = 0;
+	nextQueue = 0;
+	tasksRun = 0;
+	steals = 0;
+
+	for (int i = 0; i < threadCount; i++) {
+		queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+	}
+	for (int i = 0; i < threadCount; i++) {
+		workers.push_back(std::thread(&TaskScheduler::WorkerLoop, this, i));
+	}
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	Wait();
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stop = true;
+	}
+	workAvailable.notify_all();
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+}
+
+void TaskScheduler::Submit(std::function<void()> task)
+{
+	// Workers keep their own tasks local, other threads spread tasks round robin
+	int index;
+	if (currentScheduler == this) {
+		index = currentWorker;
+	}
+	else {
+		index = (int)(nextQueue++ % queues.size());
+	}
+
+	unfinishedTasks++;
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		queuedTasks++;
+	}
+	workAvailable.notify_one();
+}
+
+void TaskScheduler::Wait()
+{
+	std::unique_lock<std::mutex> lock(sleepMutex);
+	allDone.wait(lock, [this] { return unfinishedTasks == 0; });
+}
+
+void TaskScheduler::ParallelFor(int begin, int end, const std::function<void(int, int)>& body, int minRange)
+{
+	int count = end - begin;
+	if (count <= 0) {
+		return;
+	}
+
+	// A few ranges per worker so that stealing can even out uneven ranges
+	int rangeCount = std::max(1, std::min(count / std::max(minRange, 1), (int)workers.size() * 4));
+	if (rangeCount == 1) {
+		body(begin, end);
+		return;
+	}
+
+	// Ranges are claimed in order by whichever thread gets to them first, the caller included,
+	// so the call still finishes when every worker is busy with long tasks of its own. Tasks
+	// that start after the last range was claimed only touch the shared state, which they keep
+	// alive, never the body.
+	struct Ranges
+	{
+		std::atomic<int> next;
+		std::mutex doneMutex;
+		std::condition_variable rangesDone;
+		int remaining;
+	};
+	std::shared_ptr<Ranges> ranges = std::make_shared<Ranges>();
+	ranges->next = 0;
+	ranges->remaining = rangeCount;
+
+	std::function<void()> runRanges = [ranges, &body, begin, count, rangeCount] {
+		int r;
+		while ((r = ranges->next++) < rangeCount) {
+			body(begin + (int)((long long)count * r / rangeCount), begin + (int)((long long)count * (r + 1) / rangeCount));
+			std::lock_guard<std::mutex> lock(ranges->doneMutex);
+			if (--ranges->remaining == 0) {
+				ranges->rangesDone.notify_one();
+			}
+		}
+	};
+	for (int r = 1; r < rangeCount; r++) {
+		Submit(runRanges);
+	}
+	runRanges();
+
+	std::unique_lock<std::mutex> lock(ranges->doneMutex);
+	ranges->rangesDone.wait(lock, [&] { return ranges->remaining == 0; });
+}
+
+bool TaskScheduler::PopOwn(int index, std::function<void()>& task)
+{
+	// Newest first from the worker's own queue
+	WorkerQueue& queue = *queues[index];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tasks.empty()) {
+		return false;
+	}
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	return true;
+}
+
+bool TaskScheduler::Steal(int index, std::function<void()>& task)
+{
+	// Oldest first from the other workers, starting with the next one along
+	int count = (int)queues.size();
+	for (int offset = 1; offset < count; offset++) {
+		WorkerQueue& queue = *queues[(index + offset) % count];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty()) {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			steals++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void TaskScheduler::WorkerLoop(int index)
+{
+	currentScheduler = this;
+	currentWorker = index;
+
+	while (true) {
+		std::function<void()> task;
+		if (PopOwn(index, task) || Steal(index, task)) {
+			queuedTasks--;
+			task();
+			tasksRun++;
+
+			if (--unfinishedTasks == 0) {
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				allDone.notify_all();
+			}
+			continue;
+		}
+
+		// Nothing to run or steal, sleep until a task is queued
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		workAvailable.wait(lock, [this] { return stop || queuedTasks > 0; });
+		if (stop && queuedTasks == 0) {
+			return;
+		}
+	}
+}
+
+int TaskScheduler::GetThreadCount()
+{
+	return (int)workers.size();
+}
+
+long long TaskScheduler::GetTasksRun()
+{
+	return tasksRun;
+}
+
+long long TaskScheduler::GetSteals()
+{
+	return steals;
+}
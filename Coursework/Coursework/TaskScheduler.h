@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Work-stealing thread pool. Every worker has its own task queue; a worker runs the newest
+// task it queued itself (the data is likely still in its cache) and when it runs out of work
+// it steals the oldest task from another worker. Tasks may submit more tasks.
+class TaskScheduler
+{
+
+public:
+
+	// A thread count of 0 uses one worker per hardware thread
+	TaskScheduler(int threadCount = 0);
+	~TaskScheduler();
+
+	// Queue a task, tasks submitted from a worker go onto that worker's own queue
+	void Submit(std::function<void()> task);
+
+	// Block until every submitted task, including tasks submitted by tasks, has finished
+	void Wait();
+
+	// Split [begin, end) into contiguous ranges, run body(rangeBegin, rangeEnd) for each on the
+	// workers and the calling thread, and return once all ranges are done. The calling thread
+	// keeps taking ranges until none are left, so tasks queued by others ahead of the ranges
+	// slow the call down but cannot hold it up. Must not be called from inside a task.
+	void ParallelFor(int begin, int end, const std::function<void(int, int)>& body, int minRange = 1);
+
+	int GetThreadCount();
+	long long GetTasksRun();
+	long long GetSteals();
+
+private:
+
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void WorkerLoop(int index);
+	bool PopOwn(int index, std::function<void()>& task);
+	bool Steal(int index, std::function<void()>& task);
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<std::thread> workers;
+
+	std::mutex sleepMutex;
+	std::condition_variable workAvailable;
+	std::condition_variable allDone;
+	std::atomic<int> queuedTasks;   // tasks waiting in any queue
+	std::atomic<int> unfinishedTasks; // queued or running
+	std::atomic<unsigned int> nextQueue;
+	bool stop;
+
+	std::atomic<long long> tasksRun;
+	std::atomic<long long> steals;
+
+};
@@ -0,0 +1,166 @@
+#include "DirtyRegion.h"
+#include "TestCheck.h"
+
+namespace
+{
+	const int Size = 660;
+
+	GridRect Rect(int x0, int y0, int x1, int y1)
+	{
+		GridRect rect;
+		rect.x0 = x0;
+		rect.y0 = y0;
+		rect.x1 = x1;
+		rect.y1 = y1;
+		return rect;
+	}
+
+	bool Same(const GridRect& a, const GridRect& b)
+	{
+		return a.x0 == b.x0 && a.y0 == b.y0 && a.x1 == b.x1 && a.y1 == b.y1;
+	}
+
+	bool Contains(DirtyRegion& region, const GridRect& rect)
+	{
+		const std::vector<GridRect>& rects = region.GetRects();
+		for (size_t i = 0; i < rects.size(); i++) {
+			if (Same(rects[i], rect)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Every node of the rectangle lies in one of the region's rectangles
+	bool Covers(DirtyRegion& region, const GridRect& rect)
+	{
+		const std::vector<GridRect>& rects = region.GetRects();
+		for (size_t i = 0; i < rects.size(); i++) {
+			if (rects[i].Union(rect).Area() == rects[i].Area()) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool Disjoint(DirtyRegion& region)
+	{
+		const std::vector<GridRect>& rects = region.GetRects();
+		for (size_t a = 0; a < rects.size(); a++) {
+			for (size_t b = a + 1; b < rects.size(); b++) {
+				if (rects[a].Overlaps(rects[b])) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	void TestMerging()
+	{
+		DirtyRegion region(Size, Size);
+		CHECK(region.IsEmpty());
+
+		// Two rectangles a few nodes apart cost less sent as one
+		region.Add(Rect(10, 10, 14, 14));
+		region.Add(Rect(16, 10, 20, 14));
+		CHECK(region.GetRects().size() == 1);
+		CHECK(Contains(region, Rect(10, 10, 20, 14)));
+
+		// A distant one stays separate
+		region.Add(Rect(400, 400, 410, 410));
+		CHECK(region.GetRects().size() == 2);
+
+		// An overlapping one is always merged, and the grown rectangle keeps merging
+		region.Add(Rect(12, 12, 30, 30));
+		CHECK(region.GetRects().size() == 2);
+		CHECK(Contains(region, Rect(10, 10, 30, 30)));
+		region.Add(Rect(25, 25, 405, 405));
+		CHECK(region.GetRects().size() == 1);
+		CHECK(Contains(region, Rect(10, 10, 410, 410)));
+
+		// One already covered changes nothing
+		region.Add(Rect(11, 11, 12, 12));
+		CHECK(region.GetRects().size() == 1);
+		CHECK(region.GetArea() == 400LL * 400);
+
+		region.Clear();
+		CHECK(region.IsEmpty());
+		CHECK(region.GetArea() == 0);
+	}
+
+	void TestRectOverhead()
+	{
+		// Without a per rectangle overhead only touching rectangles are free to merge
+		DirtyRegion region(Size, Size);
+		region.SetRectOverhead(0);
+		region.Add(Rect(10, 10, 14, 14));
+		region.Add(Rect(16, 10, 20, 14));
+		CHECK(region.GetRects().size() == 2);
+		region.Add(Rect(14, 10, 16, 14));
+		CHECK(region.GetRects().size() == 1);
+		CHECK(Contains(region, Rect(10, 10, 20, 14)));
+	}
+
+	void TestClipping()
+	{
+		DirtyRegion region(Size, Size);
+
+		// Rectangles are clipped to the grid, ones entirely off it are dropped
+		region.Add(Rect(-5, -5, 3, 3));
+		CHECK(Contains(region, Rect(0, 0, 3, 3)));
+		region.Add(Rect(650, 100, 700, 110));
+		CHECK(Contains(region, Rect(650, 100, 660, 110)));
+		region.Add(Rect(700, 700, 710, 710));
+		region.Add(Rect(-20, 10, -1, 20));
+		region.Add(Rect(30, 30, 30, 40));
+		CHECK(region.GetRects().size() == 2);
+		CHECK(region.GetArea() == 9 + 100);
+
+		// A new size clears the region and clips to the new grid
+		region.Resize(100, 100);
+		CHECK(region.IsEmpty());
+		region.Add(Rect(90, 90, 200, 95));
+		CHECK(Contains(region, Rect(90, 90, 100, 95)));
+		region.AddAll();
+		CHECK(region.GetRects().size() == 1);
+		CHECK(Contains(region, Rect(0, 0, 100, 100)));
+	}
+
+	void TestCapAndCollapse()
+	{
+		// Past the cap the rectangles wasting the fewest nodes are merged, nothing added is lost
+		DirtyRegion region(Size, Size);
+		region.SetRectOverhead(0);
+		region.SetMaxRects(4);
+		std::vector<GridRect> added;
+		for (int i = 0; i < 40; i++) {
+			GridRect rect = Rect((i * 37) % 600, (i * 91) % 600, (i * 37) % 600 + 3, (i * 91) % 600 + 3);
+			added.push_back(rect);
+			region.Add(rect);
+			CHECK(region.GetRects().size() <= 4);
+		}
+		for (size_t i = 0; i < added.size(); i++) {
+			CHECK(Covers(region, added[i]));
+		}
+		CHECK(Disjoint(region));
+
+		// Once most of the grid is dirty it becomes the whole grid
+		DirtyRegion mostly(Size, Size);
+		mostly.Add(Rect(0, 0, Size, 390));
+		CHECK(mostly.GetRects().size() == 1);
+		CHECK(mostly.GetArea() == 390LL * Size);
+		mostly.Add(Rect(0, 400, Size, 410));
+		CHECK(mostly.GetRects().size() == 1);
+		CHECK(Contains(mostly, Rect(0, 0, Size, Size)));
+	}
+}
+
+int main()
+{
+	TestMerging();
+	TestRectOverhead();
+	TestClipping();
+	TestCapAndCollapse();
+	return TestCheck::Result();
+}
@@ -0,0 +1,109 @@
+#include "DisturbanceQueue.h"
+#include "TestCheck.h"
+#include <cmath>
+
+namespace
+{
+	// Still water with a gentle current, so drags have discharge to pull on
+	void FillWater(SimulationGrid2D& grid)
+	{
+		for (int y = 0; y < grid.GetSizeY(); y++) {
+			for (int x = 0; x < grid.GetSizeX(); x++) {
+				grid.SetValue(SimulationGrid2D::Height, x, y, 1.0f + 0.01f * x);
+				grid.SetValue(SimulationGrid2D::DischargeX, x, y, 0.1f);
+				grid.SetValue(SimulationGrid2D::DischargeY, x, y, -0.05f * y / grid.GetSizeY());
+			}
+		}
+	}
+
+	// What the GPU does with the flipped events: disturbance_ps draws every node of the
+	// rectangles into disturbanceRT from the state, and the rectangles are copied back
+	void ApplyLikeShader(const std::vector<DisturbanceQueue::PreparedEvent>& events, const std::vector<GridRect>& rects, SimulationGrid2D& state)
+	{
+		const float pi = 3.14159265f;
+		SimulationGrid2D drawn = state;
+		for (const GridRect& rect : rects) {
+			for (int y = rect.y0; y < rect.y1; y++) {
+				for (int x = rect.x0; x < rect.x1; x++) {
+					std::array<float, 4> node = state.GetNode(x, y);
+					for (const DisturbanceQueue::PreparedEvent& event : events) {
+						const Disturbance& disturbance = event.disturbance;
+						float radius = std::max(disturbance.radius, 0.5f);
+						float dx = x - disturbance.x;
+						float dy = y - disturbance.y;
+						float distance = std::sqrt(dx * dx + dy * dy) / radius;
+						if (distance >= 1.0f) {
+							continue;
+						}
+						float amount = event.amount * 0.5f * (1.0f + std::cos(pi * distance));
+						if (disturbance.type == Disturbance::Drag) {
+							node[SimulationGrid2D::DischargeX] += amount * (node[SimulationGrid2D::Height] * disturbance.velocityX - node[SimulationGrid2D::DischargeX]);
+							node[SimulationGrid2D::DischargeY] += amount * (node[SimulationGrid2D::Height] * disturbance.velocityY - node[SimulationGrid2D::DischargeY]);
+						}
+						else {
+							node[SimulationGrid2D::Height] += amount;
+						}
+					}
+					drawn.GetNode(x, y) = node;
+				}
+			}
+		}
+		state = drawn;
+	}
+
+	// A splash, drag or source at (x, y) changes the same nodes the same way whether it is applied
+	// to the CPU grid or, flipped, to the upside down copy of it the GPU keeps in its render
+	// textures, where the y discharge points the other way
+	void TestFlippedEventsLandInPlace()
+	{
+		const int sizeX = 48;
+		const int sizeY = 37;
+		SimulationGrid2D cpu(sizeX, sizeY, 1.0f);
+		FillWater(cpu);
+		SimulationGrid2D gpu(sizeX, sizeY, 1.0f);
+		for (int y = 0; y < sizeY; y++) {
+			for (int x = 0; x < sizeX; x++) {
+				std::array<float, 4>& node = gpu.GetNode(x, sizeY - 1 - y);
+				node = cpu.GetNode(x, y);
+				node[SimulationGrid2D::DischargeY] = -node[SimulationGrid2D::DischargeY];
+			}
+		}
+
+		DisturbanceQueue queue;
+		queue.Splash(10.0f, 6.0f, 4.0f, 0.5f);
+		queue.Splash(30.5f, 25.25f, 3.0f, -0.2f);
+		queue.Drag(20.0f, 12.0f, 0.7f, 1.5f, 5.0f, 0.4f);
+		queue.Drag(40.0f, 33.0f, -1.0f, -2.0f, 6.0f, 0.3f);
+		queue.PointSource(2.0f, 35.0f, 3.5f, 1.0f, 1.0f);
+		CHECK(queue.BeginSubstep(0.1f, sizeX, sizeY));
+
+		std::vector<DisturbanceQueue::PreparedEvent> events;
+		std::vector<GridRect> rects;
+		queue.GetFlippedY(events, rects);
+		CHECK(events.size() == queue.GetEvents().size());
+		CHECK(rects.size() == queue.GetDirtyRects().size());
+		ApplyLikeShader(events, rects, gpu);
+		queue.Apply(&cpu);
+
+		int changed = 0;
+		int wrong = 0;
+		for (int y = 0; y < sizeY; y++) {
+			for (int x = 0; x < sizeX; x++) {
+				const std::array<float, 4>& expected = cpu.GetNode(x, y);
+				const std::array<float, 4>& flipped = gpu.GetNode(x, sizeY - 1 - y);
+				changed += expected[SimulationGrid2D::Height] != 1.0f + 0.01f * x || expected[SimulationGrid2D::DischargeX] != 0.1f;
+				wrong += std::fabs(expected[SimulationGrid2D::Height] - flipped[SimulationGrid2D::Height]) > 1e-5f;
+				wrong += std::fabs(expected[SimulationGrid2D::DischargeX] - flipped[SimulationGrid2D::DischargeX]) > 1e-5f;
+				wrong += std::fabs(expected[SimulationGrid2D::DischargeY] + flipped[SimulationGrid2D::DischargeY]) > 1e-5f;
+			}
+		}
+		CHECK(changed > 0);
+		CHECK(wrong == 0);
+	}
+}
+
+int main()
+{
+	TestFlippedEventsLandInPlace();
+	return TestCheck::Result();
+}
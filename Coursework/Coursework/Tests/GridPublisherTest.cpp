@@ -0,0 +1,153 @@
+#include "GridPublisher.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+	const int Size = 64;
+
+	// Each test gets its own mapping so runs in parallel don't share one
+	std::string MappingName(const char* test)
+	{
+		return std::string("WaterGridTest_") + test + "_" + std::to_string((int)getpid());
+	}
+
+	void FillFrame(SimulationGrid2D& grid, int frame)
+	{
+		for (int y = 0; y < grid.GetSizeY(); y++) {
+			for (int x = 0; x < grid.GetSizeX(); x++) {
+				std::array<float, 4>& node = grid.GetNode(x, y);
+				node[0] = (float)frame;
+				node[1] = (float)x;
+				node[2] = (float)y;
+				node[3] = (float)frame;
+			}
+		}
+	}
+
+	// Every node of a consistent frame carries the frame's number
+	bool FrameConsistent(const std::array<float, 4>* nodes, int frame)
+	{
+		for (int i = 0; i < Size * Size; i++) {
+			if (nodes[i][0] != (float)frame || nodes[i][3] != (float)frame) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void TestReadInPlace()
+	{
+		std::string name = MappingName("InPlace");
+		GridPublisher publisher(name, Size, Size, 3);
+		GridSubscriber subscriber(name);
+		CHECK(publisher.IsOpen());
+		CHECK(subscriber.IsOpen());
+
+		GridSubscriber::SlotRead read;
+		CHECK(!subscriber.BeginRead(read));
+
+		SimulationGrid2D grid(Size, Size);
+		FillFrame(grid, 7);
+		publisher.Publish(grid.GetView(), 7);
+		CHECK(subscriber.BeginRead(read));
+		CHECK(read.frameIndex == 7);
+		CHECK(FrameConsistent(subscriber.GetSlotData(read), 7));
+		CHECK(subscriber.Validate(read));
+	}
+
+	void TestOverwrittenSlotIsTorn()
+	{
+		// With two slots, two more publications come back round to the slot being read
+		std::string name = MappingName("Overwritten");
+		GridPublisher publisher(name, Size, Size, 2);
+		GridSubscriber subscriber(name);
+		SimulationGrid2D grid(Size, Size);
+		FillFrame(grid, 0);
+		publisher.Publish(grid.GetView(), 0);
+
+		GridSubscriber::SlotRead read;
+		CHECK(subscriber.BeginRead(read));
+		FillFrame(grid, 1);
+		publisher.Publish(grid.GetView(), 1);
+		CHECK(subscriber.Validate(read));
+		FillFrame(grid, 2);
+		publisher.Publish(grid.GetView(), 2);
+		CHECK(!subscriber.Validate(read));
+		CHECK(subscriber.GetTornReads() == 1);
+	}
+
+	void TestNoTornFramesUnderLoad()
+	{
+		// The writer publishes as fast as it can into a short ring while readers read in place
+		// and by copying. A frame that passes validation must never mix two publications.
+		std::string name = MappingName("Load");
+		const int frames = 20000;
+		GridPublisher publisher(name, Size, Size, 2);
+		GridSubscriber inPlace(name);
+		GridSubscriber copying(name);
+		std::atomic<bool> done(false);
+
+		std::thread writer([&]() {
+			SimulationGrid2D grid(Size, Size);
+			for (int frame = 0; frame < frames; frame++) {
+				FillFrame(grid, frame);
+				publisher.Publish(grid.GetView(), frame);
+			}
+			done = true;
+		});
+
+		int validReads = 0;
+		int inconsistentReads = 0;
+		std::vector<std::array<float, 4>> copy;
+		while (!done) {
+			GridSubscriber::SlotRead read;
+			if (inPlace.BeginRead(read)) {
+				bool consistent = FrameConsistent(inPlace.GetSlotData(read), read.frameIndex);
+				if (inPlace.Validate(read)) {
+					validReads++;
+					inconsistentReads += consistent ? 0 : 1;
+				}
+			}
+			int frame;
+			if (copying.ReadLatest(copy, frame, 0)) {
+				validReads++;
+				inconsistentReads += FrameConsistent(copy.data(), frame) ? 0 : 1;
+			}
+		}
+		writer.join();
+
+		std::printf("valid reads %d, torn reads detected %llu\n", validReads, inPlace.GetTornReads() + copying.GetTornReads());
+		CHECK(inconsistentReads == 0);
+		CHECK(publisher.GetFramesPublished() == (unsigned long long)frames);
+
+		// Once the writer has stopped the newest frame reads cleanly
+		int frame = -1;
+		CHECK(copying.ReadLatest(copy, frame));
+		CHECK(frame == frames - 1);
+		CHECK(FrameConsistent(copy.data(), frames - 1));
+	}
+
+	// An empty grid gives an empty view, which is not published
+	void TestEmptyGridIsIgnored()
+	{
+		std::string name = MappingName("Empty");
+		GridPublisher publisher(name, Size, Size, 3);
+		SimulationGrid2D empty(0, 0, 1.0f);
+		CHECK(empty.GetView().Empty());
+		publisher.Publish(empty.GetView(), 0);
+		CHECK(publisher.GetFramesPublished() == 0);
+	}
+}
+
+int main()
+{
+	TestReadInPlace();
+	TestOverwrittenSlotIsTorn();
+	TestNoTornFramesUnderLoad();
+	TestEmptyGridIsIgnored();
+	return TestCheck::Result();
+}
@@ -0,0 +1,258 @@
+#include "GridStream.h"
+#include "TestCheck.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+	// Ports of their own for each test, away from the app's 47000, so parallel runs don't collide
+	int TestPort(int test)
+	{
+		return 20000 + ((int)getpid() * 4 + test) % 20000;
+	}
+
+	template <typename Condition>
+	bool WaitFor(Condition condition, int timeoutMs = 5000)
+	{
+		auto start = std::chrono::steady_clock::now();
+		while (!condition()) {
+			if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(timeoutMs)) {
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	void FillWaves(SimulationGrid2D& grid, int frame)
+	{
+		for (int y = 0; y < grid.GetSizeY(); y++) {
+			for (int x = 0; x < grid.GetSizeX(); x++) {
+				// Still water on the left half, so some tiles do not change between frames
+				float wave = x < grid.GetSizeX() / 2 ? 0.0f : 0.5f * sinf(0.2f * x + 0.1f * y + 0.3f * frame);
+				grid.GetNode(x, y)[SimulationGrid2D::Height] = 10.0f + wave;
+			}
+		}
+
+		// A tall pulse, the Scenario panel allows 40 m of water
+		grid.GetNode(grid.GetSizeX() * 3 / 4, grid.GetSizeY() / 2)[SimulationGrid2D::Height] = 40.0f + 0.01f * frame;
+	}
+
+	void TestTileRoundTrip()
+	{
+		using namespace GridStreamProtocol;
+		std::mt19937 random(1);
+		std::uniform_int_distribution<int32_t> values(-MaxQuantized, MaxQuantized);
+		std::vector<int32_t> previous(TileSize * TileSize), current(TileSize * TileSize);
+		for (size_t i = 0; i < previous.size(); i++) {
+			previous[i] = values(random);
+			current[i] = i % 3 == 0 ? values(random) : previous[i];
+		}
+
+		// The largest jumps either way
+		previous[1] = -MaxQuantized;
+		current[1] = MaxQuantized;
+		previous[2] = MaxQuantized;
+		current[2] = -MaxQuantized;
+
+		std::vector<uint8_t> encoded;
+		EncodeTile(current.data(), previous.data(), (int)current.size(), encoded);
+		std::vector<int32_t> decoded = previous;
+		CHECK(DecodeTile(encoded.data(), (uint32_t)encoded.size(), decoded.data(), (int)decoded.size()));
+		CHECK(decoded == current);
+
+		// Truncated or trailing data is rejected
+		decoded = previous;
+		CHECK(!DecodeTile(encoded.data(), (uint32_t)encoded.size() - 1, decoded.data(), (int)decoded.size()));
+		encoded.push_back(0);
+		decoded = previous;
+		CHECK(!DecodeTile(encoded.data(), (uint32_t)encoded.size(), decoded.data(), (int)decoded.size()));
+	}
+
+	void TestHeaderLimits()
+	{
+		using namespace GridStreamProtocol;
+		FrameHeader header;
+		std::memset(&header, 0, sizeof(header));
+		header.magic = Magic;
+		header.fullSizeX = 100;
+		header.fullSizeY = 80;
+		header.level = 1;
+		header.sizeX = 50;
+		header.sizeY = 40;
+		header.tileCount = 4;
+		header.payloadBytes = 1000;
+		CHECK(ValidHeader(header));
+
+		FrameHeader wrong = header;
+		wrong.fullSizeX = 1 << 30;
+		wrong.sizeX = 1 << 29;
+		CHECK(!ValidHeader(wrong));
+		wrong = header;
+		wrong.sizeX = 100;
+		CHECK(!ValidHeader(wrong));
+		wrong = header;
+		wrong.payloadBytes = 0xFFFFFFFF;
+		CHECK(!ValidHeader(wrong));
+		wrong = header;
+		wrong.tileCount = 5;
+		CHECK(!ValidHeader(wrong));
+		wrong = header;
+		wrong.level = GridStreamProtocol::MaxLevel + 1;
+		CHECK(!ValidHeader(wrong));
+	}
+
+	void TestLoopback()
+	{
+		// Frames sent at full resolution come back to within half a quantization step
+		const int sizeX = 100;
+		const int sizeY = 80;
+		int port = TestPort(0);
+		GridStreamServer server(port, sizeX, sizeY);
+		server.SetByteBudget(1 << 24);
+		CHECK(server.IsListening());
+		GridStreamClient client("127.0.0.1", port);
+		CHECK(WaitFor([&]() { return client.IsConnected(); }));
+		CHECK(WaitFor([&]() { return server.HasClient(); }));
+
+		SimulationGrid2D source(sizeX, sizeY);
+		SimulationGrid2D received(sizeX, sizeY);
+		float maxError = 0.0f;
+		for (int frame = 0; frame < 10; frame++) {
+			FillWaves(source, frame);
+			server.Submit(source.GetView(), frame);
+			int receivedFrame = -1;
+			CHECK(WaitFor([&]() { return client.GetLatest(&received, receivedFrame) && receivedFrame == frame; }));
+			for (int y = 0; y < sizeY; y++) {
+				for (int x = 0; x < sizeX; x++) {
+					float error = fabsf(received.GetNode(x, y)[SimulationGrid2D::Height] - source.GetNode(x, y)[SimulationGrid2D::Height]);
+					maxError = std::max(maxError, error);
+				}
+			}
+		}
+		CHECK(maxError <= 0.5f * GridStreamProtocol::QuantStep + 1e-5f);
+		CHECK(server.GetLevel() == 0);
+		CHECK(client.GetRemoteSizeX() == sizeX && client.GetRemoteSizeY() == sizeY);
+
+		// A grid of another size is refused rather than filled from the wrong nodes
+		SimulationGrid2D other(64, 64);
+		FillWaves(source, 10);
+		server.Submit(source.GetView(), 10);
+		int frameIndex;
+		CHECK(WaitFor([&]() { return client.GetFramesReceived() >= 11; }));
+		CHECK(!client.GetLatest(&other, frameIndex));
+		CHECK(client.GetLatest(&received, frameIndex) && frameIndex == 10);
+	}
+
+	void TestOverBudgetDropsLevel()
+	{
+		const int size = 128;
+		int port = TestPort(1);
+		GridStreamServer server(port, size, size);
+		server.SetByteBudget(2048);
+		GridStreamClient client("127.0.0.1", port);
+		CHECK(WaitFor([&]() { return server.HasClient(); }));
+
+		SimulationGrid2D source(size, size);
+		SimulationGrid2D received(size, size);
+		for (int frame = 0; frame < 4; frame++) {
+			FillWaves(source, frame);
+			server.Submit(source.GetView(), frame);
+			int receivedFrame = -1;
+			CHECK(WaitFor([&]() { return client.GetLatest(&received, receivedFrame) && receivedFrame == frame; }));
+		}
+		CHECK(server.GetLevel() > 0);
+		CHECK(client.IsConnected());
+	}
+
+	void TestOversizedHeaderDisconnects()
+	{
+		// A peer claiming a huge grid is dropped before anything is allocated for it
+		int port = TestPort(2);
+		int listener = socket(AF_INET, SOCK_STREAM, 0);
+		int reuse = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		sockaddr_in address;
+		std::memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons((unsigned short)port);
+		CHECK(bind(listener, (sockaddr*)&address, sizeof(address)) == 0);
+		CHECK(listen(listener, 1) == 0);
+
+		GridStreamClient client("127.0.0.1", port);
+		int peer = accept(listener, nullptr, nullptr);
+		CHECK(peer >= 0);
+		CHECK(WaitFor([&]() { return client.IsConnected(); }));
+		GridStreamProtocol::FrameHeader header;
+		std::memset(&header, 0, sizeof(header));
+		header.magic = GridStreamProtocol::Magic;
+		header.fullSizeX = 1 << 30;
+		header.fullSizeY = 1 << 30;
+		header.sizeX = 1 << 30;
+		header.sizeY = 1 << 30;
+		header.tileCount = 1;
+		header.payloadBytes = 0xFFFFFFFF;
+		CHECK(send(peer, &header, sizeof(header), 0) == (ssize_t)sizeof(header));
+		CHECK(WaitFor([&]() { return !client.IsConnected(); }));
+		CHECK(client.GetFramesReceived() == 0);
+		close(peer);
+		close(listener);
+	}
+
+	void TestViewerLeaving()
+	{
+		// The server keeps running when a viewer disconnects mid-stream, rather than being
+		// killed by SIGPIPE, and takes the next viewer
+		const int size = 256;
+		int port = TestPort(3);
+		GridStreamServer server(port, size, size);
+		server.SetByteBudget(1 << 24);
+		SimulationGrid2D source(size, size);
+		for (int viewer = 0; viewer < 2; viewer++) {
+			GridStreamClient* client = new GridStreamClient("127.0.0.1", port);
+			CHECK(WaitFor([&]() { return server.HasClient(); }));
+			FillWaves(source, 0);
+			server.Submit(source.GetView(), 0);
+			CHECK(WaitFor([&]() { return client->GetFramesReceived() > 0; }));
+			delete client;
+
+			for (int frame = 1; frame < 1000 && server.HasClient(); frame++) {
+				FillWaves(source, frame);
+				server.Submit(source.GetView(), frame);
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			CHECK(!server.HasClient());
+		}
+	}
+
+	void TestConnectDoesNotBlock()
+	{
+		// Neither making nor dropping a client waits on a host that does not answer
+		auto start = std::chrono::steady_clock::now();
+		GridStreamClient* client = new GridStreamClient("10.255.255.1", 47000);
+		CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100));
+		CHECK(!client->IsConnected());
+		delete client;
+		CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+	}
+}
+
+int main()
+{
+	TestTileRoundTrip();
+	TestHeaderLimits();
+	TestLoopback();
+	TestOverBudgetDropsLevel();
+	TestOversizedHeaderDisconnects();
+	TestViewerLeaving();
+	TestConnectDoesNotBlock();
+	return TestCheck::Result();
+}
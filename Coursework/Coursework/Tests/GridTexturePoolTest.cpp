@@ -0,0 +1,140 @@
+#include "GridTexturePool.h"
+#include "TestCheck.h"
+#include <cstring>
+
+namespace
+{
+	const int Size = 64;
+
+	// Float4 texel of a host memory texture made by the counting device
+	const float* Texel(GridTexture* texture, int x, int y)
+	{
+		const std::vector<unsigned char>& texels = *(const std::vector<unsigned char>*)texture->resource;
+		return (const float*)&texels[((size_t)y * texture->width + x) * sizeof(std::array<float, 4>)];
+	}
+
+	// One step of the application: the two simulation grids are uploaded whole, the grid
+	// followed by a partial update texture sends its dirty rectangle, and the render grid and
+	// surface maps are taken from the pool, uploaded and handed back
+	void Step(GridTexturePool& pool, GridTexture* predicted, GridTexture* corrected, GridTexture* followed,
+		SimulationGrid2D& grid, int step)
+	{
+		pool.BeginFrame();
+		grid.SetValue(SimulationGrid2D::Height, step % Size, step % Size, (float)step);
+		GridRect changed = { step % Size, step % Size, step % Size + 1, step % Size + 1 };
+		grid.MarkDirty(changed);
+
+		CHECK(pool.Upload(predicted, grid.GetView()));
+		CHECK(pool.Upload(corrected, grid.GetView()));
+		CHECK(pool.Upload(followed, &grid));
+
+		GridTexture* render = pool.Acquire(Size / 2, Size / 2);
+		GridTexture* normals = pool.Acquire(Size, Size, false, GridTexture::Snorm16x2);
+		GridTexture* foam = pool.Acquire(Size, Size, false, GridTexture::Unorm8);
+		std::vector<short> packedNormals((size_t)Size * Size * 2, (short)step);
+		std::vector<unsigned char> packedFoam((size_t)Size * Size, (unsigned char)step);
+		CHECK(pool.Upload(normals, packedNormals.data(), Size * 2 * sizeof(short)));
+		CHECK(pool.Upload(foam, packedFoam.data(), Size));
+		pool.Release(render);
+		pool.Release(normals);
+		pool.Release(foam);
+	}
+
+	void TestNoAllocationsAfterWarmUp()
+	{
+		CountingGridTextureDevice device;
+		GridTexturePool pool(&device);
+		SimulationGrid2D grid(Size, Size);
+		GridTexture* predicted = pool.Acquire(Size, Size);
+		GridTexture* corrected = pool.Acquire(Size, Size);
+		GridTexture* followed = pool.Acquire(Size, Size, true);
+		CHECK(predicted && corrected && followed);
+		CHECK(predicted != corrected);
+
+		// The first step creates every texture the steps use
+		Step(pool, predicted, corrected, followed, grid, 0);
+		int created = device.GetCreateCount();
+		int textures = pool.GetTextureCount();
+		CHECK(created == 6);
+
+		for (int step = 1; step <= 200; step++) {
+			Step(pool, predicted, corrected, followed, grid, step);
+		}
+		CHECK(device.GetCreateCount() == created);
+		CHECK(device.GetDestroyCount() == 0);
+		CHECK(pool.GetTextureCount() == textures);
+		CHECK(pool.GetFreeCount() == 3);
+
+		// Every whole upload is one mapping, the followed grid only sends its changed node
+		CHECK(device.GetMapCount() == 201 * 4);
+		CHECK(device.GetUpdateCount() == 201);
+		pool.BeginFrame();
+		CHECK(pool.GetLastFrameRegions() == 5);
+	}
+
+	void TestUploadWritesTheGrid()
+	{
+		CountingGridTextureDevice device;
+		GridTexturePool pool(&device);
+		SimulationGrid2D grid(Size, Size);
+		for (int y = 0; y < Size; y++) {
+			for (int x = 0; x < Size; x++) {
+				grid.GetNode(x, y) = { { (float)x, (float)y, (float)(x + y), 1.0f } };
+			}
+		}
+
+		GridTexture* whole = pool.Acquire(Size, Size);
+		CHECK(pool.Upload(whole, grid.GetView()));
+		CHECK(std::memcmp(Texel(whole, 0, 0), grid.GetView().GetData(), (size_t)Size * Size * sizeof(std::array<float, 4>)) == 0);
+
+		// A partial update texture keeps what it had outside the dirty rectangles
+		GridTexture* partial = pool.Acquire(Size, Size, true);
+		grid.MarkAllDirty();
+		CHECK(pool.Upload(partial, &grid));
+		CHECK(grid.GetDirtyRegion().IsEmpty());
+		grid.GetNode(3, 4)[0] = 100.0f;
+		grid.GetNode(40, 50)[0] = 200.0f;
+		GridRect changed = { 40, 50, 41, 51 };
+		grid.MarkDirty(changed);
+		CHECK(pool.Upload(partial, &grid));
+		CHECK(Texel(partial, 40, 50)[0] == 200.0f);
+		CHECK(Texel(partial, 3, 4)[0] == 3.0f);
+
+		// Wrong sizes are refused rather than written past the texture
+		SimulationGrid2D other(Size / 2, Size / 2);
+		CHECK(!pool.Upload(whole, other.GetView()));
+		CHECK(!pool.Upload(partial, &other));
+	}
+
+	void TestReleasedTexturesAreReused()
+	{
+		CountingGridTextureDevice device;
+		GridTexturePool pool(&device);
+		GridTexture* first = pool.Acquire(Size, Size);
+		pool.Release(first);
+		CHECK(pool.Acquire(Size, Size) == first);
+
+		// Another size, format or update mode is a different texture
+		GridTexture* smaller = pool.Acquire(Size / 2, Size / 2);
+		GridTexture* partial = pool.Acquire(Size, Size, true);
+		GridTexture* packed = pool.Acquire(Size, Size, false, GridTexture::Unorm8);
+		CHECK(smaller != first && partial != first && packed != first);
+		CHECK(device.GetCreateCount() == 4);
+
+		// Trim only destroys the textures not in use
+		pool.Release(smaller);
+		pool.Release(packed);
+		pool.Trim();
+		CHECK(device.GetDestroyCount() == 2);
+		CHECK(pool.GetTextureCount() == 2);
+		CHECK(device.GetLiveCount() == 2);
+	}
+}
+
+int main()
+{
+	TestNoAllocationsAfterWarmUp();
+	TestUploadWritesTheGrid();
+	TestReleasedTexturesAreReused();
+	return TestCheck::Result();
+}
@@ -0,0 +1,93 @@
+#include "HeightFieldNormals.h"
+#include "SimulationGrid2D.h"
+#include "TestCheck.h"
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Rolling waves on a sloping bed, with crests tight enough to foam
+	void FillWaves(SimulationGrid2D& grid)
+	{
+		for (int y = 0; y < grid.GetSizeY(); y++) {
+			for (int x = 0; x < grid.GetSizeX(); x++) {
+				grid.SetValue(SimulationGrid2D::Height, x, y, 1.0f + 0.5f * sinf(x * 0.05f) * cosf(y * 0.03f) + 0.2f * sinf(x * 0.7f + y * 0.4f));
+				grid.SetValue(SimulationGrid2D::Bathymetry, x, y, 0.01f * x - 0.02f * y);
+			}
+		}
+	}
+
+	bool SameOutput(HeightFieldNormals& a, HeightFieldNormals& b)
+	{
+		size_t texels = (size_t)a.GetWidth() * a.GetHeight();
+		return a.GetWidth() == b.GetWidth() && a.GetHeight() == b.GetHeight()
+			&& memcmp(a.GetNormals(), b.GetNormals(), texels * sizeof(unsigned int)) == 0
+			&& memcmp(a.GetFoamMap(), b.GetFoamMap(), texels) == 0;
+	}
+
+	// The rows are split differently with every thread count, none of which may change a node.
+	// The sizes leave partial SSE groups at the end of the rows and ranges of uneven length.
+	void TestSameWithAndWithoutThreads()
+	{
+		const int sizes[][2] = { { 517, 517 }, { 130, 67 }, { 7, 300 }, { 64, 64 } };
+		TaskScheduler workers(4);
+		for (const auto& size : sizes) {
+			SimulationGrid2D grid(size[0], size[1], 1.0f);
+			FillWaves(grid);
+
+			HeightFieldNormals single(nullptr);
+			HeightFieldNormals threaded(&workers);
+			for (HeightFieldNormals* normals : { &single, &threaded }) {
+				normals->SetMeshSize(100.0f);
+				normals->SetFoam(true);
+				normals->SetFoamScale(2.0f);
+				normals->Compute(grid.GetView());
+			}
+			CHECK(single.GetWidth() == size[0] && single.GetHeight() == size[1]);
+			CHECK(SameOutput(single, threaded));
+
+			// The same again on the buffers of the first compute
+			FillWaves(grid);
+			grid.SetValue(SimulationGrid2D::Height, size[0] / 2, size[1] / 2, 3.0f);
+			single.Compute(grid.GetView());
+			threaded.Compute(grid.GetView());
+			CHECK(SameOutput(single, threaded));
+		}
+	}
+
+	// The normals lean away from the uphill side and flat water has none of either
+	void TestSlopeAndFlatWater()
+	{
+		const int size = 33;
+		SimulationGrid2D grid(size, size, 1.0f);
+		HeightFieldNormals normals;
+		normals.SetMeshSize((float)(size - 1));
+		normals.SetFoam(true);
+		normals.Compute(grid.GetView());
+		CHECK(normals.GetNormals()[size * (size / 2) + size / 2] == 0);
+		CHECK(normals.GetFoamMap()[size * (size / 2) + size / 2] == 0);
+
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+				grid.SetValue(SimulationGrid2D::Height, x, y, 1.0f + 0.5f * x);
+			}
+		}
+		normals.Compute(grid.GetView());
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+				unsigned int packed = normals.GetNormals()[y * size + x];
+				float nx = (short)(packed & 0xFFFF) / 32767.0f;
+				float nz = (short)(packed >> 16) / 32767.0f;
+				CHECK(fabsf(nx + 0.5f / sqrtf(1.25f)) < 1e-3f);
+				CHECK(fabsf(nz) < 1e-3f);
+			}
+		}
+	}
+}
+
+int main()
+{
+	TestSameWithAndWithoutThreads();
+	TestSlopeAndFlatWater();
+	return TestCheck::Result();
+}
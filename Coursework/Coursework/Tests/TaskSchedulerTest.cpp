@@ -0,0 +1,64 @@
+#include "TaskScheduler.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace
+{
+	// Every index is visited exactly once, whatever the range and split
+	void TestParallelForCoversRange()
+	{
+		TaskScheduler scheduler(4);
+		const int counts[] = { 0, 1, 3, 17, 1000, 4099 };
+		for (int count : counts) {
+			std::vector<std::atomic<int>> visits(count + 10);
+			for (std::atomic<int>& visit : visits) {
+				visit = 0;
+			}
+			scheduler.ParallelFor(10, 10 + count, [&](int begin, int end) {
+				for (int i = begin; i < end; i++) {
+					visits[i]++;
+				}
+			}, 16);
+			int wrong = 0;
+			for (int i = 0; i < count + 10; i++) {
+				wrong += visits[i] != (i >= 10 ? 1 : 0);
+			}
+			CHECK(wrong == 0);
+		}
+	}
+
+	// With every worker stuck on a long task the caller does all the ranges itself instead of
+	// waiting for the workers to get to them
+	void TestParallelForWithBusyWorkers()
+	{
+		TaskScheduler scheduler(2);
+		std::atomic<bool> release(false);
+		for (int i = 0; i < scheduler.GetThreadCount(); i++) {
+			scheduler.Submit([&] {
+				while (!release) {
+					std::this_thread::yield();
+				}
+			});
+		}
+
+		std::atomic<int> rows(0);
+		auto start = std::chrono::steady_clock::now();
+		scheduler.ParallelFor(0, 256, [&](int begin, int end) { rows += end - begin; }, 16);
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		CHECK(rows == 256);
+		CHECK(!release);
+		CHECK(elapsed < std::chrono::seconds(1));
+
+		release = true;
+		scheduler.Wait();
+	}
+}
+
+int main()
+{
+	TestParallelForCoversRange();
+	TestParallelForWithBusyWorkers();
+	return TestCheck::Result();
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdio>
+
+// Minimal checks for the standalone tests. A failed check is reported and the test carries on,
+// main returns TestCheck::Result() so the test fails if any check did.
+namespace TestCheck
+{
+	inline int& Failures()
+	{
+		static int failures = 0;
+		return failures;
+	}
+
+	inline int Result()
+	{
+		if (Failures()) {
+			std::printf("%d checks failed\n", Failures());
+		}
+		return Failures() ? 1 : 0;
+	}
+}
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			TestCheck::Failures()++; \
+		} \
+	} while (0)
@@ -0,0 +1,122 @@
+#include "WaterQuadtree.h"
+#include "TestCheck.h"
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+	const float MeshSize = 100.0f;
+	const float ProjectionScale = 720.0f / (2.0f * tanf(3.14159265f / 8.0f));
+
+	// Cameras above the middle, low over a corner, high above, and off the edge of the mesh
+	const float Cameras[][3] = {
+		{ 0.0f, 20.0f, -60.0f }, { 0.0f, 5.0f, 0.0f }, { 40.0f, 3.0f, 40.0f },
+		{ -49.0f, 1.0f, 49.0f }, { 0.0f, 100.0f, 0.0f }, { -200.0f, 30.0f, 0.0f }
+	};
+
+	// Level drawn over every square of the finest quarter's size, row after row, -1 where
+	// nothing is drawn. Squares drawn more than once count as overlaps.
+	std::vector<int> DrawnLevels(WaterQuadtree& tree, int& side, int& overlaps, int& misaligned)
+	{
+		side = 1 << tree.GetLevelCount();
+		float unit = MeshSize / side;
+		std::vector<int> levels((size_t)side * side, -1);
+		overlaps = 0;
+		misaligned = 0;
+		for (const LodPatch& patch : tree.GetPatches()) {
+			float quarter = patch.size / 2.0f;
+			for (int q = 0; q < 4; q++) {
+				if (!(patch.quadrants & (1 << q))) {
+					continue;
+				}
+				float x = (patch.x + (q & 1) * quarter + MeshSize / 2.0f) / unit;
+				float z = (patch.z + (q >> 1) * quarter + MeshSize / 2.0f) / unit;
+				int x0 = (int)roundf(x);
+				int z0 = (int)roundf(z);
+				int cells = (int)roundf(quarter / unit);
+				if (fabsf(x - x0) > 1e-3f || fabsf(z - z0) > 1e-3f || x0 < 0 || z0 < 0 || x0 + cells > side || z0 + cells > side) {
+					misaligned++;
+					continue;
+				}
+				for (int j = z0; j < z0 + cells; j++) {
+					for (int i = x0; i < x0 + cells; i++) {
+						int& level = levels[(size_t)j * side + i];
+						if (level >= 0) {
+							overlaps++;
+						}
+						level = patch.level;
+					}
+				}
+			}
+		}
+		return levels;
+	}
+
+	// The quarters drawn tile the mesh, every part of it once and nothing outside it
+	void TestPatchesCoverTheMesh()
+	{
+		WaterQuadtree tree;
+		tree.Build(MeshSize, 32, MeshSize / 659.0f);
+		tree.SetHeightRange(0.0f, 10.0f);
+		for (float pixels : { 8.0f, 4.0f, 2.0f, 1.0f }) {
+			tree.SetScreenError(pixels, ProjectionScale);
+			for (const auto& camera : Cameras) {
+				tree.Select(camera[0], camera[1], camera[2]);
+				CHECK(!tree.GetPatches().empty());
+
+				int side, overlaps, misaligned;
+				std::vector<int> levels = DrawnLevels(tree, side, overlaps, misaligned);
+				CHECK(overlaps == 0);
+				CHECK(misaligned == 0);
+				int holes = 0;
+				for (int level : levels) {
+					holes += level < 0;
+				}
+				CHECK(holes == 0);
+			}
+		}
+	}
+
+	// Neighbouring patches are at most one level apart, the most the morph can close
+	void TestNeighboursDifferByOneLevel()
+	{
+		WaterQuadtree tree;
+		tree.Build(MeshSize, 32, MeshSize / 659.0f);
+		tree.SetHeightRange(0.0f, 10.0f);
+		bool mixed = false;
+		for (float pixels : { 8.0f, 4.0f, 2.0f, 1.0f }) {
+			tree.SetScreenError(pixels, ProjectionScale);
+			for (const auto& camera : Cameras) {
+				tree.Select(camera[0], camera[1], camera[2]);
+
+				int side, overlaps, misaligned;
+				std::vector<int> levels = DrawnLevels(tree, side, overlaps, misaligned);
+				int jumps = 0;
+				for (int j = 0; j < side; j++) {
+					for (int i = 0; i < side; i++) {
+						int level = levels[(size_t)j * side + i];
+						if (i + 1 < side) {
+							jumps += std::abs(level - levels[(size_t)j * side + i + 1]) > 1;
+							mixed |= level != levels[(size_t)j * side + i + 1];
+						}
+						if (j + 1 < side) {
+							jumps += std::abs(level - levels[(size_t)(j + 1) * side + i]) > 1;
+						}
+					}
+				}
+				CHECK(jumps == 0);
+			}
+		}
+
+		// Otherwise there was nothing to test
+		CHECK(mixed);
+	}
+}
+
+int main()
+{
+	TestPatchesCoverTheMesh();
+	TestNeighboursDifferByOneLevel();
+	return TestCheck::Result();
+}
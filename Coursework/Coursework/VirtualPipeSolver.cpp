@@ -0,0 +1,351 @@
+#include "VirtualPipeSolver.h"
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+
+namespace
+{
+	// Smallest outflow volume the drain limit divides by
+	const float MinOutflow = 1e-20f;
+
+	inline int Wrap(int i, int n)
+	{
+		return i < 0 ? i + n : (i >= n ? i - n : i);
+	}
+
+	// Net flow through the pipe from a cell to its next neighbour, from the outflow each way. It is
+	// accelerated by the difference in head s, the surface height, times the depth upwind of the
+	// pipe, its cross-section, so surface waves travel at sqrt(g h).
+	inline float Accelerate(float out, float back, float s, float sNext, float d, float dNext, float k, float damping)
+	{
+		float difference = s - sNext;
+		return (out - back) * damping + k * (difference > 0.0f ? d : dNext) * difference;
+	}
+
+	inline __m128 Accelerate(__m128 out, __m128 back, __m128 s, __m128 sNext, __m128 d, __m128 dNext, __m128 k, __m128 damping)
+	{
+		__m128 difference = _mm_sub_ps(s, sNext);
+		__m128 higher = _mm_cmpgt_ps(difference, _mm_setzero_ps());
+		__m128 upwind = _mm_or_ps(_mm_and_ps(higher, d), _mm_andnot_ps(higher, dNext));
+		return _mm_add_ps(_mm_mul_ps(_mm_sub_ps(out, back), damping), _mm_mul_ps(_mm_mul_ps(k, upwind), difference));
+	}
+}
+
+VirtualPipeSolver::VirtualPipeSolver(TaskScheduler* taskScheduler)
+{
+	scheduler = taskScheduler;
+	damping = 1.0f;
+	surfacePressure = nullptr;
+	reflective = false;
+	sizeX = 0;
+	sizeY = 0;
+	pitch = 0;
+	maxDepth = 0.0f;
+	slopedBed = false;
+}
+
+VirtualPipeSolver::~VirtualPipeSolver()
+{
+}
+
+const char* VirtualPipeSolver::GetName()
+{
+	return "Virtual pipe";
+}
+
+void VirtualPipeSolver::SetDamping(float newDamping)
+{
+	damping = newDamping;
+}
+
+void VirtualPipeSolver::SetSurfacePressure(const float* head)
+{
+	surfacePressure = head;
+}
+
+float VirtualPipeSolver::GetStableTimeStep(float courant)
+{
+	// Surface waves travel at sqrt(g h), the pipes exchange water with one neighbour per step
+	float speed = sqrtf(params.gravity * std::max(maxDepth, 1e-3f));
+	return courant * params.spatialStepSize / speed;
+}
+
+void VirtualPipeSolver::Reset()
+{
+	for (std::vector<float>* v : { &outLeft, &outRight, &outUp, &outDown }) {
+		std::fill(v->begin(), v->end(), 0.0f);
+	}
+}
+
+void VirtualPipeSolver::Resize(int nx, int ny)
+{
+	if (nx == sizeX && ny == sizeY) {
+		return;
+	}
+	sizeX = nx;
+	sizeY = ny;
+
+	// A ghost column either side, rows padded to a multiple of four floats
+	pitch = ((nx + 2) + 3) & ~3;
+	size_t count = (size_t)pitch * ny;
+	for (std::vector<float>* v : { &depth, &bed, &surface, &outLeft, &outRight, &outUp, &outDown }) {
+		v->assign(count, 0.0f);
+	}
+	zeroRow.assign(pitch, 0.0f);
+	rowMax.assign(ny, 0.0f);
+	rowSloped.assign(ny, 0);
+}
+
+void VirtualPipeSolver::ForRows(int rows, const std::function<void(int, int)>& body)
+{
+	if (scheduler) {
+		scheduler->ParallelFor(0, rows, body, 8);
+	}
+	else {
+		body(0, rows);
+	}
+}
+
+void VirtualPipeSolver::Step(SimulationGrid2D* grid)
+{
+	Advance(grid, 1);
+}
+
+void VirtualPipeSolver::Advance(SimulationGrid2D* grid, int steps)
+{
+	Resize(grid->GetSizeX(), grid->GetSizeY());
+	reflective = params.boundary == BoundaryType::Reflective;
+	float dt = params.timeStepSize;
+
+	// Depths are read back every call so changes made to the grid between calls are kept,
+	// the outflows carry over from the last call
+	Load(grid);
+	for (int step = 0; step < steps; step++) {
+		if (surfacePressure || slopedBed) {
+			ForRows(sizeY, [&](int y0, int y1) { UpdateHeads(y0, y1); });
+		}
+		ForRows(sizeY, [&](int y0, int y1) { UpdateOutflows(y0, y1, dt); });
+		ForRows(sizeY, [&](int y0, int y1) { LimitOutflows(y0, y1, dt); });
+		FillFlowGhosts();
+		ForRows(sizeY, [&](int y0, int y1) { UpdateDepths(y0, y1, dt); });
+	}
+	Store(grid);
+	grid->MarkAllDirty();
+}
+
+void VirtualPipeSolver::Load(SimulationGrid2D* grid)
+{
+	// A bed at one level everywhere does not change the head differences, the heads are then
+	// the depths and the pass adding the bed is skipped
+	float level = grid->GetRow(0)[0][SimulationGrid2D::Bathymetry];
+	ForRows(sizeY, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			const std::array<float, 4>* row = grid->GetRow(y);
+			float* d = &depth[(size_t)y * pitch + 1];
+			float* b = &bed[(size_t)y * pitch + 1];
+			char sloped = 0;
+			for (int x = 0; x < sizeX; x++) {
+				d[x] = std::max(0.0f, row[x][SimulationGrid2D::Height]);
+				b[x] = row[x][SimulationGrid2D::Bathymetry];
+				sloped |= b[x] != level;
+			}
+			rowSloped[y] = sloped;
+		}
+	});
+	slopedBed = std::find(rowSloped.begin(), rowSloped.end(), 1) != rowSloped.end();
+}
+
+void VirtualPipeSolver::Store(SimulationGrid2D* grid)
+{
+	// Discharge through a cell is the mean of the net flow through its two faces along each axis
+	float toDischarge = 0.5f * params.spatialStepSize;
+	ForRows(sizeY, [&](int y0, int y1) {
+		for (int y = y0; y < y1; y++) {
+			size_t offset = (size_t)y * pitch + 1;
+			const float* downAbove = (reflective && y == 0) ? &zeroRow[1] : &outDown[(size_t)Wrap(y - 1, sizeY) * pitch + 1];
+			const float* upBelow = (reflective && y == sizeY - 1) ? &zeroRow[1] : &outUp[(size_t)Wrap(y + 1, sizeY) * pitch + 1];
+			const float* d = &depth[offset];
+			const float* left = &outLeft[offset];
+			const float* right = &outRight[offset];
+			const float* up = &outUp[offset];
+			const float* down = &outDown[offset];
+
+			std::array<float, 4>* row = grid->GetRow(y);
+			float deepest = 0.0f;
+			for (int x = 0; x < sizeX; x++) {
+				row[x][SimulationGrid2D::Height] = d[x];
+				row[x][SimulationGrid2D::DischargeX] = (right[x - 1] - left[x] + right[x] - left[x + 1]) * toDischarge;
+				row[x][SimulationGrid2D::DischargeY] = (downAbove[x] - up[x] + down[x] - upBelow[x]) * toDischarge;
+				deepest = std::max(deepest, d[x]);
+			}
+			rowMax[y] = deepest;
+		}
+	});
+	maxDepth = *std::max_element(rowMax.begin(), rowMax.end());
+}
+
+void VirtualPipeSolver::UpdateHeads(int y0, int y1)
+{
+	for (int y = y0; y < y1; y++) {
+		const float* d = &depth[(size_t)y * pitch + 1];
+		const float* b = &bed[(size_t)y * pitch + 1];
+		float* s = &surface[(size_t)y * pitch + 1];
+		if (surfacePressure) {
+			const float* p = surfacePressure + (size_t)y * sizeX;
+			for (int x = 0; x < sizeX; x++) {
+				s[x] = d[x] + b[x] + p[x];
+			}
+		}
+		else {
+			for (int x = 0; x < sizeX; x++) {
+				s[x] = d[x] + b[x];
+			}
+		}
+	}
+}
+
+void VirtualPipeSolver::FillFlowGhosts()
+{
+	// Only the outflows pointing into the grid are read from the ghost columns
+	for (int y = 0; y < sizeY; y++) {
+		float* right = &outRight[(size_t)y * pitch];
+		float* left = &outLeft[(size_t)y * pitch];
+		right[0] = reflective ? 0.0f : right[sizeX];
+		left[sizeX + 1] = reflective ? 0.0f : left[1];
+	}
+}
+
+void VirtualPipeSolver::UpdateOutflows(int y0, int y1, float dt)
+{
+	// Flow acceleration per metre of surface difference and of depth in the pipe, the pipes are
+	// one cell long and wide
+	float k = dt * params.gravity / (params.spatialStepSize * params.spatialStepSize);
+	__m128 kv = _mm_set1_ps(k);
+	__m128 dampingv = _mm_set1_ps(damping);
+	__m128 zero = _mm_setzero_ps();
+
+	// Each pipe between two cells carries one net flow, stored as the outflow of the cell it
+	// leaves with the other cell's outflow through it zero. The row owns the pipes to the right
+	// of its cells and below them, so rows can run in parallel.
+	const std::vector<float>& head = (surfacePressure || slopedBed) ? surface : depth;
+	for (int y = y0; y < y1; y++) {
+		size_t offset = (size_t)y * pitch + 1;
+		size_t offsetBelow = (size_t)Wrap(y + 1, sizeY) * pitch + 1;
+		const float* d = &depth[offset];
+		const float* s = &head[offset];
+		const float* dBelow = &depth[offsetBelow];
+		const float* sBelow = &head[offsetBelow];
+		float* left = &outLeft[offset];
+		float* right = &outRight[offset];
+		float* down = &outDown[offset];
+		float* upBelow = &outUp[offsetBelow];
+
+		// Pipes to the right, the last cell's joins the first cell or is a wall
+		int last = sizeX - 1;
+		int vectorEnd = last & ~3;
+		for (int x = 0; x < vectorEnd; x += 4) {
+			__m128 flow = Accelerate(_mm_loadu_ps(right + x), _mm_loadu_ps(left + x + 1), _mm_loadu_ps(s + x), _mm_loadu_ps(s + x + 1),
+				_mm_loadu_ps(d + x), _mm_loadu_ps(d + x + 1), kv, dampingv);
+			_mm_storeu_ps(right + x, _mm_max_ps(zero, flow));
+			_mm_storeu_ps(left + x + 1, _mm_max_ps(zero, _mm_sub_ps(zero, flow)));
+		}
+		for (int x = vectorEnd; x < last; x++) {
+			float flow = Accelerate(right[x], left[x + 1], s[x], s[x + 1], d[x], d[x + 1], k, damping);
+			right[x] = std::max(0.0f, flow);
+			left[x + 1] = std::max(0.0f, -flow);
+		}
+		float flow = reflective ? 0.0f : Accelerate(right[last], left[0], s[last], s[0], d[last], d[0], k, damping);
+		right[last] = std::max(0.0f, flow);
+		left[0] = std::max(0.0f, -flow);
+
+		// Pipes below, the last row's join the first row or are walls
+		if (reflective && y == sizeY - 1) {
+			std::fill(down, down + sizeX, 0.0f);
+			std::fill(upBelow, upBelow + sizeX, 0.0f);
+			continue;
+		}
+		vectorEnd = sizeX & ~3;
+		for (int x = 0; x < vectorEnd; x += 4) {
+			__m128 flow = Accelerate(_mm_loadu_ps(down + x), _mm_loadu_ps(upBelow + x), _mm_loadu_ps(s + x), _mm_loadu_ps(sBelow + x),
+				_mm_loadu_ps(d + x), _mm_loadu_ps(dBelow + x), kv, dampingv);
+			_mm_storeu_ps(down + x, _mm_max_ps(zero, flow));
+			_mm_storeu_ps(upBelow + x, _mm_max_ps(zero, _mm_sub_ps(zero, flow)));
+		}
+		for (int x = vectorEnd; x < sizeX; x++) {
+			float flow = Accelerate(down[x], upBelow[x], s[x], sBelow[x], d[x], dBelow[x], k, damping);
+			down[x] = std::max(0.0f, flow);
+			upBelow[x] = std::max(0.0f, -flow);
+		}
+	}
+}
+
+void VirtualPipeSolver::LimitOutflows(int y0, int y1, float dt)
+{
+	// All four outflows of a cell are scaled so they cannot drain more than the depth it holds.
+	// Only the outflows leaving a cell are changed, the inflows are the neighbours' outflows.
+	__m128 dtv = _mm_set1_ps(dt);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 minOutflow = _mm_set1_ps(MinOutflow);
+	int vectorEnd = sizeX & ~3;
+
+	for (int y = y0; y < y1; y++) {
+		size_t offset = (size_t)y * pitch + 1;
+		const float* d = &depth[offset];
+		float* left = &outLeft[offset];
+		float* right = &outRight[offset];
+		float* up = &outUp[offset];
+		float* down = &outDown[offset];
+
+		for (int x = 0; x < vectorEnd; x += 4) {
+			__m128 l = _mm_loadu_ps(left + x);
+			__m128 r = _mm_loadu_ps(right + x);
+			__m128 u = _mm_loadu_ps(up + x);
+			__m128 dn = _mm_loadu_ps(down + x);
+			__m128 total = _mm_mul_ps(_mm_add_ps(_mm_add_ps(l, r), _mm_add_ps(u, dn)), dtv);
+			__m128 scale = _mm_min_ps(one, _mm_div_ps(_mm_loadu_ps(d + x), _mm_max_ps(total, minOutflow)));
+			_mm_storeu_ps(left + x, _mm_mul_ps(l, scale));
+			_mm_storeu_ps(right + x, _mm_mul_ps(r, scale));
+			_mm_storeu_ps(up + x, _mm_mul_ps(u, scale));
+			_mm_storeu_ps(down + x, _mm_mul_ps(dn, scale));
+		}
+		for (int x = vectorEnd; x < sizeX; x++) {
+			float scale = std::min(1.0f, d[x] / std::max((left[x] + right[x] + up[x] + down[x]) * dt, MinOutflow));
+			left[x] *= scale;
+			right[x] *= scale;
+			up[x] *= scale;
+			down[x] *= scale;
+		}
+	}
+}
+
+void VirtualPipeSolver::UpdateDepths(int y0, int y1, float dt)
+{
+	__m128 dtv = _mm_set1_ps(dt);
+	__m128 zero = _mm_setzero_ps();
+	int vectorEnd = sizeX & ~3;
+
+	for (int y = y0; y < y1; y++) {
+		size_t offset = (size_t)y * pitch + 1;
+		const float* downAbove = (reflective && y == 0) ? &zeroRow[1] : &outDown[(size_t)Wrap(y - 1, sizeY) * pitch + 1];
+		const float* upBelow = (reflective && y == sizeY - 1) ? &zeroRow[1] : &outUp[(size_t)Wrap(y + 1, sizeY) * pitch + 1];
+		float* d = &depth[offset];
+		const float* left = &outLeft[offset];
+		const float* right = &outRight[offset];
+		const float* up = &outUp[offset];
+		const float* down = &outDown[offset];
+
+		for (int x = 0; x < vectorEnd; x += 4) {
+			__m128 inflow = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(right + x - 1), _mm_loadu_ps(left + x + 1)),
+				_mm_add_ps(_mm_loadu_ps(downAbove + x), _mm_loadu_ps(upBelow + x)));
+			__m128 outflow = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(left + x), _mm_loadu_ps(right + x)),
+				_mm_add_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x)));
+			__m128 next = _mm_add_ps(_mm_loadu_ps(d + x), _mm_mul_ps(dtv, _mm_sub_ps(inflow, outflow)));
+			_mm_storeu_ps(d + x, _mm_max_ps(zero, next));
+		}
+		for (int x = vectorEnd; x < sizeX; x++) {
+			float inflow = (right[x - 1] + left[x + 1]) + (downAbove[x] + upBelow[x]);
+			float outflow = (left[x] + right[x]) + (up[x] + down[x]);
+			d[x] = std::max(0.0f, d[x] + dt * (inflow - outflow));
+		}
+	}
+}
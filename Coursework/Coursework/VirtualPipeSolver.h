@@ -0,0 +1,96 @@
+#pragma once
+#include <vector>
+#include "ShallowWaterSolver.h"
+#include "TaskScheduler.h"
+
+// Virtual pipe model (O'Brien and Hodgins, 1995; Mei et al., 2007). Every cell is joined to
+// its four neighbours by pipes. Each step the net flow through a pipe is accelerated by the
+// difference in surface height, depth plus bathymetry, across it times the depth upwind of
+// it, the pipe's cross-section, so waves travel at sqrt(g h). All four outflows of a cell are
+// scaled down when they would drain more water than the cell holds, and the depth is then
+// updated from the net flow. Momentum advection is ignored, so the flow is less accurate than
+// with the shallow water solvers, but the depth never goes negative and a step costs three
+// passes over the grid. It is meant for interactive scenes at grid sizes the other solvers
+// cannot reach.
+//
+// The outflows are part of the state and stay in the solver between steps, the grid receives
+// the depth and the discharges averaged from the pipes on either side of each cell. Advance
+// runs any number of steps on the solver's own arrays and copies to and from the grid once.
+// Rows are processed four cells at a time with SSE and split over the task scheduler when one
+// is set. No scheduler must be set when the solver itself runs on one of the scheduler's workers.
+class VirtualPipeSolver : public ShallowWaterSolver
+{
+
+public:
+
+	VirtualPipeSolver(TaskScheduler* scheduler = nullptr);
+	~VirtualPipeSolver();
+
+	void Step(SimulationGrid2D* grid) override;
+	const char* GetName() override;
+
+	// Advance the grid by the given number of time steps
+	void Advance(SimulationGrid2D* grid, int steps);
+
+	// Fraction of the outflow kept from one step to the next, 1 keeps all of it
+	void SetDamping(float damping);
+
+	// Pressure head in metres of water pushing on the surface, such as that of floating hulls,
+	// one float per node row after row. It is read every step, null removes it.
+	void SetSurfacePressure(const float* head);
+
+	// Largest stable time step for the deepest water of the last step at the given Courant number
+	float GetStableTimeStep(float courant);
+
+	// Drop the outflows, used when the grid is replaced by a new state
+	void Reset() override;
+
+private:
+
+	void Resize(int nx, int ny);
+	void ForRows(int rows, const std::function<void(int, int)>& body);
+
+	void Load(SimulationGrid2D* grid);
+	void Store(SimulationGrid2D* grid);
+
+	// Ghost columns either side of every row with the outflows into the grid, from walls or the
+	// opposite edge of the grid
+	void FillFlowGhosts();
+
+	// Flows through the pipes right of and below the rows [y0, y1) from the current heads, the
+	// outflows of those rows limited to the water they hold, then the depths from the outflows
+	void UpdateOutflows(int y0, int y1, float dt);
+	void LimitOutflows(int y0, int y1, float dt);
+	void UpdateDepths(int y0, int y1, float dt);
+
+	// Heads of the rows [y0, y1), the depths plus the bed and the surface pressure
+	void UpdateHeads(int y0, int y1);
+
+	TaskScheduler* scheduler;
+	float damping;
+	const float* surfacePressure;
+	bool reflective;
+
+	int sizeX;
+	int sizeY;
+	int pitch;
+
+	// Depth, bed, head and the outflows towards -x, +x, -y and +y, in metres per second of depth
+	// change. Rows are pitch floats apart and cell x of a row is at x + 1, after a ghost column.
+	std::vector<float> depth;
+	std::vector<float> bed;
+	std::vector<float> surface;
+	std::vector<float> outLeft, outRight, outUp, outDown;
+
+	// Outflows of the missing neighbours of the edge rows when the boundary is reflective
+	std::vector<float> zeroRow;
+
+	// Deepest water per row and over the grid in the last store
+	std::vector<float> rowMax;
+	float maxDepth;
+
+	// Rows of the last load whose bed is not at the level of the first node, and whether any are
+	std::vector<char> rowSloped;
+	bool slopedBed;
+
+};
@@ -1,7 +1,18 @@
 #include "Water.h"
+#include <algorithm>
 
-Water::Water(ID3D11Device* device, ID3D11DeviceContext* deviceCtxt, HWND hwnd, TextureManager* texMgr, int gSizeX)
+namespace
 {
+	// Side of the square the water mesh covers, as PlanarMesh builds it
+	const float MeshSize = 100.0f;
+
+	// Largest patch of the quadtree, smaller patches are used when they reach the mesh's spacing
+	const int MaxPatchCells = 32;
+}
+
+Water::Water(ID3D11Device* dev, ID3D11DeviceContext* deviceCtxt, HWND hwnd, TextureManager* texMgr, int gSizeX)
+{
+	device = dev;
 	deviceContext = deviceCtxt;
 	textureMgr = texMgr;
 	textureMgr->loadTexture(L"waves", L"res/waves.png");
@@ -10,6 +21,21 @@ Water::Water(ID3D11Device* device, ID3D11DeviceContext* deviceCtxt, HWND hwnd, T
 	waveMesh = new PlanarMesh(device, deviceContext, gSizeX);
 	wavesShader = new WaveShader(device, deviceContext, hwnd, gSizeX, textureMgr->getTexture(L"waves"));
 
+	// quadtree of patches drawn instead of the mesh when level of detail is on, built to match it
+	patchMesh = nullptr;
+	quadtree = new WaterQuadtree();
+	quadtree->SetHeightRange(-5.0f, 15.0f);
+	levelOfDetail = false;
+	triangleCount = 0;
+	buildQuadtree(gSizeX);
+
+	// frustum culling of the mesh chunks or patches
+	culler = new FrustumCuller();
+	culling = false;
+	chunkCount = 0;
+	visibleChunkCount = 0;
+	buildChunkBoxes();
+
 	// initial values for Gerstner waves
 	speed = 3.f;
 	amplitude = 0.3f;
@@ -25,23 +51,219 @@ Water::~Water()
 	if (waveMesh) {
 		delete waveMesh;
 	}
+	if (patchMesh) {
+		delete patchMesh;
+	}
+	if (quadtree) {
+		delete quadtree;
+	}
+	if (culler) {
+		delete culler;
+	}
 }
 
 
-void Water::render(XMMATRIX& camView, XMMATRIX& world, XMMATRIX& projection, Light* light, XMFLOAT3 camPos, float timeVar, ID3D11ShaderResourceView* gridTexture, bool toggleGerstner, bool toggleSWE)
+void Water::render(XMMATRIX& camView, XMMATRIX& world, XMMATRIX& projection, Light* light, XMFLOAT3 camPos, float timeVar, ID3D11ShaderResourceView* gridTexture, bool toggleGerstner, bool toggleSWE, bool toggleOcean)
 {
 
-	// Render wave mesh
-	waveMesh->sendData(deviceContext);
 	if(toggleGerstner && !toggleSWE)
 	{
 		wavesShader->setGersnterWavesParameters(speed, amplitude, wavelength, steepness);
 	}
 
-	wavesShader->setShaderParameters(world, camView, projection, light, camPos, toggleGerstner, gridTexture, toggleSWE, timeVar);
-	wavesShader->render(deviceContext, waveMesh->GetIndexCount());
+	if (culling) {
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, world * camView * projection);
+		culler->SetViewProjection(&viewProjection.m[0][0]);
+	}
+
+	if (!levelOfDetail) {
+		// Render wave mesh
+		waveMesh->sendData(deviceContext);
+		wavesShader->setShaderParameters(world, camView, projection, light, camPos, toggleGerstner, gridTexture, toggleSWE, toggleOcean, timeVar);
+		const std::vector<PlanarMesh::Chunk>& chunks = waveMesh->GetChunks();
+		chunkCount = (int)chunks.size();
+		if (!culling) {
+			wavesShader->render(deviceContext, waveMesh->GetIndexCount());
+			visibleChunkCount = chunkCount;
+			drawRanges.assign(1, DrawRange{ 0, waveMesh->GetIndexCount() });
+			triangleCount = waveMesh->GetIndexCount() / 3;
+			return;
+		}
+
+		// Chunks next to each other in the index buffer are drawn together
+		const std::vector<int>& visible = culler->Cull(chunkBoxes);
+		visibleChunkCount = (int)visible.size();
+		drawRanges.clear();
+		triangleCount = 0;
+		for (size_t i = 0; i < visible.size(); i++) {
+			const PlanarMesh::Chunk& chunk = chunks[visible[i]];
+			if (!drawRanges.empty() && drawRanges.back().startIndex + drawRanges.back().indexCount == chunk.startIndex) {
+				drawRanges.back().indexCount += chunk.indexCount;
+			}
+			else {
+				drawRanges.push_back(DrawRange{ chunk.startIndex, chunk.indexCount });
+			}
+			triangleCount += chunk.indexCount / 3;
+		}
+		for (size_t i = 0; i < drawRanges.size(); i++) {
+			wavesShader->renderRange(deviceContext, drawRanges[i].indexCount, drawRanges[i].startIndex);
+		}
+		return;
+	}
+
+	// Render the patches chosen for this camera, whole or quarter by quarter
+	quadtree->Select(camPos.x, camPos.y, camPos.z);
+	patchMesh->sendData(deviceContext);
+	wavesShader->setShaderParameters(world, camView, projection, light, camPos, toggleGerstner, gridTexture, toggleSWE, toggleOcean, timeVar);
+	int quarter = patchMesh->GetQuadrantIndexCount();
+	const std::vector<LodPatch>& patches = quadtree->GetPatches();
+	patchBoxes.Clear();
+	for (size_t i = 0; i < patches.size(); i++) {
+		const LodPatch& patch = patches[i];
+		patchBoxes.Add(patch.x, 0.0f, patch.z, patch.x + patch.size, 0.0f, patch.z + patch.size);
+	}
+	chunkCount = (int)patches.size();
+	visibleChunkCount = 0;
+	drawRanges.clear();
+	triangleCount = 0;
+	long long quarterTriangles = quarter / 3;
+	const std::vector<int>* visible = culling ? &culler->Cull(patchBoxes) : nullptr;
+	int drawn = visible ? (int)visible->size() : chunkCount;
+	for (int v = 0; v < drawn; v++) {
+		const LodPatch& patch = patches[visible ? (*visible)[v] : v];
+		visibleChunkCount++;
+		wavesShader->setPatchParameters(patch.x, patch.z, patch.spacing, patch.morphStart, patch.morphEnd, MeshSize);
+		if (patch.quadrants == 15) {
+			wavesShader->renderRange(deviceContext, 4 * quarter, 0);
+			drawRanges.push_back(DrawRange{ 0, 4 * quarter });
+			triangleCount += 4 * quarterTriangles;
+			continue;
+		}
+		for (int q = 0; q < 4; q++) {
+			if (patch.quadrants & (1 << q)) {
+				wavesShader->renderRange(deviceContext, quarter, q * quarter);
+				drawRanges.push_back(DrawRange{ q * quarter, quarter });
+				triangleCount += quarterTriangles;
+			}
+		}
+	}
+}
+
+
+void Water::GetGerstnerParameters(float& speed_, float& amplitude_, float& wavelength_, float& steepness_)
+{
+	speed_ = speed;
+	amplitude_ = amplitude;
+	wavelength_ = wavelength;
+	steepness_ = steepness;
+}
+
+
+void Water::SetOceanMaps(ID3D11ShaderResourceView* displacement, ID3D11ShaderResourceView* normals, float patchSize)
+{
+	wavesShader->setOceanParameters(displacement, normals, patchSize);
+}
+
+
+void Water::SetSurfaceMaps(ID3D11ShaderResourceView* normals, ID3D11ShaderResourceView* foam)
+{
+	wavesShader->setSurfaceMaps(normals, foam);
+}
+
+
+void Water::SetMeshResolution(int resolution)
+{
+	if (waveMesh && waveMesh->GetResolution() == resolution) {
+		return;
+	}
+	if (waveMesh) {
+		delete waveMesh;
+	}
+	waveMesh = new PlanarMesh(device, deviceContext, resolution);
+	buildQuadtree(resolution);
+	buildChunkBoxes();
+}
+
+void Water::buildChunkBoxes()
+{
+	// Flat boxes at rest, the culler grows them by the waves' reach
+	const std::vector<PlanarMesh::Chunk>& chunks = waveMesh->GetChunks();
+	chunkBoxes.Clear();
+	for (size_t i = 0; i < chunks.size(); i++) {
+		chunkBoxes.Add(chunks[i].minX, 0.0f, chunks[i].minZ, chunks[i].maxX, 0.0f, chunks[i].maxZ);
+	}
 }
 
+void Water::SetCulling(bool enabled, float horizontal, float minHeight, float maxHeight)
+{
+	culling = enabled;
+	culler->SetDisplacement(horizontal, minHeight, maxHeight);
+}
+
+bool Water::GetCulling()
+{
+	return culling;
+}
+
+int Water::GetChunkCount()
+{
+	return chunkCount;
+}
+
+int Water::GetVisibleChunkCount()
+{
+	return visibleChunkCount;
+}
+
+int Water::GetDrawCount()
+{
+	return (int)drawRanges.size();
+}
+
+float Water::GetCullTime()
+{
+	return culling ? culler->GetLastTime() : 0.0f;
+}
+
+void Water::buildQuadtree(int resolution)
+{
+	// The finest level matches the uniform mesh's spacing, the patch only changes with it
+	quadtree->Build(MeshSize, MaxPatchCells, MeshSize / (std::max(resolution, 2) - 1));
+	if (patchMesh && patchMesh->GetCells() == quadtree->GetPatchCells()) {
+		return;
+	}
+	if (patchMesh) {
+		delete patchMesh;
+	}
+	patchMesh = new PatchMesh(device, deviceContext, quadtree->GetPatchCells());
+}
+
+void Water::SetLevelOfDetail(bool enabled, float pixelError, float projectionScale)
+{
+	levelOfDetail = enabled;
+	quadtree->SetScreenError(pixelError, projectionScale);
+}
+
+bool Water::GetLevelOfDetail()
+{
+	return levelOfDetail;
+}
+
+WaterQuadtree* Water::GetQuadtree()
+{
+	return quadtree;
+}
+
+long long Water::GetTriangleCount()
+{
+	return triangleCount;
+}
+
+int Water::GetMeshResolution()
+{
+	return waveMesh->GetResolution();
+}
 
 void Water::GUI()
 {
@@ -2,6 +2,9 @@
 #include "DXF.h"
 #include "WaveShader.h"
 #include "PlanarMesh.h"
+#include "PatchMesh.h"
+#include "WaterQuadtree.h"
+#include "FrustumCuller.h"
 
 
 class Water
@@ -10,12 +13,72 @@ public:
 	Water(ID3D11Device* device, ID3D11DeviceContext* deviceContext, HWND hwnd, TextureManager* textureMgr, int gridSizeX);
 	~Water();
 
-	void render(XMMATRIX& camview, XMMATRIX& world, XMMATRIX& projection, Light* light, XMFLOAT3 camPos, float timeVar, ID3D11ShaderResourceView* gridTexture, bool toggleGerstner, bool toggleSWE);
+	void render(XMMATRIX& camview, XMMATRIX& world, XMMATRIX& projection, Light* light, XMFLOAT3 camPos, float timeVar, ID3D11ShaderResourceView* gridTexture, bool toggleGerstner, bool toggleSWE, bool toggleOcean);
 	void GUI();
 
+	// Parameters of the Gerstner waves, in the order the shader is given them
+	void GetGerstnerParameters(float& speed, float& amplitude, float& wavelength, float& steepness);
+
+	// Maps of the FFT ocean, each covering patchSize metres and tiled over the mesh
+	void SetOceanMaps(ID3D11ShaderResourceView* displacement, ID3D11ShaderResourceView* normals, float patchSize);
+
+	// Normal and foam maps of the shallow water heights, the size of the grid texture rendered
+	// with them. Null maps leave the flat normal and no foam.
+	void SetSurfaceMaps(ID3D11ShaderResourceView* normals, ID3D11ShaderResourceView* foam);
+
+	// Rebuild the surface mesh with the given number of vertices along each side
+	void SetMeshResolution(int resolution);
+	int GetMeshResolution();
+
+	// Draw the surface as patches of a quadtree chosen from the camera every frame in place of
+	// the uniform mesh, the finest level as dense as the uniform mesh. The projection scale is
+	// the one WaterQuadtree::SetScreenError takes.
+	void SetLevelOfDetail(bool enabled, float pixelError, float projectionScale);
+	bool GetLevelOfDetail();
+	WaterQuadtree* GetQuadtree();
+
+	// Skip the chunks of the mesh, or the quadtree's patches, outside the camera's frustum. The
+	// surface moves at most horizontal sideways and stays between minHeight and maxHeight, the
+	// chunks' boxes are grown to match.
+	void SetCulling(bool enabled, float horizontal, float minHeight, float maxHeight);
+	bool GetCulling();
+
+	// Triangles submitted by the last render
+	long long GetTriangleCount();
+
+	// Chunks or patches tested and kept by the last render, and the draws they were merged into
+	int GetChunkCount();
+	int GetVisibleChunkCount();
+	int GetDrawCount();
+	float GetCullTime(); // milliseconds
+
 private:
+	void buildQuadtree(int resolution);
+	void buildChunkBoxes();
+
+	// A run of the bound index buffer
+	struct DrawRange
+	{
+		int startIndex;
+		int indexCount;
+	};
+
 	WaveShader* wavesShader;
 	PlanarMesh* waveMesh;
+	PatchMesh* patchMesh;
+	WaterQuadtree* quadtree;
+	bool levelOfDetail;
+	long long triangleCount;
+
+	// Boxes of the mesh chunks at rest, and of the patches selected this frame
+	FrustumCuller* culler;
+	CullBoxes chunkBoxes;
+	CullBoxes patchBoxes;
+	std::vector<DrawRange> drawRanges;
+	bool culling;
+	int chunkCount;
+	int visibleChunkCount;
+
 	ID3D11Device* device;
 	ID3D11DeviceContext* deviceContext;
 	TextureManager* textureMgr;
@@ -0,0 +1,214 @@
+#include "WaterQuadtree.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	// Levels never needed past this, the finest patch would be 2^15 times smaller than the mesh
+	const int MaxLevels = 16;
+
+	// Range of the root and morph distances of the top level, which has nothing coarser to morph to
+	const float Unbounded = 1e30f;
+}
+
+WaterQuadtree::WaterQuadtree()
+{
+	meshSize = 100.0f;
+	patchCells = 32;
+	levelCount = 1;
+	finestSpacing = meshSize / patchCells;
+	minHeight = 0.0f;
+	maxHeight = 10.0f;
+	pixelError = 8.0f;
+	projectionScale = 1000.0f;
+	morphStartFraction = 0.7f;
+	rangesDirty = true;
+	cameraX = 0.0f;
+	cameraY = 0.0f;
+	cameraZ = 0.0f;
+	triangleCount = 0;
+	lastTime = 0.0f;
+}
+
+WaterQuadtree::~WaterQuadtree()
+{
+}
+
+void WaterQuadtree::Build(float size, int maxCells, float spacing)
+{
+	meshSize = size;
+	patchCells = std::max(2, maxCells & ~1);
+	levelCount = 1;
+	while (levelCount < MaxLevels && meshSize / (patchCells << (levelCount - 1)) > spacing) {
+		levelCount++;
+	}
+
+	// The fewest cells per patch that still reach the spacing, so the finest level is no denser
+	// than asked for
+	float cells = ceilf(meshSize / (spacing * (1 << (levelCount - 1))));
+	patchCells = std::min(patchCells, std::max(2, ((int)cells + 1) & ~1));
+	finestSpacing = meshSize / (patchCells << (levelCount - 1));
+	rangesDirty = true;
+}
+
+void WaterQuadtree::SetHeightRange(float minimum, float maximum)
+{
+	minHeight = std::min(minimum, maximum);
+	maxHeight = std::max(minimum, maximum);
+	rangesDirty = true;
+}
+
+void WaterQuadtree::SetScreenError(float pixels, float scale)
+{
+	pixelError = std::max(pixels, 0.1f);
+	projectionScale = scale;
+	rangesDirty = true;
+}
+
+float WaterQuadtree::GetScreenError()
+{
+	return pixelError;
+}
+
+void WaterQuadtree::SetMorphStart(float fraction)
+{
+	morphStartFraction = std::min(std::max(fraction, 0.05f), 0.95f);
+	rangesDirty = true;
+}
+
+void WaterQuadtree::UpdateRanges()
+{
+	// Morphing towards level L starts past the range of level L - 1 by at least a node diagonal
+	// of that level, so the coarser side of a border between levels has not started morphing
+	ranges.resize(levelCount);
+	float previousRange = 0.0f;
+	float previousDiagonal = 0.0f;
+	float heightSpan = maxHeight - minHeight;
+	for (int level = 0; level < levelCount; level++) {
+		float spacing = finestSpacing * (1 << level);
+		float range = spacing * projectionScale / pixelError;
+		if (level > 0) {
+			range = std::max(range, previousRange + previousDiagonal / morphStartFraction);
+		}
+		ranges[level] = range;
+
+		float size = spacing * patchCells;
+		previousRange = range;
+		previousDiagonal = sqrtf(2.0f * size * size + heightSpan * heightSpan);
+	}
+	rangesDirty = false;
+}
+
+bool WaterQuadtree::Intersects(float x, float z, float size, float radius)
+{
+	// Squared distance from the camera to the node's box
+	float dx = std::max(std::max(x - cameraX, cameraX - (x + size)), 0.0f);
+	float dy = std::max(std::max(minHeight - cameraY, cameraY - maxHeight), 0.0f);
+	float dz = std::max(std::max(z - cameraZ, cameraZ - (z + size)), 0.0f);
+	return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+void WaterQuadtree::AddPatch(float x, float z, float size, int level, int quadrants)
+{
+	LodPatch patch;
+	patch.x = x;
+	patch.z = z;
+	patch.size = size;
+	patch.spacing = size / patchCells;
+	patch.level = level;
+	patch.quadrants = quadrants;
+	if (level + 1 < levelCount) {
+		float previous = level > 0 ? ranges[level - 1] : 0.0f;
+		patch.morphStart = previous + morphStartFraction * (ranges[level] - previous);
+		patch.morphEnd = ranges[level];
+	}
+	else {
+		patch.morphStart = Unbounded;
+		patch.morphEnd = 2.0f * Unbounded;
+	}
+	patches.push_back(patch);
+
+	// A quarter of the patch is a quarter of its triangles
+	long long quarter = (long long)patchCells * patchCells / 2;
+	for (int q = 0; q < 4; q++) {
+		if (quadrants & (1 << q)) {
+			triangleCount += quarter;
+		}
+	}
+}
+
+bool WaterQuadtree::SelectNode(float x, float z, float size, int level)
+{
+	// Out of this level's range the parent draws the node's area
+	float range = level + 1 < levelCount ? ranges[level] : Unbounded;
+	if (!Intersects(x, z, size, range)) {
+		return false;
+	}
+	if (level == 0 || !Intersects(x, z, size, ranges[level - 1])) {
+		AddPatch(x, z, size, level, 15);
+		return true;
+	}
+
+	float half = 0.5f * size;
+	int uncovered = 0;
+	for (int q = 0; q < 4; q++) {
+		if (!SelectNode(x + (q & 1) * half, z + (q >> 1) * half, half, level - 1)) {
+			uncovered |= 1 << q;
+		}
+	}
+	if (uncovered) {
+		AddPatch(x, z, size, level, uncovered);
+	}
+	return true;
+}
+
+void WaterQuadtree::Select(float x, float y, float z)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (rangesDirty) {
+		UpdateRanges();
+	}
+	cameraX = x;
+	cameraY = y;
+	cameraZ = z;
+	patches.clear();
+	triangleCount = 0;
+	SelectNode(-0.5f * meshSize, -0.5f * meshSize, meshSize, levelCount - 1);
+
+	lastTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+const std::vector<LodPatch>& WaterQuadtree::GetPatches()
+{
+	return patches;
+}
+
+int WaterQuadtree::GetLevelCount()
+{
+	return levelCount;
+}
+
+int WaterQuadtree::GetPatchCells()
+{
+	return patchCells;
+}
+
+float WaterQuadtree::GetRange(int level)
+{
+	if (rangesDirty) {
+		UpdateRanges();
+	}
+	return ranges[level];
+}
+
+long long WaterQuadtree::GetTriangleCount()
+{
+	return triangleCount;
+}
+
+float WaterQuadtree::GetLastTime()
+{
+	return lastTime;
+}
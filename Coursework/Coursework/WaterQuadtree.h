@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+
+// A node of the water quadtree chosen to be drawn, with the distances from the camera over
+// which its vertices morph onto the next coarser level's grid
+struct LodPatch
+{
+	float x;       // corner with the smallest x and z
+	float z;
+	float size;    // side in world units
+	float spacing; // between neighbouring vertices
+	float morphStart;
+	float morphEnd;
+	int level;     // 0 is the finest
+	int quadrants; // quarters to draw, bit 0 at (-x, -z), 1 at (+x, -z), 2 at (-x, +z) and 3 at (+x, +z)
+};
+
+// Continuous distance based level of detail (CDLOD) for the water mesh. A square centred on the
+// origin is covered by a quadtree whose nodes are all drawn with the same grid patch, so the
+// vertex spacing doubles with every level up. Level L is used out to range[L] from the camera,
+// the distance at which its vertex spacing projects to the allowed number of pixels.
+//
+// Selection walks down from the root. A node is subdivided where the next finer level's range
+// reaches it, and the quarters the finer level does not reach are drawn by the node itself.
+// Over the last part of each range the vertices morph onto the next coarser level's grid, so
+// neighbouring levels meet without cracks and a change of level does not pop. The ranges are
+// widened where needed so a node never borders one more than a level coarser. Heights are not
+// known here, nodes are boxes spanning a fixed range of heights.
+class WaterQuadtree
+{
+
+public:
+
+	WaterQuadtree();
+	~WaterQuadtree();
+
+	// Cover a square meshSize across with patches of at most patchCells cells along a side, with
+	// as many levels as it takes for the finest vertex spacing to be at most finestSpacing. The
+	// patches get the fewest even number of cells that reaches it.
+	void Build(float meshSize, int patchCells, float finestSpacing);
+
+	// Heights the surface reaches, the nodes' boxes span them
+	void SetHeightRange(float minHeight, float maxHeight);
+
+	// Largest vertex spacing, in pixels, a level may project to. The projection scale is the
+	// viewport height over 2 tan(fov / 2), the projection's second diagonal element times half
+	// the viewport height.
+	void SetScreenError(float pixels, float projectionScale);
+	float GetScreenError();
+
+	// Fraction of each level's range after which its vertices start morphing
+	void SetMorphStart(float fraction);
+
+	// Choose the patches to draw from a camera position
+	void Select(float cameraX, float cameraY, float cameraZ);
+	const std::vector<LodPatch>& GetPatches();
+
+	int GetLevelCount();
+	int GetPatchCells();
+	float GetRange(int level);
+
+	// Of the last selection
+	long long GetTriangleCount();
+	float GetLastTime(); // milliseconds
+
+private:
+
+	void UpdateRanges();
+	bool SelectNode(float x, float z, float size, int level);
+	bool Intersects(float x, float z, float size, float radius);
+	void AddPatch(float x, float z, float size, int level, int quadrants);
+
+	float meshSize;
+	int patchCells;
+	int levelCount;
+	float finestSpacing;
+
+	float minHeight;
+	float maxHeight;
+	float pixelError;
+	float projectionScale;
+	float morphStartFraction;
+	bool rangesDirty;
+	std::vector<float> ranges;
+
+	float cameraX;
+	float cameraY;
+	float cameraZ;
+	std::vector<LodPatch> patches;
+	long long triangleCount;
+	float lastTime;
+
+};
@@ -0,0 +1,524 @@
+#include "WaterSurfaceQuery.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <xmmintrin.h>
+
+namespace
+{
+	const float Pi = 3.14159265358979f;
+
+	// The four Gerstner waves of wave_vs.hlsl: wavelength, amplitude and speed multipliers,
+	// then the direction before it is normalised
+	const float GerstnerWaves[4][5] = {
+		{ 1.0f, 1.0f, 1.0f, 1.0f, 0.5f },
+		{ 1.4f, 0.9f, 0.6f, 0.6f, 0.7f },
+		{ 2.7f, 0.6f, 1.2f, 0.3f, 0.5f },
+		{ 4.0f, 3.04f, 1.5f, 1.0f, 0.6f },
+	};
+
+	// The two sine waves of wave_vs.hlsl: frequency, amplitude and speed
+	const float SineWaves[2][3] = {
+		{ 0.2f, 1.2f, 1.0f },
+		{ 0.2f, 0.5f, 1.5f },
+	};
+
+	// Points per task when a batch is split over the scheduler, in groups of four
+	const int MinGroups = 256;
+
+	// Largest integer not above v, for |v| below 2^22. Adding and removing 1.5 * 2^23 rounds to
+	// the nearest integer, which is one too high when it rounded up.
+	inline __m128 Floor(__m128 v)
+	{
+		const __m128 magic = _mm_set1_ps(12582912.0f);
+		__m128 rounded = _mm_sub_ps(_mm_add_ps(v, magic), magic);
+		return _mm_sub_ps(rounded, _mm_and_ps(_mm_cmpgt_ps(rounded, v), _mm_set1_ps(1.0f)));
+	}
+
+	inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	// Sine and cosine of four angles. The angle is reduced to r in [-pi/4, pi/4] around the
+	// nearest multiple q of pi / 2, in three parts so large phases keep their precision, and
+	// the quadrant q mod 4 picks and signs the two Taylor polynomials.
+	inline void SinCos(__m128 x, __m128& s, __m128& c)
+	{
+		__m128 q = Floor(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.0f / Pi)), _mm_set1_ps(0.5f)));
+		__m128 r = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(1.5703125f)));
+		r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(4.837512969970703125e-4f)));
+		r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(7.54978995489188216e-8f)));
+		__m128 r2 = _mm_mul_ps(r, r);
+
+		__m128 sr = _mm_add_ps(_mm_set1_ps(-1.0f / 5040.0f), _mm_mul_ps(r2, _mm_set1_ps(1.0f / 362880.0f)));
+		sr = _mm_add_ps(_mm_set1_ps(1.0f / 120.0f), _mm_mul_ps(r2, sr));
+		sr = _mm_add_ps(_mm_set1_ps(-1.0f / 6.0f), _mm_mul_ps(r2, sr));
+		sr = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), sr));
+
+		__m128 cr = _mm_add_ps(_mm_set1_ps(-1.0f / 720.0f), _mm_mul_ps(r2, _mm_set1_ps(1.0f / 40320.0f)));
+		cr = _mm_add_ps(_mm_set1_ps(1.0f / 24.0f), _mm_mul_ps(r2, cr));
+		cr = _mm_add_ps(_mm_set1_ps(-0.5f), _mm_mul_ps(r2, cr));
+		cr = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(r2, cr));
+
+		__m128 quadrant = _mm_sub_ps(q, _mm_mul_ps(_mm_set1_ps(4.0f), Floor(_mm_mul_ps(q, _mm_set1_ps(0.25f)))));
+		__m128 one = _mm_cmpeq_ps(quadrant, _mm_set1_ps(1.0f));
+		__m128 two = _mm_cmpeq_ps(quadrant, _mm_set1_ps(2.0f));
+		__m128 three = _mm_cmpeq_ps(quadrant, _mm_set1_ps(3.0f));
+		__m128 swap = _mm_or_ps(one, three);
+		__m128 sign = _mm_set1_ps(-0.0f);
+		s = _mm_xor_ps(Select(swap, cr, sr), _mm_and_ps(_mm_or_ps(two, three), sign));
+		c = _mm_xor_ps(Select(swap, sr, cr), _mm_and_ps(_mm_or_ps(one, two), sign));
+	}
+
+	inline void Normalise(__m128& x, __m128& y, __m128& z)
+	{
+		__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+		__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(length, _mm_set1_ps(1e-20f)));
+		x = _mm_mul_ps(x, inverse);
+		y = _mm_mul_ps(y, inverse);
+		z = _mm_mul_ps(z, inverse);
+	}
+
+	// Bilinear taps of four texel space coordinates. Indices are left unwrapped.
+	struct Taps
+	{
+		int x0[4], y0[4];
+		__m128 tx, ty;
+	};
+
+	inline void ComputeTaps(__m128 sx, __m128 sy, Taps& taps)
+	{
+		__m128 fx = Floor(sx), fy = Floor(sy);
+		taps.tx = _mm_sub_ps(sx, fx);
+		taps.ty = _mm_sub_ps(sy, fy);
+		float ix[4], iy[4];
+		_mm_storeu_ps(ix, fx);
+		_mm_storeu_ps(iy, fy);
+		for (int l = 0; l < 4; l++) {
+			taps.x0[l] = (int)ix[l];
+			taps.y0[l] = (int)iy[l];
+		}
+	}
+
+	// Corner (x, y) of each lane as four registers, one per channel. Nodes of interleaved maps
+	// are loaded whole and transposed.
+	inline void GatherNodes(const ConstGridView& map, const int* x, const int* y, __m128* channels)
+	{
+		if (map.IsInterleaved()) {
+			__m128 n0 = _mm_loadu_ps(map.Row(y[0])[x[0]].data());
+			__m128 n1 = _mm_loadu_ps(map.Row(y[1])[x[1]].data());
+			__m128 n2 = _mm_loadu_ps(map.Row(y[2])[x[2]].data());
+			__m128 n3 = _mm_loadu_ps(map.Row(y[3])[x[3]].data());
+			_MM_TRANSPOSE4_PS(n0, n1, n2, n3);
+			channels[0] = n0;
+			channels[1] = n1;
+			channels[2] = n2;
+			channels[3] = n3;
+			return;
+		}
+		for (int ch = 0; ch < 4; ch++) {
+			channels[ch] = _mm_setr_ps(map.At(x[0], y[0], ch), map.At(x[1], y[1], ch), map.At(x[2], y[2], ch), map.At(x[3], y[3], ch));
+		}
+	}
+
+	// The four corners of every lane's cell, for all four channels
+	struct Corners
+	{
+		__m128 c00[4], c10[4], c01[4], c11[4];
+	};
+
+	inline void GatherCorners(const ConstGridView& map, const int* x0, const int* x1, const int* y0, const int* y1, Corners& corners)
+	{
+		GatherNodes(map, x0, y0, corners.c00);
+		GatherNodes(map, x1, y0, corners.c10);
+		GatherNodes(map, x0, y1, corners.c01);
+		GatherNodes(map, x1, y1, corners.c11);
+	}
+
+	// Bilinear sample of the first three channels of a periodic map of power of two size
+	inline void SampleWrapped(const ConstGridView& map, const Taps& taps, __m128* result)
+	{
+		int maskX = map.GetWidth() - 1, maskY = map.GetHeight() - 1;
+		int x0[4], x1[4], y0[4], y1[4];
+		for (int l = 0; l < 4; l++) {
+			x0[l] = taps.x0[l] & maskX;
+			x1[l] = (taps.x0[l] + 1) & maskX;
+			y0[l] = taps.y0[l] & maskY;
+			y1[l] = (taps.y0[l] + 1) & maskY;
+		}
+		Corners corners;
+		GatherCorners(map, x0, x1, y0, y1, corners);
+		for (int ch = 0; ch < 3; ch++) {
+			__m128 top = _mm_add_ps(corners.c00[ch], _mm_mul_ps(taps.tx, _mm_sub_ps(corners.c10[ch], corners.c00[ch])));
+			__m128 bottom = _mm_add_ps(corners.c01[ch], _mm_mul_ps(taps.tx, _mm_sub_ps(corners.c11[ch], corners.c01[ch])));
+			result[ch] = _mm_add_ps(top, _mm_mul_ps(taps.ty, _mm_sub_ps(bottom, top)));
+		}
+	}
+}
+
+struct WaterSurfaceQuery::Lanes
+{
+	__m128 height;
+	__m128 normalX, normalY, normalZ;
+	__m128 velocityX, velocityY, velocityZ;
+};
+
+void SurfaceSamples::Resize(size_t count)
+{
+	for (std::vector<float>* v : { &x, &z, &height, &normalX, &normalY, &normalZ, &velocityX, &velocityY, &velocityZ }) {
+		v->resize(count, 0.0f);
+	}
+}
+
+size_t SurfaceSamples::Size() const
+{
+	return x.size();
+}
+
+WaterSurfaceQuery::WaterSurfaceQuery(TaskScheduler* taskScheduler)
+{
+	scheduler = taskScheduler;
+	mode = Sine;
+	time = 0.0f;
+	iterations = 2;
+	ocean = nullptr;
+	meshSize = 100.0f;
+	spatialStepSize = 1.0f;
+	lastTime = 0.0f;
+	SetGerstnerParameters(0.0f, 0.0f, 1.0f, 0.0f);
+}
+
+WaterSurfaceQuery::~WaterSurfaceQuery()
+{
+}
+
+void WaterSurfaceQuery::SetMode(Mode newMode)
+{
+	mode = newMode;
+}
+
+WaterSurfaceQuery::Mode WaterSurfaceQuery::GetMode()
+{
+	return mode;
+}
+
+void WaterSurfaceQuery::SetTime(float newTime)
+{
+	time = newTime;
+}
+
+void WaterSurfaceQuery::SetGerstnerParameters(float speed, float amplitude, float wavelength, float steepness)
+{
+	// As calculateWave does per vertex, once per batch
+	waves.resize(4);
+	for (int i = 0; i < 4; i++) {
+		const float* w = GerstnerWaves[i];
+		Wave& wave = waves[i];
+		wave.wavenumber = 2.0f * Pi / (wavelength * w[0]);
+		wave.amplitude = amplitude * w[1];
+		wave.phaseSpeed = speed * wave.wavenumber * w[2];
+		float length = sqrtf(w[3] * w[3] + w[4] * w[4]);
+		wave.directionX = w[3] / length;
+		wave.directionZ = w[4] / length;
+		float wa = wave.wavenumber * wave.amplitude;
+		wave.steepness = wa > 0.0f ? steepness / (wa * 3.0f) : 0.0f;
+	}
+}
+
+void WaterSurfaceQuery::SetOcean(OceanSpectrum* newOcean)
+{
+	ocean = newOcean;
+}
+
+void WaterSurfaceQuery::SetGrid(const ConstGridView& newGrid, float newMeshSize, float newSpatialStepSize)
+{
+	grid = newGrid;
+	meshSize = newMeshSize;
+	spatialStepSize = newSpatialStepSize;
+}
+
+void WaterSurfaceQuery::SetDisplacementIterations(int newIterations)
+{
+	iterations = std::max(0, newIterations);
+}
+
+float WaterSurfaceQuery::GetLastTime()
+{
+	return lastTime;
+}
+
+void WaterSurfaceQuery::Query(SurfaceSamples& samples)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	int count = (int)samples.Size();
+	samples.Resize(count);
+	int groups = (count + 3) / 4;
+
+	float* destinations[7] = { samples.height.data(), samples.normalX.data(), samples.normalY.data(), samples.normalZ.data(),
+		samples.velocityX.data(), samples.velocityY.data(), samples.velocityZ.data() };
+	auto body = [&](int g0, int g1) {
+		for (int g = g0; g < g1; g++) {
+			int first = g * 4;
+			int valid = std::min(4, count - first);
+
+			// The last group is padded by repeating its last point
+			const float* x = samples.x.data() + first;
+			const float* z = samples.z.data() + first;
+			float paddedX[4], paddedZ[4];
+			if (valid < 4) {
+				for (int l = 0; l < 4; l++) {
+					paddedX[l] = x[std::min(l, valid - 1)];
+					paddedZ[l] = z[std::min(l, valid - 1)];
+				}
+				x = paddedX;
+				z = paddedZ;
+			}
+
+			Lanes out;
+			switch (mode) {
+			case Gerstner:
+				QueryGerstner(x, z, out);
+				break;
+			case Ocean:
+				QueryOcean(x, z, out);
+				break;
+			case ShallowWater:
+				QueryShallowWater(x, z, out);
+				break;
+			default:
+				QuerySine(x, z, out);
+				break;
+			}
+
+			__m128 results[7] = { out.height, out.normalX, out.normalY, out.normalZ, out.velocityX, out.velocityY, out.velocityZ };
+			for (int i = 0; i < 7; i++) {
+				if (valid == 4) {
+					_mm_storeu_ps(destinations[i] + first, results[i]);
+				}
+				else {
+					float result[4];
+					_mm_storeu_ps(result, results[i]);
+					std::copy(result, result + valid, destinations[i] + first);
+				}
+			}
+		}
+	};
+	if (scheduler && groups > MinGroups) {
+		scheduler->ParallelFor(0, groups, body, MinGroups);
+	}
+	else {
+		body(0, groups);
+	}
+
+	lastTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void WaterSurfaceQuery::QuerySine(const float* x, const float* z, Lanes& out)
+{
+	__m128 px = _mm_loadu_ps(x), pz = _mm_loadu_ps(z);
+	__m128 t = _mm_set1_ps(time);
+
+	// y = a1 sin(f1 x + s1 t) + a2 sin(f2 z + s2 t)
+	__m128 s1, c1, s2, c2;
+	SinCos(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(SineWaves[0][0]), px), _mm_mul_ps(_mm_set1_ps(SineWaves[0][2]), t)), s1, c1);
+	SinCos(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(SineWaves[1][0]), pz), _mm_mul_ps(_mm_set1_ps(SineWaves[1][2]), t)), s2, c2);
+	__m128 a1 = _mm_set1_ps(SineWaves[0][1]), a2 = _mm_set1_ps(SineWaves[1][1]);
+	out.height = _mm_add_ps(_mm_mul_ps(a1, s1), _mm_mul_ps(a2, s2));
+
+	out.normalX = _mm_mul_ps(_mm_set1_ps(-SineWaves[0][1] * SineWaves[0][0]), c1);
+	out.normalY = _mm_set1_ps(1.0f);
+	out.normalZ = _mm_mul_ps(_mm_set1_ps(-SineWaves[1][1] * SineWaves[1][0]), c2);
+	Normalise(out.normalX, out.normalY, out.normalZ);
+
+	out.velocityX = _mm_setzero_ps();
+	out.velocityY = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SineWaves[0][1] * SineWaves[0][2]), c1), _mm_mul_ps(_mm_set1_ps(SineWaves[1][1] * SineWaves[1][2]), c2));
+	out.velocityZ = _mm_setzero_ps();
+}
+
+void WaterSurfaceQuery::QueryGerstner(const float* x, const float* z, Lanes& out)
+{
+	__m128 qx = _mm_loadu_ps(x), qz = _mm_loadu_ps(z);
+	__m128 t = _mm_set1_ps(time);
+
+	// Undisplaced point p with p + D(p) = q by Newton's method on the horizontal offsets. Where
+	// the crests nearly fold the Jacobian is close to singular and a plain fixed point step
+	// p = q - D(p) is taken instead.
+	__m128 px = qx, pz = qz;
+	for (int it = 0; it < iterations; it++) {
+		__m128 dx = _mm_setzero_ps(), dz = _mm_setzero_ps();
+		__m128 jxx = _mm_set1_ps(1.0f), jxz = _mm_setzero_ps(), jzz = _mm_set1_ps(1.0f);
+		for (const Wave& wave : waves) {
+			__m128 phase = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(wave.wavenumber), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(wave.directionX), px), _mm_mul_ps(_mm_set1_ps(wave.directionZ), pz))), _mm_mul_ps(_mm_set1_ps(wave.phaseSpeed), t));
+			__m128 s, c;
+			SinCos(phase, s, c);
+			float horizontal = wave.steepness * wave.amplitude;
+			__m128 offset = _mm_mul_ps(_mm_set1_ps(horizontal), c);
+			dx = _mm_add_ps(dx, _mm_mul_ps(offset, _mm_set1_ps(wave.directionX)));
+			dz = _mm_add_ps(dz, _mm_mul_ps(offset, _mm_set1_ps(wave.directionZ)));
+			__m128 slope = _mm_mul_ps(_mm_set1_ps(horizontal * wave.wavenumber), s);
+			jxx = _mm_sub_ps(jxx, _mm_mul_ps(slope, _mm_set1_ps(wave.directionX * wave.directionX)));
+			jxz = _mm_sub_ps(jxz, _mm_mul_ps(slope, _mm_set1_ps(wave.directionX * wave.directionZ)));
+			jzz = _mm_sub_ps(jzz, _mm_mul_ps(slope, _mm_set1_ps(wave.directionZ * wave.directionZ)));
+		}
+		__m128 rx = _mm_sub_ps(_mm_sub_ps(qx, px), dx);
+		__m128 rz = _mm_sub_ps(_mm_sub_ps(qz, pz), dz);
+		__m128 determinant = _mm_sub_ps(_mm_mul_ps(jxx, jzz), _mm_mul_ps(jxz, jxz));
+		__m128 solvable = _mm_cmpgt_ps(determinant, _mm_set1_ps(0.1f));
+		__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(determinant, _mm_set1_ps(0.1f)));
+		__m128 newtonX = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(jzz, rx), _mm_mul_ps(jxz, rz)), inverse);
+		__m128 newtonZ = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(jxx, rz), _mm_mul_ps(jxz, rx)), inverse);
+		px = _mm_add_ps(px, Select(solvable, newtonX, rx));
+		pz = _mm_add_ps(pz, Select(solvable, newtonZ, rz));
+	}
+
+	// waveGetOffset and its time derivative. The normal is the cross product of the displaced
+	// surface's tangents, which the shader approximates by dropping the products of the sums.
+	__m128 hx = _mm_setzero_ps(), hz = _mm_setzero_ps();
+	__m128 jxx = _mm_set1_ps(1.0f), jxz = _mm_setzero_ps(), jzz = _mm_set1_ps(1.0f);
+	out.height = _mm_setzero_ps();
+	out.velocityX = _mm_setzero_ps();
+	out.velocityY = _mm_setzero_ps();
+	out.velocityZ = _mm_setzero_ps();
+	for (const Wave& wave : waves) {
+		__m128 phase = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(wave.wavenumber), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(wave.directionX), px), _mm_mul_ps(_mm_set1_ps(wave.directionZ), pz))), _mm_mul_ps(_mm_set1_ps(wave.phaseSpeed), t));
+		__m128 s, c;
+		SinCos(phase, s, c);
+		__m128 directionX = _mm_set1_ps(wave.directionX), directionZ = _mm_set1_ps(wave.directionZ);
+		float horizontal = wave.steepness * wave.amplitude;
+
+		out.height = _mm_add_ps(out.height, _mm_mul_ps(_mm_set1_ps(wave.amplitude), s));
+
+		__m128 rise = _mm_mul_ps(_mm_set1_ps(wave.wavenumber * wave.amplitude), c);
+		hx = _mm_add_ps(hx, _mm_mul_ps(directionX, rise));
+		hz = _mm_add_ps(hz, _mm_mul_ps(directionZ, rise));
+		__m128 slope = _mm_mul_ps(_mm_set1_ps(horizontal * wave.wavenumber), s);
+		jxx = _mm_sub_ps(jxx, _mm_mul_ps(slope, _mm_set1_ps(wave.directionX * wave.directionX)));
+		jxz = _mm_sub_ps(jxz, _mm_mul_ps(slope, _mm_set1_ps(wave.directionX * wave.directionZ)));
+		jzz = _mm_sub_ps(jzz, _mm_mul_ps(slope, _mm_set1_ps(wave.directionZ * wave.directionZ)));
+
+		__m128 sideways = _mm_mul_ps(_mm_set1_ps(-wave.phaseSpeed * horizontal), s);
+		out.velocityX = _mm_add_ps(out.velocityX, _mm_mul_ps(sideways, directionX));
+		out.velocityY = _mm_add_ps(out.velocityY, _mm_mul_ps(_mm_set1_ps(wave.phaseSpeed * wave.amplitude), c));
+		out.velocityZ = _mm_add_ps(out.velocityZ, _mm_mul_ps(sideways, directionZ));
+	}
+
+	// Tangents (jxx, hx, jxz) along x and (jxz, hz, jzz) along z
+	out.normalX = _mm_sub_ps(_mm_mul_ps(hz, jxz), _mm_mul_ps(jzz, hx));
+	out.normalY = _mm_sub_ps(_mm_mul_ps(jzz, jxx), _mm_mul_ps(jxz, jxz));
+	out.normalZ = _mm_sub_ps(_mm_mul_ps(jxz, hx), _mm_mul_ps(jxx, hz));
+	Normalise(out.normalX, out.normalY, out.normalZ);
+}
+
+void WaterSurfaceQuery::QueryOcean(const float* x, const float* z, Lanes& out)
+{
+	ConstGridView displacement = ocean ? ocean->GetDisplacementView() : ConstGridView();
+	if (displacement.Empty()) {
+		out.height = out.normalX = out.normalZ = _mm_setzero_ps();
+		out.velocityX = out.velocityY = out.velocityZ = _mm_setzero_ps();
+		out.normalY = _mm_set1_ps(1.0f);
+		return;
+	}
+
+	// Texel centres sit half a texel in, as for the shader's sampler at position / patch size
+	__m128 qx = _mm_loadu_ps(x), qz = _mm_loadu_ps(z);
+	__m128 scale = _mm_set1_ps(displacement.GetWidth() / ocean->GetSettings().patchSize);
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 px = qx, pz = qz;
+	Taps taps;
+	__m128 sampled[4];
+	for (int it = 0; it < iterations; it++) {
+		ComputeTaps(_mm_sub_ps(_mm_mul_ps(px, scale), half), _mm_sub_ps(_mm_mul_ps(pz, scale), half), taps);
+		SampleWrapped(displacement, taps, sampled);
+		px = _mm_sub_ps(qx, sampled[0]);
+		pz = _mm_sub_ps(qz, sampled[2]);
+	}
+	ComputeTaps(_mm_sub_ps(_mm_mul_ps(px, scale), half), _mm_sub_ps(_mm_mul_ps(pz, scale), half), taps);
+	SampleWrapped(displacement, taps, sampled);
+	out.height = sampled[1];
+
+	__m128 normal[3];
+	SampleWrapped(ocean->GetNormalView(), taps, normal);
+	out.normalX = normal[0];
+	out.normalY = normal[1];
+	out.normalZ = normal[2];
+	Normalise(out.normalX, out.normalY, out.normalZ);
+
+	// The particle at p moved from its previous displacement to this one over the last step
+	float step = ocean->GetLastTimeStep();
+	if (step > 0.0f) {
+		__m128 previous[3];
+		SampleWrapped(ocean->GetPreviousDisplacementView(), taps, previous);
+		__m128 inverse = _mm_set1_ps(1.0f / step);
+		out.velocityX = _mm_mul_ps(_mm_sub_ps(sampled[0], previous[0]), inverse);
+		out.velocityY = _mm_mul_ps(_mm_sub_ps(sampled[1], previous[1]), inverse);
+		out.velocityZ = _mm_mul_ps(_mm_sub_ps(sampled[2], previous[2]), inverse);
+	}
+	else {
+		out.velocityX = out.velocityY = out.velocityZ = _mm_setzero_ps();
+	}
+}
+
+void WaterSurfaceQuery::QueryShallowWater(const float* x, const float* z, Lanes& out)
+{
+	int nx = grid.GetWidth(), ny = grid.GetHeight();
+	if (grid.Empty() || nx < 2 || ny < 2) {
+		out.height = out.normalX = out.normalZ = _mm_setzero_ps();
+		out.velocityX = out.velocityY = out.velocityZ = _mm_setzero_ps();
+		out.normalY = _mm_set1_ps(1.0f);
+		return;
+	}
+
+	// Mesh corners map onto grid corners, points off the mesh read its edge
+	__m128 halfSize = _mm_set1_ps(0.5f * meshSize);
+	__m128 scaleX = _mm_set1_ps((nx - 1) / meshSize), scaleY = _mm_set1_ps((ny - 1) / meshSize);
+	__m128 gx = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(x), halfSize), scaleX);
+	__m128 gy = _mm_mul_ps(_mm_sub_ps(halfSize, _mm_loadu_ps(z)), scaleY);
+	gx = _mm_min_ps(_mm_max_ps(gx, _mm_setzero_ps()), _mm_set1_ps((float)(nx - 1)));
+	gy = _mm_min_ps(_mm_max_ps(gy, _mm_setzero_ps()), _mm_set1_ps((float)(ny - 1)));
+
+	// The last node is reached as the far end of the last cell
+	float fx[4], fy[4];
+	_mm_storeu_ps(fx, gx);
+	_mm_storeu_ps(fy, gy);
+	int x0[4], x1[4], y0[4], y1[4];
+	for (int l = 0; l < 4; l++) {
+		x0[l] = std::min((int)fx[l], nx - 2);
+		y0[l] = std::min((int)fy[l], ny - 2);
+		x1[l] = x0[l] + 1;
+		y1[l] = y0[l] + 1;
+		fx[l] = (float)x0[l];
+		fy[l] = (float)y0[l];
+	}
+	__m128 tx = _mm_sub_ps(gx, _mm_loadu_ps(fx));
+	__m128 ty = _mm_sub_ps(gy, _mm_loadu_ps(fy));
+	Corners corners;
+	GatherCorners(grid, x0, x1, y0, y1, corners);
+
+	// Values and derivatives along the grid axes of the bilinear patch, for h, q, p and the bed
+	__m128 value[4], alongX[4], alongY[4];
+	__m128 one = _mm_set1_ps(1.0f);
+	for (int ch = 0; ch < 4; ch++) {
+		__m128 c00 = corners.c00[ch], c10 = corners.c10[ch], c01 = corners.c01[ch], c11 = corners.c11[ch];
+		__m128 top = _mm_add_ps(c00, _mm_mul_ps(tx, _mm_sub_ps(c10, c00)));
+		__m128 bottom = _mm_add_ps(c01, _mm_mul_ps(tx, _mm_sub_ps(c11, c01)));
+		value[ch] = _mm_add_ps(top, _mm_mul_ps(ty, _mm_sub_ps(bottom, top)));
+		alongX[ch] = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, ty), _mm_sub_ps(c10, c00)), _mm_mul_ps(ty, _mm_sub_ps(c11, c01)));
+		alongY[ch] = _mm_sub_ps(bottom, top);
+	}
+	// The surface is the depth on top of the bed
+	out.height = _mm_add_ps(value[0], value[3]);
+
+	// Grid rows run towards -z
+	out.normalX = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(_mm_add_ps(alongX[0], alongX[3]), scaleX));
+	out.normalY = one;
+	out.normalZ = _mm_mul_ps(_mm_add_ps(alongY[0], alongY[3]), scaleY);
+	Normalise(out.normalX, out.normalY, out.normalZ);
+
+	// Dry cells have no velocity
+	__m128 wet = _mm_cmpgt_ps(value[0], _mm_set1_ps(1e-4f));
+	__m128 inverseDepth = _mm_and_ps(wet, _mm_div_ps(one, _mm_max_ps(value[0], _mm_set1_ps(1e-4f))));
+	out.velocityX = _mm_mul_ps(value[1], inverseDepth);
+	out.velocityZ = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(value[2], inverseDepth));
+	out.velocityY = _mm_mul_ps(_mm_set1_ps(-1.0f / spatialStepSize), _mm_add_ps(alongX[1], alongY[2]));
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <vector>
+#include "GridView.h"
+#include "OceanSpectrum.h"
+#include "TaskScheduler.h"
+
+// World space points and what the water surface does there. Structure of arrays, so four
+// points fill one SSE register.
+struct SurfaceSamples
+{
+	std::vector<float> x, z;
+	std::vector<float> height;
+	std::vector<float> normalX, normalY, normalZ;
+	std::vector<float> velocityX, velocityY, velocityZ;
+
+	void Resize(size_t count);
+	size_t Size() const;
+};
+
+// Height, unit normal and velocity of the rendered water surface at batches of points, for
+// gameplay and physics on the CPU. Each mode mirrors the matching branch of wave_vs.hlsl:
+//
+// - Sine and Gerstner evaluate the shader's waves analytically. Gerstner waves also move the
+//   surface sideways, so the undisplaced point that lands on the query point is found first by
+//   a few Newton iterations on the analytic offsets.
+// - Ocean samples the FFT ocean's maps bilinearly with wrapping, the way the shader's sampler
+//   does, inverts the horizontal displacement by fixed point iterations, and differences the
+//   last two evaluations for the velocity.
+// - ShallowWater interpolates a CPU grid bilinearly. The grid is spread over the water mesh,
+//   node (0, 0) at (-meshSize / 2, meshSize / 2) and rows running towards -z. Velocities are
+//   q / h and p / h in the simulation's units, and the vertical velocity is -div(q, p).
+//
+// Four points are evaluated per SSE operation and large batches are split over the task
+// scheduler.
+class WaterSurfaceQuery
+{
+
+public:
+
+	// The numbers are those of the wave shader's mode switch
+	enum Mode
+	{
+		Sine = 0,
+		Gerstner = 1,
+		Ocean = 2,
+		ShallowWater = 3
+	};
+
+	// A null scheduler queries on the calling thread
+	WaterSurfaceQuery(TaskScheduler* scheduler = nullptr);
+	~WaterSurfaceQuery();
+
+	void SetMode(Mode mode);
+	Mode GetMode();
+
+	// Seconds, the time the shader is given
+	void SetTime(float time);
+
+	// Same order as WaveShader::setGersnterWavesParameters
+	void SetGerstnerParameters(float speed, float amplitude, float wavelength, float steepness);
+
+	// The ocean is read at query time, so it must outlive the queries
+	void SetOcean(OceanSpectrum* ocean);
+
+	// The grid is read at query time. spatialStepSize is the simulation's node spacing, used
+	// for the divergence.
+	void SetGrid(const ConstGridView& grid, float meshSize, float spatialStepSize);
+
+	// Iterations inverting the horizontal displacement, 0 reads the undisplaced point
+	void SetDisplacementIterations(int iterations);
+
+	// Fill the heights, normals and velocities at the samples' x and z
+	void Query(SurfaceSamples& samples);
+
+	float GetLastTime(); // milliseconds
+
+private:
+
+	// Results for four points
+	struct Lanes;
+
+	// Constants of one of the shader's Gerstner waves, as calculateWave works them out
+	struct Wave
+	{
+		float wavenumber;
+		float amplitude;
+		float phaseSpeed;
+		float directionX;
+		float directionZ;
+		float steepness; // times amplitude and wavenumber, the horizontal amplitude factor
+	};
+
+	void QuerySine(const float* x, const float* z, Lanes& out);
+	void QueryGerstner(const float* x, const float* z, Lanes& out);
+	void QueryOcean(const float* x, const float* z, Lanes& out);
+	void QueryShallowWater(const float* x, const float* z, Lanes& out);
+
+	TaskScheduler* scheduler;
+	Mode mode;
+	float time;
+	int iterations;
+
+	std::vector<Wave> waves;
+
+	OceanSpectrum* ocean;
+
+	ConstGridView grid;
+	float meshSize;
+	float spatialStepSize;
+
+	float lastTime;
+
+};
@@ -15,6 +15,13 @@ WaveShader::WaveShader(ID3D11Device* dev, ID3D11DeviceContext* deviceCtxt, HWND
 	amplitude = 0.f;  // height of the waves
 	steepness = 0.f;  // steepness of the waves
 
+	oceanDisplacement = nullptr;
+	oceanNormals = nullptr;
+	oceanPatchSize = 1.f;
+
+	sweNormals = nullptr;
+	sweFoam = nullptr;
+
 }
 
 WaveShader::~WaveShader()
@@ -52,6 +59,20 @@ WaveShader::~WaveShader()
 		cameraBuffer = 0;
 	}
 
+	// Release the ocean constant buffer.
+	if (oceanBuffer)
+	{
+		oceanBuffer->Release();
+		oceanBuffer = 0;
+	}
+
+	// Release the patch constant buffer.
+	if (patchBuffer)
+	{
+		patchBuffer->Release();
+		patchBuffer = 0;
+	}
+
 	//Release base shader components
 	BaseShader::~BaseShader();
 
@@ -66,6 +87,19 @@ void WaveShader::setGersnterWavesParameters(float speed_, float amplitude_, floa
 
 }
 
+void WaveShader::setOceanParameters(ID3D11ShaderResourceView* displacement, ID3D11ShaderResourceView* normals, float patchSize)
+{
+	oceanDisplacement = displacement;
+	oceanNormals = normals;
+	oceanPatchSize = patchSize;
+}
+
+void WaveShader::setSurfaceMaps(ID3D11ShaderResourceView* normals, ID3D11ShaderResourceView* foam)
+{
+	sweNormals = normals;
+	sweFoam = foam;
+}
+
 
 
 void WaveShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilename)
@@ -113,6 +147,26 @@ void WaveShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilename
 	timeBufferDesc.StructureByteStride = 0;
 	device->CreateBuffer(&timeBufferDesc, NULL, &timeBuffer);
 
+	//Setup ocean Buffer
+	D3D11_BUFFER_DESC oceanBufferDesc;
+	oceanBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	oceanBufferDesc.ByteWidth = sizeof(OceanBufferType);
+	oceanBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	oceanBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	oceanBufferDesc.MiscFlags = 0;
+	oceanBufferDesc.StructureByteStride = 0;
+	device->CreateBuffer(&oceanBufferDesc, NULL, &oceanBuffer);
+
+	//Setup patch Buffer
+	D3D11_BUFFER_DESC patchBufferDesc;
+	patchBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	patchBufferDesc.ByteWidth = sizeof(PatchBufferType);
+	patchBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	patchBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	patchBufferDesc.MiscFlags = 0;
+	patchBufferDesc.StructureByteStride = 0;
+	device->CreateBuffer(&patchBufferDesc, NULL, &patchBuffer);
+
 
 	// Create a texture sampler state description
 	D3D11_SAMPLER_DESC samplerDesc;
@@ -144,7 +198,7 @@ void WaveShader::initShader(const wchar_t* vsFilename, const wchar_t* psFilename
 }
 
 
-void WaveShader::setShaderParameters(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, Light* light, XMFLOAT3 camPos, bool toggleGerstner, ID3D11ShaderResourceView* gridTexture2DView, bool toggleSWE, float timeVar)
+void WaveShader::setShaderParameters(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, Light* light, XMFLOAT3 camPos, bool toggleGerstner, ID3D11ShaderResourceView* gridTexture2DView, bool toggleSWE, bool toggleOcean, float timeVar)
 {
 	D3D11_MAPPED_SUBRESOURCE mappedResource;
 
@@ -167,6 +221,10 @@ void WaveShader::setShaderParameters(const XMMATRIX& world, const XMMATRIX& view
 	{
 		camDataPtr->toggleGerstner = 3;
 	}
+	else if (toggleOcean)
+	{
+		camDataPtr->toggleGerstner = 2;
+	}
 	else {
 		camDataPtr->toggleGerstner = toggleGerstner;
 	}
@@ -203,6 +261,30 @@ void WaveShader::setShaderParameters(const XMMATRIX& world, const XMMATRIX& view
 	deviceContext->Unmap(timeBuffer, 0);
 	deviceContext->VSSetConstantBuffers(2, 1, &timeBuffer);
 
+	// send the size of the ocean patch the maps cover, and which shallow water maps are bound
+	OceanBufferType* oceanPtr;
+	deviceContext->Map(oceanBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	oceanPtr = (OceanBufferType*)mappedResource.pData;
+	oceanPtr->patchSize = oceanPatchSize;
+	oceanPtr->sweNormalMap = sweNormals ? 1.f : 0.f;
+	oceanPtr->sweFoamMap = sweFoam ? 1.f : 0.f;
+	oceanPtr->padding = 0.f;
+	deviceContext->Unmap(oceanBuffer, 0);
+	deviceContext->VSSetConstantBuffers(3, 1, &oceanBuffer);
+
+	// the plain mesh is placed by its own vertex positions
+	PatchBufferType* patchPtr;
+	deviceContext->Map(patchBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	patchPtr = (PatchBufferType*)mappedResource.pData;
+	patchPtr->origin = XMFLOAT2(0.f, 0.f);
+	patchPtr->spacing = 1.f;
+	patchPtr->lodPatch = 0.f;
+	patchPtr->morphRange = XMFLOAT2(0.f, 1.f);
+	patchPtr->meshSize = 1.f;
+	patchPtr->padding = 0.f;
+	deviceContext->Unmap(patchBuffer, 0);
+	deviceContext->VSSetConstantBuffers(4, 1, &patchBuffer);
+
 
 
 	// Set water surface texture (image) resource in the pixel shader
@@ -211,7 +293,43 @@ void WaveShader::setShaderParameters(const XMMATRIX& world, const XMMATRIX& view
 
 	// Set render texture resource containing the simulation grid data in the vertex shader for manipulation of the mesh
 	deviceContext->VSSetShaderResources(0, 1, &gridTexture2DView);
+
+	// Set the FFT ocean maps, sampled with the same wrapping sampler
+	deviceContext->VSSetShaderResources(1, 1, &oceanDisplacement);
+	deviceContext->VSSetShaderResources(2, 1, &oceanNormals);
+
+	// Set the normals and foam worked out from the shallow water heights on the CPU
+	deviceContext->VSSetShaderResources(3, 1, &sweNormals);
+	deviceContext->VSSetShaderResources(4, 1, &sweFoam);
 	deviceContext->VSSetSamplers(0, 1, &sampleStateGrid);
 
 }
 
+void WaveShader::setPatchParameters(float x, float z, float spacing, float morphStart, float morphEnd, float meshSize)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	PatchBufferType* patchPtr;
+	deviceContext->Map(patchBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	patchPtr = (PatchBufferType*)mappedResource.pData;
+	patchPtr->origin = XMFLOAT2(x, z);
+	patchPtr->spacing = spacing;
+	patchPtr->lodPatch = 1.f;
+	patchPtr->morphRange = XMFLOAT2(morphStart, morphEnd);
+	patchPtr->meshSize = meshSize;
+	patchPtr->padding = 0.f;
+	deviceContext->Unmap(patchBuffer, 0);
+	deviceContext->VSSetConstantBuffers(4, 1, &patchBuffer);
+}
+
+void WaveShader::renderRange(ID3D11DeviceContext* deviceContext, int indexCount, int startIndex)
+{
+	// The same stages as BaseShader::render, which always starts at the first index
+	deviceContext->IASetInputLayout(layout);
+	deviceContext->VSSetShader(vertexShader, NULL, 0);
+	deviceContext->PSSetShader(pixelShader, NULL, 0);
+	deviceContext->CSSetShader(NULL, NULL, 0);
+	deviceContext->HSSetShader(NULL, NULL, 0);
+	deviceContext->DSSetShader(NULL, NULL, 0);
+	deviceContext->GSSetShader(NULL, NULL, 0);
+	deviceContext->DrawIndexed(indexCount, startIndex, 0);
+}
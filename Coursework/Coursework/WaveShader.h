@@ -29,13 +29,38 @@ class WaveShader : public BaseShader
 		XMFLOAT2A PI_and_Wavelength;
 	};
 
+	struct OceanBufferType {
+		float patchSize;
+		float sweNormalMap;
+		float sweFoamMap;
+		float padding;
+	};
+
+	struct PatchBufferType {
+		XMFLOAT2 origin;
+		float spacing;
+		float lodPatch;
+		XMFLOAT2 morphRange;
+		float meshSize;
+		float padding;
+	};
+
 
 
 public:
 	WaveShader(ID3D11Device* device, ID3D11DeviceContext* deviceContext, HWND hwnd, int gridSizeX, ID3D11ShaderResourceView* texture);
 	~WaveShader();
 	void setGersnterWavesParameters(float speed, float amplitude, float wavelength, float steepness);
-	void setShaderParameters(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, Light* light, XMFLOAT3 camPos, bool toggleGerstner, ID3D11ShaderResourceView* gridTexture2DView, bool toggleSWE, float timeVar);
+	void setOceanParameters(ID3D11ShaderResourceView* displacement, ID3D11ShaderResourceView* normals, float patchSize);
+	void setSurfaceMaps(ID3D11ShaderResourceView* normals, ID3D11ShaderResourceView* foam);
+	void setShaderParameters(const XMMATRIX& world, const XMMATRIX& view, const XMMATRIX& projection, Light* light, XMFLOAT3 camPos, bool toggleGerstner, ID3D11ShaderResourceView* gridTexture2DView, bool toggleSWE, bool toggleOcean, float timeVar);
+
+	// Place the next draws as a patch of the water quadtree, setShaderParameters goes back to a
+	// plain mesh
+	void setPatchParameters(float x, float z, float spacing, float morphStart, float morphEnd, float meshSize);
+
+	// Draw part of the bound index buffer
+	void renderRange(ID3D11DeviceContext* deviceContext, int indexCount, int startIndex);
 
 
 private: 
@@ -49,6 +74,8 @@ private:
 	ID3D11Buffer* lightBuffer;
 	ID3D11Buffer* cameraBuffer;
 	ID3D11Buffer* timeBuffer;
+	ID3D11Buffer* oceanBuffer;
+	ID3D11Buffer* patchBuffer;
 
 
 	//! [SWE] sampler state object for accessing grid in the pixel shader
@@ -64,5 +91,16 @@ private:
 	float amplitude;  // height of the waves
 	float steepness;  // steepness of the waves
 
+	//[FFT ocean]
+	// displacement and normal maps of one ocean patch, tiled over the mesh
+	ID3D11ShaderResourceView* oceanDisplacement;
+	ID3D11ShaderResourceView* oceanNormals;
+	float oceanPatchSize;
+
+	//[SWE]
+	// normal and foam maps of the shallow water heights, null when they are not computed
+	ID3D11ShaderResourceView* sweNormals;
+	ID3D11ShaderResourceView* sweFoam;
+
 };
 
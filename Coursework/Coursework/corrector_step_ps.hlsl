@@ -3,6 +3,7 @@ Texture2D correctedGridRT : register(t3);
 SamplerState sampler0 : register(s0);
 
 
+// Same buffer as the predictor's, which says why the grid size is not compiled in
 cbuffer TimeBuffer : register(b0)
 {
     float DTDXDY;
@@ -34,6 +35,12 @@ struct InputType
     float3 normal : NORMAL;
 };
 
+// Velocity of a node, dry nodes carry no momentum
+float velocity(float discharge, float depth)
+{
+    return depth > 1e-4 ? discharge / depth : 0.0;
+}
+
 float phi(float x)
 {
     return max(0, min(2 * x, 1));
@@ -88,14 +95,14 @@ PixelShaderOutput main(InputType input)
 
 
 	// obtaining u and v:
-    float u = predictedGridRTData.g / predictedGridRTData.r;
-    float v = predictedGridRTData.b / predictedGridRTData.r;
+    float u = velocity(predictedGridRTData.g, predictedGridRTData.r);
+    float v = velocity(predictedGridRTData.b, predictedGridRTData.r);
 
 	// obtaining velocities u and v for the surrounding grid nodes:
-    float leftVelU = leftData.g / leftData.r;
-    float leftVelV = leftData.b / leftData.r;
-    float topVelU = topData.g / topData.r;
-    float topVelV = topData.b / topData.r;
+    float leftVelU = velocity(leftData.g, leftData.r);
+    float leftVelV = velocity(leftData.b, leftData.r);
+    float topVelU = velocity(topData.g, topData.r);
+    float topVelV = velocity(topData.b, topData.r);
 
 
 
@@ -114,9 +121,13 @@ PixelShaderOutput main(InputType input)
                       - (topData.b * topVelV + 0.5 * gravity * topData.r * topData.r);
 
 
+	// Slope of the bed in the alpha channel, backward like the fluxes
+    float SX = gravity * 0.5 * (predictedGridRTData.r + leftData.r) * (predictedGridRTData.a - leftData.a);
+    float SY = gravity * 0.5 * (predictedGridRTData.r + topData.r) * (predictedGridRTData.a - topData.a);
+
     float HP = 0.5 * (correctedGridRTData.r + predictedGridRTData.r - DTDXDY * (F1 + G1));
-    float QP = 0.5 * (correctedGridRTData.g + predictedGridRTData.g - DTDXDY * (F2 + G2));
-    float PP = 0.5 * (correctedGridRTData.b + predictedGridRTData.b - DTDXDY * (F3 + G3));
+    float QP = 0.5 * (correctedGridRTData.g + predictedGridRTData.g - DTDXDY * (F2 + G2 + SX));
+    float PP = 0.5 * (correctedGridRTData.b + predictedGridRTData.b - DTDXDY * (F3 + G3 + SY));
 
 
 	// Update the values in corrected grid 
@@ -0,0 +1,57 @@
+// Applies the splashes, drags and point sources of one substep to the simulation state on the
+// GPU, so the state never has to be read back. The nodes are changed exactly as
+// DisturbanceQueue::ApplyEvent changes them on the CPU, event after event in queue order. The
+// state's rows are upside down here, so the events come flipped by DisturbanceQueue::GetFlippedY.
+
+Texture2D stateTexture : register(t0);
+
+#define MAX_EVENTS 64
+
+cbuffer EventBuffer : register(b0)
+{
+    float4 eventShape[MAX_EVENTS];  // x, y, radius and amount, in grid nodes
+    float4 eventMotion[MAX_EVENTS]; // type, x and y velocity of a drag
+    float4 eventCount;
+};
+
+struct InputType
+{
+    float4 position : SV_POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+};
+
+float4 main(InputType input) : SV_TARGET
+{
+    // Pixel centres are at half texels, the node indices are the whole part
+    int2 nodeIndex = int2(input.position.xy);
+    float4 node = stateTexture.Load(int3(nodeIndex, 0));
+
+    const float pi = 3.14159265;
+    for (int i = 0; i < (int)eventCount.x; i++)
+    {
+        float radius = max(eventShape[i].z, 0.5);
+        float2 offset = float2(nodeIndex) - eventShape[i].xy;
+        float distance = length(offset) / radius;
+        if (distance >= 1.0)
+        {
+            continue;
+        }
+
+        // Raised cosine falloff, smooth at the edge of the radius so no shocks are introduced
+        float weight = 0.5 * (1.0 + cos(pi * distance));
+        float amount = eventShape[i].w * weight;
+        if (eventMotion[i].x == 1.0)
+        {
+            // Drag: the discharge is pulled towards the object's velocity
+            node.g += amount * (node.r * eventMotion[i].y - node.g);
+            node.b += amount * (node.r * eventMotion[i].z - node.b);
+        }
+        else
+        {
+            // Splash or point source: water is added
+            node.r += amount;
+        }
+    }
+    return node;
+}
@@ -6,6 +6,11 @@ Texture2D correctedGridRT : register(t3);
 SamplerState sampler0 : register(s0);
 
 
+// The grid size only sets the texel size, one reciprocal per pixel next to six texture
+// fetches, and the wrap sampler already does the edges that the size specialised CPU kernels
+// peel out of their loops. firstPass is the same for every pixel of a draw, so its branch is
+// coherent. Per size variants of this shader would have nothing to remove, so these stay in
+// the constant buffer.
 cbuffer TimeBuffer : register(b0)
 {
     float DTDXDY;
@@ -30,6 +35,12 @@ struct PixelShaderOutput
     float4 Target1 : SV_TARGET1;
 };
 
+// Velocity of a node, dry nodes carry no momentum
+float velocity(float discharge, float depth)
+{
+    return depth > 1e-4 ? discharge / depth : 0.0;
+}
+
 struct InputType
 {
     float4 position : SV_POSITION;
@@ -86,14 +97,14 @@ PixelShaderOutput main(InputType input)
 
 
         // Obtaining u and v
-        float u = correctedGridRTData.g / correctedGridRTData.r;
-        float v = correctedGridRTData.b / correctedGridRTData.r;
+        float u = velocity(correctedGridRTData.g, correctedGridRTData.r);
+        float v = velocity(correctedGridRTData.b, correctedGridRTData.r);
 
         // Obtaining the necessary velocities u and v from the surrounding grid nodes:
-        float rightVelU = rightData.g / rightData.r;
-        float rightVelV = rightData.b / rightData.r;
-        float bottomVelU = bottomData.g / bottomData.r;
-        float bottomVelV = bottomData.b / bottomData.r;
+        float rightVelU = velocity(rightData.g, rightData.r);
+        float rightVelV = velocity(rightData.b, rightData.r);
+        float bottomVelU = velocity(bottomData.g, bottomData.r);
+        float bottomVelV = velocity(bottomData.b, bottomData.r);
 
 
 
@@ -113,10 +124,15 @@ PixelShaderOutput main(InputType input)
                       - (correctedGridRTData.b * v + 0.5 * gravity * correctedGridRTData.r * correctedGridRTData.r);
 
 
+        // Slope of the bed, stored in the alpha channel, pushing on the water. Taken with the mean
+        // depth either side, it cancels the hydrostatic flux differences of still water exactly.
+        float SX = gravity * 0.5 * (correctedGridRTData.r + rightData.r) * (rightData.a - correctedGridRTData.a);
+        float SY = gravity * 0.5 * (correctedGridRTData.r + bottomData.r) * (bottomData.a - correctedGridRTData.a);
+
         // Obtaining the new height and flux values from the corrected simulation grid data
         float newHP = correctedGridRTData.r - DTDXDY * (F1 + G1);
-        float newQP = correctedGridRTData.g - DTDXDY * (F2 + G2);
-        float newPP = correctedGridRTData.b - DTDXDY * (F3 + G3);
+        float newQP = correctedGridRTData.g - DTDXDY * (F2 + G2 + SX);
+        float newPP = correctedGridRTData.b - DTDXDY * (F3 + G3 + SY);
 
         // Update the values in the predicted simulation grid
         predictedGridRTData.r = newHP;
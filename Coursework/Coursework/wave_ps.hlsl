@@ -65,6 +65,9 @@ float4 main(InputType input) : SV_TARGET
     waveTexColour.xyz *= lerp(1.0, 0.5, depth * 0.01); // Decrease color intensity with depth
     waveTexColour.z += lerp(0.3, 0.4, depth * 0.001); // Increase blue component with depth
 
+    // [SWE] whiten the crests by the foam the vertex shader read
+    waveTexColour.xyz = lerp(waveTexColour.xyz, 1.0, input.heightVals.z);
+
 
 	float4 finalResult = lightColourResult * waveTexColour;
 
@@ -1,5 +1,9 @@
 
 Texture2D gridTexture : register(t0);
+Texture2D oceanDisplacement : register(t1);
+Texture2D oceanNormals : register(t2);
+Texture2D sweNormals : register(t3);
+Texture2D sweFoam : register(t4);
 SamplerState samplerGrid : register(s0);
 
 cbuffer MatrixBuffer : register(b0)
@@ -26,6 +30,24 @@ cbuffer TimeBuffer : register(b2)
     float2 PI_wavelength;
 }
 
+cbuffer OceanBuffer : register(b3)
+{
+    float oceanPatchSize;
+    float sweNormalMap; // 1 when the shallow water maps are bound, the size of the grid texture
+    float sweFoamMap;
+    float oceanPadding;
+}
+
+cbuffer PatchBuffer : register(b4)
+{
+    float2 patchOrigin;   // world x and z of the patch's first vertex
+    float patchSpacing;
+    float lodPatch;       // 1 when drawing a patch of the water quadtree
+    float2 morphRange;    // distances from the camera over which the vertices morph
+    float lodMeshSize;
+    float patchPadding;
+}
+
 struct InputType
 {
     float4 position : POSITION;
@@ -97,6 +119,22 @@ float3 waveGetNormal(Wave wave, float2 positionXZ)
 OutputType main(InputType input)
 {
     OutputType output;
+    output.heightVals = 0;
+
+    if (lodPatch == 1)
+    {
+        // [LOD] positions are grid coordinates in the patch. Towards the end of the level's range
+        // the odd vertices slide onto the next coarser grid, so levels meet without cracks.
+        float2 gridPosition = input.position.xz;
+        float2 world = patchOrigin + gridPosition * patchSpacing;
+        float morph = saturate((distance(float3(world.x, 0, world.y), cameraPosition) - morphRange.x) / (morphRange.y - morphRange.x));
+        gridPosition -= frac(gridPosition * 0.5) * 2.0 * morph;
+        world = patchOrigin + gridPosition * patchSpacing;
+
+        // The mesh corners sit on the texture corners, rows running towards -z
+        input.position.xz = world;
+        input.tex = float2(world.x / lodMeshSize + 0.5, 0.5 - world.y / lodMeshSize);
+    }
 
 
 
@@ -132,6 +170,17 @@ OutputType main(InputType input)
         input.normal.y = 1 - input.normal.y;
         input.normal.z = -input.normal.z;
     }
+    else if (toggleGerstner == 2)
+    {
+        // [FFT ocean] the maps tile every patch and are read at the undisplaced position
+        float2 oceanUV = input.position.xz / oceanPatchSize;
+        float4 displacement = oceanDisplacement.SampleLevel(samplerGrid, oceanUV, 0);
+        input.position.xyz += displacement.xyz;
+        input.normal = oceanNormals.SampleLevel(samplerGrid, oceanUV, 0).xyz;
+
+        // height and the Jacobian of the horizontal displacement, below one where crests fold
+        output.heightVals = float3(displacement.y, displacement.w, 0);
+    }
     else if(toggleGerstner ==0)
     {
         // using two sine waves to manipulate the vertices
@@ -162,13 +211,28 @@ OutputType main(InputType input)
     	// [SWE] Getting height from the simulation grid
         int2 textureSize;
         gridTexture.GetDimensions(textureSize.x, textureSize.y);
-        int2 location = int2(input.tex.x * textureSize.x, input.tex.y * textureSize.y);
-        float height = gridTexture.Load(int3(location, 0)).r;
+        // Mesh corners map onto grid corners, so a mesh with one vertex per texel reads each
+        // texel at its centre, and a quadtree patch vertex between texels blends its neighbours
+        float2 location = (input.tex * (textureSize - 1) + 0.5f) / textureSize;
+        // The surface is the water depth on top of the bed in the alpha channel
+        float4 node = gridTexture.SampleLevel(samplerGrid, location, 0);
+        float height = node.r + node.a;
 
     	// [SWE] setting the y position of the mesh vertices to the height in the grid
         input.position.y = height;
 
         output.heightVals.r = height;
+
+        // [SWE] the normal map keeps x and z, y is positive on a height field
+        if (sweNormalMap == 1)
+        {
+            float2 normalXZ = sweNormals.SampleLevel(samplerGrid, location, 0).rg;
+            input.normal = float3(normalXZ.x, sqrt(saturate(1 - dot(normalXZ, normalXZ))), normalXZ.y);
+        }
+        if (sweFoamMap == 1)
+        {
+            output.heightVals.b = sweFoam.SampleLevel(samplerGrid, location, 0).r;
+        }
   
     }
 